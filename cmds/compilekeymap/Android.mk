@@ -0,0 +1,58 @@
+# Copyright (C) 2014 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    compilekeymap.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+    libinput \
+    libutils \
+    libcutils \
+    liblog
+
+ifeq ($(HOST_OS),linux)
+    LOCAL_LDLIBS += -ldl -lpthread
+endif
+
+LOCAL_MODULE := compilekeymap
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+
+# Compile the key maps that the product installs
+# =====================================================
+#
+# Each key layout map and key character map that PRODUCT_COPY_FILES installs in
+# system/usr/keylayout or system/usr/keychars gets its image installed next to it.
+# The image is compiled from the installed map, after it has been installed, so
+# that it is not older than the map and KeyMapImage::open() accepts it.
+
+compilekeymap := $(LOCAL_INSTALLED_MODULE)
+
+keymap_files := $(sort $(filter system/usr/keylayout/%.kl system/usr/keychars/%.kcm, \
+    $(foreach cf,$(PRODUCT_COPY_FILES),$(call word-colon,2,$(cf)))))
+keymap_images := $(addprefix $(PRODUCT_OUT)/,$(addsuffix .bin,$(keymap_files)))
+
+$(keymap_images): $(PRODUCT_OUT)/%.bin: $(PRODUCT_OUT)/% $(compilekeymap)
+	@echo "Compile key map: $@"
+	$(hide) $(compilekeymap) -o $@ $< > /dev/null
+
+ALL_DEFAULT_INSTALLED_MODULES += $(keymap_images)
+
+compilekeymap :=
+keymap_files :=
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compiles key layout (.kl) and key character map (.kcm) files into the precompiled
+ * images that KeyLayoutMap::load() and KeyCharacterMap::load() use instead of parsing
+ * them, see <input/KeyMapImage.h>.
+ */
+
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+#include <input/KeyMapImage.h>
+#include <utils/String8.h>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace android;
+
+static const char* gProgName = "compilekeymap";
+
+enum FileType {
+    FILETYPE_UNKNOWN,
+    FILETYPE_KEYLAYOUT,
+    FILETYPE_KEYCHARACTERMAP,
+};
+
+static void usage() {
+    fprintf(stderr, "Keymap Compiler\n\n");
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr,
+        " %s [--overlay] [-o image] [*.kl] [*.kcm] [...]\n"
+        "   Compiles the specified key layout and key character map files into images.\n"
+        "   Each image is written next to its file, with the same name plus '.bin',\n"
+        "   unless -o is given for a single file.\n"
+        "   Key character maps are compiled as overlays with --overlay.\n\n",
+        gProgName);
+}
+
+static FileType getFileType(const char* filename) {
+    const char *extension = strrchr(filename, '.');
+    if (extension) {
+        if (strcmp(extension, ".kl") == 0) {
+            return FILETYPE_KEYLAYOUT;
+        }
+        if (strcmp(extension, ".kcm") == 0) {
+            return FILETYPE_KEYCHARACTERMAP;
+        }
+    }
+    return FILETYPE_UNKNOWN;
+}
+
+static bool compileFile(const char* filename, const char* imageFilename,
+        KeyCharacterMap::Format format) {
+    fprintf(stdout, "Compiling file '%s'...\n", filename);
+
+    String8 imagePath(imageFilename ? String8(imageFilename)
+            : KeyMapImage::getImagePath(String8(filename)));
+    status_t status;
+    switch (getFileType(filename)) {
+    case FILETYPE_UNKNOWN:
+        fprintf(stderr, "Supported file types: *.kl, *.kcm\n\n");
+        return false;
+
+    case FILETYPE_KEYLAYOUT:
+        status = KeyLayoutMap::compile(String8(filename), imagePath);
+        break;
+
+    case FILETYPE_KEYCHARACTERMAP:
+        status = KeyCharacterMap::compile(String8(filename), format, imagePath);
+        break;
+
+    default:
+        return false;
+    }
+
+    if (status) {
+        fprintf(stderr, "Error %d compiling key map file.\n\n", status);
+        return false;
+    }
+    fprintf(stdout, "Wrote '%s'.\n\n", imagePath.string());
+    return true;
+}
+
+int main(int argc, const char** argv) {
+    KeyCharacterMap::Format format = KeyCharacterMap::FORMAT_BASE;
+    const char* imageFilename = NULL;
+    int first = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (!strcmp(argv[first], "--overlay")) {
+            format = KeyCharacterMap::FORMAT_OVERLAY;
+            first += 1;
+        } else if (!strcmp(argv[first], "-o") && first + 1 < argc) {
+            imageFilename = argv[first + 1];
+            first += 2;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (first == argc || (imageFilename && argc - first != 1)) {
+        usage();
+        return 1;
+    }
+
+    int result = 0;
+    for (int i = first; i < argc; i++) {
+        if (!compileFile(argv[i], imageFilename, format)) {
+            result = 1;
+        }
+    }
+
+    if (result) {
+        fprintf(stderr, "Failed!\n");
+    } else {
+        fprintf(stdout, "Success.\n");
+    }
+    return result;
+}
@@ -15,9 +15,31 @@
 #define LOG_TAG "screenshot"
 #include <utils/Log.h>
 
+#include <ui/PixelFormat.h>
+
+using namespace android;
+
+static PixelFormat fb_pixel_format(const struct fb_var_screeninfo& vinfo) {
+    switch (vinfo.bits_per_pixel) {
+        case 16:
+            return PIXEL_FORMAT_RGB_565;
+        case 24:
+            return PIXEL_FORMAT_RGB_888;
+        case 32:
+            if (vinfo.red.offset == 16) {
+                return PIXEL_FORMAT_BGRA_8888;
+            }
+            return vinfo.transp.length ? PIXEL_FORMAT_RGBA_8888 :
+                    PIXEL_FORMAT_RGBX_8888;
+    }
+    return PIXEL_FORMAT_UNKNOWN;
+}
+
 void take_screenshot(FILE *fb_in, FILE *fb_out) {
     int fb;
-    char imgbuf[0x10000];
+    uint32_t imgbuf[0x10000 / 4];
+    uint32_t pngbuf[0x10000 / 4];
+    PixelFormat format;
     struct fb_var_screeninfo vinfo;
     png_structp png;
     png_infop info;
@@ -59,15 +81,24 @@ void take_screenshot(FILE *fb_in, FILE *fb_out) {
         return;
     }
 
+    format = fb_pixel_format(vinfo);
+    if (format == PIXEL_FORMAT_UNKNOWN) {
+        ALOGE("unsupported framebuffer depth: %d\n", vinfo.bits_per_pixel);
+        png_destroy_write_struct(&png, NULL);
+        fclose(fb_in);
+        return;
+    }
+
+    // rows are converted to RGBA_8888, whatever the framebuffer format is
     bytespp = vinfo.bits_per_pixel / 8;
     png_set_IHDR(png, info,
-        vinfo.xres, vinfo.yres, vinfo.bits_per_pixel / 4, 
+        vinfo.xres, vinfo.yres, 8,
         PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
         PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
     png_write_info(png, info);
 
     rowlen=vinfo.xres * bytespp;
-    if (rowlen > sizeof(imgbuf)) {
+    if (rowlen > sizeof(imgbuf) || vinfo.xres * 4 > sizeof(pngbuf)) {
         ALOGE("crazy rowlen: %d\n", rowlen);
         png_destroy_write_struct(&png, NULL);
         fclose(fb_in);
@@ -80,7 +111,9 @@ void take_screenshot(FILE *fb_in, FILE *fb_out) {
     for(r=0; r<vinfo.yres; r++) {
         int len = fread(imgbuf, 1, rowlen, fb_in);
         if (len <= 0) break;
-        png_write_row(png, (png_bytep)imgbuf);
+        convertPixels(pngbuf, PIXEL_FORMAT_RGBA_8888, vinfo.xres,
+                imgbuf, format, vinfo.xres, vinfo.xres, 1);
+        png_write_row(png, (png_bytep)pngbuf);
     }
 
     png_write_end(png, info);
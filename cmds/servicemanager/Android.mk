@@ -10,3 +10,6 @@ LOCAL_SHARED_LIBRARIES := liblog
 LOCAL_SRC_FILES := service_manager.c binder.c
 LOCAL_MODULE := servicemanager
 include $(BUILD_EXECUTABLE)
+
+# Build the unit tests.
+include $(call all-makefiles-under, $(LOCAL_PATH))
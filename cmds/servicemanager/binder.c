@@ -71,6 +71,7 @@ const char *cmd_name(uint32_t cmd)
         NAME(BR_FAILED_REPLY);
         NAME(BR_DEAD_REPLY);
         NAME(BR_DEAD_BINDER);
+        NAME(BR_CLEAR_DEATH_NOTIFICATION_DONE);
     default: return "???";
     }
 }
@@ -254,15 +255,19 @@ int binder_parse(struct binder_state *bs, struct binder_io *bio,
             r = 0;
             break;
         }
-        case BR_DEAD_BINDER: {
+        case BR_DEAD_BINDER:
+        case BR_CLEAR_DEATH_NOTIFICATION_DONE: {
             struct binder_death *death = (void*) *ptr++;
             death->func(bs, death->ptr);
             break;
         }
         case BR_FAILED_REPLY:
-            r = -1;
-            break;
         case BR_DEAD_REPLY:
+            if (func) {
+                /* a one-way call sent from the loop wasn't delivered,
+                 * the target is gone */
+                break;
+            }
             r = -1;
             break;
         default:
@@ -299,6 +304,15 @@ void binder_link_to_death(struct binder_state *bs, void *ptr, struct binder_deat
     binder_write(bs, cmd, sizeof(cmd));
 }
 
+void binder_clear_death(struct binder_state *bs, void *ptr, struct binder_death *death)
+{
+    uint32_t cmd[3];
+    cmd[0] = BC_CLEAR_DEATH_NOTIFICATION;
+    cmd[1] = (uint32_t) ptr;
+    cmd[2] = (uint32_t) death;
+    binder_write(bs, cmd, sizeof(cmd));
+}
+
 
 int binder_call(struct binder_state *bs,
                 struct binder_io *msg, struct binder_io *reply,
@@ -354,6 +368,33 @@ fail:
     return -1;
 }
 
+int binder_send(struct binder_state *bs,
+                struct binder_io *msg, void *target, uint32_t code)
+{
+    struct {
+        uint32_t cmd;
+        struct binder_txn txn;
+    } writebuf;
+
+    if (msg->flags & BIO_F_OVERFLOW) {
+        fprintf(stderr,"binder: txn buffer overflow\n");
+        return -1;
+    }
+
+    writebuf.cmd = BC_TRANSACTION;
+    writebuf.txn.target = target;
+    writebuf.txn.cookie = 0;
+    writebuf.txn.code = code;
+    writebuf.txn.flags = TF_ONE_WAY;
+    writebuf.txn.data_size = msg->data - msg->data0;
+    writebuf.txn.offs_size = ((char*) msg->offs) - ((char*) msg->offs0);
+    writebuf.txn.data = msg->data0;
+    writebuf.txn.offs = msg->offs0;
+
+    /* the BR_TRANSACTION_COMPLETE is read by the loop */
+    return binder_write(bs, &writebuf, sizeof(writebuf)) < 0 ? -1 : 0;
+}
+
 void binder_loop(struct binder_state *bs, binder_handler func)
 {
     int res;
@@ -61,8 +61,14 @@ enum {
     SVC_MGR_CHECK_SERVICE,
     SVC_MGR_ADD_SERVICE,
     SVC_MGR_LIST_SERVICES,
+    SVC_MGR_WAIT_FOR_SERVICE,
+    SVC_MGR_DUMP_STATS,
 };
 
+/* the code of the one-way call made to the callbacks given to
+ * SVC_MGR_WAIT_FOR_SERVICE, with the name of the service */
+#define SVC_MGR_SERVICE_REGISTERED 1
+
 typedef int (*binder_handler)(struct binder_state *bs,
                               struct binder_txn *txn,
                               struct binder_io *msg,
@@ -78,6 +84,12 @@ int binder_call(struct binder_state *bs,
                 struct binder_io *msg, struct binder_io *reply,
                 void *target, uint32_t code);
 
+/* initiate a one-way binder call
+ * - returns zero on success
+ */
+int binder_send(struct binder_state *bs,
+                struct binder_io *msg, void *target, uint32_t code);
+
 /* release any state associate with the binder_io
  * - call once any necessary data has been extracted from the
  *   binder_io after binder_call() returns
@@ -90,7 +102,11 @@ void binder_done(struct binder_state *bs,
 void binder_acquire(struct binder_state *bs, void *ptr);
 void binder_release(struct binder_state *bs, void *ptr);
 
+/* the death func is called once, from the loop, either when the object
+ * dies or, if the link is cleared first, when the driver is done with it.
+ * the binder_death must stay valid until then. */
 void binder_link_to_death(struct binder_state *bs, void *ptr, struct binder_death *death);
+void binder_clear_death(struct binder_state *bs, void *ptr, struct binder_death *death);
 
 void binder_loop(struct binder_state *bs, binder_handler func);
 
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <private/android_filesystem_config.h>
 
@@ -50,6 +51,13 @@ static struct {
     { AID_KEYSTORE, "android.security.keystore" },
 };
 
+/* allowed[] indexed by the hash of the names, see svc_init_allowed() */
+#define ALLOWED_COUNT (sizeof(allowed) / sizeof(allowed[0]))
+#define ALLOWED_HASH_SIZE 64
+static unsigned allowed_hash[ALLOWED_COUNT];
+static unsigned allowed_next[ALLOWED_COUNT];          /* index + 1, or 0 */
+static unsigned allowed_head[ALLOWED_HASH_SIZE];      /* index + 1, or 0 */
+
 void *svcmgr_handle;
 
 const char *str8(uint16_t *x)
@@ -76,16 +84,52 @@ int str16eq(uint16_t *a, const char *b)
     return 1;
 }
 
-int svc_can_register(unsigned uid, uint16_t *name)
+/* FNV-1a, of the characters of a name */
+unsigned str16hash(const uint16_t *s, unsigned len)
+{
+    unsigned h = 2166136261u;
+    while (len--) {
+        h ^= *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+unsigned str8hash(const char *s)
+{
+    unsigned h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void svc_init_allowed(void)
+{
+    unsigned n, b;
+
+    for (n = 0; n < ALLOWED_COUNT; n++) {
+        allowed_hash[n] = str8hash(allowed[n].name);
+        b = allowed_hash[n] & (ALLOWED_HASH_SIZE - 1);
+        allowed_next[n] = allowed_head[b];
+        allowed_head[b] = n + 1;
+    }
+}
+
+int svc_can_register(unsigned uid, uint16_t *name, unsigned hash)
 {
     unsigned n;
     
     if ((uid == 0) || (uid == AID_SYSTEM))
         return 1;
 
-    for (n = 0; n < sizeof(allowed) / sizeof(allowed[0]); n++)
-        if ((uid == allowed[n].uid) && str16eq(name, allowed[n].name))
+    for (n = allowed_head[hash & (ALLOWED_HASH_SIZE - 1)]; n;
+         n = allowed_next[n - 1]) {
+        if ((hash == allowed_hash[n - 1]) && (uid == allowed[n - 1].uid) &&
+            str16eq(name, allowed[n - 1].name))
             return 1;
+    }
 
     return 0;
 }
@@ -93,21 +137,76 @@ int svc_can_register(unsigned uid, uint16_t *name)
 struct svcinfo 
 {
     struct svcinfo *next;
+    struct svcinfo *hnext;      /* in svchash[] */
     void *ptr;
     struct binder_death death;
     int allow_isolated;
+    unsigned lookups;
+    uint64_t added_ns;          /* first registration, since we started */
+    unsigned hash;
     unsigned len;
     uint16_t name[0];
 };
 
+/* the services, last registered first, and by hash of their names */
+#define SVC_HASH_SIZE 256
 struct svcinfo *svclist = 0;
+struct svcinfo *svchash[SVC_HASH_SIZE];
+
+/* the callbacks to notify when a service is registered. a process gives
+ * the same callback for all the services it waits for; it's kept, with a
+ * reference and linked to death, until all of them are registered or
+ * until it dies. once out of the list, a waiter is freed by its death
+ * func, when the driver is done with it. */
+struct svcwait
+{
+    struct svcwait *next;
+    uint64_t start_ns;
+    unsigned len;
+    uint16_t name[0];
+};
+
+struct svcwaiter
+{
+    struct svcwaiter *next;
+    void *ptr;                  /* 0 once out of the list */
+    struct binder_death death;
+    struct svcwait *waits;
+};
+
+struct svcwaiter *waiterlist = 0;
+
+/* how long the waits last, until the service is registered */
+static struct {
+    unsigned count;
+    unsigned notified;
+    unsigned died;
+    unsigned refused;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} wait_stats;
+
+/* anyone can wait, so the waits are limited, for each callback and in all */
+#define MAX_WAITS_PER_WAITER 16
+#define MAX_WAITS 256
+
+static unsigned nwaits;
 
-struct svcinfo *find_svc(uint16_t *s16, unsigned len)
+static uint64_t start_ns;
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct svcinfo *find_svc(uint16_t *s16, unsigned len, unsigned hash)
 {
     struct svcinfo *si;
 
-    for (si = svclist; si; si = si->next) {
-        if ((len == si->len) &&
+    for (si = svchash[hash & (SVC_HASH_SIZE - 1)]; si; si = si->hnext) {
+        if ((hash == si->hash) && (len == si->len) &&
             !memcmp(s16, si->name, len * sizeof(uint16_t))) {
             return si;
         }
@@ -131,45 +230,191 @@ uint16_t svcmgr_id[] = {
 };
   
 
+int svc_hidden_from(struct svcinfo *si, unsigned uid)
+{
+    if (!si->allow_isolated) {
+        // If this service doesn't allow access from isolated processes,
+        // then check the uid to see if it is isolated.
+        unsigned appid = uid % AID_USER;
+        if (appid >= AID_ISOLATED_START && appid <= AID_ISOLATED_END) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void *do_find_service(struct binder_state *bs, uint16_t *s, unsigned len, unsigned uid)
 {
     struct svcinfo *si;
-    si = find_svc(s, len);
+    si = find_svc(s, len, str16hash(s, len));
 
 //    ALOGI("check_service('%s') ptr = %p\n", str8(s), si ? si->ptr : 0);
+    if (si)
+        si->lookups++;
     if (si && si->ptr) {
-        if (!si->allow_isolated) {
-            // If this service doesn't allow access from isolated processes,
-            // then check the uid to see if it is isolated.
-            unsigned appid = uid % AID_USER;
-            if (appid >= AID_ISOLATED_START && appid <= AID_ISOLATED_END) {
-                return 0;
-            }
-        }
+        if (svc_hidden_from(si, uid))
+            return 0;
         return si->ptr;
     } else {
         return 0;
     }
 }
 
+void svcwaiter_death(struct binder_state *bs, void *ptr)
+{
+    struct svcwaiter **pw;
+    struct svcwaiter *w = ptr;
+    struct svcwait *wt;
+
+    if (w->ptr) {
+        /* the waiter died first */
+        for (pw = &waiterlist; *pw != w; pw = &(*pw)->next)
+            ;
+        *pw = w->next;
+        binder_release(bs, w->ptr);
+    }
+    while ((wt = w->waits) != 0) {
+        w->waits = wt->next;
+        free(wt);
+        nwaits--;
+        wait_stats.died++;
+    }
+    free(w);
+}
+
+int do_wait_for_service(struct binder_state *bs, uint16_t *s, unsigned len,
+                        void *ptr, unsigned uid)
+{
+    struct svcinfo *si;
+    struct svcwaiter *w;
+    struct svcwait *wt;
+    unsigned n = 0;
+
+    if (!ptr || (len == 0) || (len > 127))
+        return -1;
+
+    si = find_svc(s, len, str16hash(s, len));
+    if (si && si->ptr && svc_hidden_from(si, uid)) {
+        /* it's there, the caller won't ever be allowed to see it */
+        ALOGE("wait_for_service('%s') uid=%d - PERMISSION DENIED\n", str8(s), uid);
+        return -1;
+    }
+
+    for (w = waiterlist; w; w = w->next) {
+        if (w->ptr == ptr)
+            break;
+    }
+    if (w) {
+        for (wt = w->waits; wt; wt = wt->next) {
+            if ((len == wt->len) &&
+                !memcmp(s, wt->name, len * sizeof(uint16_t))) {
+                return 0;
+            }
+            n++;
+        }
+    }
+    if ((n >= MAX_WAITS_PER_WAITER) || (nwaits >= MAX_WAITS)) {
+        ALOGE("wait_for_service('%s',%p) uid=%d - TOO MANY WAITS (%u, %u in all)\n",
+             str8(s), ptr, uid, n, nwaits);
+        wait_stats.refused++;
+        return -1;
+    }
+
+    wt = malloc(sizeof(*wt) + (len + 1) * sizeof(uint16_t));
+    if (!wt) {
+        ALOGE("wait_for_service('%s',%p) - OUT OF MEMORY\n", str8(s), ptr);
+        return -1;
+    }
+    if (!w) {
+        w = malloc(sizeof(*w));
+        if (!w) {
+            ALOGE("wait_for_service('%s',%p) - OUT OF MEMORY\n", str8(s), ptr);
+            free(wt);
+            return -1;
+        }
+        w->ptr = ptr;
+        w->death.func = svcwaiter_death;
+        w->death.ptr = w;
+        w->waits = 0;
+        w->next = waiterlist;
+        waiterlist = w;
+
+        binder_acquire(bs, ptr);
+        binder_link_to_death(bs, ptr, &w->death);
+    }
+    wt->start_ns = now_ns();
+    wt->len = len;
+    memcpy(wt->name, s, len * sizeof(uint16_t));
+    wt->name[len] = '\0';
+    wt->next = w->waits;
+    w->waits = wt;
+    nwaits++;
+    wait_stats.count++;
+    return 0;
+}
+
+void notify_waiters(struct binder_state *bs, uint16_t *s, unsigned len)
+{
+    struct svcwaiter **pw = &waiterlist;
+    struct svcwaiter *w;
+    struct svcwait **pwt;
+    struct svcwait *wt;
+    unsigned data[512/4];
+    struct binder_io msg;
+    uint64_t t;
+
+    while ((w = *pw) != 0) {
+        for (pwt = &w->waits; (wt = *pwt) != 0; pwt = &wt->next) {
+            if ((len == wt->len) &&
+                !memcmp(s, wt->name, len * sizeof(uint16_t))) {
+                break;
+            }
+        }
+        if (wt) {
+            bio_init(&msg, data, sizeof(data), 0);
+            bio_put_string16(&msg, wt->name);
+            binder_send(bs, &msg, w->ptr, SVC_MGR_SERVICE_REGISTERED);
+            *pwt = wt->next;
+
+            t = now_ns() - wt->start_ns;
+            nwaits--;
+            wait_stats.notified++;
+            wait_stats.total_ns += t;
+            if (wait_stats.max_ns < t)
+                wait_stats.max_ns = t;
+            free(wt);
+        }
+        if (!w->waits) {
+            binder_clear_death(bs, w->ptr, &w->death);
+            binder_release(bs, w->ptr);
+            w->ptr = 0;
+            *pw = w->next;
+        } else {
+            pw = &w->next;
+        }
+    }
+}
+
 int do_add_service(struct binder_state *bs,
                    uint16_t *s, unsigned len,
                    void *ptr, unsigned uid, int allow_isolated)
 {
     struct svcinfo *si;
+    unsigned hash;
     //ALOGI("add_service('%s',%p,%s) uid=%d\n", str8(s), ptr,
     //        allow_isolated ? "allow_isolated" : "!allow_isolated", uid);
 
     if (!ptr || (len == 0) || (len > 127))
         return -1;
 
-    if (!svc_can_register(uid, s)) {
+    hash = str16hash(s, len);
+    if (!svc_can_register(uid, s, hash)) {
         ALOGE("add_service('%s',%p) uid=%d - PERMISSION DENIED\n",
              str8(s), ptr, uid);
         return -1;
     }
 
-    si = find_svc(s, len);
+    si = find_svc(s, len, hash);
     if (si) {
         if (si->ptr) {
             ALOGE("add_service('%s',%p) uid=%d - ALREADY REGISTERED, OVERRIDE\n",
@@ -191,15 +436,68 @@ int do_add_service(struct binder_state *bs,
         si->death.func = svcinfo_death;
         si->death.ptr = si;
         si->allow_isolated = allow_isolated;
+        si->lookups = 0;
+        si->added_ns = now_ns() - start_ns;
+        si->hash = hash;
         si->next = svclist;
         svclist = si;
+        si->hnext = svchash[hash & (SVC_HASH_SIZE - 1)];
+        svchash[hash & (SVC_HASH_SIZE - 1)] = si;
     }
 
     binder_acquire(bs, ptr);
     binder_link_to_death(bs, ptr, &si->death);
+    notify_waiters(bs, s, len);
     return 0;
 }
 
+/* how long svcmgr_handler() takes, by transaction code */
+struct svcstats
+{
+    unsigned count;
+    unsigned errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+static struct svcstats code_stats[SVC_MGR_DUMP_STATS + 1];
+
+static const char *code_names[SVC_MGR_DUMP_STATS + 1] = {
+    "unknown", "get", "check", "add", "list", "wait", "dump",
+};
+
+void do_dump_stats(void)
+{
+    struct svcinfo *si;
+    struct svcstats *st;
+    unsigned n, count = 0;
+
+    for (si = svclist; si; si = si->next)
+        count++;
+    ALOGI("%u services\n", count);
+    for (si = svclist; si; si = si->next) {
+        ALOGI("  %s: %u lookups, added at %u ms%s\n", str8(si->name),
+             si->lookups, (unsigned) (si->added_ns / 1000000),
+             si->ptr ? "" : " (dead)");
+    }
+    for (n = 0; n <= SVC_MGR_DUMP_STATS; n++) {
+        st = &code_stats[n];
+        if (!st->count)
+            continue;
+        ALOGI("  %s: %u calls, %u failed, avg %u us, max %u us\n",
+             code_names[n], st->count, st->errors,
+             (unsigned) (st->total_ns / st->count / 1000),
+             (unsigned) (st->max_ns / 1000));
+    }
+    if (wait_stats.count || wait_stats.refused) {
+        ALOGI("  waits: %u, %u notified, %u waiters died, %u refused, avg %u ms, max %u ms\n",
+             wait_stats.count, wait_stats.notified, wait_stats.died, wait_stats.refused,
+             wait_stats.notified ?
+                 (unsigned) (wait_stats.total_ns / wait_stats.notified / 1000000) : 0,
+             (unsigned) (wait_stats.max_ns / 1000000));
+    }
+}
+
 int svcmgr_handler(struct binder_state *bs,
                    struct binder_txn *txn,
                    struct binder_io *msg,
@@ -248,6 +546,26 @@ int svcmgr_handler(struct binder_state *bs,
             return -1;
         break;
 
+    case SVC_MGR_WAIT_FOR_SERVICE:
+        s = bio_get_string16(msg, &len);
+        ptr = do_find_service(bs, s, len, txn->sender_euid);
+        if (ptr) {
+            bio_put_ref(reply, ptr);
+            return 0;
+        }
+        if (do_wait_for_service(bs, s, len, bio_get_ref(msg), txn->sender_euid))
+            return -1;
+        break;
+
+    case SVC_MGR_DUMP_STATS:
+        if ((txn->sender_euid != 0) && (txn->sender_euid != AID_SYSTEM) &&
+            (txn->sender_euid != AID_SHELL)) {
+            ALOGE("dump_stats uid=%d - PERMISSION DENIED\n", txn->sender_euid);
+            return -1;
+        }
+        do_dump_stats();
+        break;
+
     case SVC_MGR_LIST_SERVICES: {
         unsigned n = bio_get_uint32(msg);
 
@@ -269,6 +587,29 @@ int svcmgr_handler(struct binder_state *bs,
     return 0;
 }
 
+int svcmgr_timed_handler(struct binder_state *bs,
+                         struct binder_txn *txn,
+                         struct binder_io *msg,
+                         struct binder_io *reply)
+{
+    struct svcstats *st;
+    uint64_t start, t;
+    int res;
+
+    start = now_ns();
+    res = svcmgr_handler(bs, txn, msg, reply);
+    t = now_ns() - start;
+
+    st = &code_stats[txn->code <= SVC_MGR_DUMP_STATS ? txn->code : 0];
+    st->count++;
+    if (res)
+        st->errors++;
+    st->total_ns += t;
+    if (st->max_ns < t)
+        st->max_ns = t;
+    return res;
+}
+
 int main(int argc, char **argv)
 {
     struct binder_state *bs;
@@ -281,7 +622,9 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    start_ns = now_ns();
+    svc_init_allowed();
     svcmgr_handle = svcmgr;
-    binder_loop(bs, svcmgr_handler);
+    binder_loop(bs, svcmgr_timed_handler);
     return 0;
 }
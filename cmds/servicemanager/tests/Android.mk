@@ -0,0 +1,22 @@
+# Build the unit tests.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# The service manager is built with a fake binder.c, from the test.
+LOCAL_SRC_FILES := \
+    service_manager_test.cpp \
+    ../service_manager.c
+
+LOCAL_CFLAGS := -Dmain=service_manager_main
+
+LOCAL_SHARED_LIBRARIES := \
+    liblog \
+    libutils
+
+LOCAL_STATIC_LIBRARIES := \
+    libgtest \
+    libgtest_main
+
+LOCAL_MODULE := service_manager_test
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdio.h>
+
+#include <gtest/gtest.h>
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+
+extern "C" {
+#include "../binder.h"
+
+// in service_manager.c
+void svc_init_allowed(void);
+int do_add_service(struct binder_state *bs, uint16_t *s, unsigned len,
+                   void *ptr, unsigned uid, int allow_isolated);
+int do_wait_for_service(struct binder_state *bs, uint16_t *s, unsigned len,
+                        void *ptr, unsigned uid);
+}
+
+using namespace android;
+
+// Stands in for binder.c: records the references and death links taken by
+// the service manager, and the one-way calls it sends.
+static DefaultKeyedVector<void*, int> gRefs;
+static DefaultKeyedVector<void*, struct binder_death*> gDeathLinks;
+static Vector<struct binder_death*> gClearedDeathLinks;
+static Vector<void*> gSent;
+
+extern "C" {
+struct binder_state *binder_open(unsigned mapsize) { return NULL; }
+void binder_close(struct binder_state *bs) { }
+int binder_become_context_manager(struct binder_state *bs) { return 0; }
+void binder_loop(struct binder_state *bs, binder_handler func) { }
+
+int binder_send(struct binder_state *bs, struct binder_io *msg, void *target, uint32_t code)
+{
+    gSent.add(target);
+    return 0;
+}
+
+void binder_acquire(struct binder_state *bs, void *ptr)
+{
+    gRefs.replaceValueFor(ptr, gRefs.valueFor(ptr) + 1);
+}
+
+void binder_release(struct binder_state *bs, void *ptr)
+{
+    gRefs.replaceValueFor(ptr, gRefs.valueFor(ptr) - 1);
+}
+
+void binder_link_to_death(struct binder_state *bs, void *ptr, struct binder_death *death)
+{
+    // the driver only keeps one link per reference
+    EXPECT_TRUE(gDeathLinks.valueFor(ptr) == NULL) << "already linked to death";
+    gDeathLinks.add(ptr, death);
+}
+
+void binder_clear_death(struct binder_state *bs, void *ptr, struct binder_death *death)
+{
+    ASSERT_EQ(death, gDeathLinks.valueFor(ptr));
+    gDeathLinks.removeItem(ptr);
+    gClearedDeathLinks.add(death);
+}
+
+void bio_init(struct binder_io *bio, void *data, uint32_t maxdata, uint32_t maxobjects) { }
+void bio_put_ref(struct binder_io *bio, void *ptr) { }
+void bio_put_uint32(struct binder_io *bio, uint32_t n) { }
+void bio_put_string16(struct binder_io *bio, const uint16_t *str) { }
+uint32_t bio_get_uint32(struct binder_io *bio) { return 0; }
+uint16_t *bio_get_string16(struct binder_io *bio, uint32_t *sz) { return NULL; }
+void *bio_get_ref(struct binder_io *bio) { return NULL; }
+}
+
+// The objects are only used as handles. The services stay registered, so
+// each test registers new ones, under new names.
+static char WAITER, OTHER_WAITER;
+static char gWaiters[256 / 16];
+static char gServices[16];
+static size_t gServiceCount;
+
+class ServiceManagerTest : public testing::Test {
+protected:
+    static void SetUpTestCase() {
+        svc_init_allowed();
+    }
+
+    virtual void SetUp() {
+        gRefs.clear();
+        gSent.clear();
+        ASSERT_EQ(0U, gClearedDeathLinks.size());
+    }
+
+    int addService(const char* name) {
+        unsigned len = toString16(name);
+        return do_add_service(NULL, mName, len, &gServices[gServiceCount++], 0, 0);
+    }
+
+    int waitForService(const char* name, void* ptr, unsigned uid = 0) {
+        unsigned len = toString16(name);
+        return do_wait_for_service(NULL, mName, len, ptr, uid);
+    }
+
+    // as the loop does on BR_DEAD_BINDER
+    void kill(void* ptr) {
+        struct binder_death* death = gDeathLinks.valueFor(ptr);
+        ASSERT_TRUE(death != NULL);
+        gDeathLinks.removeItem(ptr);
+        death->func(NULL, death->ptr);
+    }
+
+    // as the loop does on BR_CLEAR_DEATH_NOTIFICATION_DONE
+    void finishClearingDeathLinks() {
+        for (size_t i = 0; i < gClearedDeathLinks.size(); i++) {
+            gClearedDeathLinks[i]->func(NULL, gClearedDeathLinks[i]->ptr);
+        }
+        gClearedDeathLinks.clear();
+    }
+
+private:
+    unsigned toString16(const char* name) {
+        unsigned len = 0;
+        while (name[len]) {
+            mName[len] = name[len];
+            len++;
+        }
+        mName[len] = 0;
+        return len;
+    }
+
+    uint16_t mName[128];
+};
+
+TEST_F(ServiceManagerTest, WaitForService_NotifiesWaiterOnce) {
+    ASSERT_EQ(0, waitForService("notified", &WAITER));
+    EXPECT_EQ(1, gRefs.valueFor(&WAITER));
+    EXPECT_TRUE(gDeathLinks.valueFor(&WAITER) != NULL);
+
+    ASSERT_EQ(0, addService("notified"));
+    ASSERT_EQ(1U, gSent.size());
+    EXPECT_EQ(&WAITER, gSent[0]);
+    EXPECT_EQ(0, gRefs.valueFor(&WAITER))
+            << "the waiter should have been released once notified";
+    EXPECT_TRUE(gDeathLinks.valueFor(&WAITER) == NULL)
+            << "the death link of the waiter should have been cleared";
+    finishClearingDeathLinks();
+
+    // registering the service again doesn't notify anyone
+    ASSERT_EQ(0, addService("notified"));
+    EXPECT_EQ(1U, gSent.size());
+}
+
+TEST_F(ServiceManagerTest, WaitForService_DropsWaiterWhenItDies) {
+    ASSERT_EQ(0, waitForService("died", &WAITER));
+    ASSERT_EQ(0, waitForService("died", &OTHER_WAITER));
+    kill(&WAITER);
+    EXPECT_EQ(0, gRefs.valueFor(&WAITER))
+            << "the dead waiter should have been released";
+
+    ASSERT_EQ(0, addService("died"));
+    ASSERT_EQ(1U, gSent.size())
+            << "only the live waiter should have been notified";
+    EXPECT_EQ(&OTHER_WAITER, gSent[0]);
+    EXPECT_EQ(0, gRefs.valueFor(&OTHER_WAITER));
+    finishClearingDeathLinks();
+}
+
+TEST_F(ServiceManagerTest, WaitForService_KeepsWaiterUntilAllServicesAreAdded) {
+    ASSERT_EQ(0, waitForService("first", &WAITER));
+    ASSERT_EQ(0, waitForService("first", &WAITER));
+    ASSERT_EQ(0, waitForService("second", &WAITER));
+    EXPECT_EQ(1, gRefs.valueFor(&WAITER));
+
+    ASSERT_EQ(0, addService("first"));
+    EXPECT_EQ(1U, gSent.size())
+            << "the waiter should have been notified once for the service";
+    EXPECT_EQ(1, gRefs.valueFor(&WAITER));
+    EXPECT_TRUE(gDeathLinks.valueFor(&WAITER) != NULL);
+
+    ASSERT_EQ(0, addService("second"));
+    EXPECT_EQ(2U, gSent.size());
+    EXPECT_EQ(0, gRefs.valueFor(&WAITER));
+    finishClearingDeathLinks();
+
+    // the same callback can wait again
+    ASSERT_EQ(0, waitForService("third", &WAITER));
+    kill(&WAITER);
+    EXPECT_EQ(0, gRefs.valueFor(&WAITER));
+}
+
+TEST_F(ServiceManagerTest, WaitForService_LimitsWaitsPerWaiter) {
+    char name[16];
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "limited%d", i);
+        ASSERT_EQ(0, waitForService(name, &WAITER));
+    }
+    EXPECT_EQ(0, waitForService("limited0", &WAITER))
+            << "waiting again for the same service should still succeed";
+    EXPECT_EQ(-1, waitForService("limited16", &WAITER));
+    EXPECT_EQ(0, waitForService("limited16", &OTHER_WAITER));
+
+    kill(&WAITER);
+    kill(&OTHER_WAITER);
+    EXPECT_EQ(0, waitForService("limited16", &WAITER))
+            << "the waits of a dead waiter should have been dropped";
+    kill(&WAITER);
+}
+
+TEST_F(ServiceManagerTest, WaitForService_LimitsWaitsInAll) {
+    char name[16];
+    for (size_t w = 0; w < sizeof(gWaiters); w++) {
+        for (int i = 0; i < 16; i++) {
+            snprintf(name, sizeof(name), "all%d", i);
+            ASSERT_EQ(0, waitForService(name, &gWaiters[w]));
+        }
+    }
+    EXPECT_EQ(-1, waitForService("all0", &WAITER));
+
+    ASSERT_EQ(0, addService("all0"));
+    EXPECT_EQ(sizeof(gWaiters), gSent.size());
+    EXPECT_EQ(0, waitForService("all16", &WAITER))
+            << "the notified waits should have been dropped";
+
+    kill(&WAITER);
+    for (size_t w = 0; w < sizeof(gWaiters); w++) {
+        kill(&gWaiters[w]);
+    }
+}
+
+TEST_F(ServiceManagerTest, WaitForService_RefusesServiceHiddenFromCaller) {
+    const unsigned isolatedUid = 99000; // AID_ISOLATED_START
+
+    ASSERT_EQ(0, addService("hidden"));
+    EXPECT_EQ(-1, waitForService("hidden", &WAITER, isolatedUid));
+    EXPECT_TRUE(gDeathLinks.valueFor(&WAITER) == NULL)
+            << "the isolated caller should not be kept waiting";
+    EXPECT_EQ(0, gRefs.valueFor(&WAITER));
+
+    // a service that isn't there yet may still be allowed for it
+    EXPECT_EQ(0, waitForService("hidden_later", &WAITER, isolatedUid));
+    kill(&WAITER);
+}
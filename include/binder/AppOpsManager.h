@@ -19,6 +19,7 @@
 
 #include <binder/IAppOpsService.h>
 
+#include <utils/String8.h>
 #include <utils/threads.h>
 
 // ---------------------------------------------------------------------------
@@ -76,6 +77,13 @@ public:
             const sp<IAppOpsCallback>& callback);
     void stopWatchingMode(const sp<IAppOpsCallback>& callback);
 
+    // In a process with a binder thread pool, the modes returned by
+    // checkOp() and noteOp() are cached until the app ops service reports
+    // that they changed, for a second at most. When the mode is cached,
+    // noteOp() returns it right away and reports the operation to the
+    // service with a one-way call.
+    static void dumpCache(String8& result);
+
 private:
     Mutex mLock;
     sp<IAppOpsService> mService;
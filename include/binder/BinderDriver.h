@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BINDER_DRIVER_H
+#define ANDROID_BINDER_DRIVER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+/*
+ * BinderDriver is what ProcessState and IPCThreadState talk to. The default
+ * one is the kernel driver behind /dev/binder; others (see
+ * LoopbackBinderDriver) implement the same protocol in userspace so that
+ * libbinder can be exercised where there is no binder driver.
+ */
+class BinderDriver : public virtual RefBase
+{
+public:
+    // Opens a new connection to the driver, returns a file descriptor
+    // or -errno.
+    virtual int         open() = 0;
+    virtual void        close(int fd) = 0;
+
+    // Maps size bytes of the connection's receive buffer, returns
+    // MAP_FAILED on error.
+    virtual void*       mmap(int fd, size_t size) = 0;
+
+    // Issues one of the BINDER_* ioctls, returns NO_ERROR or -errno.
+    virtual status_t    ioctl(int fd, unsigned long request, void* arg) = 0;
+
+    // Waits up to timeout (forever if negative) for work the calling thread
+    // would read, without reading it. Returns NO_ERROR when there is some,
+    // TIMED_OUT or -errno.
+    virtual status_t    poll(int fd, nsecs_t timeout) = 0;
+
+    // The driver used by ProcessState::self(). setDefault() must be called
+    // before the ProcessState is created, i.e. before any binder call.
+    static  sp<BinderDriver> getDefault();
+    static  void        setDefault(const sp<BinderDriver>& driver);
+
+protected:
+    virtual             ~BinderDriver();
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_BINDER_DRIVER_H
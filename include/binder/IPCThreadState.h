@@ -20,6 +20,7 @@
 #include <utils/Errors.h>
 #include <binder/Parcel.h>
 #include <binder/ProcessState.h>
+#include <binder/TransactionStats.h>
 #include <utils/Vector.h>
 
 #ifdef HAVE_WIN32_PROC
@@ -64,6 +65,31 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // Between beginOnewayBatch() and the matching endOnewayBatch(),
+            // one-way transactions made by this thread are queued and handed
+            // to the driver together, in a single BINDER_WRITE_READ when
+            // possible, instead of one ioctl each. Batches nest; only the
+            // outermost endOnewayBatch() flushes.
+            //
+            // Ordering: all the commands of a thread go through the same
+            // queue, so batched transactions reach the driver in the order
+            // they were made and before any later synchronous transaction or
+            // reply from this thread. A synchronous transaction flushes the
+            // batch before it's sent.
+            //
+            // Errors: transact() returns NO_ERROR for a one-way transaction
+            // once it's queued (or an error if it couldn't be queued). The
+            // first delivery error of the batch (e.g. DEAD_OBJECT or
+            // FAILED_TRANSACTION) is returned by the outermost
+            // endOnewayBatch(), without saying which transaction failed.
+            //
+            // The data of a queued transaction is copied (binder references
+            // are acquired and file descriptors dup'ed), so the caller may
+            // destroy its Parcel right away. A batch must be ended before
+            // the thread returns to the thread pool.
+            void                beginOnewayBatch();
+            status_t            endOnewayBatch();
+
             void                incStrongHandle(int32_t handle);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle);
@@ -101,8 +127,20 @@ private:
             status_t            getAndExecuteCommand();
             status_t            executeCommand(int32_t command);
             void                processPendingDerefs();
+            // With a dynamic pool policy, whether the driver had no work
+            // for this thread for the policy's idle timeout.
+            bool                idleTimedOut();
             
             void                clearCaller();
+            status_t            queueOnewayTransaction(int32_t handle,
+                                                       uint32_t code,
+                                                       const Parcel& data,
+                                                       uint32_t flags);
+            status_t            flushOnewayBatch();
+            void                recordTransaction(const Parcel& data, uint32_t code,
+                                                  bool incoming, size_t replySize,
+                                                  nsecs_t start, nsecs_t driver,
+                                                  nsecs_t handling);
             
     static  void                threadDestructor(void *st);
     static  void                freeBuffer(Parcel* parcel,
@@ -122,6 +160,17 @@ private:
             uid_t               mCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+            // only used when TransactionStats are enabled
+            TransactionStats::ThreadTable* mStats;
+            nsecs_t             mDriverTime;
+            // one-way batching
+            int32_t             mOnewayBatchDepth;
+            size_t              mOnewayPending;
+            status_t            mOnewayBatchError;
+            Vector<Parcel*>     mOnewayParcels;
+            // thread pool accounting
+            bool                mInThreadPool;
+            uint32_t            mIncomingDepth;
 };
 
 }; // namespace android
@@ -34,7 +34,8 @@ public:
 
     /**
      * Retrieve an existing service, blocking for a few seconds
-     * if it doesn't yet exist.
+     * if it doesn't yet exist. The services are cached in the
+     * process until they die.
      */
     virtual sp<IBinder>         getService( const String16& name) const = 0;
 
@@ -60,6 +61,13 @@ public:
         CHECK_SERVICE_TRANSACTION,
         ADD_SERVICE_TRANSACTION,
         LIST_SERVICES_TRANSACTION,
+        // like CHECK_SERVICE_TRANSACTION, but when the service isn't
+        // registered yet, the binder given after the name gets a one-way
+        // call with the name once it is
+        WAIT_FOR_SERVICE_TRANSACTION,
+        // logs the lookups of each service and the time spent handling
+        // each kind of transaction, for debugging
+        DUMP_STATS_TRANSACTION,
     };
 };
 
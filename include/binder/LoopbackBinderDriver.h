@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LOOPBACK_BINDER_DRIVER_H
+#define ANDROID_LOOPBACK_BINDER_DRIVER_H
+
+#include <binder/BinderDriver.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+struct binder_transaction_data;
+struct binder_write_read;
+
+/*
+ * A binder driver implemented in userspace, for the threads of a single
+ * process. It speaks the same BINDER_WRITE_READ protocol as the kernel
+ * driver, so ProcessState, IPCThreadState and Parcel run unmodified on top
+ * of it, which makes it possible to test and profile them on a host:
+ *
+ *     BinderDriver::setDefault(new LoopbackBinderDriver());
+ *     ProcessState::self()->becomeContextManager(NULL, NULL);
+ *     setTheContextObject(service);  // see IPCThreadState.cpp
+ *     ProcessState::self()->startThreadPool();
+ *     // transactions on handle 0 now go through the driver to the pool
+ *
+ * Each connection is a binder context of its own, in which the only node
+ * is the context manager (handle 0). As with the kernel driver, binder
+ * objects sent within a process are delivered as local objects; they are
+ * kept alive until the buffer that carries them is freed. File descriptors
+ * are dup'ed. Transactions, replies, one-way ordering per node, recursive
+ * calls, BR_SPAWN_LOOPER and death notifications (see killContextManager())
+ * behave as they do with the kernel driver, and so does poll(): it waits
+ * for work as a read would, except that a thread waiting in it also counts
+ * as idle when the driver decides whether to spawn a looper.
+ *
+ * The descriptors themselves can't be polled, setupPolling() is not supported.
+ */
+class LoopbackBinderDriver : public BinderDriver
+{
+public:
+                        LoopbackBinderDriver();
+
+    virtual int         open();
+    virtual void        close(int fd);
+    virtual void*       mmap(int fd, size_t size);
+    virtual status_t    ioctl(int fd, unsigned long request, void* arg);
+    virtual status_t    poll(int fd, nsecs_t timeout);
+
+    // Simulates the death of the process hosting the context manager of
+    // the given connection: queued transactions to it fail with
+    // DEAD_OBJECT, death notifications are sent and new transactions fail
+    // until a new context manager is set.
+            void        killContextManager(int fd);
+
+protected:
+    virtual             ~LoopbackBinderDriver();
+
+private:
+    struct Buffer;
+    struct Transaction;
+    struct Work;
+    struct Thread;
+    struct Connection;
+
+    // A reference that a transaction buffer held on a local object.
+    struct ObjectRef {
+        uint32_t    type;       // BINDER_TYPE_BINDER or BINDER_TYPE_WEAK_BINDER
+        void*       object;     // the IBinder, or its weakref_type
+        const void* id;
+    };
+
+            status_t    ioctlLocked(int fd, unsigned long request, void* arg);
+            status_t    writeReadLocked(int fd, binder_write_read& bwr, bool read);
+
+            Thread*     getThreadLocked(Connection* c);
+            void        threadExitLocked(Connection* c);
+            void        destroyConnectionLocked(Connection* c);
+
+            status_t    writeCommandsLocked(Connection* c, Thread* t,
+                                            const uint8_t* buffer, size_t size,
+                                            size_t* consumed);
+            status_t    readCommandsLocked(Connection* c, Thread* t,
+                                           uint8_t* buffer, size_t size,
+                                           size_t* consumed);
+            // Returns NO_ERROR once t has work, TIMED_OUT, or -EBADF when
+            // the connection was closed (c and t are gone then).
+            status_t    waitForWorkLocked(Connection* c, Thread* t,
+                                          nsecs_t timeout);
+
+            void        transactionLocked(Connection* c, Thread* t,
+                                          const binder_transaction_data& tr,
+                                          bool reply);
+            void        failTransactionLocked(Connection* c, Transaction* x);
+            void        updateRefsLocked(Connection* c, uint32_t cmd,
+                                         int32_t handle);
+
+            Buffer*     copyBufferLocked(Connection* c,
+                                         const binder_transaction_data& tr,
+                                         bool async);
+            void        releaseBufferLocked(Connection* c, Buffer* b,
+                                            bool closeFds);
+            void        freeBufferLocked(Connection* c, uintptr_t data);
+
+            void        postLocked(Thread* t, uint32_t cmd, uintptr_t arg,
+                                   Transaction* x);
+            void        postLocked(Connection* c, uint32_t cmd, uintptr_t arg,
+                                   Transaction* x);
+
+            // Hands the references released under mLock to the caller,
+            // which drops them with dropObjects() once mLock is released.
+            Vector<ObjectRef> takeReleasedObjectsLocked();
+    static  void        dropObjects(const Vector<ObjectRef>& objects);
+
+            Mutex       mLock;  // protects everything below, and all connections
+            KeyedVector<int, Connection*> mConnections;
+            // dropping the last reference on an object runs its destructor,
+            // which may call back into the driver, so it's never done with
+            // mLock held
+            Vector<ObjectRef> mReleasedObjects;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_LOOPBACK_BINDER_DRIVER_H
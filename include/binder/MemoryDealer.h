@@ -28,17 +28,30 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class SimpleBestFitAllocator;
+class String8;
 
 // ----------------------------------------------------------------------------
 
 class MemoryDealer : public RefBase
 {
 public:
-    MemoryDealer(size_t size, const char* name = 0);
+    // How allocate() looks for a free block. BEST_FIT, the default, walks
+    // all the blocks for the smallest one that fits. SEGREGATED_FIT keeps
+    // the free blocks in lists of power-of-two size classes and takes one
+    // from the smallest class that fits, in constant time, at the cost of
+    // some fragmentation. With both, deallocate() takes constant time.
+    enum Policy {
+        BEST_FIT,
+        SEGREGATED_FIT
+    };
+
+    MemoryDealer(size_t size, const char* name = 0,
+            Policy policy = BEST_FIT);
 
     virtual sp<IMemory> allocate(size_t size);
     virtual void        deallocate(size_t offset);
     virtual void        dump(const char* what) const;
+            void        dump(String8& result, const char* what) const;
 
     sp<IMemoryHeap> getMemoryHeap() const { return heap(); }
 
@@ -103,6 +103,13 @@ public:
     status_t            writeWeakBinder(const wp<IBinder>& val);
     status_t            writeInt32Array(size_t len, const int32_t *val);
 
+    // Write count values in a single copy. The result is the same as count
+    // calls to writeInt32() (resp. writeInt64(), writeFloat()), in
+    // particular no length is written.
+    status_t            writeInt32Values(const int32_t* values, size_t count);
+    status_t            writeInt64Values(const int64_t* values, size_t count);
+    status_t            writeFloatValues(const float* values, size_t count);
+
     template<typename T>
     status_t            write(const Flattenable<T>& val);
 
@@ -131,6 +138,20 @@ public:
     // The caller should call release() on the blob after writing its contents.
     status_t            writeBlob(size_t len, WritableBlob* outBlob);
 
+    // Like writeBlob(), but a large blob is written to an ashmem region of a
+    // per-process pool, already mapped and faulted in, instead of a new one.
+    // The receiver gets a read-only region as with writeBlob(), along with a
+    // binder that keeps the region out of the pool until every receiver has
+    // released its blob. Only then is the region reused, and only for blobs
+    // sent to the same target. The release is handled on one of the binder
+    // threads of this process; without them, the regions aren't reused.
+    status_t            writePooledBlob(size_t len, const sp<IBinder>& target,
+                                        WritableBlob* outBlob);
+
+    // Returns the number of ashmem regions the blob pool created and the
+    // number of times it reused one.
+    static void         getBlobPoolStats(size_t* outCreated, size_t* outReused);
+
     status_t            writeObject(const flat_binder_object& val, bool nullMetaData);
 
     // Like Parcel.java's writeNoException().  Just writes a zero int32.
@@ -148,6 +169,12 @@ public:
     status_t            readInt64(int64_t *pArg) const;
     float               readFloat() const;
     status_t            readFloat(float *pArg) const;
+    // Read count values written by count calls to writeInt32() (resp.
+    // writeInt64(), writeFloat()) or by the matching write*Values(). Nothing
+    // is read if the parcel doesn't hold enough data.
+    status_t            readInt32Values(int32_t* values, size_t count) const;
+    status_t            readInt64Values(int64_t* values, size_t count) const;
+    status_t            readFloatValues(float* values, size_t count) const;
     double              readDouble() const;
     status_t            readDouble(double *pArg) const;
     intptr_t            readIntPtr() const;
@@ -221,6 +248,14 @@ private:
     void                freeDataNoInit();
     void                initState();
     void                scanForFds() const;
+
+    void*               allocBuffer(void* inlineBuffer, size_t inlineSize,
+                                    size_t size, size_t* outSize);
+    void*               growBuffer(void* inlineBuffer, size_t inlineSize,
+                                   void* buffer, size_t size, size_t used,
+                                   size_t desired, size_t* outSize);
+    void                freeBuffer(void* buffer, size_t size);
+    status_t            growObjects(size_t desired);
                         
     template<class T>
     status_t            readAligned(T *pArg) const;
@@ -230,6 +265,12 @@ private:
     template<class T>
     status_t            writeAligned(T val);
 
+    template<class T>
+    status_t            readAlignedValues(T* values, size_t count) const;
+
+    template<class T>
+    status_t            writeAlignedValues(const T* values, size_t count);
+
     status_t            mError;
     uint8_t*            mData;
     size_t              mDataSize;
@@ -247,6 +288,15 @@ private:
     release_func        mOwner;
     void*               mOwnerCookie;
 
+    // Small parcels, which are the vast majority of binder transactions,
+    // are stored in place and don't need any heap allocation.
+    enum {
+        INLINE_DATA_SIZE = 256,
+        INLINE_OBJECTS_COUNT = 4
+    };
+    uint64_t            mInlineData[INLINE_DATA_SIZE / sizeof(uint64_t)];
+    size_t              mInlineObjects[INLINE_OBJECTS_COUNT];
+
     class Blob {
     public:
         Blob();
@@ -262,6 +312,8 @@ private:
         bool mMapped;
         void* mData;
         size_t mSize;
+        // keeps a pooled region out of the sender's pool while it's mapped
+        sp<IBinder> mToken;
     };
 
     class FlattenableHelperInterface {
@@ -20,9 +20,11 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <utils/KeyedVector.h>
+#include <utils/RWLock.h>
 #include <utils/String16.h>
 #include <utils/Singleton.h>
-#include <utils/SortedVector.h>
+#include <utils/Vector.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -31,40 +33,69 @@ namespace android {
  * PermissionCache caches permission checks for a given uid.
  *
  * Currently the cache is not updated when there is a permission change,
- * for instance when an application is uninstalled.
+ * for instance when an application is uninstalled; invalidate() must be
+ * called for that.
  *
  * IMPORTANT: for the reason stated above, only system permissions are safe
  * to cache. This restriction may be lifted at a later time.
  *
+ * Permissions checked often should be looked up by id, which avoids
+ * comparing their names on each check:
+ *
+ *     static int32_t getDumpId() {
+ *         static const int32_t id =
+ *                 PermissionCache::getPermissionId(String16("android.permission.DUMP"));
+ *         return id;
+ *     }
+ *     ...
+ *     if (!PermissionCache::checkCallingPermission(getDumpId())) ...
+ *
+ * Don't look ids up while the static objects are initialized: the cache
+ * may not be constructed yet.
  */
 
 class PermissionCache : Singleton<PermissionCache> {
+    enum {
+        // the cache is a hash table of CACHE_SIZE entries, it's purged
+        // when half of them are used
+        CACHE_BITS = 9,
+        CACHE_SIZE = 1 << CACHE_BITS
+    };
     struct Entry {
-        String16    name;
-        uid_t       uid;
+        uint64_t    key;        // uid and permission id + 1, 0 when unused
         bool        granted;
-        inline bool operator < (const Entry& e) const {
-            return (uid == e.uid) ? (name < e.name) : (uid < e.uid);
-        }
     };
-    mutable Mutex mLock;
-    // we pool all the permission names we see, as many permissions checks
-    // will have identical names
-    SortedVector< String16 > mPermissionNamesPool;
-    // this is our cache per say. it stores pooled names.
-    SortedVector< Entry > mCache;
-
-    // free the whole cache, but keep the permission name pool
+    mutable RWLock mLock;
+    // we intern all the permission names we see, as many permissions checks
+    // will have identical names. a permission id is its index in
+    // mPermissionNames.
+    Vector< String16 > mPermissionNames;
+    KeyedVector< String16, int32_t > mPermissionIds;
+    // this is our cache per say.
+    Entry mCache[CACHE_SIZE];
+    size_t mCacheCount;
+
+    // free the whole cache, or the entries of a uid, but keep the
+    // permission names
     void purge();
+    void purge(uid_t uid);
 
-    status_t check(bool* granted,
-            const String16& permission, uid_t uid) const;
+    int32_t intern(const String16& permission);
+    bool getPermissionName(int32_t id, String16* outName) const;
 
-    void cache(const String16& permission, uid_t uid, bool granted);
+    static uint64_t makeKey(int32_t id, uid_t uid);
+    static size_t hash(uint64_t key);
+    status_t check(bool* granted, int32_t id, uid_t uid) const;
+    void cache(int32_t id, uid_t uid, bool granted);
+    void insertLocked(uint64_t key, bool granted);
 
 public:
     PermissionCache();
 
+    // returns the id of a permission, which stays valid for the lifetime of
+    // the process
+    static int32_t getPermissionId(const String16& permission);
+
     static bool checkCallingPermission(const String16& permission);
 
     static bool checkCallingPermission(const String16& permission,
@@ -72,6 +103,18 @@ public:
 
     static bool checkPermission(const String16& permission,
             pid_t pid, uid_t uid);
+
+    static bool checkCallingPermission(int32_t permissionId);
+
+    static bool checkCallingPermission(int32_t permissionId,
+                                int32_t* outPid, int32_t* outUid);
+
+    static bool checkPermission(int32_t permissionId,
+            pid_t pid, uid_t uid);
+
+    // forget the cached checks, of all the uids or of one
+    static void invalidate();
+    static void invalidate(uid_t uid);
 };
 
 // ---------------------------------------------------------------------------
@@ -17,10 +17,12 @@
 #ifndef ANDROID_PROCESS_STATE_H
 #define ANDROID_PROCESS_STATE_H
 
+#include <binder/BinderDriver.h>
 #include <binder/IBinder.h>
 #include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 
 #include <utils/threads.h>
 
@@ -73,6 +75,47 @@ public:
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
             void                giveThreadPoolName();
 
+    // How busy the binder thread pool has been. "Saturated" means all
+    // the pool threads were handling a transaction, so that new incoming
+    // transactions had to queue in the driver; the driver doesn't say how
+    // long each one waited, the saturated time is an upper bound.
+    struct ThreadPoolStats {
+        size_t      threads;            // threads in the pool
+        size_t      busyThreads;        // of which handling a transaction
+        size_t      maxBusyThreads;
+        size_t      maxThreads;         // the limit given to the driver
+        uint32_t    transactions;       // wraps around
+        uint64_t    saturations;
+        nsecs_t     saturatedTime;
+        nsecs_t     maxSaturatedTime;
+        uint32_t    grown;              // times the policy raised maxThreads
+        uint32_t    retired;            // threads the policy made exit
+    };
+
+            void                getThreadPoolStats(ThreadPoolStats* outStats) const;
+            void                dumpThreadPoolStats(String8& result) const;
+
+    // The threads in the binder thread pool right now. Without any, the
+    // process only gets incoming transactions while it makes calls.
+            size_t              getThreadPoolThreadCount() const;
+
+    // With a dynamic policy the limit given to the driver is raised by one,
+    // up to maxThreads, every time the pool stays saturated for growAfter.
+    // The pooled threads (other than the main ones) then poll the driver
+    // before waiting for work; one that stays idle for idleTimeout exits
+    // the pool if there are more than minThreads. A thread already waiting
+    // for work when the policy is set only does so once it got some. With
+    // an idleTimeout of 0 the pool never shrinks.
+    struct ThreadPoolPolicy {
+        bool        dynamic;
+        size_t      minThreads;
+        size_t      maxThreads;
+        nsecs_t     growAfter;
+        nsecs_t     idleTimeout;
+    };
+
+            void                setThreadPoolPolicy(const ThreadPoolPolicy& policy);
+
 private:
     friend class IPCThreadState;
     
@@ -90,6 +133,16 @@ private:
             
             handle_entry*       lookupHandleLocked(int32_t handle);
 
+            // called by IPCThreadState for the pool threads
+            void                threadPoolEnter();
+            void                threadPoolExit(bool retired);
+            void                threadPoolTransactionStarted();
+            void                threadPoolTransactionFinished();
+            // called when the driver says a non-main pool thread stayed
+            // idle, returns whether it should leave the pool
+            bool                threadPoolIdleTimedOut();
+
+            const sp<BinderDriver> mDriver;
             int                 mDriverFD;
             void*               mVMStart;
             
@@ -108,6 +161,20 @@ private:
             String8             mRootDir;
             bool                mThreadPoolStarted;
     volatile int32_t            mThreadPoolSeq;
+
+    // Updated by every pool transaction, without the lock.
+    volatile int32_t            mPoolThreads;
+    volatile int32_t            mBusyThreads;
+    volatile int32_t            mMaxBusyThreads;
+    volatile int32_t            mPoolTransactions;
+    volatile int32_t            mThreadPoolDynamic;
+    volatile int32_t            mThreadPoolIdleTimeoutMs;  // 0: never retire
+
+    mutable Mutex               mThreadPoolLock;  // protects everything below.
+            ThreadPoolStats     mThreadPoolStats;
+            ThreadPoolPolicy    mThreadPoolPolicy;
+            nsecs_t             mSaturationStart;
+            size_t              mRetiringThreads;
 };
     
 }; // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_TRANSACTION_STATS_H
+#define ANDROID_TRANSACTION_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * TransactionStats records, per interface descriptor and transaction code,
+ * how many binder transactions this process made (outgoing) and served
+ * (incoming), how big they were and how long they took.
+ *
+ * Recording is off by default; when it's off the cost is a single branch
+ * per transaction. It can be turned on with setEnabled() or by setting the
+ * debug.binder.stats system property before the process starts.
+ *
+ * Each thread records into its own table without any locking; the tables
+ * are merged when the stats are queried. Counters read while other threads
+ * are recording may therefore be off by a transaction.
+ */
+class TransactionStats {
+public:
+    // Latency histograms have log2 buckets: bucket 0 counts transactions
+    // under 2us, bucket i those in [2^i, 2^(i+1)) us and the last one
+    // everything above.
+    enum { HISTOGRAM_BUCKETS = 16 };
+
+    struct Histogram {
+        uint32_t    counts[HISTOGRAM_BUCKETS];
+
+        void        add(nsecs_t duration);
+        void        merge(const Histogram& other);
+        // Returns an upper bound, in microseconds, of the given percentile.
+        uint32_t    percentile(uint32_t percent) const;
+    };
+
+    struct Entry {
+        String16    descriptor;     // empty when the data has no interface token
+        uint32_t    code;
+        bool        incoming;       // served by this process
+        uint64_t    count;
+        uint64_t    requestBytes;
+        uint64_t    replyBytes;
+        // outgoing: the whole transact() call; incoming: from the start of
+        // the call to the reply being handed to the driver.
+        Histogram   total;
+        // outgoing: time blocked in the driver; incoming: time sending the
+        // reply.
+        Histogram   driver;
+        // incoming only: time spent in BBinder::transact().
+        Histogram   handling;
+    };
+
+    static void     setEnabled(bool enabled);
+    static inline bool isEnabled() { return sEnabled; }
+
+    // Returns the stats of all the threads of this process, merged.
+    static void     getEntries(Vector<Entry>* outEntries);
+
+    // Appends a human readable summary to result, suitable for dumpsys.
+    static void     dump(String8& result);
+
+    // Used by IPCThreadState. Tables are only created once a thread records
+    // its first transaction.
+    class ThreadTable;
+    static void     init();
+    static ThreadTable* createThreadTable();
+    static void     destroyThreadTable(ThreadTable* table);
+    static void     record(ThreadTable* table, const uint8_t* data, size_t dataSize,
+                           uint32_t code, bool incoming, size_t replySize,
+                           nsecs_t total, nsecs_t driver, nsecs_t handling);
+
+private:
+    static volatile bool sEnabled;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_TRANSACTION_STATS_H
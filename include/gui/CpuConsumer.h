@@ -104,6 +104,18 @@ class CpuConsumer : public ConsumerBase
     // lockNextBuffer.
     status_t unlockBuffer(const LockedBuffer &nativeBuffer);
 
+    // Converts the crop region of a buffer returned by lockNextBuffer to
+    // HAL_PIXEL_FORMAT_RGBA_8888 or HAL_PIXEL_FORMAT_RGB_565, reading the
+    // locked planes in place. The source must be HAL_PIXEL_FORMAT_YCrCb_420_SP
+    // (NV21), HAL_PIXEL_FORMAT_YV12 or HAL_PIXEL_FORMAT_YCbCr_420_888.
+    // downscale may be 1, 2 or 4, in which case dst receives a box-filtered
+    // image of (width / downscale) x (height / downscale) pixels. dstStride
+    // is in pixels. Returns BAD_VALUE for unsupported formats or scales, and
+    // for a crop that starts on an odd row or column.
+    static status_t convertLockedBuffer(const LockedBuffer& src,
+            PixelFormat dstFormat, uint32_t downscale,
+            void* dst, uint32_t dstStride);
+
   private:
     // Maximum number of buffers that can be locked at a time
     uint32_t mMaxLockedBuffers;
@@ -314,6 +314,96 @@ protected:
     nsecs_t mEventTime;
 };
 
+/*
+ * A vector that keeps its storage when items are removed from it, so that it can be
+ * emptied and refilled without allocating, unlike Vector which shrinks its storage.
+ * Used for the storage of objects that are reused for every input event.
+ *
+ * The storage is only released when the vector is destroyed.
+ */
+template<typename TYPE>
+class ReusableVector {
+public:
+    ReusableVector() : mSize(0) { }
+
+    ReusableVector(const ReusableVector<TYPE>& rhs) :
+            mItems(rhs.mItems), mSize(rhs.mSize) { }
+
+    ReusableVector<TYPE>& operator=(const ReusableVector<TYPE>& rhs) {
+        if (this != &rhs) {
+            clear();
+            appendArray(rhs.array(), rhs.size());
+        }
+        return *this;
+    }
+
+    inline size_t size() const { return mSize; }
+    inline bool isEmpty() const { return mSize == 0; }
+    inline size_t capacity() const { return mItems.capacity(); }
+
+    /* Grows the storage to hold at least the given number of items. */
+    ssize_t setCapacity(size_t size) {
+        return size > mItems.capacity() ? mItems.setCapacity(size) : ssize_t(mItems.capacity());
+    }
+
+    inline const TYPE* array() const { return mItems.array(); }
+    inline TYPE* editArray() { return mItems.editArray(); }
+
+    inline const TYPE& itemAt(size_t index) const { return mItems.itemAt(index); }
+    inline const TYPE& operator[](size_t index) const { return mItems.itemAt(index); }
+    inline TYPE& editItemAt(size_t index) { return mItems.editItemAt(index); }
+    inline const TYPE& top() const { return mItems.itemAt(mSize - 1); }
+    inline TYPE& editTop() { return mItems.editItemAt(mSize - 1); }
+
+    inline void clear() { mSize = 0; }
+
+    ssize_t push(const TYPE& item) {
+        if (mSize < mItems.size()) {
+            mItems.editItemAt(mSize) = item;
+        } else {
+            mItems.push(item);
+        }
+        return mSize++;
+    }
+
+    inline ssize_t push() { return push(TYPE()); }
+
+    ssize_t appendArray(const TYPE* array, size_t length) {
+        size_t reused = mItems.size() - mSize;
+        if (reused > length) {
+            reused = length;
+        }
+        if (reused) {
+            TYPE* items = mItems.editArray();
+            for (size_t i = 0; i < reused; i++) {
+                items[mSize + i] = array[i];
+            }
+        }
+        if (reused < length) {
+            mItems.appendArray(array + reused, length - reused);
+        }
+        ssize_t index = mSize;
+        mSize += length;
+        return index;
+    }
+
+    ssize_t removeItemsAt(size_t index, size_t count = 1) {
+        TYPE* items = mItems.editArray();
+        for (size_t i = index + count; i < mSize; i++) {
+            items[i - count] = items[i];
+        }
+        mSize -= count;
+        return index;
+    }
+
+    inline ssize_t removeAt(size_t index) { return removeItemsAt(index); }
+
+private:
+    // The items in use are the first mSize ones.
+    Vector<TYPE> mItems;
+    size_t mSize;
+};
+
 /*
  * Motion events.
  */
@@ -521,6 +611,16 @@ public:
             nsecs_t eventTime,
             const PointerCoords* pointerCoords);
 
+    // Makes room for sampleCount samples in all, so that adding the samples of a batch
+    // one by one doesn't reallocate the sample storage as it grows.
+    void reserveSamples(size_t sampleCount);
+
+    // Returns the number of pointer coordinates the sample storage can hold.  The storage
+    // is kept when the event is initialized again.
+    inline size_t getSamplePointerCoordsCapacity() const {
+        return mSamplePointerCoords.capacity();
+    }
+
     void offsetLocation(float xOffset, float yOffset);
 
     void scale(float scaleFactor);
@@ -559,9 +659,9 @@ protected:
     float mXPrecision;
     float mYPrecision;
     nsecs_t mDownTime;
-    Vector<PointerProperties> mPointerProperties;
-    Vector<nsecs_t> mSampleEventTimes;
-    Vector<PointerCoords> mSamplePointerCoords;
+    ReusableVector<PointerProperties> mPointerProperties;
+    ReusableVector<nsecs_t> mSampleEventTimes;
+    ReusableVector<PointerCoords> mSamplePointerCoords;
 };
 
 /*
@@ -576,6 +676,14 @@ public:
 
     virtual KeyEvent* createKeyEvent() = 0;
     virtual MotionEvent* createMotionEvent() = 0;
+
+    /* Creates a motion event that will hold the given number of samples of the given
+     * number of pointers.  Factories that reuse events can use it to pick one that
+     * has room for them. */
+    virtual MotionEvent* createMotionEventForSamples(size_t pointerCount,
+            size_t sampleCount) {
+        return createMotionEvent();
+    }
 };
 
 /*
@@ -597,6 +705,12 @@ private:
 
 /*
  * An input event factory implementation that maintains a pool of input events.
+ *
+ * Recycled motion events keep the storage of their pointers and samples, and are pooled
+ * by size class of that storage so that a batch of samples gets an event that can hold
+ * it without allocating.  Events that hold too many samples are not pooled.
+ *
+ * Not thread-safe: events must be created and recycled on the same thread.
  */
 class PooledInputEventFactory : public InputEventFactoryInterface {
 public:
@@ -605,14 +719,28 @@ public:
 
     virtual KeyEvent* createKeyEvent();
     virtual MotionEvent* createMotionEvent();
+    virtual MotionEvent* createMotionEventForSamples(size_t pointerCount, size_t sampleCount);
 
     void recycle(InputEvent* event);
 
 private:
+    enum {
+        // Size classes of motion events, by the number of pointer coordinates they
+        // can hold: up to 4, 16, 64 and 1024.
+        MOTION_EVENT_SIZE_CLASSES = 4,
+    };
+
     const size_t mMaxPoolSize;
 
-    Vector<KeyEvent*> mKeyEventPool;
-    Vector<MotionEvent*> mMotionEventPool;
+    // Stacks of free events, of mMaxPoolSize entries each.  The motion events are
+    // counted together.
+    KeyEvent** mKeyEventPool;
+    size_t mKeyEventCount;
+    MotionEvent** mMotionEventPools[MOTION_EVENT_SIZE_CLASSES];
+    size_t mMotionEventCounts[MOTION_EVENT_SIZE_CLASSES];
+    size_t mMotionEventCount;
+
+    static ssize_t getSizeClass(size_t pointerCoordsCount);
 };
 
 } // namespace android
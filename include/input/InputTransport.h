@@ -28,7 +28,9 @@
  */
 
 #include <input/Input.h>
+#include <input/VelocityTracker.h>
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
 #include <utils/String8.h>
@@ -45,11 +47,17 @@ struct InputMessage {
         TYPE_KEY = 1,
         TYPE_MOTION = 2,
         TYPE_FINISHED = 3,
+        TYPE_MOTION_COMPACT = 4,
     };
 
     struct Header {
         uint32_t type;
-        uint32_t padding; // 8 byte alignment for the body that follows
+
+        // Time from the event time to when the event was published, in microseconds,
+        // or 0 if the publisher does not track latency.  Once received by a consumer
+        // that tracks latency, the time to when it was received instead.
+        // Also gives the body that follows an 8 byte alignment.
+        uint32_t delay;
     } header;
 
     union Body {
@@ -104,6 +112,38 @@ struct InputMessage {
             }
         } motion;
 
+        // A motion event in which the pointers are packed in a variable length
+        // stream of bytes.  Each pointer is either written whole: its id, tool type
+        // and axis bits as varints followed by the values of the axes that are
+        // present, or, if delta is true, only as the varint encoded XOR of the bits
+        // of each axis value with those of the same axis of the same pointer in the
+        // previous message on the channel, which must be a motion event with the
+        // same pointers and axes.
+        struct MotionCompact {
+            uint32_t seq;
+            nsecs_t eventTime;
+            int32_t deviceId;
+            int32_t source;
+            int32_t action;
+            int32_t flags;
+            int32_t metaState;
+            int32_t buttonState;
+            int32_t edgeFlags;
+            nsecs_t downTime;
+            float xOffset;
+            float yOffset;
+            float xPrecision;
+            float yPrecision;
+            uint32_t pointerCount;
+            uint16_t dataSize;
+            bool delta;
+            uint8_t data[sizeof(Motion::Pointer) * MAX_POINTERS];
+
+            inline size_t size() const {
+                return sizeof(MotionCompact) - sizeof(data) + dataSize;
+            }
+        } motionCompact;
+
         struct Finished {
             uint32_t seq;
             bool handled;
@@ -116,6 +156,42 @@ struct InputMessage {
 
     bool isValid(size_t actualSize) const;
     size_t size() const;
+
+    /* Makes this message a TYPE_MOTION_COMPACT encoding of the given TYPE_MOTION message,
+     * delta encoded against previous if it is not NULL and has the same pointers
+     * and axes.
+     *
+     * Returns false, leaving this message in an unspecified state, if the compact
+     * encoding would not be smaller than the original message.
+     */
+    bool encodeCompactMotion(const InputMessage& msg, const InputMessage* previous);
+
+    /* Decodes this TYPE_MOTION_COMPACT message into a TYPE_MOTION message.
+     * previous is the message that preceded this one on the channel, decoded, or NULL.
+     *
+     * Returns OK on success.
+     * Returns BAD_VALUE if the message is malformed, or is delta encoded and previous
+     * is NULL or does not match it.
+     */
+    status_t decodeCompactMotion(InputMessage* outMsg, const InputMessage* previous) const;
+};
+
+/*
+ * Histogram of input latencies, with log2 buckets: bucket 0 counts latencies under 2us,
+ * bucket i those in [2^i, 2^(i+1)) us and the last one everything above.
+ */
+struct InputLatencyHistogram {
+    enum { BUCKETS = 20 };
+
+    uint32_t counts[BUCKETS];
+
+    void add(nsecs_t latency);
+
+    /* Returns the number of latencies added. */
+    uint64_t getCount() const;
+
+    /* Returns an upper bound, in microseconds, of the given percentile. */
+    uint32_t percentile(uint32_t percent) const;
 };
 
 /*
@@ -168,6 +244,33 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
+    /* Sends several messages to the other endpoint, with as few system calls as possible.
+     * Uses sendmmsg(), or one send() per message on kernels without it.
+     *
+     * The messages are sent in order, and each one is either sent whole or not at all.
+     * Sets outSent to the number of messages that were sent, even on failure.
+     *
+     * Returns OK if all the messages were sent.
+     * Returns WOULD_BLOCK if the channel became full before all of them were sent.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count, size_t* outSent);
+
+    /* Receives up to count messages sent by the other endpoint, with a single system call.
+     * Uses recvmmsg(), or one recv() per message on kernels without it.
+     *
+     * If there is no message present, try again after poll() indicates that the fd
+     * is readable.
+     *
+     * Returns OK on success, and sets outReceived to the number of messages received,
+     * which is at least 1.
+     * Returns WOULD_BLOCK if there is no message present.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t receiveMessages(InputMessage* msgs, size_t count, size_t* outReceived);
+
     /* Returns a new object that has a duplicate of this channel's fd. */
     sp<InputChannel> dup() const;
 
@@ -238,10 +341,31 @@ public:
             const PointerProperties* pointerProperties,
             const PointerCoords* pointerCoords);
 
+    /* Starts a batch: until endBatch() is called, the events published are only
+     * validated and queued, and publishKeyEvent() and publishMotionEvent() return OK
+     * unless they are invalid.
+     */
+    void beginBatch();
+
+    /* Sends the events queued since beginBatch(), in order and with as few system calls
+     * as possible.  Sets outPublished to the number of events that were sent; the
+     * others were not sent at all and are dropped from the batch, they must be
+     * published again later.
+     *
+     * Returns OK if all the events were sent.
+     * Returns WOULD_BLOCK if the channel became full.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t endBatch(size_t* outPublished);
+
     /* Receives the finished signal from the consumer in reply to the original dispatch signal.
      * If a signal was received, returns the message sequence number,
      * and whether the consumer handled the message.
      *
+     * The signals are read from the channel several at a time and buffered, so draining
+     * them by calling this until it returns WOULD_BLOCK takes few system calls.
+     *
      * The returned sequence number is never 0 unless the operation failed.
      *
      * Returns OK on success.
@@ -251,8 +375,70 @@ public:
      */
     status_t receiveFinishedSignal(uint32_t* outSeq, bool* outHandled);
 
+    /* Receives up to maxCount finished signals at once, with at most one system call.
+     * Sets outCount to the number of signals received, and fills outSeqs and
+     * outHandled with their sequence numbers and whether they were handled.
+     *
+     * Returns OK on success.
+     * Returns WOULD_BLOCK if there is no signal present.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t receiveFinishedSignals(uint32_t* outSeqs, bool* outHandled,
+            size_t maxCount, size_t* outCount);
+
+    /* Enables or disables the compact encoding of motion events on this channel.
+     * Disabled by default.
+     *
+     * When enabled, the pointers of motion events are sent as TYPE_MOTION_COMPACT
+     * messages which only carry the axes that are present, and the motion events
+     * of a batch that follow another one with the same pointers and axes are
+     * delta encoded against it.  Consumers always understand both encodings, so
+     * this only needs to be decided by the publisher of each channel.
+     */
+    void setCompactMotionEncoding(bool enabled);
+
+    /* Gets the number of motion samples sent on this channel since it was created,
+     * and the number of bytes they took on the wire, headers included.
+     */
+    void getMotionStats(uint64_t* outSamples, uint64_t* outBytes) const;
+
+    /* Enables or disables latency tracking on this channel.  Disabled by default.
+     *
+     * When enabled, the events are stamped with the time it took to publish them
+     * after their event time, for consumers that track latency.
+     */
+    void setLatencyTracking(bool enabled);
+
 private:
     sp<InputChannel> mChannel;
+
+    bool mCompactMotion;
+    bool mTrackLatency;
+
+    // The last motion event queued in the batch in progress, if it is also the
+    // last message, as a reference for delta encoding.
+    InputMessage mLastMotion;
+    bool mLastMotionValid;
+
+    uint64_t mMotionSamples;
+    uint64_t mMotionBytes;
+
+    // True between beginBatch() and endBatch().
+    bool mBatching;
+
+    // The messages of the batch in progress.
+    Vector<InputMessage> mBatch;
+
+    // Finished signals received from the channel and not returned yet, from
+    // mReceiveIndex to mReceiveCount.  Allocated on first use.
+    Vector<InputMessage> mReceiveBuffer;
+    size_t mReceiveIndex;
+    size_t mReceiveCount;
+
+    status_t publishMessage(InputMessage& msg);
+    void messageSent(const InputMessage& msg);
+    status_t fillReceiveBuffer(size_t maxCount);
 };
 
 /*
@@ -320,6 +506,9 @@ public:
      * Alternately, the caller can call hasDeferredEvent() to determine whether there is
      * a deferred event waiting and then ensure that its event loop wakes up at least
      * one more time to consume the deferred event.
+     *
+     * Messages that were received from the input channel together with the last one
+     * consumed, but not consumed yet, count as deferred events.
      */
     bool hasDeferredEvent() const;
 
@@ -330,10 +519,82 @@ public:
      */
     bool hasPendingBatch() const;
 
+    /* How touches are resampled at the frame time given to consume(). */
+    enum ResampleMode {
+        /* Interpolates touches a few milliseconds before the frame time, or extrapolates
+         * them linearly from the last two samples, by at most 8 ms. */
+        RESAMPLE_LINEAR,
+
+        /* Predicts where touches will be when the frame is presented, at the frame time
+         * plus the frame latency, from a velocity estimate of each pointer.  Pointers
+         * whose motion fits the estimate poorly are predicted less far. */
+        RESAMPLE_PREDICTIVE,
+    };
+
+    /* Sets the resampling mode, and the time it takes the application to present a
+     * frame after the frame time, as it measures it.  The default is RESAMPLE_LINEAR.
+     *
+     * Has no effect if touch resampling is disabled by the 'ro.input.noresample' property.
+     */
+    void setResampleMode(ResampleMode mode, nsecs_t frameLatency);
+
+    // Accuracy of the touch positions extrapolated by resampling, measured against
+    // the real samples received after them.
+    struct ResampleStats {
+        uint64_t    predictions;        // resampled samples past the last real one
+        nsecs_t     predictionTime;     // total time predicted
+        uint64_t    measuredPointers;   // pointers compared with the real samples
+        double      error;              // total distance to the real positions
+        double      squaredError;
+        float       maxError;
+    };
+
+    /* Gets the resampling statistics since the consumer was created. */
+    void getResampleStats(ResampleStats* outStats) const;
+
+    // Latency of the events received on this channel.  The dispatch and queue
+    // histograms only count events stamped by a publisher that tracks latency.
+    struct LatencyStats {
+        InputLatencyHistogram dispatch;   // from the event time to publishing
+        InputLatencyHistogram queue;      // from publishing to being received
+        InputLatencyHistogram batching;   // from being received to being consumed
+        InputLatencyHistogram handling;   // from being consumed to sendFinishedSignal()
+        InputLatencyHistogram total;      // from the event time to sendFinishedSignal()
+    };
+
+    /* Enables or disables latency tracking.  Disabled by default, in which case
+     * consuming events does not read the clock.
+     *
+     * The batching histogram counts every sample, the handling and total ones every
+     * event, from the event time of its last sample that was received, not resampled.
+     */
+    void setLatencyTracking(bool enabled);
+
+    /* Gets the latency statistics since latency tracking was enabled. */
+    void getLatencyStats(LatencyStats* outStats) const;
+
+    /* Appends a summary of the latency statistics to dump. */
+    void dumpLatencyStats(String8& dump) const;
+
 private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    ResampleMode mResampleMode;
+    nsecs_t mFrameLatency;
+    ResampleStats mResampleStats;
+
+    bool mTrackLatency;
+    LatencyStats mLatencyStats;
+
+    // Events consumed and not finished yet, when tracking latency.
+    struct ConsumedEvent {
+        uint32_t seq;
+        nsecs_t eventTime;
+        nsecs_t consumeTime;
+    };
+    ReusableVector<ConsumedEvent> mConsumedEvents;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
@@ -344,9 +605,20 @@ private:
     // call to consume and that still needs to be handled.
     bool mMsgDeferred;
 
-    // Batched motion events per device and source.
+    // Messages received from the channel all at once and not consumed yet.
+    Vector<InputMessage> mReceiveBuffer;
+    size_t mReceiveIndex;
+    size_t mReceiveCount;
+
+    // The last message received if it is a motion event, decoded, as a reference for
+    // the delta encoded motion events that may follow it.
+    InputMessage mLastMotion;
+    bool mLastMotionValid;
+
+    // Batched motion events per device and source.  Batches that have been consumed are
+    // kept, empty, so that their storage is reused by the next ones.
     struct Batch {
-        Vector<InputMessage> samples;
+        ReusableVector<InputMessage> samples;
     };
     Vector<Batch> mBatches;
 
@@ -380,6 +652,10 @@ private:
         History history[2];
         History lastResample;
 
+        // True if lastResample was extrapolated, and not compared with the real
+        // samples yet.
+        bool lastResamplePredicted;
+
         void initialize(int32_t deviceId, int32_t source) {
             this->deviceId = deviceId;
             this->source = source;
@@ -387,6 +663,7 @@ private:
             historySize = 0;
             lastResample.eventTime = 0;
             lastResample.idBits.clear();
+            lastResamplePredicted = false;
         }
 
         void addHistory(const InputMessage* msg) {
@@ -403,6 +680,11 @@ private:
     };
     Vector<TouchState> mTouchStates;
 
+    // Velocity of the pointers per device and source, only for predictive resampling,
+    // keyed by getTouchKey().  The trackers are owned by the consumer and kept when a
+    // gesture ends, to be cleared and reused by the next one on the same device.
+    KeyedVector<int64_t, VelocityTracker*> mVelocityTrackers;
+
     // Chain of batched sequence numbers.  When multiple input messages are combined into
     // a batch, we append a record here that associates the last sequence number in the
     // batch with the previous one.  When the finished signal is sent, we traverse the
@@ -411,7 +693,12 @@ private:
         uint32_t seq;   // sequence number of batched input message
         uint32_t chain; // sequence number of previous batched input message
     };
-    Vector<SeqChain> mSeqChains;
+    ReusableVector<SeqChain> mSeqChains;
+
+    // The sequence numbers of a chain being finished, and the finished signals sent
+    // for them a batch at a time.
+    ReusableVector<uint32_t> mFinishedSeqs;
+    Vector<InputMessage> mFinishedBuffer;
 
     status_t consumeBatch(InputEventFactoryInterface* factory,
             nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent);
@@ -422,11 +709,25 @@ private:
     void rewriteMessage(const TouchState& state, InputMessage* msg);
     void resampleTouchState(nsecs_t frameTime, MotionEvent* event,
             const InputMessage *next);
+    bool predictTouchState(TouchState& touchState, const VelocityTracker& velocityTracker,
+            nsecs_t sampleTime, const MotionEvent* event);
+    void measurePrediction(TouchState& touchState, const InputMessage* msg);
+    VelocityTracker* findVelocityTracker(int32_t deviceId, int32_t source) const;
+    static void addVelocityMovement(VelocityTracker* velocityTracker,
+            const InputMessage* msg);
 
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
+    Batch& addBatch();
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
+    static int64_t getTouchKey(int32_t deviceId, int32_t source);
 
     status_t sendUnchainedFinishedSignal(uint32_t seq, bool handled);
+    status_t receiveMessage(InputMessage* msg);
+
+    void messageReceived(InputMessage* msg);
+    void messageConsumed(const InputMessage* msg);
+    void eventConsumed(const InputMessage* msg);
+    void eventFinished(uint32_t seq);
 
     static void initializeKeyEvent(KeyEvent* event, const InputMessage* msg);
     static void initializeMotionEvent(MotionEvent* event, const InputMessage* msg);
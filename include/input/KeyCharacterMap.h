@@ -24,6 +24,7 @@
 #endif
 
 #include <input/Input.h>
+#include <input/KeyMapImage.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
 #include <utils/Tokenizer.h>
@@ -68,9 +69,14 @@ public:
         int32_t metaState;
     };
 
-    /* Loads a key character map from a file. */
+    /* Loads a key character map from its precompiled image if there is one for the file,
+     * or from the file otherwise. */
     static status_t load(const String8& filename, Format format, sp<KeyCharacterMap>* outMap);
 
+    /* Loads a key character map from a file and writes its precompiled image. */
+    static status_t compile(const String8& filename, Format format,
+            const String8& imageFilename);
+
     /* Loads a key character map from its string contents. */
     static status_t loadContents(const String8& filename,
             const char* contents, Format format, sp<KeyCharacterMap>* outMap);
@@ -211,6 +217,41 @@ private:
         status_t parseCharacterLiteral(char16_t* outCharacter);
     };
 
+    // Entries of the tables of an image.  Keys are sorted by key code, and each refers
+    // to its behaviors, in the order of the list.  Key mappings are sorted by code.
+    struct ImageInfo {
+        int32_t type;
+    };
+
+    struct ImageKey {
+        int32_t keyCode;
+        char16_t label;
+        char16_t number;
+        uint32_t firstBehavior;
+        uint32_t behaviorCount;
+    };
+
+    struct ImageBehavior {
+        int32_t metaState;
+        int32_t fallbackKeyCode;
+        char16_t character;
+        char16_t reserved;
+    };
+
+    struct ImageKeyMapping {
+        int32_t code;
+        int32_t keyCode;
+    };
+
+    enum {
+        TABLE_INFO = 0,
+        TABLE_KEYS = 1,
+        TABLE_BEHAVIORS = 2,
+        TABLE_KEYS_BY_SCAN_CODE = 3,
+        TABLE_KEYS_BY_USAGE_CODE = 4,
+        TABLE_COUNT = 5,
+    };
+
     static sp<KeyCharacterMap> sEmpty;
 
     KeyedVector<int32_t, Key*> mKeys;
@@ -230,6 +271,14 @@ private:
     bool findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMetaState) const;
 
     static status_t load(Tokenizer* tokenizer, Format format, sp<KeyCharacterMap>* outMap);
+    static status_t loadText(const String8& filename, Format format,
+            sp<KeyCharacterMap>* outMap);
+    static status_t load(const KeyMapImage* image, Format format,
+            sp<KeyCharacterMap>* outMap);
+    static void loadKeyMappings(const KeyMapImage* image, size_t table,
+            KeyedVector<int32_t, int32_t>* outMappings);
+    static void addKeyMappings(const KeyedVector<int32_t, int32_t>& mappings,
+            Vector<ImageKeyMapping>* outEntries);
 
     static void addKey(Vector<KeyEvent>& outEvents,
             int32_t deviceId, int32_t keyCode, int32_t metaState, bool down, nsecs_t time);
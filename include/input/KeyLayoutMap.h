@@ -18,6 +18,7 @@
 #define _LIBINPUT_KEY_LAYOUT_MAP_H
 
 #include <stdint.h>
+#include <input/KeyMapImage.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
 #include <utils/Tokenizer.h>
@@ -62,8 +63,13 @@ struct AxisInfo {
  */
 class KeyLayoutMap : public RefBase {
 public:
+    /* Loads a key layout map from its precompiled image if there is one for the file,
+     * or from the file otherwise. */
     static status_t load(const String8& filename, sp<KeyLayoutMap>* outMap);
 
+    /* Loads a key layout map from a file and writes its precompiled image. */
+    static status_t compile(const String8& filename, const String8& imageFilename);
+
     status_t mapKey(int32_t scanCode, int32_t usageCode,
             int32_t* outKeyCode, uint32_t* outFlags) const;
     status_t findScanCodesForKey(int32_t keyCode, Vector<int32_t>* outScanCodes) const;
@@ -79,12 +85,47 @@ private:
         uint32_t flags;
     };
 
+    // Entries of the tables of an image, sorted by code.
+    struct ImageKey {
+        int32_t code;
+        Key key;
+    };
+
+    struct ImageAxis {
+        int32_t code;
+        int32_t mode;
+        int32_t axis;
+        int32_t highAxis;
+        int32_t splitValue;
+        int32_t flatOverride;
+    };
+
+    enum {
+        TABLE_KEYS_BY_SCAN_CODE = 0,
+        TABLE_KEYS_BY_USAGE_CODE = 1,
+        TABLE_AXES = 2,
+        TABLE_COUNT = 3,
+    };
+
     KeyedVector<int32_t, Key> mKeysByScanCode;
     KeyedVector<int32_t, Key> mKeysByUsageCode;
     KeyedVector<int32_t, AxisInfo> mAxes;
 
+    // The image the map was loaded from, if any.  The tables above are empty then, and the
+    // keys and axes are looked up in the image instead.
+    KeyMapImage* mImage;
+    const ImageKey* mImageKeysByScanCode;
+    size_t mImageKeysByScanCodeCount;
+    const ImageKey* mImageKeysByUsageCode;
+    size_t mImageKeysByUsageCodeCount;
+    const ImageAxis* mImageAxes;
+    size_t mImageAxesCount;
+
     KeyLayoutMap();
 
+    static status_t loadText(const String8& filename, sp<KeyLayoutMap>* outMap);
+    status_t setImage(KeyMapImage* image);
+
     const Key* getKey(int32_t scanCode, int32_t usageCode) const;
 
     class Parser {
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_KEY_MAP_IMAGE_H
+#define _LIBINPUT_KEY_MAP_IMAGE_H
+
+#include <stdint.h>
+#include <utils/Errors.h>
+#include <utils/String8.h>
+
+namespace android {
+
+/**
+ * A precompiled key layout map (.kl) or key character map (.kcm) file.
+ *
+ * Parsing the text files takes a noticeable time every time an input device is opened,
+ * so they can be compiled ahead of time with the compilekeymap tool into images that are
+ * placed next to them, with the same name plus ".bin".  KeyLayoutMap::load() and
+ * KeyCharacterMap::load() use the image of a file instead of parsing it if it is up to
+ * date, and parse the file otherwise.  Like make, an image is up to date when the file
+ * is not newer than it; it must also have been compiled from a file of the same size.
+ * Checking this only takes a stat() of each file, so the text is never read.  The build
+ * compiles the maps installed in system/usr/keylayout and system/usr/keychars after
+ * installing them, see cmds/compilekeymap/Android.mk.
+ *
+ * An image is a Header, followed by a TableHeader for each table, followed by the tables:
+ * arrays of fixed size entries whose layout is defined by the map that wrote them, in
+ * the native byte order.  Images are mapped read-only: key layout maps look their keys up
+ * in the tables in place, key character maps are built from them without parsing.
+ */
+class KeyMapImage {
+public:
+    enum {
+        MAGIC_KEY_LAYOUT_MAP = 0x314d4c4b,     // "KLM1"
+        MAGIC_KEY_CHARACTER_MAP = 0x314d434b,  // "KCM1"
+
+        // Incremented when the layout of the header or of a table changes.
+        VERSION = 2,
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;          // size of the whole image
+        uint32_t sourceSize;    // size of the text file it was compiled from
+        uint32_t tableCount;
+    };
+
+    struct TableHeader {
+        uint32_t offset;        // from the start of the image, aligned on 4 bytes
+        uint32_t count;
+        uint32_t entrySize;
+    };
+
+    // A table to write.
+    struct Table {
+        const void* data;
+        uint32_t count;
+        uint32_t entrySize;
+    };
+
+    ~KeyMapImage();
+
+    /* Returns the path of the image of a text file. */
+    static String8 getImagePath(const String8& filename);
+
+    /* Maps the image of a text file, if there is one with the specified magic number and
+     * the current version that is up to date.
+     *
+     * Returns NAME_NOT_FOUND if there is no image or if it is out of date, in which case the
+     * text file must be parsed instead.
+     * Returns BAD_VALUE if the image is malformed.
+     */
+    static status_t open(const String8& filename, uint32_t magic, KeyMapImage** outImage);
+
+    /* Writes the image of a text file to the specified path. */
+    static status_t write(const String8& filename, const String8& imageFilename,
+            uint32_t magic, const Table* tables, size_t tableCount);
+
+    /* Gets a table of the image, or NULL if there isn't one with this index and entry size.
+     * The table remains valid as long as the image. */
+    const void* getTable(size_t index, size_t entrySize, size_t* outCount) const;
+
+    inline size_t getSize() const { return mSize; }
+
+private:
+    KeyMapImage(void* data, size_t size);
+
+    void* mData;
+    size_t mSize;
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_KEY_MAP_IMAGE_H
@@ -191,6 +191,64 @@ private:
 };
 
 
+/*
+ * Velocity tracker algorithm that fits the same unweighted least-squares polynomial
+ * as LeastSquaresVelocityTrackerStrategy, over the same window of samples, but keeps
+ * running moment sums for each pointer so that adding a movement and getting an
+ * estimator both take constant time.
+ */
+class IncrementalLeastSquaresVelocityTrackerStrategy : public VelocityTrackerStrategy {
+public:
+    // Degree must be 1 or 2.
+    IncrementalLeastSquaresVelocityTrackerStrategy(uint32_t degree);
+    virtual ~IncrementalLeastSquaresVelocityTrackerStrategy();
+
+    virtual void clear();
+    virtual void clearPointers(BitSet32 idBits);
+    virtual void addMovement(nsecs_t eventTime, BitSet32 idBits,
+            const VelocityTracker::Position* positions);
+    virtual bool getEstimator(uint32_t id, VelocityTracker::Estimator* outEstimator) const;
+
+private:
+    // Sample horizon and number of samples to keep, as for lsq.
+    static const nsecs_t HORIZON = 100 * 1000000; // 100 ms
+    static const uint32_t HISTORY_SIZE = 20;
+
+    struct Sample {
+        nsecs_t eventTime;
+        float x, y;
+    };
+
+    // Samples in the window of a particular pointer, and their moments relative to an
+    // origin which is moved to the oldest sample whenever the sums are recomputed.
+    struct State {
+        Sample samples[HISTORY_SIZE];
+        uint32_t oldest;
+        uint32_t count;
+
+        // Samples removed from the sums since they were last recomputed.
+        uint32_t removed;
+
+        nsecs_t originTime;
+        float originX, originY;
+
+        // Sums of t^k, x t^k and y t^k, and of x^2 and y^2, where t is in seconds.
+        double st[5];
+        double sx[3], sy[3];
+        double sxx, syy;
+    };
+
+    const uint32_t mDegree;
+    BitSet32 mPointerIdBits;
+    State mPointerState[MAX_POINTER_ID + 1];
+
+    static void initState(State& state, nsecs_t eventTime, float x, float y);
+    static void addSample(State& state, nsecs_t eventTime, float x, float y);
+    static void accumulate(State& state, const Sample& sample, double sign);
+    static void recomputeSums(State& state);
+};
+
+
 /*
  * Velocity tracker algorithm that uses an IIR filter.
  */
@@ -19,6 +19,7 @@
 
 #include <utils/threads.h>
 
+#include <binder/BinderDriver.h>
 #include <binder/IBinder.h>
 #include <binder/IMemory.h>
 #include <binder/ProcessState.h>
@@ -34,6 +35,10 @@ extern Vector<int32_t> gTextBuffers;
 extern Mutex gProcessMutex;
 extern sp<ProcessState> gProcess;
 
+// For BinderDriver.cpp
+extern Mutex gBinderDriverLock;
+extern sp<BinderDriver> gBinderDriver;
+
 // For ServiceManager.cpp
 extern Mutex gDefaultServiceManagerLock;
 extern sp<IServiceManager> gDefaultServiceManager;
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PRIVATE_GUI_YUV_TO_RGB_H
+#define ANDROID_PRIVATE_GUI_YUV_TO_RGB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// YuvPlanes describes a YUV 4:2:0 image in place. It covers NV21, NV12, YV12
+// and the flexible YCbCr_420_888 layout: chromaStep is 2 for semi-planar
+// layouts (cb and cr point into the same interleaved plane) and 1 for
+// planar ones.
+struct YuvPlanes {
+    const uint8_t* y;
+    const uint8_t* cb;
+    const uint8_t* cr;
+    size_t yStride;
+    size_t cStride;
+    size_t chromaStep;
+};
+
+// The kernels below convert full-range BT.601 (JFIF) YUV, which is what the
+// camera HAL produces, reading the planes directly. width and height are the
+// size of the source image; downscale is 1, 2 or 4 and the destination
+// receives (width / downscale) x (height / downscale) pixels, each one the
+// box average of the corresponding source block. dstStride is in bytes.
+
+void convertYuvToRgba8888(const YuvPlanes& src, uint32_t width,
+        uint32_t height, uint8_t* dst, size_t dstStride, uint32_t downscale);
+
+void convertYuvToRgb565(const YuvPlanes& src, uint32_t width,
+        uint32_t height, uint8_t* dst, size_t dstStride, uint32_t downscale);
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_PRIVATE_GUI_YUV_TO_RGB_H
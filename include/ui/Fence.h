@@ -104,6 +104,9 @@ private:
     friend class LightRefBase<Fence>;
     ~Fence();
 
+    // The watcher polls the fence's own fd while it holds a reference.
+    friend class FenceWatcher;
+
     // Disallow copying
     Fence(const Fence& rhs);
     Fence& operator = (const Fence& rhs);
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FENCE_WATCHER_H
+#define ANDROID_FENCE_WATCHER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/Singleton.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Fence;
+class String8;
+
+// ===========================================================================
+// FenceWatcher
+// ===========================================================================
+
+// FenceWatcher waits on any number of fences at once from a single thread
+// and reports the time at which each of them signaled. Registering a fence
+// replaces periodic Fence::getSignalTime() polling: the sync timestamp is
+// queried exactly once per fence, after the kernel reported it signaled,
+// however many callbacks are registered for that fence.
+//
+// The time is delivered when the watcher thread gets to run, which can be
+// a little after the fence signaled: until then, a FenceTime still reads
+// as pending even though Fence::getSignalTime() would return the time.
+//
+// Each watched fence costs an epoll registration, its removal and a wakeup
+// of the watcher thread, more than the couple of sync ioctls it saves when
+// a single user polls it. It pays off for fences that many users share,
+// like the display present fence, which every layer's FrameTracker and
+// DispSync track.
+class FenceWatcher : public Singleton<FenceWatcher>
+{
+public:
+    class Callback : public virtual RefBase {
+    public:
+        virtual ~Callback() { }
+
+        // onFenceSignaled is called from the watcher thread once the fence
+        // has signaled. signalTime is the value Fence::getSignalTime()
+        // returned at that point, -1 if the fence was invalid or an error
+        // occurred. It must not block.
+        virtual void onFenceSignaled(nsecs_t signalTime) = 0;
+    };
+
+    static inline FenceWatcher& get() { return getInstance(); }
+
+    // watch registers callback to be invoked when fence signals. An invalid
+    // fence is reported as signaled right away, from the calling thread.
+    // Only a weak reference to callback is kept; the fence is kept until it
+    // signals or all its callbacks are unwatched.
+    status_t watch(const sp<Fence>& fence, const sp<Callback>& callback);
+
+    // unwatch removes callback from the fences it waits on. A fence left
+    // without callbacks is no longer watched and is released. It is safe
+    // to call from the callback's destructor.
+    void unwatch(const Callback* callback);
+
+    // dump appends the watcher statistics to the result string.
+    void dump(String8& result) const;
+
+private:
+    class WatcherThread;
+    friend class Singleton<FenceWatcher>;
+
+    struct watch_rec_t {
+        sp<Fence> fence;
+        Vector<wp<Callback> > callbacks;
+    };
+
+    FenceWatcher();
+    ~FenceWatcher();
+
+    // waitForFences blocks until at least one fence signals and dispatches
+    // the callbacks of all the fences that did. Called by WatcherThread.
+    bool waitForFences();
+
+    // mEpollFd is the epoll instance all the watched fence fds are
+    // registered with.
+    int mEpollFd;
+
+    // mThread waits on mEpollFd. It is started by the first watch() call.
+    sp<WatcherThread> mThread;
+
+    // mWatches maps the fence fd registered with epoll to the fence and
+    // the callbacks to invoke. The fence is held so that its fd stays open
+    // and the same fd can't be reused by another fence meanwhile.
+    KeyedVector<int, watch_rec_t> mWatches;
+
+    // statistics reported by dump()
+    uint64_t mNumWatched;
+    uint64_t mNumSignaled;
+    uint64_t mNumWakeups;
+
+    mutable Mutex mMutex;
+};
+
+// ===========================================================================
+// FenceTime
+// ===========================================================================
+
+// FenceTime holds the signal time of a fence registered with the
+// FenceWatcher, so that it can be read cheaply from any thread without
+// touching the fence itself. The fence stops being watched for it when the
+// FenceTime is released.
+class FenceTime : public FenceWatcher::Callback
+{
+public:
+    // create returns a FenceTime that is updated when fence signals.
+    static sp<FenceTime> create(const sp<Fence>& fence);
+
+    // getSignalTime has the same semantics as Fence::getSignalTime(): it
+    // returns INT64_MAX while the fence hasn't signaled and -1 if the fence
+    // is invalid or an error occurred. It never issues an ioctl.
+    nsecs_t getSignalTime() const;
+
+private:
+    FenceTime();
+    virtual ~FenceTime();
+    virtual void onFenceSignaled(nsecs_t signalTime);
+
+    nsecs_t mSignalTime;
+    mutable Mutex mMutex;
+};
+
+}; // namespace android
+
+#endif // ANDROID_FENCE_WATCHER_H
@@ -18,12 +18,17 @@
 #define ANDROID_UI_BUFFER_MAPPER_H
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/Singleton.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
 
 #include <hardware/gralloc.h>
 
+#include <ui/Rect.h>
 
 struct gralloc_module_t;
 
@@ -31,7 +36,7 @@ namespace android {
 
 // ---------------------------------------------------------------------------
 
-class Rect;
+class String8;
 
 class GraphicBufferMapper : public Singleton<GraphicBufferMapper>
 {
@@ -53,12 +58,73 @@ public:
     // dumps information about the mapping of this handle
     void dump(buffer_handle_t handle);
 
+    // dumps the mapping cache state and lock latency statistics
+    void dump(String8& result) const;
+
     status_t getphys(buffer_handle_t handle, void** paddr);
 
+    // When enabled, a lock() on a handle that is already locked with a
+    // compatible usage and a bounding rect returns the existing CPU mapping
+    // instead of going back to gralloc. The gralloc unlock is issued when
+    // the last reference is released, so a buffer is never left locked in
+    // gralloc once its users are done with it. Off by default; can also be
+    // turned on with the debug.gralloc.map_cache property.
+    void setMappingCacheEnabled(bool enabled);
+
 private:
     friend class Singleton<GraphicBufferMapper>;
+    friend class GraphicBufferAllocator;
     GraphicBufferMapper();
+
+    struct mapping_rec_t {
+        mapping_rec_t() : usage(0), vaddr(0), isYCbCr(false),
+                refCount(0), passthroughCount(0) {
+            memset(&ycbcr, 0, sizeof(ycbcr));
+        }
+        int usage;
+        Rect bounds;
+        void* vaddr;
+        android_ycbcr ycbcr;
+        bool isYCbCr;
+        // number of lock() calls sharing this mapping
+        uint32_t refCount;
+        // number of lock() calls that could not share the mapping and
+        // went straight to gralloc while it was held
+        uint32_t passthroughCount;
+    };
+
+    struct lock_stats_t {
+        lock_stats_t() : lockCount(0), cacheHits(0),
+                totalLockTime(0), maxLockTime(0) { }
+        uint64_t lockCount;
+        uint64_t cacheHits;
+        nsecs_t totalLockTime;
+        nsecs_t maxLockTime;
+    };
+
+    // returns the cached mapping for handle if it can satisfy the request,
+    // takes a reference on it. mLock must be held.
+    mapping_rec_t* acquireCachedMappingLocked(buffer_handle_t handle,
+            int usage, const Rect& bounds, bool isYCbCr);
+
+    // records a successful gralloc lock, either as a new shareable
+    // mapping or as a pass-through lock of a handle that is already
+    // mapped. mLock must be held.
+    void addMappingLocked(buffer_handle_t handle, int usage,
+            const Rect& bounds, void* vaddr, const android_ycbcr* ycbcr);
+
+    void recordLockTimeLocked(nsecs_t duration, bool hit);
+
+    // drops any cached state for handle, called when the handle is
+    // unregistered or freed.
+    void forgetMapping(buffer_handle_t handle);
+
     gralloc_module_t const *mAllocMod;
+
+    mutable Mutex mLock;
+    bool mMappingCacheEnabled;
+    KeyedVector<buffer_handle_t, mapping_rec_t> mMappings;
+    lock_stats_t mStats;
 };
 
 // ---------------------------------------------------------------------------
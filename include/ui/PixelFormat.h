@@ -63,6 +63,7 @@ enum {
     PIXEL_FORMAT_BGRA_8888   = HAL_PIXEL_FORMAT_BGRA_8888,  // 4x8-bit BGRA
     PIXEL_FORMAT_RGBA_5551   = 6,                           // 16-bit ARGB
     PIXEL_FORMAT_RGBA_4444   = 7,                           // 16-bit ARGB
+    PIXEL_FORMAT_A_8         = 8,                           // 8-bit A
 };
 
 typedef int32_t PixelFormat;
@@ -70,6 +71,21 @@ typedef int32_t PixelFormat;
 ssize_t bytesPerPixel(PixelFormat format);
 ssize_t bitsPerPixel(PixelFormat format);
 
+// canConvertPixels returns true if convertPixels supports converting from
+// srcFormat to dstFormat. RGBA_8888, RGBX_8888, BGRA_8888, RGB_888, RGB_565
+// and A_8 can be converted to each other.
+bool canConvertPixels(PixelFormat dstFormat, PixelFormat srcFormat);
+
+// convertPixels converts a w x h rectangle of pixels from src to dst.
+// Strides are in pixels and both pointers address the top-left pixel of the
+// rectangle. Channels missing from the source read as 0 for color and 0xFF
+// for alpha; 5 and 6 bit channels are expanded by bit replication and
+// truncated when narrowing. Returns BAD_VALUE if the conversion isn't
+// supported.
+status_t convertPixels(void* dst, PixelFormat dstFormat, size_t dstStride,
+        const void* src, PixelFormat srcFormat, size_t srcStride,
+        uint32_t w, uint32_t h);
+
 }; // namespace android
 
 #endif // UI_PIXELFORMAT_H
@@ -107,6 +107,13 @@ MATRIX PURE inverse(const MATRIX& src) {
     return inverse;
 }
 
+// inverse() on a matrix goes through InverseImpl, so that a given matrix
+// type can provide a faster implementation by specializing it (see mat4.h).
+template<typename MATRIX>
+struct InverseImpl {
+    static MATRIX PURE inverse(const MATRIX& m) { return matrix::inverse(m); }
+};
+
 template<typename MATRIX_R, typename MATRIX_A, typename MATRIX_B>
 MATRIX_R PURE multiply(const MATRIX_A& lhs, const MATRIX_B& rhs) {
     // pre-requisite:
@@ -236,7 +243,7 @@ public:
      * is instantiated, at which point they're only templated on the 2nd parameter
      * (the first one, BASE<T> being known).
      */
-    friend BASE<T> PURE inverse(const BASE<T>& m)   { return matrix::inverse(m); }
+    friend BASE<T> PURE inverse(const BASE<T>& m)   { return matrix::InverseImpl< BASE<T> >::inverse(m); }
     friend BASE<T> PURE transpose(const BASE<T>& m) { return matrix::transpose(m); }
     friend T       PURE trace(const BASE<T>& m)     { return matrix::trace(m); }
 };
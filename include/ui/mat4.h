@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <ui/vec2.h>
 #include <ui/vec4.h>
 #include <utils/String8.h>
 
@@ -148,6 +149,37 @@ public:
     static tmat44 rotate(A radian, const tvec3<B>& about);
 };
 
+// ----------------------------------------------------------------------------------------
+// float specializations
+// ----------------------------------------------------------------------------------------
+
+/*
+ * The most common operations on mat4 (i.e. tmat44<float>) are implemented
+ * out of line in libui, using NEON or SSE when available. Being non-template
+ * functions, they're preferred over the generic templates below.
+ */
+
+tmat44<float> PURE operator *(const tmat44<float>& lhs, const tmat44<float>& rhs);
+tvec4<float> PURE operator *(const tmat44<float>& lhs, const tvec4<float>& rhs);
+
+namespace matrix {
+template <>
+struct InverseImpl< tmat44<float> > {
+    static tmat44<float> PURE inverse(const tmat44<float>& m);
+};
+}; // namespace matrix
+
+// transform computes out[i] = m * in[i] for count vectors. out and in may
+// be the same array.
+void transform(const tmat44<float>& m, tvec4<float>* out,
+        const tvec4<float>* in, size_t count);
+
+// transform computes out[i] = (m * vec4(in[i], 0, 1)).xy for count vectors,
+// which is what's needed for 2D vertices or texture coordinates with an
+// affine transform. out and in may be the same array.
+void transform(const tmat44<float>& m, tvec2<float>* out,
+        const tvec2<float>* in, size_t count);
+
 // ----------------------------------------------------------------------------------------
 // Constructors
 // ----------------------------------------------------------------------------------------
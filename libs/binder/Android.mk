@@ -16,6 +16,7 @@
 sources := \
     AppOpsManager.cpp \
     Binder.cpp \
+    BinderDriver.cpp \
     BpBinder.cpp \
     BufferedTextOutput.cpp \
     Debug.cpp \
@@ -34,6 +35,7 @@ sources := \
     ProcessState.cpp \
     Static.cpp \
     TextOutput.cpp \
+    TransactionStats.cpp \
 
 LOCAL_PATH:= $(call my-dir)
 
@@ -50,3 +52,31 @@ LOCAL_MODULE := libbinder
 LOCAL_STATIC_LIBRARIES += libutils
 LOCAL_SRC_FILES := $(sources)
 include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_LDLIBS += -lpthread
+LOCAL_MODULE := libbinder
+LOCAL_STATIC_LIBRARIES += libutils
+LOCAL_SRC_FILES := $(sources)
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# The userspace binder driver, only for the tests and benchmarks: it is not
+# part of libbinder on the device.
+include $(CLEAR_VARS)
+LOCAL_MODULE := libbinder_loopback
+LOCAL_SRC_FILES := LoopbackBinderDriver.cpp
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libbinder_loopback
+LOCAL_SRC_FILES := LoopbackBinderDriver.cpp
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# Include subdirectory makefiles
+# ============================================================
+
+# If we're building with ONE_SHOT_MAKEFILE (mm, mmm), then what the framework
+# team really wants is to build the stuff defined by this makefile.
+ifeq (,$(ONE_SHOT_MAKEFILE))
+include $(call first-makefiles-under,$(LOCAL_PATH))
+endif
@@ -17,8 +17,13 @@
 #include <binder/AppOpsManager.h>
 #include <binder/Binder.h>
 #include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
 
+#include <utils/KeyedVector.h>
+#include <utils/SortedVector.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -26,6 +31,219 @@ static String16 _appops("appops");
 static pthread_mutex_t gTokenMutex = PTHREAD_MUTEX_INITIALIZER;
 static sp<IBinder> gToken;
 
+// ---------------------------------------------------------------------------
+
+// The modes are only cached in processes with a binder thread pool, as the
+// others don't get the change notifications.
+class AppOpsCache : public BnAppOpsCallback
+{
+public:
+    AppOpsCache() : mGeneration(0), mHits(0), mMisses(0), mInvalidations(0),
+            mWatchResets(0), mNotesSent(0) { }
+
+    // Forgets everything if the service changed (it died), and returns
+    // the generation to give to put() after asking the service.
+    uint32_t begin(const sp<IAppOpsService>& service);
+
+    bool get(int32_t op, int32_t uid, const String16& package, int32_t* outMode);
+
+    // makes sure the service tells us when the mode of op for package
+    // changes; must be called before asking the service for the mode
+    void watch(const sp<IAppOpsService>& service, int32_t op,
+            const String16& package);
+
+    void put(uint32_t generation, int32_t op, int32_t uid,
+            const String16& package, int32_t mode);
+
+    // reports the operation without waiting for the mode, which is cached
+    void sendNote(const sp<IAppOpsService>& service, int32_t op, int32_t uid,
+            const String16& package);
+
+    void dump(String8& result);
+
+    virtual void opChanged(int32_t op, const String16& packageName);
+
+private:
+    struct Key {
+        int32_t     op;
+        int32_t     uid;
+        String16    package;
+        Key() : op(0), uid(0) { }
+        Key(int32_t op, int32_t uid, const String16& package)
+            : op(op), uid(uid), package(package) { }
+        bool operator < (const Key& o) const {
+            if (op != o.op) return op < o.op;
+            if (uid != o.uid) return uid < o.uid;
+            return package < o.package;
+        }
+    };
+    struct Entry {
+        int32_t     mode;
+        nsecs_t     time;
+    };
+
+    enum {
+        // no more than this many modes are cached
+        MAX_ENTRIES = 256,
+        // the service keeps a registration per watched op and package;
+        // past this many, they're all dropped and the cache starts over
+        MAX_WATCHED = 64
+    };
+    // how long a mode is cached, in case a change notification is late
+    static const nsecs_t kMaxAge = 1000000000LL;
+
+    void clearLocked();
+
+    Mutex mLock;
+    // held while registering with the service, so that the registrations
+    // it keeps are the ones in mWatched
+    Mutex mWatchLock;
+    sp<IBinder> mService;
+    KeyedVector<Key, Entry> mModes;
+    SortedVector<Key> mWatched;     // the uid isn't used
+    uint32_t mGeneration;
+
+    uint64_t mHits;
+    uint64_t mMisses;
+    uint64_t mInvalidations;
+    uint64_t mWatchResets;
+    uint64_t mNotesSent;
+};
+
+uint32_t AppOpsCache::begin(const sp<IAppOpsService>& service)
+{
+    Mutex::Autolock _l(mLock);
+    if (service->asBinder() != mService) {
+        clearLocked();
+        mWatched.clear();
+        mService = service->asBinder();
+    }
+    return mGeneration;
+}
+
+bool AppOpsCache::get(int32_t op, int32_t uid, const String16& package,
+        int32_t* outMode)
+{
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mModes.indexOfKey(Key(op, uid, package));
+    if (index >= 0) {
+        const Entry& e(mModes.valueAt(index));
+        if (systemTime(SYSTEM_TIME_MONOTONIC) - e.time < kMaxAge) {
+            *outMode = e.mode;
+            mHits++;
+            return true;
+        }
+        mModes.removeItemsAt(index);
+    }
+    mMisses++;
+    return false;
+}
+
+void AppOpsCache::watch(const sp<IAppOpsService>& service, int32_t op,
+        const String16& package)
+{
+    const Key key(op, 0, package);
+    Mutex::Autolock _w(mWatchLock);
+    bool reset = false;
+    {
+        Mutex::Autolock _l(mLock);
+        if (mWatched.indexOf(key) >= 0) {
+            return;
+        }
+        if (mWatched.size() >= MAX_WATCHED) {
+            mWatched.clear();
+            clearLocked();
+            mWatchResets++;
+            reset = true;
+        }
+        mWatched.add(key);
+    }
+    if (reset) {
+        service->stopWatchingMode(this);
+    }
+    service->startWatchingMode(op, package, this);
+}
+
+void AppOpsCache::put(uint32_t generation, int32_t op, int32_t uid,
+        const String16& package, int32_t mode)
+{
+    Mutex::Autolock _l(mLock);
+    if (generation != mGeneration) {
+        // the mode may have changed since it was asked for
+        return;
+    }
+    if (mModes.size() >= MAX_ENTRIES) {
+        mModes.clear();
+    }
+    Entry e;
+    e.mode = mode;
+    e.time = systemTime(SYSTEM_TIME_MONOTONIC);
+    mModes.add(Key(op, uid, package), e);
+}
+
+void AppOpsCache::opChanged(int32_t op, const String16& packageName)
+{
+    Mutex::Autolock _l(mLock);
+    for (size_t i = mModes.size(); i > 0; i--) {
+        const Key& key(mModes.keyAt(i-1));
+        if (key.op == op && key.package == packageName) {
+            mModes.removeItemsAt(i-1);
+        }
+    }
+    mGeneration++;
+    mInvalidations++;
+}
+
+void AppOpsCache::clearLocked()
+{
+    mModes.clear();
+    mGeneration++;
+}
+
+void AppOpsCache::sendNote(const sp<IAppOpsService>& service, int32_t op,
+        int32_t uid, const String16& package)
+{
+    // IAppOpsService::noteOperation() as a one-way call: the service still
+    // gets every note when it happens, even if we die right after, but we
+    // don't wait for the mode it returns.
+    Parcel data, reply;
+    data.writeInterfaceToken(IAppOpsService::descriptor);
+    data.writeInt32(op);
+    data.writeInt32(uid);
+    data.writeString16(package);
+    service->asBinder()->transact(IAppOpsService::NOTE_OPERATION_TRANSACTION, data,
+            &reply, IBinder::FLAG_ONEWAY);
+
+    Mutex::Autolock _l(mLock);
+    mNotesSent++;
+}
+
+void AppOpsCache::dump(String8& result)
+{
+    Mutex::Autolock _l(mLock);
+    const uint64_t lookups = mHits + mMisses;
+    result.appendFormat("  AppOps cache: %zu modes, %zu watched (reset %llu times), "
+            "%llu hits / %llu lookups (%d%%), %llu invalidations, "
+            "%llu one-way notes\n",
+            mModes.size(), mWatched.size(), (unsigned long long)mWatchResets,
+            (unsigned long long)mHits, (unsigned long long)lookups,
+            lookups ? int(mHits * 100 / lookups) : 0,
+            (unsigned long long)mInvalidations, (unsigned long long)mNotesSent);
+}
+
+static Mutex gCacheLock;
+static sp<AppOpsCache> gCache;
+
+static sp<AppOpsCache> getCache() {
+    Mutex::Autolock _l(gCacheLock);
+    if (gCache == NULL) {
+        gCache = new AppOpsCache();
+    }
+    return gCache;
+}
+
+// ---------------------------------------------------------------------------
+
 static const sp<IBinder>& getToken(const sp<IAppOpsService>& service) {
     pthread_mutex_lock(&gTokenMutex);
     if (gToken == NULL) {
@@ -53,6 +271,7 @@ sp<IAppOpsService> AppOpsManager::getService()
                 ALOGI("Waiting for app ops service");
             } else if ((uptimeMillis()-startTime) > 10000) {
                 ALOGW("Waiting too long for app ops service, giving up");
+                mLock.unlock();
                 return NULL;
             }
             sleep(1);
@@ -68,12 +287,42 @@ sp<IAppOpsService> AppOpsManager::getService()
 int32_t AppOpsManager::checkOp(int32_t op, int32_t uid, const String16& callingPackage)
 {
     sp<IAppOpsService> service = getService();
-    return service != NULL ? service->checkOperation(op, uid, callingPackage) : MODE_IGNORED;
+    if (service == NULL) {
+        return MODE_IGNORED;
+    }
+    if (ProcessState::self()->getThreadPoolThreadCount() == 0) {
+        return service->checkOperation(op, uid, callingPackage);
+    }
+    sp<AppOpsCache> cache = getCache();
+    const uint32_t generation = cache->begin(service);
+    int32_t mode;
+    if (!cache->get(op, uid, callingPackage, &mode)) {
+        cache->watch(service, op, callingPackage);
+        mode = service->checkOperation(op, uid, callingPackage);
+        cache->put(generation, op, uid, callingPackage, mode);
+    }
+    return mode;
 }
 
 int32_t AppOpsManager::noteOp(int32_t op, int32_t uid, const String16& callingPackage) {
     sp<IAppOpsService> service = getService();
-    return service != NULL ? service->noteOperation(op, uid, callingPackage) : MODE_IGNORED;
+    if (service == NULL) {
+        return MODE_IGNORED;
+    }
+    if (ProcessState::self()->getThreadPoolThreadCount() == 0) {
+        return service->noteOperation(op, uid, callingPackage);
+    }
+    sp<AppOpsCache> cache = getCache();
+    const uint32_t generation = cache->begin(service);
+    int32_t mode;
+    if (cache->get(op, uid, callingPackage, &mode)) {
+        cache->sendNote(service, op, uid, callingPackage);
+    } else {
+        cache->watch(service, op, callingPackage);
+        mode = service->noteOperation(op, uid, callingPackage);
+        cache->put(generation, op, uid, callingPackage, mode);
+    }
+    return mode;
 }
 
 int32_t AppOpsManager::startOp(int32_t op, int32_t uid, const String16& callingPackage) {
@@ -104,4 +353,8 @@ void AppOpsManager::stopWatchingMode(const sp<IAppOpsCallback>& callback) {
     }
 }
 
+void AppOpsManager::dumpCache(String8& result) {
+    getCache()->dump(result);
+}
+
 }; // namespace android
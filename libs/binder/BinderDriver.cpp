@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BinderDriver"
+
+#include <binder/BinderDriver.h>
+
+#include <private/binder/Static.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+class KernelBinderDriver : public BinderDriver
+{
+public:
+    virtual int open()
+    {
+        int fd = ::open("/dev/binder", O_RDWR);
+        if (fd < 0) {
+            return -errno;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return fd;
+    }
+
+    virtual void close(int fd)
+    {
+        ::close(fd);
+    }
+
+    virtual void* mmap(int fd, size_t size)
+    {
+        return ::mmap(0, size, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    }
+
+    virtual status_t ioctl(int fd, unsigned long request, void* arg)
+    {
+        return (::ioctl(fd, request, arg) >= 0) ? status_t(NO_ERROR) : -errno;
+    }
+
+    virtual status_t poll(int fd, nsecs_t timeout)
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int timeoutMillis = timeout < 0 ? -1 : toMillisecondTimeoutDelay(0, timeout);
+        int result = ::poll(&pfd, 1, timeoutMillis);
+        if (result < 0) {
+            return -errno;
+        }
+        return result ? status_t(NO_ERROR) : status_t(TIMED_OUT);
+    }
+};
+
+// ---------------------------------------------------------------------------
+
+BinderDriver::~BinderDriver()
+{
+}
+
+sp<BinderDriver> BinderDriver::getDefault()
+{
+    Mutex::Autolock _l(gBinderDriverLock);
+    if (gBinderDriver == NULL) {
+        gBinderDriver = new KernelBinderDriver();
+    }
+    return gBinderDriver;
+}
+
+void BinderDriver::setDefault(const sp<BinderDriver>& driver)
+{
+    Mutex::Autolock _l(gBinderDriverLock);
+    gBinderDriver = driver;
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
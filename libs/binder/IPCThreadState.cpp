@@ -22,6 +22,8 @@
 #include <binder/BpBinder.h>
 #include <binder/TextOutput.h>
 
+#include <cutils/atomic.h>
+#include <cutils/compiler.h>
 #include <cutils/sched_policy.h>
 #include <utils/Debug.h>
 #include <utils/Log.h>
@@ -296,6 +298,9 @@ static pthread_key_t gTLS = 0;
 static bool gShutdown = false;
 static bool gDisableBackgroundScheduling = false;
 
+// one-way transactions queued by a batch are flushed once there are this many
+static const size_t kMaxOnewayBatch = 32;
+
 IPCThreadState* IPCThreadState::self()
 {
     if (gHaveTLS) {
@@ -472,6 +477,22 @@ void IPCThreadState::processPendingDerefs()
     }
 }
 
+bool IPCThreadState::idleTimedOut()
+{
+    const int32_t timeoutMs =
+            android_atomic_acquire_load(&mProcess->mThreadPoolIdleTimeoutMs);
+    if (timeoutMs <= 0 || mIn.dataPosition() < mIn.dataSize()) {
+        return false;
+    }
+    // The driver only knows what this thread is waiting for once it got
+    // the commands written so far.
+    if (mOut.dataSize() > 0 && talkWithDriver(false) < NO_ERROR) {
+        return false;
+    }
+    const nsecs_t timeout = milliseconds(timeoutMs);
+    return mProcess->mDriver->poll(mProcess->mDriverFD, timeout) == TIMED_OUT;
+}
+
 void IPCThreadState::joinThreadPool(bool isMain)
 {
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS JOINING THE THREAD POOL\n", (void*)pthread_self(), getpid());
@@ -482,10 +503,23 @@ void IPCThreadState::joinThreadPool(bool isMain)
     // scheduling group, so first we will make sure it is in the foreground
     // one to avoid performing an initial transaction in the background.
     set_sched_policy(mMyThreadId, SP_FOREGROUND);
-        
+
+    mProcess->threadPoolEnter();
+    mInThreadPool = true;
+
     status_t result;
+    bool retired = false;
     do {
         processPendingDerefs();
+
+        // Let a thread that stayed idle exit the thread pool if it is no
+        // longer needed and it is not the main process thread.
+        if (!isMain && idleTimedOut() && mProcess->threadPoolIdleTimedOut()) {
+            result = TIMED_OUT;
+            retired = true;
+            break;
+        }
+
         // now get the next command to be processed, waiting if necessary
         result = getAndExecuteCommand();
 
@@ -497,11 +531,15 @@ void IPCThreadState::joinThreadPool(bool isMain)
         
         // Let this thread exit the thread pool if it is no longer
         // needed and it is not the main process thread.
-        if(result == TIMED_OUT && !isMain) {
+        if(result == TIMED_OUT && !isMain && mProcess->threadPoolIdleTimedOut()) {
+            retired = true;
             break;
         }
     } while (result != -ECONNREFUSED && result != -EBADF);
 
+    mInThreadPool = false;
+    mProcess->threadPoolExit(retired);
+
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS LEAVING THE THREAD POOL err=%p\n",
         (void*)pthread_self(), getpid(), (void*)result);
     
@@ -539,7 +577,7 @@ void IPCThreadState::stopProcess(bool immediate)
     flushCommands();
     int fd = mProcess->mDriverFD;
     mProcess->mDriverFD = -1;
-    close(fd);
+    mProcess->mDriver->close(fd);
     //kill(getpid(), SIGKILL);
 }
 
@@ -549,6 +587,15 @@ status_t IPCThreadState::transact(int32_t handle,
 {
     status_t err = data.errorCheck();
 
+    // driver time of this transaction, not of any nested one
+    nsecs_t start = 0;
+    nsecs_t outerDriverTime = 0;
+    if (CC_UNLIKELY(TransactionStats::isEnabled())) {
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        outerDriverTime = mDriverTime;
+        mDriverTime = 0;
+    }
+
     flags |= TF_ACCEPT_FDS;
 
     IF_LOG_TRANSACTIONS() {
@@ -558,6 +605,23 @@ status_t IPCThreadState::transact(int32_t handle,
             << indent << data << dedent << endl;
     }
     
+    if (err == NO_ERROR && mOnewayBatchDepth > 0 && (flags & TF_ONE_WAY)) {
+        LOG_ONEWAY(">>>> QUEUE from pid %d uid %d ONE WAY", getpid(), getuid());
+        err = queueOnewayTransaction(handle, code, data, flags);
+        if (CC_UNLIKELY(start)) {
+            recordTransaction(data, code, false, 0, start, 0, 0);
+            mDriverTime = outerDriverTime;
+        }
+        return (err == NO_ERROR) ? err : (mLastError = err);
+    }
+    if (err == NO_ERROR && mOnewayPending > 0) {
+        // We're about to wait for the driver: send the batch first, so that
+        // its completions and errors aren't mistaken for this transaction's.
+        // This is also the case of a call made by an incoming transaction
+        // handled while the batch is flushed.
+        flushOnewayBatch();
+    }
+
     if (err == NO_ERROR) {
         LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
             (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
@@ -577,11 +641,18 @@ status_t IPCThreadState::transact(int32_t handle,
             ALOGI(">>>>>> CALLING transaction %d", code);
         }
         #endif
+        size_t replySize = 0;
         if (reply) {
             err = waitForResponse(reply);
+            replySize = reply->dataSize();
         } else {
             Parcel fakeReply;
             err = waitForResponse(&fakeReply);
+            replySize = fakeReply.dataSize();
+        }
+        if (CC_UNLIKELY(start)) {
+            recordTransaction(data, code, false, replySize, start, mDriverTime, 0);
+            mDriverTime = outerDriverTime;
         }
         #if 0
         if (code == 4) { // relayout
@@ -600,11 +671,111 @@ status_t IPCThreadState::transact(int32_t handle,
         }
     } else {
         err = waitForResponse(NULL, NULL);
+        if (CC_UNLIKELY(start)) {
+            recordTransaction(data, code, false, 0, start, mDriverTime, 0);
+            mDriverTime = outerDriverTime;
+        }
     }
     
     return err;
 }
 
+void IPCThreadState::beginOnewayBatch()
+{
+    mOnewayBatchDepth++;
+}
+
+status_t IPCThreadState::endOnewayBatch()
+{
+    LOG_ALWAYS_FATAL_IF(mOnewayBatchDepth <= 0,
+            "endOnewayBatch() called without beginOnewayBatch()");
+    if (--mOnewayBatchDepth > 0) {
+        return NO_ERROR;
+    }
+    flushOnewayBatch();
+    const status_t err = mOnewayBatchError;
+    mOnewayBatchError = NO_ERROR;
+    return err;
+}
+
+status_t IPCThreadState::queueOnewayTransaction(int32_t handle, uint32_t code,
+        const Parcel& data, uint32_t flags)
+{
+    // The driver only reads the transaction data when the batch is
+    // flushed, so it needs to outlive the caller's parcel.
+    Parcel* copy = new Parcel();
+    status_t err = copy->appendFrom(&data, 0, data.dataSize());
+    if (err == NO_ERROR) {
+        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, NULL);
+    }
+    if (err != NO_ERROR) {
+        delete copy;
+        return err;
+    }
+    mOnewayParcels.push(copy);
+    mOnewayPending++;
+    if (mOnewayPending >= kMaxOnewayBatch) {
+        flushOnewayBatch();
+    }
+    return NO_ERROR;
+}
+
+status_t IPCThreadState::flushOnewayBatch()
+{
+    // Every queued transaction gets either a BR_TRANSACTION_COMPLETE or an
+    // error; other commands (incoming calls) are handled as they come.
+    status_t result = NO_ERROR;
+    while (mOnewayPending > 0) {
+        status_t err = talkWithDriver();
+        if (err >= NO_ERROR) {
+            err = mIn.errorCheck();
+        }
+        if (err < NO_ERROR) {
+            // The connection is unusable. Drop what wasn't sent, as it may
+            // refer to the copies, and give up on the whole batch.
+            mOut.setDataSize(0);
+            mOnewayPending = 0;
+            result = err;
+            break;
+        }
+        if (mIn.dataAvail() == 0) continue;
+
+        const int32_t cmd = mIn.readInt32();
+        switch (cmd) {
+        case BR_TRANSACTION_COMPLETE:
+            mOnewayPending--;
+            break;
+        case BR_DEAD_REPLY:
+            mOnewayPending--;
+            if (result == NO_ERROR) result = DEAD_OBJECT;
+            break;
+        case BR_FAILED_REPLY:
+            mOnewayPending--;
+            if (result == NO_ERROR) result = FAILED_TRANSACTION;
+            break;
+        default: {
+            // An incoming transaction isn't part of the batch: its one-way
+            // calls are sent right away.
+            const int32_t batchDepth = mOnewayBatchDepth;
+            mOnewayBatchDepth = 0;
+            err = executeCommand(cmd);
+            mOnewayBatchDepth = batchDepth;
+            if (err != NO_ERROR && result == NO_ERROR) result = err;
+            break;
+        }
+        }
+    }
+
+    for (size_t i=0 ; i<mOnewayParcels.size() ; i++) {
+        delete mOnewayParcels[i];
+    }
+    mOnewayParcels.clear();
+    if (result != NO_ERROR && mOnewayBatchError == NO_ERROR) {
+        mOnewayBatchError = result;
+    }
+    return result;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
@@ -679,16 +850,41 @@ IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
       mMyThreadId(androidGetTid()),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mStats(NULL),
+      mDriverTime(0),
+      mOnewayBatchDepth(0),
+      mOnewayPending(0),
+      mOnewayBatchError(NO_ERROR),
+      mInThreadPool(false),
+      mIncomingDepth(0)
 {
     pthread_setspecific(gTLS, this);
     clearCaller();
     mIn.setDataCapacity(256);
     mOut.setDataCapacity(256);
+    TransactionStats::init();
 }
 
 IPCThreadState::~IPCThreadState()
 {
+    if (mStats) {
+        TransactionStats::destroyThreadTable(mStats);
+    }
+    for (size_t i=0 ; i<mOnewayParcels.size() ; i++) {
+        delete mOnewayParcels[i];
+    }
+}
+
+void IPCThreadState::recordTransaction(const Parcel& data, uint32_t code,
+        bool incoming, size_t replySize, nsecs_t start, nsecs_t driver,
+        nsecs_t handling)
+{
+    if (mStats == NULL) {
+        mStats = TransactionStats::createThreadTable();
+    }
+    TransactionStats::record(mStats, data.data(), data.dataSize(), code, incoming,
+            replySize, systemTime(SYSTEM_TIME_MONOTONIC) - start, driver, handling);
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
@@ -844,14 +1040,12 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
         IF_LOG_COMMANDS() {
             alog << "About to read/write, write size = " << mOut.dataSize() << endl;
         }
-#if defined(HAVE_ANDROID_OS)
-        if (ioctl(mProcess->mDriverFD, BINDER_WRITE_READ, &bwr) >= 0)
-            err = NO_ERROR;
-        else
-            err = -errno;
-#else
-        err = INVALID_OPERATION;
-#endif
+        const nsecs_t ioctlStart = CC_UNLIKELY(TransactionStats::isEnabled()) ?
+                systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+        err = mProcess->mDriver->ioctl(mProcess->mDriverFD, BINDER_WRITE_READ, &bwr);
+        if (CC_UNLIKELY(ioctlStart)) {
+            mDriverTime += systemTime(SYSTEM_TIME_MONOTONIC) - ioctlStart;
+        }
         if (mProcess->mDriverFD <= 0) {
             err = -EBADF;
         }
@@ -1057,6 +1251,15 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
 
             //ALOGI(">>>> TRANSACT from pid %d uid %d\n", mCallingPid, mCallingUid);
             
+            // nested transactions don't make the thread any busier
+            const bool poolTransaction = mInThreadPool && mIncomingDepth == 0;
+            if (poolTransaction) {
+                mProcess->threadPoolTransactionStarted();
+            }
+            mIncomingDepth++;
+
+            const nsecs_t start = CC_UNLIKELY(TransactionStats::isEnabled()) ?
+                    systemTime(SYSTEM_TIME_MONOTONIC) : 0;
             Parcel reply;
             IF_LOG_TRANSACTIONS() {
                 TextOutput::Bundle _b(alog);
@@ -1082,12 +1285,25 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
             //ALOGI("<<<< TRANSACT from pid %d restore pid %d uid %d\n",
             //     mCallingPid, origPid, origUid);
             
+            const nsecs_t handled = CC_UNLIKELY(start) ?
+                    systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+
             if ((tr.flags & TF_ONE_WAY) == 0) {
                 LOG_ONEWAY("Sending reply to %d!", mCallingPid);
                 sendReply(reply, 0);
             } else {
                 LOG_ONEWAY("NOT sending reply to %d!", mCallingPid);
             }
+
+            if (CC_UNLIKELY(start)) {
+                recordTransaction(buffer, tr.code, true, reply.dataSize(), start,
+                        systemTime(SYSTEM_TIME_MONOTONIC) - handled, handled - start);
+            }
+
+            mIncomingDepth--;
+            if (poolTransaction) {
+                mProcess->threadPoolTransactionFinished();
+            }
             
             mCallingPid = origPid;
             mCallingUid = origUid;
@@ -1144,11 +1360,9 @@ void IPCThreadState::threadDestructor(void *st)
         IPCThreadState* const self = static_cast<IPCThreadState*>(st);
         if (self) {
                 self->flushCommands();
-#if defined(HAVE_ANDROID_OS)
         if (self->mProcess->mDriverFD > 0) {
-            ioctl(self->mProcess->mDriverFD, BINDER_THREAD_EXIT, 0);
+            self->mProcess->mDriver->ioctl(self->mProcess->mDriverFD, BINDER_THREAD_EXIT, 0);
         }
-#endif
                 delete self;
         }
 }
@@ -19,11 +19,13 @@
 #include <binder/IServiceManager.h>
 
 #include <utils/Debug.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
 #include <utils/String8.h>
 #include <utils/SystemClock.h>
+#include <utils/threads.h>
 
 #include <private/binder/Static.h>
 
@@ -124,33 +126,144 @@ bool checkPermission(const String16& permission, pid_t pid, uid_t uid)
 
 // ----------------------------------------------------------------------
 
+// The services looked up by this process, until they die.
+class ServiceCache : public IBinder::DeathRecipient
+{
+public:
+    sp<IBinder> get(const String16& name)
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mServices.indexOfKey(name);
+        if (index >= 0) {
+            sp<IBinder> service = mServices.valueAt(index);
+            if (service->isBinderAlive()) {
+                return service;
+            }
+            mServices.removeItemsAt(index);
+        }
+        return NULL;
+    }
+
+    void put(const String16& name, const sp<IBinder>& service)
+    {
+        {
+            Mutex::Autolock _l(mLock);
+            ssize_t index = mServices.indexOfKey(name);
+            if (index >= 0 && mServices.valueAt(index) == service) {
+                return;
+            }
+            mServices.add(name, service);
+        }
+        // local services can't die without us, they're not linked
+        if (service->linkToDeath(this) == DEAD_OBJECT) {
+            binderDied(service);
+        }
+    }
+
+    virtual void binderDied(const wp<IBinder>& who)
+    {
+        Mutex::Autolock _l(mLock);
+        for (size_t i = mServices.size(); i > 0; i--) {
+            if (mServices.valueAt(i-1).get() == who.unsafe_get()) {
+                mServices.removeItemsAt(i-1);
+            }
+        }
+    }
+
+private:
+    Mutex mLock;
+    KeyedVector<String16, sp<IBinder> > mServices;
+};
+
+// Called by the service manager when a service we're waiting for is
+// registered. This only wakes up the waiters if the process has a thread
+// pool; otherwise they still find the service when their wait times out.
+class ServiceNotifier : public BBinder
+{
+public:
+    ServiceNotifier() : mSequence(0) { }
+
+    uint32_t sequence()
+    {
+        Mutex::Autolock _l(mLock);
+        return mSequence;
+    }
+
+    // waits for a notification after the given sequence number
+    void wait(uint32_t sequence, nsecs_t timeout)
+    {
+        Mutex::Autolock _l(mLock);
+        if (mSequence == sequence) {
+            mCondition.waitRelative(mLock, timeout);
+        }
+    }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags = 0)
+    {
+        if (code != IBinder::FIRST_CALL_TRANSACTION) {
+            return BBinder::onTransact(code, data, reply, flags);
+        }
+        Mutex::Autolock _l(mLock);
+        mSequence++;
+        mCondition.broadcast();
+        return NO_ERROR;
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    uint32_t mSequence;
+};
+
 class BpServiceManager : public BpInterface<IServiceManager>
 {
 public:
     BpServiceManager(const sp<IBinder>& impl)
-        : BpInterface<IServiceManager>(impl)
+        : BpInterface<IServiceManager>(impl),
+          mCache(new ServiceCache()),
+          mNotifier(new ServiceNotifier())
     {
     }
 
     virtual sp<IBinder> getService(const String16& name) const
     {
-        unsigned n;
-        for (n = 0; n < 5; n++){
-            sp<IBinder> svc = checkService(name);
+        sp<IBinder> svc = checkService(name);
+        if (svc != NULL) return svc;
+
+        // Ask to be notified when the service is registered, and wait for
+        // it for up to 5 seconds. The wait is done in slices of a second,
+        // as we may not get the notification.
+        ALOGI("Waiting for service %s...\n", String8(name).string());
+        for (unsigned n = 0; n < 5; n++) {
+            const uint32_t sequence = mNotifier->sequence();
+            status_t err = waitForService(name, &svc);
+            if (svc != NULL) return svc;
+            if (err == NO_ERROR) {
+                mNotifier->wait(sequence, seconds(1));
+            } else {
+                // an older service manager, or one that refused the wait, poll
+                sleep(1);
+            }
+            svc = checkService(name);
             if (svc != NULL) return svc;
-            ALOGI("Waiting for service %s...\n", String8(name).string());
-            sleep(1);
         }
         return NULL;
     }
 
     virtual sp<IBinder> checkService( const String16& name) const
     {
+        sp<IBinder> svc = mCache->get(name);
+        if (svc != NULL) return svc;
+
         Parcel data, reply;
         data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
         data.writeString16(name);
         remote()->transact(CHECK_SERVICE_TRANSACTION, data, &reply);
-        return reply.readStrongBinder();
+        svc = reply.readStrongBinder();
+        if (svc != NULL) mCache->put(name, svc);
+        return svc;
     }
 
     virtual status_t addService(const String16& name, const sp<IBinder>& service,
@@ -162,7 +275,9 @@ public:
         data.writeStrongBinder(service);
         data.writeInt32(allowIsolated ? 1 : 0);
         status_t err = remote()->transact(ADD_SERVICE_TRANSACTION, data, &reply);
-        return err == NO_ERROR ? reply.readExceptionCode() : err;
+        err = (err == NO_ERROR) ? reply.readExceptionCode() : err;
+        if (err == NO_ERROR) mCache->put(name, service);
+        return err;
     }
 
     virtual Vector<String16> listServices()
@@ -181,6 +296,27 @@ public:
         }
         return res;
     }
+
+private:
+    // returns the service if it's registered, otherwise makes sure the
+    // notifier is called when it is
+    status_t waitForService(const String16& name, sp<IBinder>* outService) const
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
+        data.writeString16(name);
+        data.writeStrongBinder(mNotifier);
+        status_t err = remote()->transact(WAIT_FOR_SERVICE_TRANSACTION, data, &reply);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        *outService = reply.readStrongBinder();
+        if (*outService != NULL) mCache->put(name, *outService);
+        return NO_ERROR;
+    }
+
+    const sp<ServiceCache> mCache;
+    const sp<ServiceNotifier> mNotifier;
 };
 
 IMPLEMENT_META_INTERFACE(ServiceManager, "android.os.IServiceManager");
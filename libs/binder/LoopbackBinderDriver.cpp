@@ -0,0 +1,963 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LoopbackBinderDriver"
+
+#include <binder/LoopbackBinderDriver.h>
+
+#include <binder/IBinder.h>
+#include <utils/List.h>
+#include <utils/Log.h>
+#include <utils/SortedVector.h>
+
+#include <private/binder/binder_module.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+enum {
+    LOOPER_REGISTERED   = 0x01,
+    LOOPER_ENTERED      = 0x02,
+    LOOPER_EXITED       = 0x04,
+};
+
+// The data and offsets of a transaction, as seen by its receiver.
+struct LoopbackBinderDriver::Buffer {
+    uint8_t*    data;
+    size_t      dataSize;
+    size_t*     offsets;
+    size_t      offsetsCount;
+    bool        async;      // belongs to a one-way transaction
+};
+
+struct LoopbackBinderDriver::Transaction {
+    Thread*     from;       // NULL for one-way calls and replies, or once the sender exited
+    Thread*     to;         // set when a synchronous call is picked up
+    binder_transaction_data tr;
+    Buffer*     buffer;
+};
+
+// An item of a todo list: a BR_* command, with either a transaction or
+// a pointer sized argument depending on the command.
+struct LoopbackBinderDriver::Work {
+    uint32_t        cmd;
+    uintptr_t       arg;
+    Transaction*    transaction;
+};
+
+struct LoopbackBinderDriver::Thread {
+    pid_t                   tid;
+    uint32_t                looper;
+    Condition               cond;
+    List<Work>              todo;
+    // the synchronous transactions this thread sent or is handling, the
+    // most recent last
+    Vector<Transaction*>    stack;
+};
+
+struct LoopbackBinderDriver::Connection {
+    KeyedVector<pid_t, Thread*> threads;
+    List<Work>              todo;
+    Vector<Thread*>         idle;           // threads waiting on todo
+    size_t                  waiters;        // threads blocked in readCommandsLocked()
+    bool                    closed;
+    size_t                  maxThreads;
+    size_t                  requestedThreads;
+    size_t                  startedThreads;
+
+    // the context manager node
+    bool                    hasContextManager;
+    bool                    contextManagerDead;
+    bool                    asyncBusy;      // a one-way call is being handled
+    List<Transaction*>      asyncTodo;      // and these are waiting for it
+    int32_t                 strongRefs;
+    int32_t                 weakRefs;
+    Vector<uintptr_t>       deathCookies;
+    Vector<uintptr_t>       deadCookies;    // sent, waiting to be cleared
+
+    KeyedVector<uintptr_t, Buffer*> buffers;
+    void*                   vmStart;
+    size_t                  vmSize;
+};
+
+template<typename T>
+static void removeFromStack(Vector<T*>& stack, T* x)
+{
+    for (size_t i=stack.size() ; i>0 ; i--) {
+        if (stack[i-1] == x) {
+            stack.removeAt(i-1);
+            return;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+LoopbackBinderDriver::LoopbackBinderDriver()
+{
+}
+
+LoopbackBinderDriver::~LoopbackBinderDriver()
+{
+    while (mConnections.size()) {
+        close(mConnections.keyAt(0));
+    }
+}
+
+int LoopbackBinderDriver::open()
+{
+    // A real descriptor, so that it's unique and can be checked like the
+    // kernel driver's.
+    int fd = ::open("/dev/null", O_RDWR);
+    if (fd < 0) {
+        return -errno;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    Connection* c = new Connection();
+    c->waiters = 0;
+    c->closed = false;
+    c->maxThreads = 0;
+    c->requestedThreads = 0;
+    c->startedThreads = 0;
+    c->hasContextManager = false;
+    c->contextManagerDead = false;
+    c->asyncBusy = false;
+    c->strongRefs = 0;
+    c->weakRefs = 0;
+    c->vmStart = MAP_FAILED;
+    c->vmSize = 0;
+
+    Mutex::Autolock _l(mLock);
+    mConnections.add(fd, c);
+    return fd;
+}
+
+void LoopbackBinderDriver::close(int fd)
+{
+    Vector<ObjectRef> released;
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mConnections.indexOfKey(fd);
+        if (index < 0) {
+            return;
+        }
+        Connection* c = mConnections.valueAt(index);
+        mConnections.removeItemsAt(index);
+        ::close(fd);
+
+        c->closed = true;
+        if (c->waiters) {
+            // the last thread to wake up destroys it
+            for (size_t i=0 ; i<c->threads.size() ; i++) {
+                c->threads.valueAt(i)->cond.signal();
+            }
+        } else {
+            destroyConnectionLocked(c);
+        }
+        released = takeReleasedObjectsLocked();
+    }
+    dropObjects(released);
+}
+
+void* LoopbackBinderDriver::mmap(int fd, size_t size)
+{
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mConnections.indexOfKey(fd);
+    if (index < 0) {
+        errno = EBADF;
+        return MAP_FAILED;
+    }
+    Connection* c = mConnections.valueAt(index);
+    if (c->vmStart != MAP_FAILED) {
+        errno = EBUSY;
+        return MAP_FAILED;
+    }
+    // Transaction buffers are allocated on the heap, this mapping is only
+    // there to honor the interface.
+    c->vmStart = ::mmap(0, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (c->vmStart != MAP_FAILED) {
+        c->vmSize = size;
+    }
+    return c->vmStart;
+}
+
+status_t LoopbackBinderDriver::ioctl(int fd, unsigned long request, void* arg)
+{
+    status_t err = NO_ERROR;
+    Vector<ObjectRef> released;
+    if (request == BINDER_WRITE_READ) {
+        // The write and the read are done under the lock separately, so
+        // that what the written commands released is dropped before this
+        // thread waits for work.
+        binder_write_read& bwr(*static_cast<binder_write_read*>(arg));
+        if (bwr.write_size > 0) {
+            { // scope for the lock
+                Mutex::Autolock _l(mLock);
+                err = writeReadLocked(fd, bwr, false);
+                released = takeReleasedObjectsLocked();
+            }
+            dropObjects(released);
+        }
+        if (err != NO_ERROR || bwr.read_size <= 0) {
+            return err;
+        }
+        { // scope for the lock
+            Mutex::Autolock _l(mLock);
+            err = writeReadLocked(fd, bwr, true);
+            released = takeReleasedObjectsLocked();
+        }
+    } else {
+        Mutex::Autolock _l(mLock);
+        err = ioctlLocked(fd, request, arg);
+        released = takeReleasedObjectsLocked();
+    }
+    dropObjects(released);
+    return err;
+}
+
+status_t LoopbackBinderDriver::writeReadLocked(int fd, binder_write_read& bwr, bool read)
+{
+    ssize_t index = mConnections.indexOfKey(fd);
+    if (index < 0) {
+        return -EBADF;
+    }
+    Connection* c = mConnections.valueAt(index);
+    Thread* t = getThreadLocked(c);
+
+    status_t err;
+    if (!read) {
+        size_t consumed = bwr.write_consumed;
+        err = writeCommandsLocked(c, t,
+                reinterpret_cast<const uint8_t*>(bwr.write_buffer),
+                bwr.write_size, &consumed);
+        bwr.write_consumed = consumed;
+        if (err != NO_ERROR) {
+            bwr.read_consumed = 0;
+        }
+    } else {
+        size_t consumed = bwr.read_consumed;
+        err = readCommandsLocked(c, t,
+                reinterpret_cast<uint8_t*>(bwr.read_buffer),
+                bwr.read_size, &consumed);
+        // c and t are gone if the connection was closed meanwhile
+        if (err != -EBADF) {
+            bwr.read_consumed = consumed;
+        }
+    }
+    return err;
+}
+
+status_t LoopbackBinderDriver::ioctlLocked(int fd, unsigned long request, void* arg)
+{
+    ssize_t index = mConnections.indexOfKey(fd);
+    if (index < 0) {
+        return -EBADF;
+    }
+    Connection* c = mConnections.valueAt(index);
+
+    switch (request) {
+        case BINDER_SET_MAX_THREADS:
+            c->maxThreads = *static_cast<size_t*>(arg);
+            return NO_ERROR;
+        case BINDER_SET_CONTEXT_MGR:
+            if (c->hasContextManager && !c->contextManagerDead) {
+                return -EBUSY;
+            }
+            c->hasContextManager = true;
+            c->contextManagerDead = false;
+            c->asyncBusy = false;
+            c->strongRefs = 0;
+            c->weakRefs = 0;
+            return NO_ERROR;
+        case BINDER_THREAD_EXIT:
+            threadExitLocked(c);
+            return NO_ERROR;
+        case BINDER_VERSION:
+            static_cast<binder_version*>(arg)->protocol_version =
+                    BINDER_CURRENT_PROTOCOL_VERSION;
+            return NO_ERROR;
+        case BINDER_SET_IDLE_PRIORITY:
+            return NO_ERROR;
+    }
+    return -EINVAL;
+}
+
+status_t LoopbackBinderDriver::poll(int fd, nsecs_t timeout)
+{
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mConnections.indexOfKey(fd);
+    if (index < 0) {
+        return -EBADF;
+    }
+    Connection* c = mConnections.valueAt(index);
+    return waitForWorkLocked(c, getThreadLocked(c), timeout);
+}
+
+void LoopbackBinderDriver::killContextManager(int fd)
+{
+    Vector<ObjectRef> released;
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mConnections.indexOfKey(fd);
+        if (index < 0) {
+            return;
+        }
+        Connection* c = mConnections.valueAt(index);
+        if (!c->hasContextManager || c->contextManagerDead) {
+            return;
+        }
+        c->contextManagerDead = true;
+
+        // Fail the calls nobody picked up yet, the ones being handled finish
+        // normally.
+        List<Work>::iterator it(c->todo.begin());
+        while (it != c->todo.end()) {
+            if (it->cmd == BR_TRANSACTION) {
+                failTransactionLocked(c, it->transaction);
+                it = c->todo.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (List<Transaction*>::iterator i(c->asyncTodo.begin()) ; i != c->asyncTodo.end() ; ++i) {
+            failTransactionLocked(c, *i);
+        }
+        c->asyncTodo.clear();
+
+        for (size_t i=0 ; i<c->deathCookies.size() ; i++) {
+            postLocked(c, BR_DEAD_BINDER, c->deathCookies[i], NULL);
+            c->deadCookies.add(c->deathCookies[i]);
+        }
+        c->deathCookies.clear();
+        released = takeReleasedObjectsLocked();
+    }
+    dropObjects(released);
+}
+
+// ---------------------------------------------------------------------------
+
+LoopbackBinderDriver::Thread* LoopbackBinderDriver::getThreadLocked(Connection* c)
+{
+    const pid_t tid = androidGetTid();
+    ssize_t index = c->threads.indexOfKey(tid);
+    if (index >= 0) {
+        return c->threads.valueAt(index);
+    }
+    Thread* t = new Thread();
+    t->tid = tid;
+    t->looper = 0;
+    c->threads.add(tid, t);
+    return t;
+}
+
+void LoopbackBinderDriver::threadExitLocked(Connection* c)
+{
+    ssize_t index = c->threads.indexOfKey(androidGetTid());
+    if (index < 0) {
+        return;
+    }
+    Thread* t = c->threads.valueAt(index);
+    // like the kernel, startedThreads isn't decremented
+    c->threads.removeItemsAt(index);
+
+    // The calls this thread was handling won't get a reply, and the replies
+    // to the calls it made have nowhere to go.
+    for (size_t i=t->stack.size() ; i>0 ; i--) {
+        Transaction* x = t->stack[i-1];
+        if (x->to == t) {
+            if (x->from) {
+                removeFromStack(x->from->stack, x);
+                postLocked(x->from, BR_DEAD_REPLY, 0, NULL);
+            }
+            delete x;
+        } else {
+            x->from = NULL;
+        }
+    }
+    for (List<Work>::iterator it(t->todo.begin()) ; it != t->todo.end() ; ++it) {
+        if (it->transaction) {
+            failTransactionLocked(c, it->transaction);
+        }
+    }
+    delete t;
+}
+
+void LoopbackBinderDriver::destroyConnectionLocked(Connection* c)
+{
+    SortedVector<Transaction*> transactions;
+    for (List<Work>::iterator it(c->todo.begin()) ; it != c->todo.end() ; ++it) {
+        if (it->transaction) transactions.add(it->transaction);
+    }
+    for (List<Transaction*>::iterator it(c->asyncTodo.begin()) ; it != c->asyncTodo.end() ; ++it) {
+        transactions.add(*it);
+    }
+    for (size_t i=0 ; i<c->threads.size() ; i++) {
+        Thread* t = c->threads.valueAt(i);
+        for (List<Work>::iterator it(t->todo.begin()) ; it != t->todo.end() ; ++it) {
+            if (it->transaction) transactions.add(it->transaction);
+        }
+        for (size_t j=0 ; j<t->stack.size() ; j++) {
+            transactions.add(t->stack[j]);
+        }
+        delete t;
+    }
+    for (size_t i=0 ; i<transactions.size() ; i++) {
+        delete transactions[i];
+    }
+    // undelivered buffers still hold their file descriptors
+    while (c->buffers.size()) {
+        releaseBufferLocked(c, c->buffers.valueAt(0), true);
+    }
+    if (c->vmStart != MAP_FAILED) {
+        munmap(c->vmStart, c->vmSize);
+    }
+    delete c;
+}
+
+// ---------------------------------------------------------------------------
+
+status_t LoopbackBinderDriver::writeCommandsLocked(Connection* c, Thread* t,
+        const uint8_t* buffer, size_t size, size_t* consumed)
+{
+    union {
+        binder_transaction_data tr;
+        binder_ptr_cookie       ptrCookie;
+        int32_t                 value;
+        void*                   ptr;
+    } args;
+
+    size_t pos = *consumed;
+    while (pos + sizeof(uint32_t) <= size) {
+        uint32_t cmd;
+        memcpy(&cmd, buffer + pos, sizeof(cmd));
+        // BC_* commands encode the size of their arguments
+        const size_t argsSize = _IOC_SIZE(cmd);
+        if (argsSize > sizeof(args) || pos + sizeof(cmd) + argsSize > size) {
+            ALOGE("bad command 0x%08x", cmd);
+            return -EINVAL;
+        }
+        // zero-filled, so that pointers passed as 32-bit values read back right
+        memset(&args, 0, sizeof(args));
+        memcpy(&args, buffer + pos + sizeof(cmd), argsSize);
+
+        switch (cmd) {
+            case BC_TRANSACTION:
+            case BC_REPLY:
+                transactionLocked(c, t, args.tr, cmd == BC_REPLY);
+                break;
+            case BC_FREE_BUFFER:
+                freeBufferLocked(c, uintptr_t(args.ptr));
+                break;
+            case BC_INCREFS:
+            case BC_ACQUIRE:
+            case BC_RELEASE:
+            case BC_DECREFS:
+                updateRefsLocked(c, cmd, args.value);
+                break;
+            case BC_INCREFS_DONE:
+            case BC_ACQUIRE_DONE:
+            case BC_ACQUIRE_RESULT:
+                // we never ask for references on local objects
+                break;
+            case BC_REGISTER_LOOPER:
+                if (c->requestedThreads > 0) {
+                    c->requestedThreads--;
+                }
+                c->startedThreads++;
+                t->looper |= LOOPER_REGISTERED;
+                break;
+            case BC_ENTER_LOOPER:
+                t->looper |= LOOPER_ENTERED;
+                break;
+            case BC_EXIT_LOOPER:
+                t->looper |= LOOPER_EXITED;
+                break;
+            case BC_REQUEST_DEATH_NOTIFICATION: {
+                const int32_t handle = int32_t(uintptr_t(args.ptrCookie.ptr));
+                const uintptr_t cookie = uintptr_t(args.ptrCookie.cookie);
+                if (handle != 0 || !c->hasContextManager) {
+                    ALOGE("death notification requested for invalid handle %d", handle);
+                } else if (c->contextManagerDead) {
+                    c->deadCookies.add(cookie);
+                    postLocked(t, BR_DEAD_BINDER, cookie, NULL);
+                } else {
+                    c->deathCookies.add(cookie);
+                }
+                break;
+            }
+            case BC_CLEAR_DEATH_NOTIFICATION: {
+                const uintptr_t cookie = uintptr_t(args.ptrCookie.cookie);
+                Vector<uintptr_t>* lists[] = { &c->deathCookies, &c->deadCookies };
+                bool found = false;
+                for (size_t i=0 ; i<2 && !found ; i++) {
+                    for (size_t j=0 ; j<lists[i]->size() ; j++) {
+                        if (lists[i]->itemAt(j) == cookie) {
+                            lists[i]->removeAt(j);
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+                if (found) {
+                    postLocked(t, BR_CLEAR_DEATH_NOTIFICATION_DONE, cookie, NULL);
+                } else {
+                    ALOGE("no death notification for cookie %p", (void*)cookie);
+                }
+                break;
+            }
+            case BC_DEAD_BINDER_DONE:
+                break;
+            default:
+                ALOGE("unsupported command 0x%08x", cmd);
+                return -EINVAL;
+        }
+        pos += sizeof(cmd) + argsSize;
+        *consumed = pos;
+    }
+    return NO_ERROR;
+}
+
+status_t LoopbackBinderDriver::readCommandsLocked(Connection* c, Thread* t,
+        uint8_t* buffer, size_t size, size_t* consumed)
+{
+    const size_t start = *consumed;
+    size_t pos = start;
+    if (pos == 0) {
+        if (size < sizeof(uint32_t)) {
+            return NO_ERROR;
+        }
+        const uint32_t noop = BR_NOOP;
+        memcpy(buffer, &noop, sizeof(noop));
+        pos += sizeof(noop);
+    }
+
+    status_t err = waitForWorkLocked(c, t, -1);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    // A thread with no transaction in progress picks up work for the whole
+    // connection, otherwise it only gets what's meant for it.
+    const bool waitForProcWork = t->stack.isEmpty() && t->todo.empty();
+
+    for (;;) {
+        List<Work>* queue;
+        if (!t->todo.empty()) {
+            queue = &t->todo;
+        } else if (waitForProcWork && !c->todo.empty()) {
+            queue = &c->todo;
+        } else {
+            break;
+        }
+        const Work w(*queue->begin());
+        // BR_* commands encode the size of their arguments too
+        const size_t argsSize = _IOC_SIZE(w.cmd);
+        if (pos + sizeof(w.cmd) + argsSize > size) {
+            break;
+        }
+        queue->erase(queue->begin());
+        memcpy(buffer + pos, &w.cmd, sizeof(w.cmd));
+        pos += sizeof(w.cmd);
+        if (w.transaction) {
+            Transaction* x = w.transaction;
+            memcpy(buffer + pos, &x->tr, sizeof(x->tr));
+            pos += sizeof(x->tr);
+            if (w.cmd == BR_TRANSACTION && !(x->tr.flags & TF_ONE_WAY)) {
+                x->to = t;
+                t->stack.add(x);
+            } else {
+                delete x;
+            }
+            // let the caller handle the transaction before anything else
+            break;
+        }
+        if (argsSize) {
+            memcpy(buffer + pos, &w.arg, argsSize);
+            pos += argsSize;
+        }
+    }
+
+    // Ask for a new looper if nobody is left to pick up work for the
+    // connection.
+    if (start == 0 && c->requestedThreads == 0 && c->idle.isEmpty()
+            && c->startedThreads < c->maxThreads
+            && (t->looper & (LOOPER_REGISTERED | LOOPER_ENTERED))) {
+        c->requestedThreads++;
+        const uint32_t spawn = BR_SPAWN_LOOPER;
+        memcpy(buffer, &spawn, sizeof(spawn));
+    }
+
+    *consumed = pos;
+    return NO_ERROR;
+}
+
+status_t LoopbackBinderDriver::waitForWorkLocked(Connection* c, Thread* t,
+        nsecs_t timeout)
+{
+    const nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
+    bool waitForProcWork = t->stack.isEmpty() && t->todo.empty();
+    while (t->todo.empty() && (!waitForProcWork || c->todo.empty())) {
+        nsecs_t remaining = 0;
+        if (timeout >= 0) {
+            remaining = deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+            if (remaining <= 0) {
+                return TIMED_OUT;
+            }
+        }
+        c->waiters++;
+        if (waitForProcWork) {
+            c->idle.add(t);
+        }
+        if (timeout >= 0) {
+            t->cond.waitRelative(mLock, remaining);
+        } else {
+            t->cond.wait(mLock);
+        }
+        if (waitForProcWork) {
+            // normally done by whoever woke us up
+            for (size_t i=0 ; i<c->idle.size() ; i++) {
+                if (c->idle[i] == t) {
+                    c->idle.removeAt(i);
+                    break;
+                }
+            }
+        }
+        c->waiters--;
+        if (c->closed) {
+            if (c->waiters == 0) {
+                destroyConnectionLocked(c);
+            }
+            return -EBADF;
+        }
+        waitForProcWork = t->stack.isEmpty() && t->todo.empty();
+    }
+    return NO_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+
+void LoopbackBinderDriver::transactionLocked(Connection* c, Thread* t,
+        const binder_transaction_data& tr, bool reply)
+{
+    Thread* target = NULL;
+    Transaction* inReplyTo = NULL;
+    const bool oneway = !reply && (tr.flags & TF_ONE_WAY);
+
+    if (reply) {
+        inReplyTo = t->stack.isEmpty() ? NULL : t->stack.top();
+        if (inReplyTo == NULL || inReplyTo->to != t) {
+            ALOGE("reply with no transaction to reply to");
+            postLocked(t, BR_FAILED_REPLY, 0, NULL);
+            return;
+        }
+        t->stack.pop();
+        target = inReplyTo->from;
+        if (target) {
+            removeFromStack(target->stack, inReplyTo);
+        }
+        delete inReplyTo;
+        if (target == NULL) {
+            postLocked(t, BR_DEAD_REPLY, 0, NULL);
+            return;
+        }
+    } else {
+        if (tr.target.handle != 0 || !c->hasContextManager) {
+            ALOGE("transaction to invalid handle %ld", long(tr.target.handle));
+            postLocked(t, BR_FAILED_REPLY, 0, NULL);
+            return;
+        }
+        if (c->contextManagerDead) {
+            postLocked(t, BR_DEAD_REPLY, 0, NULL);
+            return;
+        }
+        if (!oneway) {
+            // A call made while handling a call goes back to the thread
+            // that's waiting for us, so that recursive calls don't need
+            // another thread.
+            for (size_t i=t->stack.size() ; i>0 && target == NULL ; i--) {
+                if (t->stack[i-1]->to == t) {
+                    target = t->stack[i-1]->from;
+                }
+            }
+        }
+    }
+
+    Buffer* b = copyBufferLocked(c, tr, oneway);
+    if (b == NULL) {
+        postLocked(t, BR_FAILED_REPLY, 0, NULL);
+        if (reply) {
+            postLocked(target, BR_FAILED_REPLY, 0, NULL);
+        }
+        return;
+    }
+
+    Transaction* x = new Transaction();
+    x->from = (reply || oneway) ? NULL : t;
+    x->to = NULL;
+    x->buffer = b;
+    x->tr.target.ptr = NULL;    // the context manager node
+    x->tr.cookie = NULL;
+    x->tr.code = tr.code;
+    x->tr.flags = tr.flags;
+    x->tr.sender_pid = getpid();
+    x->tr.sender_euid = geteuid();
+    x->tr.data_size = b->dataSize;
+    x->tr.offsets_size = b->offsetsCount * sizeof(size_t);
+    x->tr.data.ptr.buffer = b->data;
+    x->tr.data.ptr.offsets = b->offsets;
+
+    postLocked(t, BR_TRANSACTION_COMPLETE, 0, NULL);
+    if (reply) {
+        postLocked(target, BR_REPLY, 0, x);
+    } else if (oneway) {
+        // one-way calls to a node are handled one at a time, in order
+        if (c->asyncBusy) {
+            c->asyncTodo.push_back(x);
+        } else {
+            c->asyncBusy = true;
+            postLocked(c, BR_TRANSACTION, 0, x);
+        }
+    } else {
+        t->stack.add(x);
+        if (target) {
+            postLocked(target, BR_TRANSACTION, 0, x);
+        } else {
+            postLocked(c, BR_TRANSACTION, 0, x);
+        }
+    }
+}
+
+void LoopbackBinderDriver::failTransactionLocked(Connection* c, Transaction* x)
+{
+    if (x->from) {
+        removeFromStack(x->from->stack, x);
+        postLocked(x->from, BR_DEAD_REPLY, 0, NULL);
+    }
+    releaseBufferLocked(c, x->buffer, true);
+    delete x;
+}
+
+void LoopbackBinderDriver::updateRefsLocked(Connection* c, uint32_t cmd, int32_t handle)
+{
+    if (handle != 0 || !c->hasContextManager) {
+        ALOGE("reference count change on invalid handle %d", handle);
+        return;
+    }
+    switch (cmd) {
+        case BC_INCREFS:
+            c->weakRefs++;
+            break;
+        case BC_ACQUIRE:
+            c->strongRefs++;
+            break;
+        case BC_RELEASE:
+            if (c->strongRefs == 0) {
+                ALOGE("BC_RELEASE on handle %d with no strong reference", handle);
+            } else {
+                c->strongRefs--;
+            }
+            break;
+        case BC_DECREFS:
+            if (c->weakRefs == 0) {
+                ALOGE("BC_DECREFS on handle %d with no weak reference", handle);
+            } else {
+                c->weakRefs--;
+            }
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+LoopbackBinderDriver::Buffer* LoopbackBinderDriver::copyBufferLocked(Connection* c,
+        const binder_transaction_data& tr, bool async)
+{
+    if (tr.offsets_size % sizeof(size_t)) {
+        ALOGE("transaction with invalid offsets size %zu", size_t(tr.offsets_size));
+        return NULL;
+    }
+
+    // like the kernel, keep the data and the offsets in one block
+    const size_t dataSize = tr.data_size;
+    const size_t alignedSize = (dataSize + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    Buffer* b = new Buffer();
+    b->data = static_cast<uint8_t*>(malloc(alignedSize + tr.offsets_size + sizeof(size_t)));
+    if (b->data == NULL) {
+        delete b;
+        return NULL;
+    }
+    b->dataSize = dataSize;
+    b->offsets = reinterpret_cast<size_t*>(b->data + alignedSize);
+    b->offsetsCount = tr.offsets_size / sizeof(size_t);
+    b->async = async;
+    if (dataSize) {
+        memcpy(b->data, tr.data.ptr.buffer, dataSize);
+    }
+    if (tr.offsets_size) {
+        memcpy(b->offsets, tr.data.ptr.offsets, tr.offsets_size);
+    }
+
+    // Take references on the objects for as long as the buffer lives,
+    // as the sender may drop its own as soon as the call is sent.
+    for (size_t i=0 ; i<b->offsetsCount ; i++) {
+        const size_t offset = b->offsets[i];
+        bool valid = offset <= dataSize && dataSize - offset >= sizeof(flat_binder_object)
+                && (offset % sizeof(uint32_t)) == 0;
+        if (valid) {
+            flat_binder_object* obj =
+                    reinterpret_cast<flat_binder_object*>(b->data + offset);
+            switch (obj->type) {
+                case BINDER_TYPE_BINDER:
+                    if (obj->binder) {
+                        static_cast<IBinder*>(obj->cookie)->incStrong(b);
+                    }
+                    break;
+                case BINDER_TYPE_WEAK_BINDER:
+                    if (obj->binder) {
+                        static_cast<RefBase::weakref_type*>(obj->binder)->incWeak(b);
+                    }
+                    break;
+                case BINDER_TYPE_HANDLE:
+                case BINDER_TYPE_WEAK_HANDLE:
+                    valid = obj->handle == 0 && c->hasContextManager;
+                    break;
+                case BINDER_TYPE_FD:
+                    obj->handle = dup(obj->handle);
+                    valid = obj->handle >= 0;
+                    break;
+                default:
+                    valid = false;
+                    break;
+            }
+        }
+        if (!valid) {
+            ALOGE("transaction with invalid object at offset %zu", offset);
+            b->offsetsCount = i;
+            releaseBufferLocked(NULL, b, true);
+            return NULL;
+        }
+    }
+
+    c->buffers.add(uintptr_t(b->data), b);
+    return b;
+}
+
+void LoopbackBinderDriver::releaseBufferLocked(Connection* c, Buffer* b, bool closeFds)
+{
+    for (size_t i=0 ; i<b->offsetsCount ; i++) {
+        const flat_binder_object* obj =
+                reinterpret_cast<const flat_binder_object*>(b->data + b->offsets[i]);
+        switch (obj->type) {
+            case BINDER_TYPE_BINDER:
+            case BINDER_TYPE_WEAK_BINDER:
+                if (obj->binder) {
+                    ObjectRef ref;
+                    ref.type = obj->type;
+                    ref.object = (obj->type == BINDER_TYPE_BINDER) ? obj->cookie : obj->binder;
+                    ref.id = b;
+                    mReleasedObjects.add(ref);
+                }
+                break;
+            case BINDER_TYPE_FD:
+                if (closeFds) {
+                    ::close(obj->handle);
+                }
+                break;
+        }
+    }
+    if (c) {
+        c->buffers.removeItem(uintptr_t(b->data));
+    }
+    free(b->data);
+    delete b;
+}
+
+Vector<LoopbackBinderDriver::ObjectRef> LoopbackBinderDriver::takeReleasedObjectsLocked()
+{
+    Vector<ObjectRef> objects(mReleasedObjects);
+    mReleasedObjects.clear();
+    return objects;
+}
+
+void LoopbackBinderDriver::dropObjects(const Vector<ObjectRef>& objects)
+{
+    for (size_t i=0 ; i<objects.size() ; i++) {
+        const ObjectRef& ref(objects[i]);
+        if (ref.type == BINDER_TYPE_BINDER) {
+            static_cast<IBinder*>(ref.object)->decStrong(ref.id);
+        } else {
+            static_cast<RefBase::weakref_type*>(ref.object)->decWeak(ref.id);
+        }
+    }
+}
+
+void LoopbackBinderDriver::freeBufferLocked(Connection* c, uintptr_t data)
+{
+    ssize_t index = c->buffers.indexOfKey(data);
+    if (index < 0) {
+        ALOGE("BC_FREE_BUFFER with unknown buffer 0x%08lx", (unsigned long)data);
+        return;
+    }
+    Buffer* b = c->buffers.valueAt(index);
+    if (b->async) {
+        // the node is ready for its next one-way call
+        if (c->asyncTodo.empty()) {
+            c->asyncBusy = false;
+        } else {
+            postLocked(c, BR_TRANSACTION, 0, *c->asyncTodo.begin());
+            c->asyncTodo.erase(c->asyncTodo.begin());
+        }
+    }
+    // the receiver's Parcel owns the file descriptors
+    releaseBufferLocked(c, b, false);
+}
+
+void LoopbackBinderDriver::postLocked(Thread* t, uint32_t cmd, uintptr_t arg,
+        Transaction* x)
+{
+    Work w;
+    w.cmd = cmd;
+    w.arg = arg;
+    w.transaction = x;
+    t->todo.push_back(w);
+    t->cond.signal();
+}
+
+void LoopbackBinderDriver::postLocked(Connection* c, uint32_t cmd, uintptr_t arg,
+        Transaction* x)
+{
+    Work w;
+    w.cmd = cmd;
+    w.arg = arg;
+    w.transaction = x;
+    c->todo.push_back(w);
+    if (!c->idle.isEmpty()) {
+        // wake a single thread, and make sure the next post wakes another
+        Thread* idle = c->idle[0];
+        c->idle.removeAt(0);
+        idle->cond.signal();
+    }
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
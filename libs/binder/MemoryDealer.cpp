@@ -120,13 +120,21 @@ private:
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Keeps the chunks of the heap in a list sorted by address, so that a freed
+ * chunk is merged with its neighbors in constant time. The free chunks are
+ * also kept in lists by size class (chunks of [2^n, 2^(n+1)) units go in
+ * bin n) and the allocated ones in a hash table by start, so that neither
+ * the SEGREGATED_FIT allocations nor the deallocations walk the chunk list.
+ */
 class SimpleBestFitAllocator
 {
     enum {
         PAGE_ALIGNED = 0x00000001
     };
 public:
-    SimpleBestFitAllocator(size_t size);
+    SimpleBestFitAllocator(size_t size,
+            MemoryDealer::Policy policy = MemoryDealer::BEST_FIT);
     ~SimpleBestFitAllocator();
 
     size_t      allocate(size_t size, uint32_t flags = 0);
@@ -139,24 +147,59 @@ private:
 
     struct chunk_t {
         chunk_t(size_t start, size_t size)
-        : start(start), size(size), free(1), prev(0), next(0) {
+        : start(start), size(size), free(1), prev(0), next(0),
+          freePrev(0), freeNext(0) {
         }
         size_t              start;
         size_t              size : 28;
         int                 free : 4;
         mutable chunk_t*    prev;
         mutable chunk_t*    next;
+        // links in the bin, for free chunks
+        chunk_t*            freePrev;
+        chunk_t*            freeNext;
     };
 
     ssize_t  alloc(size_t size, uint32_t flags);
+    chunk_t* findBestFit(size_t size, uint32_t flags);
+    chunk_t* findSegregatedFit(size_t size);
+    void     use(chunk_t* chunk, size_t size, uint32_t flags);
     chunk_t* dealloc(size_t start);
     void     dump_l(const char* what) const;
     void     dump_l(String8& res, const char* what) const;
 
+    static size_t binFor(size_t size);
+    void     binInsert(chunk_t* chunk);
+    void     binRemove(chunk_t* chunk);
+
+    size_t   hash(size_t start) const;
+    void     tableInsert(chunk_t* chunk);
+    chunk_t* tableRemove(size_t start);
+
     static const int    kMemoryAlign;
+    static const size_t kNumBins = 32;
+    // chunks looked at in the first bin that may fit, before falling back
+    // to a larger bin, where any chunk fits
+    static const size_t kMaxBinScan = 8;
+
     mutable Mutex       mLock;
+    const MemoryDealer::Policy mPolicy;
     LinkedList<chunk_t> mList;
     size_t              mHeapSize;
+
+    chunk_t*            mBins[kNumBins];
+    uint32_t            mBinMap;        // bit n is set when bin n isn't empty
+    chunk_t**           mTable;         // allocated chunks, linear probing
+    size_t              mTableBits;
+    size_t              mTableCount;
+
+    // statistics, sizes are in units of kMemoryAlign
+    size_t              mAllocated;
+    size_t              mAllocations;
+    size_t              mPeakAllocated;
+    size_t              mPeakAllocations;
+    size_t              mFreeChunks;
+    uint32_t            mFailures;
 };
 
 // ----------------------------------------------------------------------------
@@ -225,9 +268,9 @@ Allocation::~Allocation()
 
 // ----------------------------------------------------------------------------
 
-MemoryDealer::MemoryDealer(size_t size, const char* name)
+MemoryDealer::MemoryDealer(size_t size, const char* name, Policy policy)
     : mHeap(new MemoryHeapBase(size, 0, name)),
-    mAllocator(new SimpleBestFitAllocator(size))
+    mAllocator(new SimpleBestFitAllocator(size, policy))
 {    
 }
 
@@ -256,6 +299,11 @@ void MemoryDealer::dump(const char* what) const
     allocator()->dump(what);
 }
 
+void MemoryDealer::dump(String8& result, const char* what) const
+{
+    allocator()->dump(result, what);
+}
+
 const sp<IMemoryHeap>& MemoryDealer::heap() const {
     return mHeap;
 }
@@ -269,13 +317,22 @@ SimpleBestFitAllocator* MemoryDealer::allocator() const {
 // align all the memory blocks on a cache-line boundary
 const int SimpleBestFitAllocator::kMemoryAlign = 32;
 
-SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size)
+SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size,
+        MemoryDealer::Policy policy)
+    : mPolicy(policy), mBinMap(0), mTableBits(4), mTableCount(0),
+      mAllocated(0), mAllocations(0), mPeakAllocated(0), mPeakAllocations(0),
+      mFreeChunks(0), mFailures(0)
 {
     size_t pagesize = getpagesize();
     mHeapSize = ((size + pagesize-1) & ~(pagesize-1));
 
+    memset(mBins, 0, sizeof(mBins));
+    mTable = new chunk_t*[1 << mTableBits];
+    memset(mTable, 0, sizeof(chunk_t*) << mTableBits);
+
     chunk_t* node = new chunk_t(0, mHeapSize / kMemoryAlign);
     mList.insertHead(node);
+    binInsert(node);
 }
 
 SimpleBestFitAllocator::~SimpleBestFitAllocator()
@@ -283,6 +340,7 @@ SimpleBestFitAllocator::~SimpleBestFitAllocator()
     while(!mList.isEmpty()) {
         delete mList.remove(mList.head());
     }
+    delete [] mTable;
 }
 
 size_t SimpleBestFitAllocator::size() const
@@ -313,6 +371,25 @@ ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
         return 0;
     }
     size = (size + kMemoryAlign-1) / kMemoryAlign;
+
+    chunk_t* free_chunk;
+    if (mPolicy == MemoryDealer::SEGREGATED_FIT && !(flags & PAGE_ALIGNED)) {
+        free_chunk = findSegregatedFit(size);
+    } else {
+        free_chunk = findBestFit(size, flags);
+    }
+
+    if (free_chunk) {
+        use(free_chunk, size, flags);
+        return (free_chunk->start)*kMemoryAlign;
+    }
+    mFailures++;
+    return NO_MEMORY;
+}
+
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findBestFit(
+        size_t size, uint32_t flags)
+{
     chunk_t* free_chunk = 0;
     chunk_t* cur = mList.head();
 
@@ -333,76 +410,215 @@ ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
         }
         cur = cur->next;
     }
+    return free_chunk;
+}
 
-    if (free_chunk) {
-        const size_t free_size = free_chunk->size;
-        free_chunk->free = 0;
-        free_chunk->size = size;
-        if (free_size > size) {
-            int extra = 0;
-            if (flags & PAGE_ALIGNED)
-                extra = ( -free_chunk->start & ((pagesize/kMemoryAlign)-1) ) ;
-            if (extra) {
-                chunk_t* split = new chunk_t(free_chunk->start, extra);
-                free_chunk->start += extra;
-                mList.insertBefore(free_chunk, split);
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findSegregatedFit(
+        size_t size)
+{
+    // the chunks of the size's own bin may be too small, look at a few
+    // of them for the best fit...
+    const size_t bin = binFor(size);
+    chunk_t* free_chunk = 0;
+    chunk_t* cur = mBins[bin];
+    for (size_t i = 0; cur && i < kMaxBinScan; i++, cur = cur->freeNext) {
+        if (cur->size >= size) {
+            if ((!free_chunk) || (cur->size < free_chunk->size)) {
+                free_chunk = cur;
+            }
+            if (cur->size == size) {
+                break;
             }
+        }
+    }
+    if (free_chunk) {
+        return free_chunk;
+    }
 
-            ALOGE_IF((flags&PAGE_ALIGNED) && 
-                    ((free_chunk->start*kMemoryAlign)&(pagesize-1)),
-                    "PAGE_ALIGNED requested, but page is not aligned!!!");
+    // ...then any chunk of the next bin that isn't empty will do...
+    const uint32_t larger = mBinMap & ~((2u << bin) - 1);
+    if (larger) {
+        return mBins[__builtin_ctz(larger)];
+    }
 
-            const ssize_t tail_free = free_size - (size+extra);
-            if (tail_free > 0) {
-                chunk_t* split = new chunk_t(
-                        free_chunk->start + free_chunk->size, tail_free);
-                mList.insertAfter(free_chunk, split);
-            }
+    // ...and only when there's none, go through the rest of the bin.
+    for (; cur; cur = cur->freeNext) {
+        if (cur->size >= size) {
+            return cur;
         }
-        return (free_chunk->start)*kMemoryAlign;
     }
-    return NO_MEMORY;
+    return 0;
+}
+
+void SimpleBestFitAllocator::use(chunk_t* free_chunk, size_t size,
+        uint32_t flags)
+{
+    size_t pagesize = getpagesize();
+    const size_t free_size = free_chunk->size;
+    binRemove(free_chunk);
+    free_chunk->free = 0;
+    free_chunk->size = size;
+    if (free_size > size) {
+        int extra = 0;
+        if (flags & PAGE_ALIGNED)
+            extra = ( -free_chunk->start & ((pagesize/kMemoryAlign)-1) ) ;
+        if (extra) {
+            chunk_t* split = new chunk_t(free_chunk->start, extra);
+            free_chunk->start += extra;
+            mList.insertBefore(free_chunk, split);
+            binInsert(split);
+        }
+
+        ALOGE_IF((flags&PAGE_ALIGNED) && 
+                ((free_chunk->start*kMemoryAlign)&(pagesize-1)),
+                "PAGE_ALIGNED requested, but page is not aligned!!!");
+
+        const ssize_t tail_free = free_size - (size+extra);
+        if (tail_free > 0) {
+            chunk_t* split = new chunk_t(
+                    free_chunk->start + free_chunk->size, tail_free);
+            mList.insertAfter(free_chunk, split);
+            binInsert(split);
+        }
+    }
+    tableInsert(free_chunk);
+
+    mAllocated += size;
+    mAllocations++;
+    if (mPeakAllocated < mAllocated)
+        mPeakAllocated = mAllocated;
+    if (mPeakAllocations < mAllocations)
+        mPeakAllocations = mAllocations;
 }
 
 SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::dealloc(size_t start)
 {
     start = start / kMemoryAlign;
-    chunk_t* cur = mList.head();
-    while (cur) {
-        if (cur->start == start) {
-            LOG_FATAL_IF(cur->free,
-                "block at offset 0x%08lX of size 0x%08lX already freed",
-                cur->start*kMemoryAlign, cur->size*kMemoryAlign);
-
-            // merge freed blocks together
-            chunk_t* freed = cur;
-            cur->free = 1;
-            do {
-                chunk_t* const p = cur->prev;
-                chunk_t* const n = cur->next;
-                if (p && (p->free || !cur->size)) {
-                    freed = p;
-                    p->size += cur->size;
-                    mList.remove(cur);
-                    delete cur;
-                }
-                cur = n;
-            } while (cur && cur->free);
-
-            #ifndef NDEBUG
-                if (!freed->free) {
-                    dump_l("dealloc (!freed->free)");
-                }
-            #endif
-            LOG_FATAL_IF(!freed->free,
-                "freed block at offset 0x%08lX of size 0x%08lX is not free!",
-                freed->start * kMemoryAlign, freed->size * kMemoryAlign);
-
-            return freed;
+    chunk_t* cur = tableRemove(start);
+    if (cur == 0) {
+        #ifndef NDEBUG
+            // not an allocated block, tell a double free from a bad offset
+            for (cur = mList.head(); cur && cur->start <= start; cur = cur->next) {
+                LOG_FATAL_IF(cur->start == start && cur->free,
+                    "block at offset 0x%08lX of size 0x%08lX already freed",
+                    cur->start*kMemoryAlign, cur->size*kMemoryAlign);
+            }
+        #endif
+        return 0;
+    }
+    mAllocated -= cur->size;
+    mAllocations--;
+
+    // merge freed blocks together
+    chunk_t* freed = cur;
+    cur->free = 1;
+    chunk_t* const p = cur->prev;
+    if (p && p->free) {
+        binRemove(p);
+        p->size += cur->size;
+        mList.remove(cur);
+        delete cur;
+        freed = p;
+    }
+    chunk_t* const n = freed->next;
+    if (n && n->free) {
+        binRemove(n);
+        freed->size += n->size;
+        mList.remove(n);
+        delete n;
+    }
+    binInsert(freed);
+    return freed;
+}
+
+size_t SimpleBestFitAllocator::binFor(size_t size)
+{
+    const size_t bin = 31 - __builtin_clz(uint32_t(size));
+    return bin < kNumBins ? bin : kNumBins-1;
+}
+
+void SimpleBestFitAllocator::binInsert(chunk_t* chunk)
+{
+    const size_t bin = binFor(chunk->size);
+    chunk->freePrev = 0;
+    chunk->freeNext = mBins[bin];
+    if (mBins[bin])
+        mBins[bin]->freePrev = chunk;
+    mBins[bin] = chunk;
+    mBinMap |= 1u << bin;
+    mFreeChunks++;
+}
+
+void SimpleBestFitAllocator::binRemove(chunk_t* chunk)
+{
+    const size_t bin = binFor(chunk->size);
+    if (chunk->freePrev)
+        chunk->freePrev->freeNext = chunk->freeNext;
+    else
+        mBins[bin] = chunk->freeNext;
+    if (chunk->freeNext)
+        chunk->freeNext->freePrev = chunk->freePrev;
+    if (mBins[bin] == 0)
+        mBinMap &= ~(1u << bin);
+    chunk->freePrev = chunk->freeNext = 0;
+    mFreeChunks--;
+}
+
+size_t SimpleBestFitAllocator::hash(size_t start) const
+{
+    return (uint32_t(start) * 0x9E3779B1u) >> (32 - mTableBits);
+}
+
+void SimpleBestFitAllocator::tableInsert(chunk_t* chunk)
+{
+    if ((mTableCount + 1) * 2 > (size_t(1) << mTableBits)) {
+        // keep the table at most half full
+        chunk_t** const old = mTable;
+        const size_t oldSize = size_t(1) << mTableBits;
+        mTableBits++;
+        mTable = new chunk_t*[1 << mTableBits];
+        memset(mTable, 0, sizeof(chunk_t*) << mTableBits);
+        mTableCount = 0;
+        for (size_t i = 0; i < oldSize; i++) {
+            if (old[i])
+                tableInsert(old[i]);
         }
-        cur = cur->next;
+        delete [] old;
     }
-    return 0;
+    const size_t mask = (size_t(1) << mTableBits) - 1;
+    size_t i = hash(chunk->start);
+    while (mTable[i]) {
+        i = (i + 1) & mask;
+    }
+    mTable[i] = chunk;
+    mTableCount++;
+}
+
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::tableRemove(
+        size_t start)
+{
+    const size_t mask = (size_t(1) << mTableBits) - 1;
+    size_t i = hash(start);
+    while (mTable[i] && mTable[i]->start != start) {
+        i = (i + 1) & mask;
+    }
+    chunk_t* const chunk = mTable[i];
+    if (chunk == 0) {
+        return 0;
+    }
+
+    // shift back the entries that come after it in the same probe sequence
+    for (size_t j = (i + 1) & mask; mTable[j]; j = (j + 1) & mask) {
+        const size_t k = hash(mTable[j]->start);
+        const bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            mTable[i] = mTable[j];
+            i = j;
+        }
+    }
+    mTable[i] = 0;
+    mTableCount--;
+    return chunk;
 }
 
 void SimpleBestFitAllocator::dump(const char* what) const
@@ -428,14 +644,15 @@ void SimpleBestFitAllocator::dump(String8& result,
 void SimpleBestFitAllocator::dump_l(String8& result,
         const char* what) const
 {
-    size_t size = 0;
     int32_t i = 0;
     chunk_t const* cur = mList.head();
     
     const size_t SIZE = 256;
     char buffer[SIZE];
-    snprintf(buffer, SIZE, "  %s (%p, size=%u)\n",
-            what, this, (unsigned int)mHeapSize);
+    snprintf(buffer, SIZE, "  %s (%p, size=%u, %s)\n",
+            what, this, (unsigned int)mHeapSize,
+            mPolicy == MemoryDealer::SEGREGATED_FIT ?
+                    "segregated fit" : "best fit");
     
     result.append(buffer);
             
@@ -453,15 +670,41 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         
         result.append(buffer);
 
-        if (!cur->free)
-            size += cur->size*kMemoryAlign;
-
         i++;
         cur = cur->next;
     }
+
+    // the largest free chunk is in the last bin that isn't empty
+    size_t largest = 0;
+    if (mBinMap) {
+        cur = mBins[31 - __builtin_clz(mBinMap)];
+        for (; cur; cur = cur->freeNext) {
+            if (largest < cur->size)
+                largest = cur->size;
+        }
+    }
+    const size_t size = mAllocated*kMemoryAlign;
+    const size_t peak = mPeakAllocated*kMemoryAlign;
+    const size_t free = mHeapSize - size;
+    largest *= kMemoryAlign;
+    // how much of the free memory can't be used for one allocation
+    const int fragmentation = free ? int(100 - (largest*100) / free) : 0;
+
     snprintf(buffer, SIZE,
             "  size allocated: %u (%u KB)\n", int(size), int(size/1024));
     result.append(buffer);
+    snprintf(buffer, SIZE,
+            "  allocations: %u (peak %u), high-water mark: %u (%u KB), "
+            "failed: %u\n",
+            int(mAllocations), int(mPeakAllocations),
+            int(peak), int(peak/1024), mFailures);
+    result.append(buffer);
+    snprintf(buffer, SIZE,
+            "  free: %u (%u KB) in %u blocks, largest: %u (%u KB), "
+            "fragmentation: %d%%\n",
+            int(free), int(free/1024), int(mFreeChunks),
+            int(largest), int(largest/1024), fragmentation);
+    result.append(buffer);
 }
 
 
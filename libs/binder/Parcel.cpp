@@ -30,11 +30,13 @@
 #include <utils/String8.h>
 #include <utils/String16.h>
 #include <utils/misc.h>
+#include <utils/threads.h>
 #include <utils/Flattenable.h>
 #include <cutils/ashmem.h>
 
 #include <private/binder/binder_module.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -60,6 +62,22 @@
 // Maximum size of a blob to transfer in-place.
 static const size_t IN_PLACE_BLOB_LIMIT = 40 * 1024;
 
+// How a blob is stored, written before it.
+enum {
+    BLOB_INPLACE = 0,
+    BLOB_ASHMEM = 1,
+    // in a region of the sender's blob pool, followed by the binder that
+    // keeps the region out of the pool
+    BLOB_ASHMEM_POOLED = 2,
+};
+
+// The pooled regions are a power of two in size, from the smallest that
+// holds a blob that isn't written in place.
+static const size_t MIN_POOLED_BLOB_REGION = 64 * 1024;
+static const size_t MAX_POOLED_BLOB_REGION = 4 * 1024 * 1024;
+// Size of the regions the pool keeps mapped while nobody uses them.
+static const size_t MAX_IDLE_BLOB_POOL = 8 * 1024 * 1024;
+
 // XXX This can be made public if we want to provide
 // support for typed data.
 struct small_flat_data
@@ -284,6 +302,101 @@ status_t unflatten_binder(const sp<ProcessState>& proc,
 
 // ---------------------------------------------------------------------------
 
+// Per-thread cache of the heap buffers released by Parcels. Most parcels
+// are short-lived (the data and reply of a transaction are built and torn
+// down on the same thread) and have similar sizes, so recycling their
+// buffers saves a malloc/free pair per parcel, without any locking.
+
+// buffers are allocated in multiples of this, so that they can be reused
+// for slightly different sizes.
+static const size_t kBufferGranularity = 64;
+// bigger buffers are never cached.
+static const size_t kMaxCachedBufferSize = 4096;
+
+struct BufferCache {
+    enum { MAX_BUFFERS = 8 };
+    size_t count;
+    void* buffers[MAX_BUFFERS];
+    size_t sizes[MAX_BUFFERS];
+};
+
+static pthread_once_t gBufferCacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gBufferCacheKey;
+
+static void destroyBufferCache(void* p)
+{
+    BufferCache* cache = static_cast<BufferCache*>(p);
+    for (size_t i=0 ; i<cache->count ; i++) {
+        free(cache->buffers[i]);
+    }
+    free(cache);
+}
+
+static void createBufferCacheKey()
+{
+    pthread_key_create(&gBufferCacheKey, destroyBufferCache);
+}
+
+static BufferCache* getBufferCache()
+{
+    pthread_once(&gBufferCacheOnce, createBufferCacheKey);
+    BufferCache* cache = static_cast<BufferCache*>(
+            pthread_getspecific(gBufferCacheKey));
+    if (cache == NULL) {
+        cache = static_cast<BufferCache*>(calloc(1, sizeof(BufferCache)));
+        if (cache != NULL && pthread_setspecific(gBufferCacheKey, cache) != 0) {
+            free(cache);
+            cache = NULL;
+        }
+    }
+    return cache;
+}
+
+static void* allocCachedBuffer(size_t size, size_t* outSize)
+{
+    if (size <= kMaxCachedBufferSize) {
+        size = (size + kBufferGranularity - 1) & ~(kBufferGranularity - 1);
+        BufferCache* cache = getBufferCache();
+        if (cache != NULL) {
+            // best fit
+            ssize_t best = -1;
+            for (size_t i=0 ; i<cache->count ; i++) {
+                if (cache->sizes[i] >= size &&
+                        (best < 0 || cache->sizes[i] < cache->sizes[best])) {
+                    best = i;
+                }
+            }
+            if (best >= 0) {
+                void* buffer = cache->buffers[best];
+                *outSize = cache->sizes[best];
+                cache->count--;
+                cache->buffers[best] = cache->buffers[cache->count];
+                cache->sizes[best] = cache->sizes[cache->count];
+                return buffer;
+            }
+        }
+    }
+    void* buffer = malloc(size);
+    *outSize = buffer ? size : 0;
+    return buffer;
+}
+
+static void freeCachedBuffer(void* buffer, size_t size)
+{
+    if (size <= kMaxCachedBufferSize) {
+        BufferCache* cache = getBufferCache();
+        if (cache != NULL && cache->count < BufferCache::MAX_BUFFERS) {
+            cache->buffers[cache->count] = buffer;
+            cache->sizes[cache->count] = size;
+            cache->count++;
+            return;
+        }
+    }
+    free(buffer);
+}
+
+// ---------------------------------------------------------------------------
+
 Parcel::Parcel()
 {
     initState();
@@ -410,14 +523,10 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
     if (numObjects > 0) {
         // grow objects
         if (mObjectsCapacity < mObjectsSize + numObjects) {
-            int newSize = ((mObjectsSize + numObjects)*3)/2;
-            size_t *objects =
-                (size_t*)realloc(mObjects, newSize*sizeof(size_t));
-            if (objects == (size_t*)0) {
-                return NO_MEMORY;
+            err = growObjects(((mObjectsSize + numObjects)*3)/2);
+            if (err != NO_ERROR) {
+                return err;
             }
-            mObjects = objects;
-            mObjectsCapacity = newSize;
         }
         
         // append and acquire objects
@@ -766,7 +875,7 @@ status_t Parcel::writeBlob(size_t len, WritableBlob* outBlob)
 
     if (!mAllowFds || len <= IN_PLACE_BLOB_LIMIT) {
         ALOGV("writeBlob: write in place");
-        status = writeInt32(0);
+        status = writeInt32(BLOB_INPLACE);
         if (status) return status;
 
         void* ptr = writeInplace(len);
@@ -792,7 +901,7 @@ status_t Parcel::writeBlob(size_t len, WritableBlob* outBlob)
             if (result < 0) {
                 status = result;
             } else {
-                status = writeInt32(1);
+                status = writeInt32(BLOB_ASHMEM);
                 if (!status) {
                     status = writeFileDescriptor(fd, true /*takeOwnership*/);
                     if (!status) {
@@ -808,6 +917,199 @@ status_t Parcel::writeBlob(size_t len, WritableBlob* outBlob)
     return status;
 }
 
+// --- blob pool ---
+
+/*
+ * The regions of pooled blobs stay mapped read-write in this process between
+ * their uses, so that reusing one costs no syscall and no page fault. They are
+ * sealed read-only before they're ever sent, and since the protection mask of
+ * a region can only be lowered, receivers can never map them writable.
+ *
+ * A region goes out with a BlobRegionToken, which the receivers hold as long
+ * as they map it: it only comes back to the pool once the sender's parcel and
+ * every receiver's blob have released the token, so nobody sees a blob change
+ * while they hold it. It's then only reused for blobs sent to the same target,
+ * which already had the region.
+ */
+struct BlobRegion {
+    int fd;
+    void* data;
+    size_t size;
+    wp<IBinder> target;
+    BlobRegion* next;
+};
+
+class BlobPool {
+public:
+    BlobPool() : mIdle(NULL), mIdleSize(0), mCreated(0), mReused(0) { }
+
+    // Returns an idle region that can hold len bytes and was last sent to
+    // target, or a new one; NULL if len is too large to be pooled.
+    BlobRegion* acquire(size_t len, const sp<IBinder>& target);
+    void release(BlobRegion* region);
+    void getStats(size_t* outCreated, size_t* outReused);
+
+private:
+    static BlobRegion* create(size_t size);
+    static void destroy(BlobRegion* region);
+
+    Mutex mLock;
+    BlobRegion* mIdle;
+    size_t mIdleSize;
+    size_t mCreated;
+    size_t mReused;
+};
+
+static BlobPool& blobPool()
+{
+    static BlobPool pool;
+    return pool;
+}
+
+class BlobRegionToken : public BBinder {
+public:
+    BlobRegionToken(BlobRegion* region) : mRegion(region) { }
+
+protected:
+    virtual ~BlobRegionToken() {
+        blobPool().release(mRegion);
+    }
+
+private:
+    BlobRegion* const mRegion;
+};
+
+BlobRegion* BlobPool::acquire(size_t len, const sp<IBinder>& target)
+{
+    if (len > MAX_POOLED_BLOB_REGION) {
+        return NULL;
+    }
+    size_t size = MIN_POOLED_BLOB_REGION;
+    while (size < len) {
+        size <<= 1;
+    }
+
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        for (BlobRegion** r = &mIdle; *r; r = &(*r)->next) {
+            BlobRegion* region = *r;
+            // the address alone could be the one of a new object
+            if (region->size == size && region->target.unsafe_get() == target.get()
+                    && region->target.promote() != NULL) {
+                *r = region->next;
+                mIdleSize -= size;
+                mReused++;
+                region->next = NULL;
+                return region;
+            }
+        }
+    }
+
+    BlobRegion* region = create(size);
+    if (region) {
+        region->target = target;
+        Mutex::Autolock _l(mLock);
+        mCreated++;
+    }
+    return region;
+}
+
+void BlobPool::release(BlobRegion* region)
+{
+    // a region is of no use once its target is gone
+    const bool targetAlive = region->target.promote() != NULL;
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        if (targetAlive && mIdleSize + region->size <= MAX_IDLE_BLOB_POOL) {
+            region->next = mIdle;
+            mIdle = region;
+            mIdleSize += region->size;
+            return;
+        }
+    }
+    destroy(region);
+}
+
+void BlobPool::getStats(size_t* outCreated, size_t* outReused)
+{
+    Mutex::Autolock _l(mLock);
+    *outCreated = mCreated;
+    *outReused = mReused;
+}
+
+BlobRegion* BlobPool::create(size_t size)
+{
+    int fd = ashmem_create_region("Parcel Blob", size);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ashmem_set_prot_region(fd, PROT_READ | PROT_WRITE) < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    // MAP_POPULATE faults the region in once, rather than on every use
+    void* ptr = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+        ::close(fd);
+        return NULL;
+    }
+    if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+        ::munmap(ptr, size);
+        ::close(fd);
+        return NULL;
+    }
+    BlobRegion* region = new BlobRegion;
+    region->fd = fd;
+    region->data = ptr;
+    region->size = size;
+    region->next = NULL;
+    return region;
+}
+
+void BlobPool::destroy(BlobRegion* region)
+{
+    ::munmap(region->data, region->size);
+    ::close(region->fd);
+    delete region;
+}
+
+status_t Parcel::writePooledBlob(size_t len, const sp<IBinder>& target,
+        WritableBlob* outBlob)
+{
+    if (!mAllowFds || len <= IN_PLACE_BLOB_LIMIT || target == NULL) {
+        return writeBlob(len, outBlob);
+    }
+
+    BlobRegion* region = blobPool().acquire(len, target);
+    if (!region) {
+        return writeBlob(len, outBlob);
+    }
+    // from now on the region goes back to the pool with its token
+    sp<IBinder> token = new BlobRegionToken(region);
+
+    ALOGV("writePooledBlob: write to pooled ashmem");
+    status_t status = writeInt32(BLOB_ASHMEM_POOLED);
+    if (!status) {
+        // the token keeps the region, and its fd, for as long as this parcel
+        status = writeFileDescriptor(region->fd, false /*takeOwnership*/);
+    }
+    if (!status) {
+        status = writeStrongBinder(token);
+    }
+    if (status) {
+        return status;
+    }
+    // the mapping belongs to the pool, releasing the blob must not unmap it
+    outBlob->init(false /*mapped*/, region->data, len);
+    return NO_ERROR;
+}
+
+void Parcel::getBlobPoolStats(size_t* outCreated, size_t* outReused)
+{
+    blobPool().getStats(outCreated, outReused);
+}
+
 status_t Parcel::write(const FlattenableHelperInterface& val)
 {
     status_t err;
@@ -875,11 +1177,8 @@ restart_write:
         if (err != NO_ERROR) return err;
     }
     if (!enoughObjects) {
-        size_t newSize = ((mObjectsSize+2)*3)/2;
-        size_t* objects = (size_t*)realloc(mObjects, newSize*sizeof(size_t));
-        if (objects == NULL) return NO_MEMORY;
-        mObjects = objects;
-        mObjectsCapacity = newSize;
+        const status_t err = growObjects(((mObjectsSize+2)*3)/2);
+        if (err != NO_ERROR) return err;
     }
     
     goto restart_write;
@@ -956,6 +1255,65 @@ restart_write:
     return err;
 }
 
+template<class T>
+status_t Parcel::readAlignedValues(T* values, size_t count) const {
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(PAD_SIZE(sizeof(T)) == sizeof(T));
+
+    const size_t len = count * sizeof(T);
+    if (len / sizeof(T) != count) {
+        // integer overflow
+        return BAD_VALUE;
+    }
+    const void* data = readInplace(len);
+    if (data == NULL) {
+        return NOT_ENOUGH_DATA;
+    }
+    memcpy(values, data, len);
+    return NO_ERROR;
+}
+
+template<class T>
+status_t Parcel::writeAlignedValues(const T* values, size_t count) {
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(PAD_SIZE(sizeof(T)) == sizeof(T));
+
+    const size_t len = count * sizeof(T);
+    if (len / sizeof(T) != count) {
+        // integer overflow
+        return BAD_VALUE;
+    }
+    return write(values, len);
+}
+
+status_t Parcel::readInt32Values(int32_t* values, size_t count) const
+{
+    return readAlignedValues(values, count);
+}
+
+status_t Parcel::readInt64Values(int64_t* values, size_t count) const
+{
+    return readAlignedValues(values, count);
+}
+
+status_t Parcel::readFloatValues(float* values, size_t count) const
+{
+    return readAlignedValues(values, count);
+}
+
+status_t Parcel::writeInt32Values(const int32_t* values, size_t count)
+{
+    return writeAlignedValues(values, count);
+}
+
+status_t Parcel::writeInt64Values(const int64_t* values, size_t count)
+{
+    return writeAlignedValues(values, count);
+}
+
+status_t Parcel::writeFloatValues(const float* values, size_t count)
+{
+    return writeAlignedValues(values, count);
+}
+
 status_t Parcel::readInt32(int32_t *pArg) const
 {
     return readAligned(pArg);
@@ -1160,11 +1518,11 @@ int Parcel::readFileDescriptor() const
 
 status_t Parcel::readBlob(size_t len, ReadableBlob* outBlob) const
 {
-    int32_t useAshmem;
-    status_t status = readInt32(&useAshmem);
+    int32_t blobType;
+    status_t status = readInt32(&blobType);
     if (status) return status;
 
-    if (!useAshmem) {
+    if (blobType == BLOB_INPLACE) {
         ALOGV("readBlob: read in place");
         const void* ptr = readInplace(len);
         if (!ptr) return BAD_VALUE;
@@ -1177,10 +1535,17 @@ status_t Parcel::readBlob(size_t len, ReadableBlob* outBlob) const
     int fd = readFileDescriptor();
     if (fd == int(BAD_TYPE)) return BAD_VALUE;
 
+    sp<IBinder> token;
+    if (blobType == BLOB_ASHMEM_POOLED) {
+        token = readStrongBinder();
+        if (token == NULL) return BAD_VALUE;
+    }
+
     void* ptr = ::mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
-    if (!ptr) return NO_MEMORY;
+    if (ptr == MAP_FAILED) return NO_MEMORY;
 
     outBlob->init(true /*mapped*/, ptr, len);
+    outBlob->mToken = token;
     return NO_ERROR;
 }
 
@@ -1399,8 +1764,8 @@ void Parcel::freeDataNoInit()
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
     } else {
         releaseObjects();
-        if (mData) free(mData);
-        if (mObjects) free(mObjects);
+        freeBuffer(mData, mDataCapacity);
+        freeBuffer(mObjects, mObjectsCapacity*sizeof(size_t));
     }
 }
 
@@ -1419,26 +1784,27 @@ status_t Parcel::restartWrite(size_t desired)
         return continueWrite(desired);
     }
     
-    uint8_t* data = (uint8_t*)realloc(mData, desired);
-    if (!data && desired > mDataCapacity) {
-        mError = NO_MEMORY;
-        return NO_MEMORY;
+    if (desired > mDataCapacity) {
+        // the content is still needed by releaseObjects() below
+        size_t capacity;
+        uint8_t* data = (uint8_t*)growBuffer(mInlineData, sizeof(mInlineData),
+                mData, mDataCapacity, mDataSize, desired, &capacity);
+        if (!data) {
+            mError = NO_MEMORY;
+            return NO_MEMORY;
+        }
+        mData = data;
+        mDataCapacity = capacity;
     }
     
     releaseObjects();
     
-    if (data) {
-        mData = data;
-        mDataCapacity = desired;
-    }
-    
     mDataSize = mDataPos = 0;
     ALOGV("restartWrite Setting data size of %p to %d\n", this, mDataSize);
     ALOGV("restartWrite Setting data pos of %p to %d\n", this, mDataPos);
         
-    free(mObjects);
-    mObjects = NULL;
-    mObjectsSize = mObjectsCapacity = 0;
+    // keep the objects array around for the new content
+    mObjectsSize = 0;
     mNextObjectHint = 0;
     mHasFds = false;
     mFdsKnown = true;
@@ -1473,17 +1839,21 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t dataCapacity;
+        uint8_t* data = (uint8_t*)allocBuffer(mInlineData, sizeof(mInlineData),
+                desired, &dataCapacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
         }
         size_t* objects = NULL;
+        size_t objectsCapacity = 0;
         
         if (objectsSize) {
-            objects = (size_t*)malloc(objectsSize*sizeof(size_t));
+            objects = (size_t*)allocBuffer(mInlineObjects, sizeof(mInlineObjects),
+                    objectsSize*sizeof(size_t), &objectsCapacity);
             if (!objects) {
-                free(data);
+                freeBuffer(data, dataCapacity);
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1511,8 +1881,9 @@ status_t Parcel::continueWrite(size_t desired)
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %d\n", this, mDataSize);
-        mDataCapacity = desired;
-        mObjectsSize = mObjectsCapacity = objectsSize;
+        mDataCapacity = dataCapacity;
+        mObjectsSize = objectsSize;
+        mObjectsCapacity = objectsCapacity / sizeof(size_t);
         mNextObjectHint = 0;
 
     } else if (mData) {
@@ -1528,22 +1899,19 @@ status_t Parcel::continueWrite(size_t desired)
                 }
                 release_object(proc, *flat, this);
             }
-            size_t* objects =
-                (size_t*)realloc(mObjects, objectsSize*sizeof(size_t));
-            if (objects) {
-                mObjects = objects;
-            }
             mObjectsSize = objectsSize;
             mNextObjectHint = 0;
         }
 
-        // We own the data, so we can just do a realloc().
+        // We own the data, so we can just grow it.
         if (desired > mDataCapacity) {
-            uint8_t* data = (uint8_t*)realloc(mData, desired);
+            size_t capacity;
+            uint8_t* data = (uint8_t*)growBuffer(mInlineData, sizeof(mInlineData),
+                    mData, mDataCapacity, mDataSize, desired, &capacity);
             if (data) {
                 mData = data;
-                mDataCapacity = desired;
-            } else if (desired > mDataCapacity) {
+                mDataCapacity = capacity;
+            } else {
                 mError = NO_MEMORY;
                 return NO_MEMORY;
             }
@@ -1560,7 +1928,9 @@ status_t Parcel::continueWrite(size_t desired)
         
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = (uint8_t*)allocBuffer(mInlineData, sizeof(mInlineData),
+                desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -1575,12 +1945,63 @@ status_t Parcel::continueWrite(size_t desired)
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %d\n", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %d\n", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
 }
 
+void* Parcel::allocBuffer(void* inlineBuffer, size_t inlineSize,
+        size_t size, size_t* outSize)
+{
+    if (size <= inlineSize && inlineBuffer != mData && inlineBuffer != mObjects) {
+        *outSize = inlineSize;
+        return inlineBuffer;
+    }
+    return allocCachedBuffer(size, outSize);
+}
+
+void* Parcel::growBuffer(void* inlineBuffer, size_t inlineSize,
+        void* buffer, size_t size, size_t used, size_t desired, size_t* outSize)
+{
+    if (buffer && buffer != inlineBuffer && size > kMaxCachedBufferSize) {
+        // large buffers aren't cached, and realloc() may be able to grow
+        // them in place.
+        void* newBuffer = realloc(buffer, desired);
+        *outSize = newBuffer ? desired : size;
+        return newBuffer;
+    }
+    void* newBuffer = allocBuffer(inlineBuffer, inlineSize, desired, outSize);
+    if (newBuffer) {
+        if (used) {
+            memcpy(newBuffer, buffer, used < size ? used : size);
+        }
+        freeBuffer(buffer, size);
+    }
+    return newBuffer;
+}
+
+void Parcel::freeBuffer(void* buffer, size_t size)
+{
+    if (buffer && buffer != mInlineData && buffer != mInlineObjects) {
+        freeCachedBuffer(buffer, size);
+    }
+}
+
+status_t Parcel::growObjects(size_t desired)
+{
+    size_t size;
+    size_t* objects = (size_t*)growBuffer(mInlineObjects, sizeof(mInlineObjects),
+            mObjects, mObjectsCapacity*sizeof(size_t), mObjectsSize*sizeof(size_t),
+            desired*sizeof(size_t), &size);
+    if (objects == NULL) {
+        return NO_MEMORY;
+    }
+    mObjects = objects;
+    mObjectsCapacity = size / sizeof(size_t);
+    return NO_ERROR;
+}
+
 void Parcel::initState()
 {
     mError = NO_ERROR;
@@ -1642,6 +2063,7 @@ void Parcel::Blob::clear() {
     mMapped = false;
     mData = NULL;
     mSize = 0;
+    mToken.clear();
 }
 
 }; // namespace android
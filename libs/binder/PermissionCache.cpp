@@ -17,6 +17,7 @@
 #define LOG_TAG "PermissionCache"
 
 #include <stdint.h>
+#include <string.h>
 #include <utils/Log.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
@@ -31,47 +32,107 @@ ANDROID_SINGLETON_STATIC_INSTANCE(PermissionCache) ;
 
 // ----------------------------------------------------------------------------
 
-PermissionCache::PermissionCache() {
+PermissionCache::PermissionCache() : mCacheCount(0) {
+    memset(mCache, 0, sizeof(mCache));
 }
 
-status_t PermissionCache::check(bool* granted,
-        const String16& permission, uid_t uid) const {
-    Mutex::Autolock _l(mLock);
-    Entry e;
-    e.name = permission;
-    e.uid  = uid;
-    ssize_t index = mCache.indexOf(e);
+int32_t PermissionCache::intern(const String16& permission) {
+    { // scope for the read lock
+        RWLock::AutoRLock _l(mLock);
+        ssize_t index = mPermissionIds.indexOfKey(permission);
+        if (index >= 0) {
+            return mPermissionIds.valueAt(index);
+        }
+    }
+    RWLock::AutoWLock _l(mLock);
+    ssize_t index = mPermissionIds.indexOfKey(permission);
     if (index >= 0) {
-        *granted = mCache.itemAt(index).granted;
-        return NO_ERROR;
+        return mPermissionIds.valueAt(index);
     }
-    return NAME_NOT_FOUND;
+    const int32_t id = mPermissionNames.add(permission);
+    mPermissionIds.add(permission, id);
+    return id;
 }
 
-void PermissionCache::cache(const String16& permission,
-        uid_t uid, bool granted) {
-    Mutex::Autolock _l(mLock);
-    Entry e;
-    ssize_t index = mPermissionNamesPool.indexOf(permission);
-    if (index > 0) {
-        e.name = mPermissionNamesPool.itemAt(index);
-    } else {
-        mPermissionNamesPool.add(permission);
-        e.name = permission;
+bool PermissionCache::getPermissionName(int32_t id, String16* outName) const {
+    RWLock::AutoRLock _l(mLock);
+    if (id < 0 || size_t(id) >= mPermissionNames.size()) {
+        return false;
     }
+    *outName = mPermissionNames[id];
+    return true;
+}
+
+uint64_t PermissionCache::makeKey(int32_t id, uid_t uid) {
     // note, we don't need to store the pid, which is not actually used in
     // permission checks
-    e.uid  = uid;
-    e.granted = granted;
-    index = mCache.indexOf(e);
-    if (index < 0) {
-        mCache.add(e);
+    return (uint64_t(uid) << 32) | uint32_t(id + 1);
+}
+
+size_t PermissionCache::hash(uint64_t key) {
+    return (uint32_t(key ^ (key >> 32)) * 0x9E3779B1u) >> (32 - CACHE_BITS);
+}
+
+status_t PermissionCache::check(bool* granted,
+        int32_t id, uid_t uid) const {
+    const uint64_t key = makeKey(id, uid);
+    RWLock::AutoRLock _l(mLock);
+    for (size_t i = hash(key); mCache[i].key; i = (i + 1) & (CACHE_SIZE - 1)) {
+        if (mCache[i].key == key) {
+            *granted = mCache[i].granted;
+            return NO_ERROR;
+        }
     }
+    return NAME_NOT_FOUND;
+}
+
+void PermissionCache::cache(int32_t id, uid_t uid, bool granted) {
+    RWLock::AutoWLock _l(mLock);
+    if (mCacheCount >= CACHE_SIZE / 2) {
+        // keep the table sparse rather than the oldest checks
+        memset(mCache, 0, sizeof(mCache));
+        mCacheCount = 0;
+    }
+    insertLocked(makeKey(id, uid), granted);
+}
+
+void PermissionCache::insertLocked(uint64_t key, bool granted) {
+    size_t i = hash(key);
+    for (; mCache[i].key; i = (i + 1) & (CACHE_SIZE - 1)) {
+        if (mCache[i].key == key) {
+            // another thread checked it at the same time
+            return;
+        }
+    }
+    mCache[i].key = key;
+    mCache[i].granted = granted;
+    mCacheCount++;
 }
 
 void PermissionCache::purge() {
-    Mutex::Autolock _l(mLock);
-    mCache.clear();
+    RWLock::AutoWLock _l(mLock);
+    memset(mCache, 0, sizeof(mCache));
+    mCacheCount = 0;
+}
+
+void PermissionCache::purge(uid_t uid) {
+    RWLock::AutoWLock _l(mLock);
+    // entries can't be removed from the table in place, rebuild it
+    Vector<Entry> kept;
+    for (size_t i = 0; i < CACHE_SIZE; i++) {
+        if (mCache[i].key && uid_t(mCache[i].key >> 32) != uid) {
+            kept.add(mCache[i]);
+        }
+    }
+    memset(mCache, 0, sizeof(mCache));
+    mCacheCount = 0;
+    for (size_t i = 0; i < kept.size(); i++) {
+        insertLocked(kept[i].key, kept[i].granted);
+    }
+}
+
+int32_t PermissionCache::getPermissionId(const String16& permission) {
+    return PermissionCache::getInstance().intern(permission);
 }
 
 bool PermissionCache::checkCallingPermission(const String16& permission) {
@@ -80,16 +141,32 @@ bool PermissionCache::checkCallingPermission(const String16& permission) {
 
 bool PermissionCache::checkCallingPermission(
         const String16& permission, int32_t* outPid, int32_t* outUid) {
+    return PermissionCache::checkCallingPermission(
+            getPermissionId(permission), outPid, outUid);
+}
+
+bool PermissionCache::checkPermission(
+        const String16& permission, pid_t pid, uid_t uid) {
+    return PermissionCache::checkPermission(
+            getPermissionId(permission), pid, uid);
+}
+
+bool PermissionCache::checkCallingPermission(int32_t permissionId) {
+    return PermissionCache::checkCallingPermission(permissionId, NULL, NULL);
+}
+
+bool PermissionCache::checkCallingPermission(
+        int32_t permissionId, int32_t* outPid, int32_t* outUid) {
     IPCThreadState* ipcState = IPCThreadState::self();
     pid_t pid = ipcState->getCallingPid();
     uid_t uid = ipcState->getCallingUid();
     if (outPid) *outPid = pid;
     if (outUid) *outUid = uid;
-    return PermissionCache::checkPermission(permission, pid, uid);
+    return PermissionCache::checkPermission(permissionId, pid, uid);
 }
 
 bool PermissionCache::checkPermission(
-        const String16& permission, pid_t pid, uid_t uid) {
+        int32_t permissionId, pid_t pid, uid_t uid) {
     if ((uid == 0) || (pid == getpid())) {
         // root and ourselves is always okay
         return true;
@@ -97,17 +174,31 @@ bool PermissionCache::checkPermission(
 
     PermissionCache& pc(PermissionCache::getInstance());
     bool granted = false;
-    if (pc.check(&granted, permission, uid) != NO_ERROR) {
+    if (pc.check(&granted, permissionId, uid) != NO_ERROR) {
+        String16 permission;
+        if (!pc.getPermissionName(permissionId, &permission)) {
+            ALOGE("checking unknown permission id %d for uid=%d",
+                    permissionId, uid);
+            return false;
+        }
         nsecs_t t = -systemTime();
         granted = android::checkPermission(permission, pid, uid);
         t += systemTime();
         ALOGD("checking %s for uid=%d => %s (%d us)",
                 String8(permission).string(), uid,
                 granted?"granted":"denied", (int)ns2us(t));
-        pc.cache(permission, uid, granted);
+        pc.cache(permissionId, uid, granted);
     }
     return granted;
 }
 
+void PermissionCache::invalidate() {
+    PermissionCache::getInstance().purge();
+}
+
+void PermissionCache::invalidate(uid_t uid) {
+    PermissionCache::getInstance().purge(uid);
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
@@ -36,12 +36,14 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
 #define BINDER_VM_SIZE ((1*1024*1024) - (4096 *2))
+#define DEFAULT_MAX_BINDER_THREADS 15
 
 
 // ---------------------------------------------------------------------------
@@ -155,13 +157,13 @@ bool ProcessState::becomeContextManager(context_check_func checkFunc, void* user
         mBinderContextUserData = userData;
 
         int dummy = 0;
-        status_t result = ioctl(mDriverFD, BINDER_SET_CONTEXT_MGR, &dummy);
-        if (result == 0) {
+        status_t result = mDriver->ioctl(mDriverFD, BINDER_SET_CONTEXT_MGR, &dummy);
+        if (result == NO_ERROR) {
             mManagesContexts = true;
-        } else if (result == -1) {
+        } else {
             mBinderContextCheckFunc = NULL;
             mBinderContextUserData = NULL;
-            ALOGE("Binder ioctl to become context manager failed: %s\n", strerror(errno));
+            ALOGE("Binder ioctl to become context manager failed: %s\n", strerror(-result));
         }
     }
     return mManagesContexts;
@@ -328,66 +330,240 @@ void ProcessState::spawnPooledThread(bool isMain)
 }
 
 status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
-    status_t result = NO_ERROR;
-    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &maxThreads) == -1) {
-        result = -errno;
+    { // scope for the lock
+        AutoMutex _l(mThreadPoolLock);
+        const ThreadPoolPolicy& p(mThreadPoolPolicy);
+        // The driver keeps counting the threads that left the pool, leave
+        // room for as many replacements.
+        if (p.dynamic && maxThreads > p.maxThreads + mThreadPoolStats.retired) {
+            maxThreads = p.maxThreads + mThreadPoolStats.retired;
+        }
+    }
+    status_t result = mDriver->ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &maxThreads);
+    if (result != NO_ERROR) {
         ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+    } else {
+        AutoMutex _l(mThreadPoolLock);
+        mThreadPoolStats.maxThreads = maxThreads;
     }
     return result;
 }
 
+void ProcessState::getThreadPoolStats(ThreadPoolStats* outStats) const
+{
+    AutoMutex _l(mThreadPoolLock);
+    *outStats = mThreadPoolStats;
+    outStats->threads = mPoolThreads;
+    outStats->busyThreads = mBusyThreads;
+    outStats->maxBusyThreads = mMaxBusyThreads;
+    outStats->transactions = mPoolTransactions;
+}
+
+size_t ProcessState::getThreadPoolThreadCount() const
+{
+    return android_atomic_acquire_load(&mPoolThreads);
+}
+
+void ProcessState::dumpThreadPoolStats(String8& result) const
+{
+    ThreadPoolStats s;
+    getThreadPoolStats(&s);
+    result.appendFormat("Binder thread pool: %zu threads, %zu busy (max %zu), "
+            "driver limit %zu, %s policy\n",
+            s.threads, s.busyThreads, s.maxBusyThreads, s.maxThreads,
+            mThreadPoolDynamic ? "dynamic" : "static");
+    result.appendFormat("  %u transactions, saturated %llu times for %.3f ms "
+            "(longest %.3f ms), grown %u times, retired %u threads\n",
+            s.transactions, (unsigned long long)s.saturations,
+            s.saturatedTime / 1e6, s.maxSaturatedTime / 1e6, s.grown, s.retired);
+}
+
+void ProcessState::setThreadPoolPolicy(const ThreadPoolPolicy& policy)
+{
+    size_t maxThreads;
+    { // scope for the lock
+        AutoMutex _l(mThreadPoolLock);
+        mThreadPoolPolicy = policy;
+        maxThreads = mThreadPoolStats.maxThreads;
+    }
+    android_atomic_release_store(policy.dynamic ? 1 : 0, &mThreadPoolDynamic);
+
+    int32_t idleTimeoutMs = 0;
+    if (policy.dynamic && policy.idleTimeout > 0) {
+        idleTimeoutMs = toMillisecondTimeoutDelay(0, policy.idleTimeout);
+    }
+    android_atomic_release_store(idleTimeoutMs, &mThreadPoolIdleTimeoutMs);
+    if (policy.dynamic) {
+        // clamps the current limit to the new maximum
+        setThreadPoolMaxThreadCount(maxThreads);
+    }
+}
+
+// Raises *max to value, unless it is already higher.
+static void atomicRaise(volatile int32_t* max, int32_t value)
+{
+    int32_t old;
+    do {
+        old = *max;
+        if (old >= value) {
+            return;
+        }
+    } while (android_atomic_cmpxchg(old, value, max));
+}
+
+void ProcessState::threadPoolEnter()
+{
+    android_atomic_inc(&mPoolThreads);
+}
+
+void ProcessState::threadPoolExit(bool retired)
+{
+    android_atomic_dec(&mPoolThreads);
+    if (retired) {
+        AutoMutex _l(mThreadPoolLock);
+        mRetiringThreads--;
+    }
+}
+
+void ProcessState::threadPoolTransactionStarted()
+{
+    android_atomic_inc(&mPoolTransactions);
+    const int32_t busy = android_atomic_inc(&mBusyThreads) + 1;
+    atomicRaise(&mMaxBusyThreads, busy);
+    if (busy < mPoolThreads) {
+        return;
+    }
+
+    // All the threads are busy, only then is the time taken.
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    AutoMutex _l(mThreadPoolLock);
+    mThreadPoolStats.saturations++;
+    mSaturationStart = now;
+}
+
+void ProcessState::threadPoolTransactionFinished()
+{
+    const int32_t busy = android_atomic_dec(&mBusyThreads);
+    if (busy < mPoolThreads) {
+        return;
+    }
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t newMaxThreads = 0;
+    { // scope for the lock
+        AutoMutex _l(mThreadPoolLock);
+        if (mSaturationStart == 0) {
+            // another thread finished first, or this one just joined
+            return;
+        }
+        ThreadPoolStats& s(mThreadPoolStats);
+        const ThreadPoolPolicy& p(mThreadPoolPolicy);
+        const nsecs_t saturated = now - mSaturationStart;
+        mSaturationStart = 0;
+        s.saturatedTime += saturated;
+        if (saturated > s.maxSaturatedTime) {
+            s.maxSaturatedTime = saturated;
+        }
+        if (p.dynamic && saturated >= p.growAfter
+                && s.maxThreads < p.maxThreads + s.retired) {
+            // the driver spawns the thread the next time it needs one
+            newMaxThreads = s.maxThreads + 1;
+            s.grown++;
+        }
+    }
+    if (newMaxThreads) {
+        setThreadPoolMaxThreadCount(newMaxThreads);
+    }
+}
+
+bool ProcessState::threadPoolIdleTimedOut()
+{
+    size_t newMaxThreads = 0;
+    { // scope for the lock
+        AutoMutex _l(mThreadPoolLock);
+        const ThreadPoolPolicy& p(mThreadPoolPolicy);
+        if (p.dynamic) {
+            if (size_t(mPoolThreads) <= p.minThreads + mRetiringThreads) {
+                return false;
+            }
+            // The driver still counts the threads it had us spawn once
+            // they exit, raise its limit so that this one can be replaced
+            // when needed.
+            mThreadPoolStats.retired++;
+            newMaxThreads = mThreadPoolStats.maxThreads + 1;
+        }
+        mRetiringThreads++;
+    }
+    if (newMaxThreads) {
+        setThreadPoolMaxThreadCount(newMaxThreads);
+    }
+    return true;
+}
+
 void ProcessState::giveThreadPoolName() {
     androidSetThreadName( makeBinderThreadName().string() );
 }
 
-static int open_driver()
+static int open_driver(const sp<BinderDriver>& driver)
 {
-    int fd = open("/dev/binder", O_RDWR);
+    int fd = driver->open();
     if (fd >= 0) {
-        fcntl(fd, F_SETFD, FD_CLOEXEC);
         int vers;
-        status_t result = ioctl(fd, BINDER_VERSION, &vers);
-        if (result == -1) {
-            ALOGE("Binder ioctl to obtain version failed: %s", strerror(errno));
-            close(fd);
-            fd = -1;
+        status_t result = driver->ioctl(fd, BINDER_VERSION, &vers);
+        if (result != NO_ERROR) {
+            ALOGE("Binder ioctl to obtain version failed: %s", strerror(-result));
+            driver->close(fd);
+            return -1;
         }
-        if (result != 0 || vers != BINDER_CURRENT_PROTOCOL_VERSION) {
+        if (vers != BINDER_CURRENT_PROTOCOL_VERSION) {
             ALOGE("Binder driver protocol does not match user space protocol!");
-            close(fd);
-            fd = -1;
+            driver->close(fd);
+            return -1;
         }
-        size_t maxThreads = 15;
-        result = ioctl(fd, BINDER_SET_MAX_THREADS, &maxThreads);
-        if (result == -1) {
-            ALOGE("Binder ioctl to set max threads failed: %s", strerror(errno));
+        size_t maxThreads = DEFAULT_MAX_BINDER_THREADS;
+        result = driver->ioctl(fd, BINDER_SET_MAX_THREADS, &maxThreads);
+        if (result != NO_ERROR) {
+            ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
         }
     } else {
-        ALOGW("Opening '/dev/binder' failed: %s\n", strerror(errno));
+        ALOGW("Opening the binder driver failed: %s\n", strerror(-fd));
     }
     return fd;
 }
 
 ProcessState::ProcessState()
-    : mDriverFD(open_driver())
+    : mDriver(BinderDriver::getDefault())
+    , mDriverFD(open_driver(mDriver))
     , mVMStart(MAP_FAILED)
     , mManagesContexts(false)
     , mBinderContextCheckFunc(NULL)
     , mBinderContextUserData(NULL)
     , mThreadPoolStarted(false)
     , mThreadPoolSeq(1)
+    , mPoolThreads(0)
+    , mBusyThreads(0)
+    , mMaxBusyThreads(0)
+    , mPoolTransactions(0)
+    , mThreadPoolDynamic(0)
+    , mThreadPoolIdleTimeoutMs(0)
+    , mSaturationStart(0)
+    , mRetiringThreads(0)
 {
+    memset(&mThreadPoolStats, 0, sizeof(mThreadPoolStats));
+    mThreadPoolStats.maxThreads = DEFAULT_MAX_BINDER_THREADS;
+    memset(&mThreadPoolPolicy, 0, sizeof(mThreadPoolPolicy));
+
     if (mDriverFD >= 0) {
         // XXX Ideally, there should be a specific define for whether we
         // have mmap (or whether we could possibly have the kernel module
         // availabla).
 #if !defined(HAVE_WIN32_IPC)
         // mmap the binder, providing a chunk of virtual address space to receive transactions.
-        mVMStart = mmap(0, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, mDriverFD, 0);
+        mVMStart = mDriver->mmap(mDriverFD, BINDER_VM_SIZE);
         if (mVMStart == MAP_FAILED) {
             // *sigh*
             ALOGE("Using /dev/binder failed: unable to mmap transaction memory.\n");
-            close(mDriverFD);
+            mDriver->close(mDriverFD);
             mDriverFD = -1;
         }
 #else
@@ -75,6 +75,11 @@ TextOutput& aerr(gStderrTextOutput);
 Mutex gProcessMutex;
 sp<ProcessState> gProcess;
 
+// ------------ BinderDriver.cpp
+
+Mutex gBinderDriverLock;
+sp<BinderDriver> gBinderDriver;
+
 class LibBinderIPCtStatics
 {
 public:
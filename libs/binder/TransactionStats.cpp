@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionStats"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <binder/TransactionStats.h>
+
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <utils/Log.h>
+#include <utils/threads.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+volatile bool TransactionStats::sEnabled = false;
+
+/*
+ * A ThreadTable is only ever written by its thread. It's a fixed size open
+ * addressing hash table so that readers on other threads never see it being
+ * reallocated: a slot is filled in first and then published by setting its
+ * state with release semantics.
+ */
+class TransactionStats::ThreadTable {
+public:
+    enum { SIZE = 128 };
+
+    struct Slot {
+        volatile int32_t    state;      // 0: free, 1: in use
+        uint32_t            hash;
+        Entry               entry;
+    };
+
+    Slot        slots[SIZE];
+    uint32_t    dropped;
+
+    ThreadTable() : dropped(0) {
+        for (size_t i=0 ; i<SIZE ; i++) {
+            slots[i].state = 0;
+        }
+    }
+};
+
+static Mutex gLock;
+// the tables of the live threads
+static Vector<TransactionStats::ThreadTable*> gTables;
+// the merged stats of the threads that have exited
+static Vector<TransactionStats::Entry> gRetired;
+static uint32_t gRetiredDropped = 0;
+
+static pthread_once_t gInitOnce = PTHREAD_ONCE_INIT;
+
+static void initFromProperty()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.binder.stats", value, "0");
+    if (atoi(value)) {
+        TransactionStats::setEnabled(true);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+void TransactionStats::Histogram::add(nsecs_t duration)
+{
+    uint32_t us = uint32_t(duration / 1000);
+    size_t bucket = 0;
+    while (us > 1 && bucket < HISTOGRAM_BUCKETS-1) {
+        us >>= 1;
+        bucket++;
+    }
+    counts[bucket]++;
+}
+
+void TransactionStats::Histogram::merge(const Histogram& other)
+{
+    for (size_t i=0 ; i<HISTOGRAM_BUCKETS ; i++) {
+        counts[i] += other.counts[i];
+    }
+}
+
+uint32_t TransactionStats::Histogram::percentile(uint32_t percent) const
+{
+    uint64_t total = 0;
+    for (size_t i=0 ; i<HISTOGRAM_BUCKETS ; i++) {
+        total += counts[i];
+    }
+    const uint64_t target = (total * percent + 99) / 100;
+    uint64_t sum = 0;
+    for (size_t i=0 ; i<HISTOGRAM_BUCKETS ; i++) {
+        sum += counts[i];
+        if (sum >= target) {
+            return 2u << i;
+        }
+    }
+    return 2u << (HISTOGRAM_BUCKETS-1);
+}
+
+// ---------------------------------------------------------------------------
+
+void TransactionStats::setEnabled(bool enabled)
+{
+    sEnabled = enabled;
+}
+
+void TransactionStats::init()
+{
+    pthread_once(&gInitOnce, initFromProperty);
+}
+
+TransactionStats::ThreadTable* TransactionStats::createThreadTable()
+{
+    ThreadTable* table = new ThreadTable();
+    Mutex::Autolock _l(gLock);
+    gTables.add(table);
+    return table;
+}
+
+static bool sameKey(const TransactionStats::Entry& a, const TransactionStats::Entry& b)
+{
+    return a.code == b.code && a.incoming == b.incoming && a.descriptor == b.descriptor;
+}
+
+static void mergeEntry(Vector<TransactionStats::Entry>& entries,
+        const TransactionStats::Entry& e)
+{
+    for (size_t i=0 ; i<entries.size() ; i++) {
+        if (sameKey(entries[i], e)) {
+            TransactionStats::Entry& m = entries.editItemAt(i);
+            m.count += e.count;
+            m.requestBytes += e.requestBytes;
+            m.replyBytes += e.replyBytes;
+            m.total.merge(e.total);
+            m.driver.merge(e.driver);
+            m.handling.merge(e.handling);
+            return;
+        }
+    }
+    entries.add(e);
+}
+
+static void mergeTable(Vector<TransactionStats::Entry>& entries,
+        const TransactionStats::ThreadTable* table)
+{
+    for (size_t i=0 ; i<TransactionStats::ThreadTable::SIZE ; i++) {
+        const TransactionStats::ThreadTable::Slot& slot(table->slots[i]);
+        if (android_atomic_acquire_load(&slot.state)) {
+            mergeEntry(entries, slot.entry);
+        }
+    }
+}
+
+void TransactionStats::destroyThreadTable(ThreadTable* table)
+{
+    { // scope for the lock
+        Mutex::Autolock _l(gLock);
+        for (size_t i=0 ; i<gTables.size() ; i++) {
+            if (gTables[i] == table) {
+                gTables.removeAt(i);
+                break;
+            }
+        }
+        mergeTable(gRetired, table);
+        gRetiredDropped += table->dropped;
+    }
+    delete table;
+}
+
+// Returns the interface descriptor at the start of a transaction's data, as
+// written by Parcel::writeInterfaceToken(): a strict mode policy followed by
+// a String16 (length, characters and a terminating 0).
+static const char16_t* interfaceToken(const uint8_t* data, size_t dataSize,
+        size_t* outLength)
+{
+    if (dataSize < 2*sizeof(int32_t)) {
+        return NULL;
+    }
+    int32_t length;
+    memcpy(&length, data + sizeof(int32_t), sizeof(length));
+    if (length <= 0 || size_t(length) >= (dataSize - 2*sizeof(int32_t)) / sizeof(char16_t)) {
+        return NULL;
+    }
+    *outLength = length;
+    return reinterpret_cast<const char16_t*>(data + 2*sizeof(int32_t));
+}
+
+void TransactionStats::record(ThreadTable* table, const uint8_t* data, size_t dataSize,
+        uint32_t code, bool incoming, size_t replySize,
+        nsecs_t total, nsecs_t driver, nsecs_t handling)
+{
+    size_t length = 0;
+    const char16_t* descriptor = interfaceToken(data, dataSize, &length);
+
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ code ^ (incoming ? 0x80000000u : 0);
+    for (size_t i=0 ; i<length ; i++) {
+        hash = (hash ^ descriptor[i]) * 16777619u;
+    }
+
+    for (size_t probe=0 ; probe<ThreadTable::SIZE ; probe++) {
+        ThreadTable::Slot& slot(table->slots[(hash + probe) % ThreadTable::SIZE]);
+        Entry& e(slot.entry);
+        if (slot.state == 0) {
+            e.descriptor = descriptor ? String16(descriptor, length) : String16();
+            e.code = code;
+            e.incoming = incoming;
+            e.count = 0;
+            e.requestBytes = 0;
+            e.replyBytes = 0;
+            memset(&e.total, 0, sizeof(e.total));
+            memset(&e.driver, 0, sizeof(e.driver));
+            memset(&e.handling, 0, sizeof(e.handling));
+            slot.hash = hash;
+            android_atomic_release_store(1, &slot.state);
+        } else if (slot.hash != hash || e.code != code || e.incoming != incoming
+                || e.descriptor.size() != length
+                || (length && memcmp(e.descriptor.string(), descriptor,
+                        length * sizeof(char16_t)))) {
+            continue;
+        }
+        e.count++;
+        e.requestBytes += dataSize;
+        e.replyBytes += replySize;
+        e.total.add(total);
+        e.driver.add(driver);
+        if (incoming) {
+            e.handling.add(handling);
+        }
+        return;
+    }
+    table->dropped++;
+}
+
+void TransactionStats::getEntries(Vector<Entry>* outEntries)
+{
+    outEntries->clear();
+    Mutex::Autolock _l(gLock);
+    for (size_t i=0 ; i<gRetired.size() ; i++) {
+        mergeEntry(*outEntries, gRetired[i]);
+    }
+    for (size_t i=0 ; i<gTables.size() ; i++) {
+        mergeTable(*outEntries, gTables[i]);
+    }
+}
+
+void TransactionStats::dump(String8& result)
+{
+    Vector<Entry> entries;
+    getEntries(&entries);
+    uint32_t dropped;
+    { // scope for the lock
+        Mutex::Autolock _l(gLock);
+        dropped = gRetiredDropped;
+        for (size_t i=0 ; i<gTables.size() ; i++) {
+            dropped += gTables[i]->dropped;
+        }
+    }
+
+    result.appendFormat("Binder transaction stats (%s, %d entries, %u dropped):\n",
+            sEnabled ? "enabled" : "disabled", int(entries.size()), dropped);
+    result.append("  dir  code        count  req-avg  rep-avg"
+            "  total-p50/p99(us)  driver-p50/p99(us)  handling-p50/p99(us)  interface\n");
+    for (size_t i=0 ; i<entries.size() ; i++) {
+        const Entry& e(entries[i]);
+        const uint64_t count = e.count ? e.count : 1;
+        result.appendFormat("  %-4s %-10u %6llu %8llu %8llu  %8u/%-8u  %8u/%-8u  ",
+                e.incoming ? "in" : "out", e.code,
+                (unsigned long long)e.count,
+                (unsigned long long)(e.requestBytes / count),
+                (unsigned long long)(e.replyBytes / count),
+                e.total.percentile(50), e.total.percentile(99),
+                e.driver.percentile(50), e.driver.percentile(99));
+        if (e.incoming) {
+            result.appendFormat("  %8u/%-8u  ",
+                    e.handling.percentile(50), e.handling.percentile(99));
+        } else {
+            result.append("         -/-         ");
+        }
+        result.append(e.descriptor.size() ? String8(e.descriptor).string() : "?");
+        result.append("\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,55 @@
+# Build the unit tests.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# Build the unit tests.
+test_src_files := \
+    AppOpsManager_test.cpp \
+    IPCThreadState_test.cpp \
+    IServiceManager_test.cpp \
+    LoopbackBinderDriver_test.cpp \
+    MemoryDealer_test.cpp \
+    Parcel_test.cpp \
+    ProcessState_test.cpp
+
+shared_libraries := \
+    libbinder \
+    libcutils \
+    libutils
+
+static_libraries := \
+    libbinder_loopback \
+    libgtest \
+    libgtest_main
+
+$(foreach file,$(test_src_files), \
+    $(eval include $(CLEAR_VARS)) \
+    $(eval LOCAL_SHARED_LIBRARIES := $(shared_libraries)) \
+    $(eval LOCAL_STATIC_LIBRARIES := $(static_libraries)) \
+    $(eval LOCAL_SRC_FILES := $(file)) \
+    $(eval LOCAL_MODULE := $(notdir $(file:%.cpp=%))) \
+    $(eval include $(BUILD_NATIVE_TEST)) \
+)
+
+# The same tests on the host, where the loopback driver stands in for
+# /dev/binder.
+host_static_libraries := \
+    libbinder_loopback \
+    libbinder \
+    libutils \
+    liblog \
+    libcutils \
+    libgtest_host \
+    libgtest_main_host
+
+$(foreach file,$(test_src_files), \
+    $(eval include $(CLEAR_VARS)) \
+    $(eval LOCAL_STATIC_LIBRARIES := $(host_static_libraries)) \
+    $(eval LOCAL_LDLIBS := -lpthread) \
+    $(eval LOCAL_SRC_FILES := $(file)) \
+    $(eval LOCAL_MODULE := $(notdir $(file:%.cpp=%))) \
+    $(eval include $(BUILD_HOST_NATIVE_TEST)) \
+)
+
+# Build the manual test programs.
+include $(call all-makefiles-under, $(LOCAL_PATH))
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <binder/AppOpsManager.h>
+#include <binder/Binder.h>
+#include <binder/IServiceManager.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+
+// Keeps the registrations like the app ops service: a callback watching an
+// op for a package is told about the changes of the op, and of the package.
+class FakeAppOpsService : public BnAppOpsService
+{
+public:
+    FakeAppOpsService() : mMode(AppOpsManager::MODE_ALLOWED), mChecks(0), mNotes(0),
+            mStops(0), mMaxWatchers(0) {
+    }
+
+    Mutex mLock;
+    int32_t mMode;
+    int mChecks;
+    int mNotes;
+    int mStops;
+    size_t mMaxWatchers;
+
+    struct Watcher {
+        int32_t op;
+        String16 package;
+        sp<IAppOpsCallback> callback;
+    };
+    Vector<Watcher> mWatchers;
+
+    void setMode(int32_t op, const String16& package, int32_t mode) {
+        Vector<sp<IAppOpsCallback> > callbacks;
+        {
+            Mutex::Autolock _l(mLock);
+            mMode = mode;
+            for (size_t i = 0; i < mWatchers.size(); i++) {
+                if (mWatchers[i].op == op || mWatchers[i].package == package) {
+                    callbacks.add(mWatchers[i].callback);
+                }
+            }
+        }
+        for (size_t i = 0; i < callbacks.size(); i++) {
+            callbacks[i]->opChanged(op, package);
+        }
+    }
+
+    size_t countWatchers(int32_t op, const String16& package) {
+        Mutex::Autolock _l(mLock);
+        size_t count = 0;
+        for (size_t i = 0; i < mWatchers.size(); i++) {
+            if (mWatchers[i].op == op && mWatchers[i].package == package) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    virtual int32_t checkOperation(int32_t code, int32_t uid, const String16& packageName) {
+        Mutex::Autolock _l(mLock);
+        mChecks++;
+        return mMode;
+    }
+
+    virtual int32_t noteOperation(int32_t code, int32_t uid, const String16& packageName) {
+        Mutex::Autolock _l(mLock);
+        mNotes++;
+        return mMode;
+    }
+
+    virtual int32_t startOperation(const sp<IBinder>& token, int32_t code, int32_t uid,
+            const String16& packageName) {
+        return mMode;
+    }
+
+    virtual void finishOperation(const sp<IBinder>& token, int32_t code, int32_t uid,
+            const String16& packageName) {
+    }
+
+    virtual void startWatchingMode(int32_t op, const String16& packageName,
+            const sp<IAppOpsCallback>& callback) {
+        Mutex::Autolock _l(mLock);
+        Watcher w;
+        w.op = op;
+        w.package = packageName;
+        w.callback = callback;
+        mWatchers.add(w);
+        if (mMaxWatchers < mWatchers.size()) {
+            mMaxWatchers = mWatchers.size();
+        }
+    }
+
+    virtual void stopWatchingMode(const sp<IAppOpsCallback>& callback) {
+        Mutex::Autolock _l(mLock);
+        mStops++;
+        for (size_t i = mWatchers.size(); i > 0; i--) {
+            if (mWatchers[i-1].callback->asBinder() == callback->asBinder()) {
+                mWatchers.removeAt(i-1);
+            }
+        }
+    }
+
+    virtual sp<IBinder> getToken(const sp<IBinder>& clientToken) {
+        return clientToken;
+    }
+};
+
+// The context manager of the test, it only knows the app ops service.
+class FakeServiceManager : public BBinder
+{
+public:
+    FakeServiceManager(const sp<IBinder>& appOps) : mAppOps(appOps) {
+    }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case IServiceManager::GET_SERVICE_TRANSACTION:
+            case IServiceManager::CHECK_SERVICE_TRANSACTION:
+                data.enforceInterface(IServiceManager::descriptor);
+                return reply->writeStrongBinder(
+                        data.readString16() == String16("appops") ? mAppOps : NULL);
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+
+private:
+    const sp<IBinder> mAppOps;
+};
+
+class AppOpsManagerTest : public testing::Test {
+protected:
+    static sp<FakeAppOpsService> sService;
+
+    static void SetUpTestCase() {
+        BinderDriver::setDefault(new LoopbackBinderDriver());
+        ASSERT_TRUE(ProcessState::self()->becomeContextManager(NULL, NULL));
+        sService = new FakeAppOpsService();
+        setTheContextObject(new FakeServiceManager(sService->asBinder()));
+        ProcessState::self()->startThreadPool();
+        // the modes are only cached once the pool is running
+        for (int i = 0; i < 500 && ProcessState::self()->getThreadPoolThreadCount() == 0; i++) {
+            usleep(10000);
+        }
+        ASSERT_NE(0U, ProcessState::self()->getThreadPoolThreadCount());
+    }
+
+    virtual void SetUp() {
+        Mutex::Autolock _l(sService->mLock);
+        sService->mMode = AppOpsManager::MODE_ALLOWED;
+    }
+
+    int getChecks() {
+        Mutex::Autolock _l(sService->mLock);
+        return sService->mChecks;
+    }
+
+    int getNotes() {
+        Mutex::Autolock _l(sService->mLock);
+        return sService->mNotes;
+    }
+
+    AppOpsManager mAppOps;
+};
+
+sp<FakeAppOpsService> AppOpsManagerTest::sService;
+
+TEST_F(AppOpsManagerTest, CheckOp_IsCachedUntilModeChanges) {
+    const String16 package("checked");
+    const int checks = getChecks();
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(AppOpsManager::MODE_ALLOWED, mAppOps.checkOp(1, 1000, package));
+    }
+    EXPECT_EQ(1, getChecks() - checks);
+
+    sService->setMode(1, package, AppOpsManager::MODE_IGNORED);
+    EXPECT_EQ(AppOpsManager::MODE_IGNORED, mAppOps.checkOp(1, 1000, package))
+            << "the cached mode should have been dropped when it changed";
+    EXPECT_EQ(2, getChecks() - checks);
+}
+
+TEST_F(AppOpsManagerTest, NoteOp_ReportsEveryNote) {
+    const String16 package("noted");
+    const int notes = getNotes();
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(AppOpsManager::MODE_ALLOWED, mAppOps.noteOp(2, 1000, package));
+    }
+    EXPECT_EQ(10, getNotes() - notes)
+            << "the notes should have been reported one by one, right away";
+
+    sService->setMode(2, package, AppOpsManager::MODE_ERRORED);
+    EXPECT_EQ(AppOpsManager::MODE_ERRORED, mAppOps.noteOp(2, 1000, package));
+    EXPECT_EQ(11, getNotes() - notes);
+}
+
+TEST_F(AppOpsManagerTest, Watch_RegistersOncePerOpAndPackage) {
+    const String16 package("watched");
+    mAppOps.checkOp(3, 1000, package);
+    mAppOps.checkOp(3, 1001, package);
+    mAppOps.noteOp(3, 1002, package);
+    EXPECT_EQ(1U, sService->countWatchers(3, package));
+}
+
+TEST_F(AppOpsManagerTest, Watch_IsCapped) {
+    const int packageCount = 200;
+    for (int i = 0; i < packageCount; i++) {
+        mAppOps.checkOp(4, 1000, String16(String8::format("package%d", i)));
+    }
+    Mutex::Autolock _l(sService->mLock);
+    EXPECT_LT(0, sService->mStops)
+            << "the registrations should have been dropped when there were too many";
+    EXPECT_GE(64U, sService->mMaxWatchers);
+    EXPECT_GE(64U, sService->mWatchers.size());
+}
+
+TEST_F(AppOpsManagerTest, Watch_KeepsModesCorrectAfterReset) {
+    const String16 package("reset");
+    const int packageCount = 100;
+    EXPECT_EQ(AppOpsManager::MODE_ALLOWED, mAppOps.checkOp(5, 1000, package));
+    for (int i = 0; i < packageCount; i++) {
+        mAppOps.checkOp(5, 1000, String16(String8::format("other%d", i)));
+    }
+    EXPECT_EQ(AppOpsManager::MODE_ALLOWED, mAppOps.checkOp(5, 1000, package));
+    sService->setMode(5, package, AppOpsManager::MODE_IGNORED);
+    EXPECT_EQ(AppOpsManager::MODE_IGNORED, mAppOps.checkOp(5, 1000, package));
+}
+
+} // namespace android
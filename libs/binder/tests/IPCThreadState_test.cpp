@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <binder/Binder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+
+static const nsecs_t TIMEOUT = 5000000000LL;
+
+enum {
+    ECHO = IBinder::FIRST_CALL_TRANSACTION,
+    RECORD,
+};
+
+class RecordingService : public BBinder
+{
+public:
+    Mutex mLock;
+    Condition mCondition;
+    Vector<int32_t> mRecords;
+
+    // Waits until count one-way calls were recorded.
+    status_t waitForRecords(size_t count) {
+        Mutex::Autolock _l(mLock);
+        while (mRecords.size() < count) {
+            status_t err = mCondition.waitRelative(mLock, TIMEOUT);
+            if (err != NO_ERROR) {
+                return err;
+            }
+        }
+        return NO_ERROR;
+    }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case ECHO:
+                return reply->writeInt32(data.readInt32());
+            case RECORD: {
+                Mutex::Autolock _l(mLock);
+                mRecords.add(data.readInt32());
+                mCondition.broadcast();
+                return NO_ERROR;
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+};
+
+// The thread pool of the test process serves calls made on handle 0,
+// through the loopback driver.
+class IPCThreadStateTest : public testing::Test {
+protected:
+    static sp<RecordingService> sService;
+
+    static void SetUpTestCase() {
+        BinderDriver::setDefault(new LoopbackBinderDriver());
+        ASSERT_TRUE(ProcessState::self()->becomeContextManager(NULL, NULL));
+        sService = new RecordingService();
+        setTheContextObject(sService);
+        ProcessState::self()->startThreadPool();
+    }
+
+    virtual void SetUp() {
+        Mutex::Autolock _l(sService->mLock);
+        sService->mRecords.clear();
+    }
+
+    sp<IBinder> getService() {
+        return ProcessState::self()->getContextObject(NULL);
+    }
+
+    status_t record(const sp<IBinder>& service, int32_t value) {
+        Parcel data;
+        data.writeInt32(value);
+        return service->transact(RECORD, data, NULL, IBinder::FLAG_ONEWAY);
+    }
+
+    void checkRecords(size_t count) {
+        Mutex::Autolock _l(sService->mLock);
+        ASSERT_EQ(count, sService->mRecords.size());
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(int32_t(i), sService->mRecords[i]);
+        }
+    }
+};
+
+sp<RecordingService> IPCThreadStateTest::sService;
+
+TEST_F(IPCThreadStateTest, OnewayBatch_IsSentWhenEnded) {
+    IPCThreadState* self = IPCThreadState::self();
+    sp<IBinder> service = getService();
+    self->beginOnewayBatch();
+    for (int32_t i = 0; i < 10; i++) {
+        ASSERT_EQ(NO_ERROR, record(service, i));
+    }
+    {
+        Mutex::Autolock _l(sService->mLock);
+        EXPECT_EQ(0U, sService->mRecords.size())
+                << "the batch shouldn't have been sent before it was ended";
+    }
+    ASSERT_EQ(NO_ERROR, self->endOnewayBatch());
+
+    ASSERT_EQ(NO_ERROR, sService->waitForRecords(10));
+    checkRecords(10);
+}
+
+TEST_F(IPCThreadStateTest, OnewayBatch_NestedBatchesAreSentByOutermostEnd) {
+    IPCThreadState* self = IPCThreadState::self();
+    sp<IBinder> service = getService();
+    self->beginOnewayBatch();
+    ASSERT_EQ(NO_ERROR, record(service, 0));
+    self->beginOnewayBatch();
+    ASSERT_EQ(NO_ERROR, record(service, 1));
+    ASSERT_EQ(NO_ERROR, self->endOnewayBatch());
+    {
+        Mutex::Autolock _l(sService->mLock);
+        EXPECT_EQ(0U, sService->mRecords.size());
+    }
+    ASSERT_EQ(NO_ERROR, record(service, 2));
+    ASSERT_EQ(NO_ERROR, self->endOnewayBatch());
+
+    ASSERT_EQ(NO_ERROR, sService->waitForRecords(3));
+    checkRecords(3);
+}
+
+TEST_F(IPCThreadStateTest, OnewayBatch_IsFlushedBySynchronousTransaction) {
+    IPCThreadState* self = IPCThreadState::self();
+    sp<IBinder> service = getService();
+    self->beginOnewayBatch();
+    for (int32_t i = 0; i < 5; i++) {
+        ASSERT_EQ(NO_ERROR, record(service, i));
+    }
+
+    // the completions of the batch must not be taken for this call's reply
+    Parcel data, reply;
+    data.writeInt32(42);
+    ASSERT_EQ(NO_ERROR, service->transact(ECHO, data, &reply));
+    EXPECT_EQ(42, reply.readInt32());
+
+    EXPECT_EQ(NO_ERROR, sService->waitForRecords(5))
+            << "the batch should have been sent before the synchronous call";
+    ASSERT_EQ(NO_ERROR, record(service, 5));
+    ASSERT_EQ(NO_ERROR, self->endOnewayBatch());
+
+    ASSERT_EQ(NO_ERROR, sService->waitForRecords(6));
+    checkRecords(6);
+}
+
+TEST_F(IPCThreadStateTest, OnewayBatch_IsFlushedWhenFull) {
+    const size_t count = 100;
+    IPCThreadState* self = IPCThreadState::self();
+    sp<IBinder> service = getService();
+    self->beginOnewayBatch();
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(NO_ERROR, record(service, i));
+    }
+    EXPECT_EQ(NO_ERROR, sService->waitForRecords(count / 2))
+            << "a long batch shouldn't be held until it is ended";
+    ASSERT_EQ(NO_ERROR, self->endOnewayBatch());
+
+    ASSERT_EQ(NO_ERROR, sService->waitForRecords(count));
+    checkRecords(count);
+}
+
+} // namespace android
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <binder/Binder.h>
+#include <binder/IServiceManager.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+
+static const nsecs_t MILLIS = 1000000;
+
+// The context manager of the test, speaking the protocol of servicemanager.
+// Without wait support, it behaves like an older servicemanager.
+class FakeServiceManager : public BBinder
+{
+public:
+    FakeServiceManager() : mSupportsWait(true), mChecks(0) {
+    }
+
+    Mutex mLock;
+    bool mSupportsWait;
+    int mChecks;
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case IServiceManager::CHECK_SERVICE_TRANSACTION: {
+                if (!data.enforceInterface(IServiceManager::descriptor)) {
+                    return PERMISSION_DENIED;
+                }
+                Mutex::Autolock _l(mLock);
+                mChecks++;
+                return reply->writeStrongBinder(mServices.valueFor(data.readString16()));
+            }
+            case IServiceManager::ADD_SERVICE_TRANSACTION: {
+                if (!data.enforceInterface(IServiceManager::descriptor)) {
+                    return PERMISSION_DENIED;
+                }
+                String16 name = data.readString16();
+                sp<IBinder> service = data.readStrongBinder();
+                Vector<sp<IBinder> > waiters;
+                {
+                    Mutex::Autolock _l(mLock);
+                    mServices.add(name, service);
+                    ssize_t index = mWaiters.indexOfKey(name);
+                    if (index >= 0) {
+                        waiters = mWaiters.valueAt(index);
+                        mWaiters.removeItemsAt(index);
+                    }
+                }
+                for (size_t i = 0; i < waiters.size(); i++) {
+                    Parcel notification;
+                    notification.writeString16(name);
+                    waiters[i]->transact(IBinder::FIRST_CALL_TRANSACTION, notification,
+                            NULL, IBinder::FLAG_ONEWAY);
+                }
+                return reply->writeInt32(0);
+            }
+            case IServiceManager::WAIT_FOR_SERVICE_TRANSACTION: {
+                if (!data.enforceInterface(IServiceManager::descriptor)) {
+                    return PERMISSION_DENIED;
+                }
+                Mutex::Autolock _l(mLock);
+                if (!mSupportsWait) {
+                    break;
+                }
+                String16 name = data.readString16();
+                sp<IBinder> service = mServices.valueFor(name);
+                if (service == NULL) {
+                    ssize_t index = mWaiters.indexOfKey(name);
+                    if (index < 0) {
+                        index = mWaiters.add(name, Vector<sp<IBinder> >());
+                    }
+                    mWaiters.editValueAt(index).add(data.readStrongBinder());
+                }
+                return reply->writeStrongBinder(service);
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+
+private:
+    DefaultKeyedVector<String16, sp<IBinder> > mServices;
+    KeyedVector<String16, Vector<sp<IBinder> > > mWaiters;
+};
+
+struct DelayedAdd {
+    sp<IServiceManager> sm;
+    String16 name;
+    nsecs_t delay;
+};
+
+static void* addServiceAfterDelay(void* arg) {
+    DelayedAdd* add = static_cast<DelayedAdd*>(arg);
+    usleep(add->delay / 1000);
+    add->sm->addService(add->name, new BBinder());
+    return NULL;
+}
+
+class IServiceManagerTest : public testing::Test {
+protected:
+    static sp<FakeServiceManager> sServiceManager;
+
+    static void SetUpTestCase() {
+        BinderDriver::setDefault(new LoopbackBinderDriver());
+        ASSERT_TRUE(ProcessState::self()->becomeContextManager(NULL, NULL));
+        sServiceManager = new FakeServiceManager();
+        setTheContextObject(sServiceManager);
+        ProcessState::self()->startThreadPool();
+    }
+
+    virtual void TearDown() {
+        Mutex::Autolock _l(sServiceManager->mLock);
+        sServiceManager->mSupportsWait = true;
+    }
+
+    // a new proxy, with an empty cache
+    sp<IServiceManager> getServiceManager() {
+        return interface_cast<IServiceManager>(ProcessState::self()->getContextObject(NULL));
+    }
+
+    int getChecks() {
+        Mutex::Autolock _l(sServiceManager->mLock);
+        return sServiceManager->mChecks;
+    }
+
+    // Returns how long getService() took to find the service added by
+    // another thread after the given delay.
+    nsecs_t getServiceAddedAfter(const String16& name, nsecs_t delay) {
+        DelayedAdd add;
+        add.sm = getServiceManager();
+        add.name = name;
+        add.delay = delay;
+        pthread_t thread;
+        pthread_create(&thread, NULL, addServiceAfterDelay, &add);
+
+        sp<IServiceManager> sm = getServiceManager();
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        sp<IBinder> service = sm->getService(name);
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        pthread_join(thread, NULL);
+
+        EXPECT_TRUE(service != NULL);
+        return elapsed;
+    }
+};
+
+sp<FakeServiceManager> IServiceManagerTest::sServiceManager;
+
+TEST_F(IServiceManagerTest, CheckService_IsCached) {
+    sp<IServiceManager> sm = getServiceManager();
+    ASSERT_EQ(NO_ERROR, sm->addService(String16("cached"), new BBinder()));
+    sp<IServiceManager> other = getServiceManager();
+    int checks = getChecks();
+    sp<IBinder> service = other->checkService(String16("cached"));
+    ASSERT_TRUE(service != NULL);
+    EXPECT_EQ(service, other->checkService(String16("cached")));
+    EXPECT_EQ(service, other->getService(String16("cached")));
+    EXPECT_EQ(1, getChecks() - checks)
+            << "the service should have been looked up once";
+
+    // a service that isn't registered isn't cached
+    checks = getChecks();
+    EXPECT_TRUE(other->checkService(String16("missing")) == NULL);
+    EXPECT_TRUE(other->checkService(String16("missing")) == NULL);
+    EXPECT_EQ(2, getChecks() - checks);
+}
+
+TEST_F(IServiceManagerTest, GetService_IsNotifiedWhenServiceIsAdded) {
+    nsecs_t elapsed = getServiceAddedAfter(String16("notified"), 100 * MILLIS);
+    EXPECT_GE(elapsed, 100 * MILLIS);
+    EXPECT_LT(elapsed, 500 * MILLIS)
+            << "getService() should have returned before its first poll";
+}
+
+TEST_F(IServiceManagerTest, GetService_PollsOlderServiceManager) {
+    {
+        Mutex::Autolock _l(sServiceManager->mLock);
+        sServiceManager->mSupportsWait = false;
+    }
+    nsecs_t elapsed = getServiceAddedAfter(String16("polled"), 100 * MILLIS);
+    EXPECT_GE(elapsed, 1000 * MILLIS)
+            << "getService() should have found the service on its first poll";
+}
+
+} // namespace android
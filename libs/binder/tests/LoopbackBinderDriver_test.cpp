@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <binder/Binder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+
+static const nsecs_t TIMEOUT = 5000000000LL;
+
+enum {
+    ECHO = IBinder::FIRST_CALL_TRANSACTION,
+    RECORD,
+    RECURSE,
+    HOLD,
+};
+
+// The context manager of the test. It runs in the thread pool, on the other
+// side of the loopback driver.
+class TestService : public BBinder
+{
+public:
+    TestService() : mHeld(false), mReleased(false), mEchoThread(0) {
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<int32_t> mRecords;
+    bool mHeld;
+    bool mReleased;
+    pid_t mEchoThread;
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case ECHO: {
+                Mutex::Autolock _l(mLock);
+                mEchoThread = gettid();
+                return reply->writeInt32(data.readInt32());
+            }
+            case RECORD: {
+                Mutex::Autolock _l(mLock);
+                mRecords.add(data.readInt32());
+                mCondition.broadcast();
+                return NO_ERROR;
+            }
+            case RECURSE: {
+                Parcel echoData, echoReply;
+                echoData.writeInt32(data.readInt32());
+                status_t err = ProcessState::self()->getContextObject(NULL)->transact(
+                        ECHO, echoData, &echoReply);
+                if (err == NO_ERROR) {
+                    err = reply->writeInt32(echoReply.readInt32());
+                }
+                return err;
+            }
+            case HOLD: {
+                // keeps the buffer, and the object it carries, until released
+                Mutex::Autolock _l(mLock);
+                mHeld = true;
+                mCondition.broadcast();
+                while (!mReleased) {
+                    if (mCondition.waitRelative(mLock, TIMEOUT) != NO_ERROR) {
+                        return TIMED_OUT;
+                    }
+                }
+                return NO_ERROR;
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+};
+
+// Goes back into the driver when it is destroyed.
+class DriverUser : public BBinder
+{
+public:
+    DriverUser(const sp<BinderDriver>& driver, Mutex* lock, Condition* condition,
+            bool* destroyed) :
+            mDriver(driver), mLock(lock), mCondition(condition), mDestroyed(destroyed) {
+    }
+
+protected:
+    virtual ~DriverUser() {
+        int fd = mDriver->open();
+        if (fd >= 0) {
+            mDriver->close(fd);
+        }
+        Mutex::Autolock _l(*mLock);
+        *mDestroyed = true;
+        mCondition->broadcast();
+    }
+
+private:
+    sp<BinderDriver> mDriver;
+    Mutex* mLock;
+    Condition* mCondition;
+    bool* mDestroyed;
+};
+
+class LoopbackBinderDriverTest : public testing::Test {
+protected:
+    static sp<LoopbackBinderDriver> sDriver;
+    static sp<TestService> sService;
+
+    static void SetUpTestCase() {
+        sDriver = new LoopbackBinderDriver();
+        BinderDriver::setDefault(sDriver);
+        ASSERT_TRUE(ProcessState::self()->becomeContextManager(NULL, NULL));
+        sService = new TestService();
+        setTheContextObject(sService);
+        ProcessState::self()->startThreadPool();
+    }
+
+    virtual void SetUp() {
+        Mutex::Autolock _l(sService->mLock);
+        sService->mRecords.clear();
+        sService->mHeld = false;
+        sService->mReleased = false;
+        sService->mEchoThread = 0;
+    }
+
+    sp<IBinder> getService() {
+        return ProcessState::self()->getContextObject(NULL);
+    }
+};
+
+sp<LoopbackBinderDriver> LoopbackBinderDriverTest::sDriver;
+sp<TestService> LoopbackBinderDriverTest::sService;
+
+TEST_F(LoopbackBinderDriverTest, Transact_ReturnsReply) {
+    Parcel data, reply;
+    data.writeInt32(42);
+    ASSERT_EQ(NO_ERROR, getService()->transact(ECHO, data, &reply));
+    EXPECT_EQ(42, reply.readInt32());
+    EXPECT_NE(gettid(), sService->mEchoThread)
+            << "the call should have been handled by the thread pool";
+}
+
+TEST_F(LoopbackBinderDriverTest, OnewayTransactions_AreDeliveredInOrder) {
+    const int32_t count = 100;
+    sp<IBinder> service = getService();
+    for (int32_t i = 0; i < count; i++) {
+        Parcel data;
+        data.writeInt32(i);
+        ASSERT_EQ(NO_ERROR, service->transact(RECORD, data, NULL, IBinder::FLAG_ONEWAY));
+    }
+
+    Mutex::Autolock _l(sService->mLock);
+    while (sService->mRecords.size() < size_t(count)) {
+        ASSERT_EQ(NO_ERROR, sService->mCondition.waitRelative(sService->mLock, TIMEOUT));
+    }
+    for (int32_t i = 0; i < count; i++) {
+        EXPECT_EQ(i, sService->mRecords[i]);
+    }
+}
+
+TEST_F(LoopbackBinderDriverTest, RecursiveTransaction_GoesBackToCallingThread) {
+    Parcel data, reply;
+    data.writeInt32(7);
+    ASSERT_EQ(NO_ERROR, getService()->transact(RECURSE, data, &reply));
+    EXPECT_EQ(7, reply.readInt32());
+    EXPECT_EQ(gettid(), sService->mEchoThread)
+            << "the nested call should have been handled by the waiting thread";
+}
+
+// The buffer of a one-way call holds the last reference on the object it
+// carries; freeing the buffer destroys the object, whose destructor uses the
+// driver again. The driver must not hold its lock meanwhile.
+TEST_F(LoopbackBinderDriverTest, ReleasedObject_IsDestroyedOutsideDriverLock) {
+    Mutex lock;
+    Condition condition;
+    bool destroyed = false;
+    {
+        sp<IBinder> object = new DriverUser(sDriver, &lock, &condition, &destroyed);
+        Parcel data;
+        data.writeStrongBinder(object);
+        ASSERT_EQ(NO_ERROR, getService()->transact(HOLD, data, NULL, IBinder::FLAG_ONEWAY));
+
+        Mutex::Autolock _l(sService->mLock);
+        while (!sService->mHeld) {
+            ASSERT_EQ(NO_ERROR, sService->mCondition.waitRelative(sService->mLock, TIMEOUT));
+        }
+    }
+    {
+        Mutex::Autolock _l(sService->mLock);
+        sService->mReleased = true;
+        sService->mCondition.broadcast();
+    }
+
+    Mutex::Autolock _l(lock);
+    while (!destroyed) {
+        ASSERT_EQ(NO_ERROR, condition.waitRelative(lock, TIMEOUT))
+                << "the object should have been destroyed when its buffer was freed";
+    }
+
+    // the pool must still be usable
+    Parcel data, reply;
+    data.writeInt32(1);
+    ASSERT_EQ(NO_ERROR, getService()->transact(ECHO, data, &reply));
+    EXPECT_EQ(1, reply.readInt32());
+}
+
+} // namespace android
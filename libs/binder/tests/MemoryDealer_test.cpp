@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <binder/IMemory.h>
+#include <binder/MemoryDealer.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+static const size_t HEAP_SIZE = 64 * 1024;
+static const size_t ALIGNMENT = 32;
+
+static const MemoryDealer::Policy POLICIES[] = {
+    MemoryDealer::BEST_FIT,
+    MemoryDealer::SEGREGATED_FIT,
+};
+static const size_t POLICY_COUNT = sizeof(POLICIES) / sizeof(POLICIES[0]);
+
+TEST(MemoryDealerTest, Allocate_ReturnsAlignedDisjointBlocks) {
+    static const size_t sizes[] = { 1, 31, 32, 33, 100, 4096, 5000 };
+    const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+    for (size_t p = 0; p < POLICY_COUNT; p++) {
+        SCOPED_TRACE(POLICIES[p]);
+        sp<MemoryDealer> dealer = new MemoryDealer(HEAP_SIZE, "test", POLICIES[p]);
+        sp<IMemory> memory[count];
+        for (size_t i = 0; i < count; i++) {
+            memory[i] = dealer->allocate(sizes[i]);
+            ASSERT_TRUE(memory[i] != NULL);
+            EXPECT_EQ(sizes[i], memory[i]->size());
+            EXPECT_EQ(0, memory[i]->offset() % ALIGNMENT);
+            EXPECT_LE(size_t(memory[i]->offset()) + sizes[i], HEAP_SIZE);
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < i; j++) {
+                const bool disjoint =
+                        size_t(memory[i]->offset()) >= memory[j]->offset() + sizes[j] ||
+                        size_t(memory[j]->offset()) >= memory[i]->offset() + sizes[i];
+                EXPECT_TRUE(disjoint) << "blocks " << i << " and " << j << " overlap";
+            }
+        }
+    }
+}
+
+TEST(MemoryDealerTest, Allocate_FailsWhenHeapIsFull) {
+    for (size_t p = 0; p < POLICY_COUNT; p++) {
+        SCOPED_TRACE(POLICIES[p]);
+        sp<MemoryDealer> dealer = new MemoryDealer(HEAP_SIZE, "test", POLICIES[p]);
+        sp<IMemory> all = dealer->allocate(HEAP_SIZE);
+        ASSERT_TRUE(all != NULL);
+        EXPECT_TRUE(dealer->allocate(1) == NULL);
+        all.clear();
+        EXPECT_TRUE(dealer->allocate(1) != NULL)
+                << "the heap should have been freed with the block";
+    }
+}
+
+TEST(MemoryDealerTest, Deallocate_CoalescesFreeBlocks) {
+    const size_t quarter = HEAP_SIZE / 4;
+    for (size_t p = 0; p < POLICY_COUNT; p++) {
+        SCOPED_TRACE(POLICIES[p]);
+        sp<MemoryDealer> dealer = new MemoryDealer(HEAP_SIZE, "test", POLICIES[p]);
+        Vector<sp<IMemory> > blocks;
+        for (size_t i = 0; i < 4; i++) {
+            sp<IMemory> block = dealer->allocate(quarter);
+            ASSERT_TRUE(block != NULL);
+            blocks.add(block);
+        }
+        ASSERT_TRUE(dealer->allocate(1) == NULL);
+
+        // the two blocks in the middle make a free block of half the heap
+        const ssize_t offset = blocks[1]->offset() < blocks[2]->offset() ?
+                blocks[1]->offset() : blocks[2]->offset();
+        blocks.editItemAt(1).clear();
+        blocks.editItemAt(2).clear();
+        sp<IMemory> half = dealer->allocate(2 * quarter);
+        ASSERT_TRUE(half != NULL);
+        EXPECT_EQ(offset, half->offset());
+
+        // and everything, one block of the whole heap
+        half.clear();
+        blocks.clear();
+        sp<IMemory> all = dealer->allocate(HEAP_SIZE);
+        ASSERT_TRUE(all != NULL);
+        EXPECT_EQ(0, all->offset());
+    }
+}
+
+TEST(MemoryDealerTest, Deallocate_IgnoresUnknownOffset) {
+    sp<MemoryDealer> dealer = new MemoryDealer(HEAP_SIZE, "test");
+    sp<IMemory> block = dealer->allocate(ALIGNMENT);
+    ASSERT_TRUE(block != NULL);
+    dealer->deallocate(block->offset() + 4 * ALIGNMENT);
+    EXPECT_TRUE(dealer->allocate(HEAP_SIZE - ALIGNMENT) != NULL)
+            << "the rest of the heap should still be free";
+}
+
+TEST(MemoryDealerTest, Deallocate_DoubleFreeIsFatal) {
+    sp<MemoryDealer> dealer = new MemoryDealer(HEAP_SIZE, "test");
+    // The block is freed twice directly, so that its IMemory would free it
+    // a third time: all of it happens in the death test's child process.
+    EXPECT_DEBUG_DEATH({
+        sp<IMemory> block = dealer->allocate(2 * ALIGNMENT);
+        sp<IMemory> next = dealer->allocate(ALIGNMENT);
+        const ssize_t offset = block->offset();
+        dealer->deallocate(offset);
+        dealer->deallocate(offset);
+        block.clear();
+        next.clear();
+        ASSERT_TRUE(dealer->allocate(HEAP_SIZE) != NULL);
+    }, "");
+}
+
+} // namespace android
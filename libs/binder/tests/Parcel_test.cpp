@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <string.h>
+
+#include <binder/Binder.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class ParcelTest : public testing::Test {
+protected:
+    static bool isStoredInPlace(const Parcel& parcel) {
+        const uint8_t* begin = reinterpret_cast<const uint8_t*>(&parcel);
+        return parcel.data() >= begin && parcel.data() < begin + sizeof(parcel);
+    }
+
+    static void writeValues(Parcel* parcel, int32_t first, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_EQ(NO_ERROR, parcel->writeInt32(first + i));
+        }
+    }
+
+    static void checkValues(const Parcel& parcel, int32_t first, size_t count) {
+        parcel.setDataPosition(0);
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_EQ(int32_t(first + i), parcel.readInt32()) << "at index " << i;
+        }
+    }
+
+    struct Reference {
+        const uint8_t* data;
+        size_t dataSize;
+        int releaseCount;
+    };
+
+    static void releaseReference(Parcel* parcel, const uint8_t* data, size_t dataSize,
+            const size_t* objects, size_t objectsSize, void* cookie) {
+        Reference* reference = static_cast<Reference*>(cookie);
+        EXPECT_EQ(reference->data, data);
+        EXPECT_EQ(reference->dataSize, dataSize);
+        reference->releaseCount += 1;
+    }
+};
+
+TEST_F(ParcelTest, SmallParcelIsStoredInPlace) {
+    Parcel parcel;
+    writeValues(&parcel, 100, 16);
+
+    EXPECT_TRUE(isStoredInPlace(parcel));
+    EXPECT_EQ(16 * sizeof(int32_t), parcel.dataSize());
+    checkValues(parcel, 100, 16);
+}
+
+TEST_F(ParcelTest, GrowsFromInPlaceToHeap) {
+    Parcel parcel;
+    writeValues(&parcel, 100, 16);
+    ASSERT_TRUE(isStoredInPlace(parcel));
+
+    writeValues(&parcel, 116, 240);
+
+    EXPECT_FALSE(isStoredInPlace(parcel))
+            << "1KB of data should have been moved to the heap";
+    EXPECT_EQ(256 * sizeof(int32_t), parcel.dataSize());
+    EXPECT_GE(parcel.dataCapacity(), parcel.dataSize());
+    checkValues(parcel, 100, 256);
+}
+
+TEST_F(ParcelTest, GrowsObjectsFromInPlaceToHeap) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+
+    Parcel parcel;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(NO_ERROR, parcel.writeInt32(i));
+        ASSERT_EQ(NO_ERROR, parcel.writeDupFileDescriptor(fds[i % 2]));
+    }
+
+    EXPECT_EQ(10U, parcel.objectsCount());
+    parcel.setDataPosition(0);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(i, parcel.readInt32());
+        int fd = parcel.readFileDescriptor();
+        EXPECT_GE(fd, 0);
+        EXPECT_NE(fds[0], fd);
+        EXPECT_NE(fds[1], fd);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(ParcelTest, SetDataCapacity_KeepsContent) {
+    Parcel parcel;
+    writeValues(&parcel, 100, 3);
+
+    ASSERT_EQ(NO_ERROR, parcel.setDataCapacity(1000));
+    EXPECT_GE(parcel.dataCapacity(), 1000U);
+    EXPECT_FALSE(isStoredInPlace(parcel));
+    EXPECT_EQ(3 * sizeof(int32_t), parcel.dataSize());
+    checkValues(parcel, 100, 3);
+
+    const uint8_t* data = parcel.data();
+    size_t capacity = parcel.dataCapacity();
+    ASSERT_EQ(NO_ERROR, parcel.setDataCapacity(10));
+    EXPECT_EQ(data, parcel.data()) << "a smaller capacity should not shrink the buffer";
+    EXPECT_EQ(capacity, parcel.dataCapacity());
+}
+
+TEST_F(ParcelTest, FreeData_EmptiesParcel) {
+    Parcel parcel;
+    writeValues(&parcel, 100, 256);
+
+    parcel.freeData();
+    EXPECT_EQ(0U, parcel.dataSize());
+    EXPECT_EQ(0U, parcel.dataPosition());
+    EXPECT_EQ(0U, parcel.dataCapacity());
+
+    writeValues(&parcel, 200, 4);
+    EXPECT_TRUE(isStoredInPlace(parcel))
+            << "the parcel should be stored in place again";
+    checkValues(parcel, 200, 4);
+}
+
+TEST_F(ParcelTest, IpcSetDataReference_ReleasesDataWhenFreed) {
+    Parcel source;
+    writeValues(&source, 100, 8);
+
+    Reference reference = { source.data(), source.dataSize(), 0 };
+    Parcel parcel;
+    parcel.ipcSetDataReference(reference.data, reference.dataSize, NULL, 0,
+            releaseReference, &reference);
+    EXPECT_EQ(reference.data, parcel.data());
+    checkValues(parcel, 100, 8);
+    EXPECT_EQ(0, reference.releaseCount);
+
+    parcel.freeData();
+    EXPECT_EQ(1, reference.releaseCount);
+    EXPECT_EQ(0U, parcel.dataSize());
+}
+
+TEST_F(ParcelTest, IpcSetDataReference_CopiesDataWhenWritten) {
+    Parcel source;
+    writeValues(&source, 100, 8);
+
+    Reference reference = { source.data(), source.dataSize(), 0 };
+    {
+        Parcel parcel;
+        parcel.ipcSetDataReference(reference.data, reference.dataSize, NULL, 0,
+                releaseReference, &reference);
+        parcel.setDataPosition(parcel.dataSize());
+        ASSERT_EQ(NO_ERROR, parcel.writeInt32(108));
+
+        EXPECT_EQ(1, reference.releaseCount)
+                << "the reference should be released once the data is copied";
+        EXPECT_NE(reference.data, parcel.data());
+        EXPECT_TRUE(isStoredInPlace(parcel));
+        checkValues(parcel, 100, 9);
+    }
+    EXPECT_EQ(1, reference.releaseCount);
+}
+
+TEST_F(ParcelTest, ReleasedBufferIsReusedOnSameThread) {
+    // an odd size, so that no buffer released by another test can fit it better
+    const size_t capacity = 3000;
+    const uint8_t* data;
+    {
+        Parcel parcel;
+        ASSERT_EQ(NO_ERROR, parcel.setDataCapacity(capacity));
+        data = parcel.data();
+    }
+
+    Parcel parcel;
+    ASSERT_EQ(NO_ERROR, parcel.setDataCapacity(capacity));
+    EXPECT_EQ(data, parcel.data());
+    writeValues(&parcel, 100, capacity / sizeof(int32_t));
+    checkValues(parcel, 100, capacity / sizeof(int32_t));
+}
+
+// The pooled blobs carry a binder, which needs a driver to be flattened.
+class ParcelBlobPoolTest : public ParcelTest {
+protected:
+    static void SetUpTestCase() {
+        BinderDriver::setDefault(new LoopbackBinderDriver());
+    }
+
+    static const size_t BLOB_SIZE = 100 * 1024;
+
+    // Writes a pooled blob for target and fills it with value.
+    static void writeBlob(Parcel* parcel, const sp<IBinder>& target, uint8_t value,
+            void** outData) {
+        Parcel::WritableBlob blob;
+        ASSERT_EQ(NO_ERROR, parcel->writePooledBlob(BLOB_SIZE, target, &blob));
+        memset(blob.data(), value, BLOB_SIZE);
+        *outData = blob.data();
+        blob.release();
+    }
+
+    static void checkBlob(const Parcel::ReadableBlob& blob, uint8_t value) {
+        const uint8_t* data = static_cast<const uint8_t*>(blob.data());
+        for (size_t i = 0; i < BLOB_SIZE; i++) {
+            ASSERT_EQ(value, data[i]) << "at offset " << i;
+        }
+    }
+
+    static size_t getReused() {
+        size_t created, reused;
+        Parcel::getBlobPoolStats(&created, &reused);
+        return reused;
+    }
+};
+
+TEST_F(ParcelBlobPoolTest, PooledBlob_IsReusedOnceReleased) {
+    sp<IBinder> target = new BBinder();
+    void* data;
+    {
+        Parcel parcel;
+        ASSERT_NO_FATAL_FAILURE(writeBlob(&parcel, target, 1, &data));
+        parcel.setDataPosition(0);
+        Parcel::ReadableBlob blob;
+        ASSERT_EQ(NO_ERROR, parcel.readBlob(BLOB_SIZE, &blob));
+        ASSERT_NO_FATAL_FAILURE(checkBlob(blob, 1));
+    }
+
+    size_t reused = getReused();
+    Parcel parcel;
+    void* reusedData;
+    ASSERT_NO_FATAL_FAILURE(writeBlob(&parcel, target, 2, &reusedData));
+    EXPECT_EQ(data, reusedData);
+    EXPECT_EQ(reused + 1, getReused());
+}
+
+TEST_F(ParcelBlobPoolTest, PooledBlob_IsNotReusedWhileReceiverHoldsIt) {
+    sp<IBinder> target = new BBinder();
+    Parcel::ReadableBlob heldBlob;
+    void* data;
+    {
+        Parcel parcel;
+        ASSERT_NO_FATAL_FAILURE(writeBlob(&parcel, target, 1, &data));
+        parcel.setDataPosition(0);
+        ASSERT_EQ(NO_ERROR, parcel.readBlob(BLOB_SIZE, &heldBlob));
+    }
+
+    Parcel parcel;
+    void* otherData;
+    ASSERT_NO_FATAL_FAILURE(writeBlob(&parcel, target, 2, &otherData));
+    EXPECT_NE(data, otherData);
+    ASSERT_NO_FATAL_FAILURE(checkBlob(heldBlob, 1))
+            << "the held blob should not have changed";
+}
+
+TEST_F(ParcelBlobPoolTest, PooledBlob_IsOnlyReusedForSameTarget) {
+    sp<IBinder> target = new BBinder();
+    sp<IBinder> otherTarget = new BBinder();
+    void* data;
+    {
+        Parcel parcel;
+        ASSERT_NO_FATAL_FAILURE(writeBlob(&parcel, target, 1, &data));
+    }
+
+    Parcel parcel;
+    void* otherData;
+    ASSERT_NO_FATAL_FAILURE(writeBlob(&parcel, otherTarget, 2, &otherData));
+    EXPECT_NE(data, otherData);
+}
+
+} // namespace android
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+
+#include <gtest/gtest.h>
+#include <binder/Binder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+
+static const nsecs_t MILLIS = 1000000;
+static const nsecs_t TIMEOUT = 5000 * MILLIS;
+static const size_t MAX_THREADS = 15;
+
+enum {
+    PING = IBinder::FIRST_CALL_TRANSACTION,
+    BLOCK,
+};
+
+// BLOCK calls wait until all the expected ones arrived, so that as many
+// pool threads are busy at once.
+class BlockingService : public BBinder
+{
+public:
+    BlockingService() : mExpected(0), mBlocked(0) {
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    int mExpected;
+    int mBlocked;
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case PING:
+                return NO_ERROR;
+            case BLOCK: {
+                Mutex::Autolock _l(mLock);
+                mBlocked++;
+                mCondition.broadcast();
+                while (mBlocked < mExpected) {
+                    if (mCondition.waitRelative(mLock, TIMEOUT) != NO_ERROR) {
+                        return TIMED_OUT;
+                    }
+                }
+                return NO_ERROR;
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+};
+
+static void* callBlock(void*) {
+    Parcel data, reply;
+    ProcessState::self()->getContextObject(NULL)->transact(BLOCK, data, &reply);
+    return NULL;
+}
+
+class ProcessStateTest : public testing::Test {
+protected:
+    static sp<BlockingService> sService;
+
+    static void SetUpTestCase() {
+        BinderDriver::setDefault(new LoopbackBinderDriver());
+        ASSERT_TRUE(ProcessState::self()->becomeContextManager(NULL, NULL));
+        sService = new BlockingService();
+        setTheContextObject(sService);
+        ProcessState::self()->startThreadPool();
+    }
+
+    virtual void TearDown() {
+        ProcessState::ThreadPoolPolicy policy;
+        memset(&policy, 0, sizeof(policy));
+        ProcessState::self()->setThreadPoolPolicy(policy);
+        ProcessState::self()->setThreadPoolMaxThreadCount(MAX_THREADS);
+    }
+
+    ProcessState::ThreadPoolStats getStats() {
+        ProcessState::ThreadPoolStats stats;
+        ProcessState::self()->getThreadPoolStats(&stats);
+        return stats;
+    }
+
+    // Makes count calls at once, so that the driver spawns as many pool threads.
+    void makeConcurrentCalls(int count) {
+        {
+            Mutex::Autolock _l(sService->mLock);
+            sService->mExpected = count;
+            sService->mBlocked = 0;
+        }
+        pthread_t threads[count];
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(0, pthread_create(&threads[i], NULL, callBlock, NULL));
+        }
+        for (int i = 0; i < count; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // Waits until the pool has the given number of threads.
+    bool waitForThreads(size_t threads) {
+        const nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + TIMEOUT;
+        while (getStats().threads != threads) {
+            if (systemTime(SYSTEM_TIME_MONOTONIC) > deadline) {
+                return false;
+            }
+            usleep(10000);
+        }
+        return true;
+    }
+};
+
+sp<BlockingService> ProcessStateTest::sService;
+
+TEST_F(ProcessStateTest, ThreadPoolStats_CountTransactions) {
+    sp<IBinder> service = ProcessState::self()->getContextObject(NULL);
+    const ProcessState::ThreadPoolStats before = getStats();
+    for (int i = 0; i < 10; i++) {
+        Parcel data, reply;
+        ASSERT_EQ(NO_ERROR, service->transact(PING, data, &reply));
+    }
+    const ProcessState::ThreadPoolStats after = getStats();
+
+    EXPECT_EQ(before.transactions + 10, after.transactions);
+    EXPECT_GE(after.threads, 1U);
+    EXPECT_GE(after.maxBusyThreads, 1U);
+}
+
+TEST_F(ProcessStateTest, ThreadPoolStats_CountSaturations) {
+    makeConcurrentCalls(4);
+    const ProcessState::ThreadPoolStats stats = getStats();
+
+    EXPECT_GE(stats.threads, 4U);
+    EXPECT_GE(stats.maxBusyThreads, 4U);
+    EXPECT_GE(stats.saturations, 1U)
+            << "all the threads were busy until the last call arrived";
+}
+
+TEST_F(ProcessStateTest, DynamicPolicy_ClampsMaxThreads) {
+    ProcessState::ThreadPoolPolicy policy;
+    memset(&policy, 0, sizeof(policy));
+    policy.dynamic = true;
+    policy.minThreads = 1;
+    policy.maxThreads = 4;
+    policy.growAfter = 10 * MILLIS;
+    policy.idleTimeout = TIMEOUT;
+    ProcessState::self()->setThreadPoolPolicy(policy);
+
+    ASSERT_EQ(NO_ERROR, ProcessState::self()->setThreadPoolMaxThreadCount(100));
+    const ProcessState::ThreadPoolStats stats = getStats();
+    EXPECT_EQ(policy.maxThreads + stats.retired, stats.maxThreads);
+}
+
+TEST_F(ProcessStateTest, DynamicPolicy_RetiresIdleThreads) {
+    const uint32_t retired = getStats().retired;
+    ProcessState::ThreadPoolPolicy policy;
+    memset(&policy, 0, sizeof(policy));
+    policy.dynamic = true;
+    policy.minThreads = 2;
+    policy.maxThreads = 8;
+    policy.growAfter = TIMEOUT;
+    policy.idleTimeout = 20 * MILLIS;
+    ProcessState::self()->setThreadPoolPolicy(policy);
+
+    // the threads already waiting for work only see the policy after this
+    makeConcurrentCalls(6);
+
+    EXPECT_TRUE(waitForThreads(policy.minThreads))
+            << "the idle threads should have left the pool, down to minThreads";
+    const ProcessState::ThreadPoolStats stats = getStats();
+    EXPECT_LE(retired + 4, stats.retired);
+    EXPECT_LE(stats.maxThreads, policy.maxThreads + stats.retired);
+
+    // the pool still works, and can grow again
+    makeConcurrentCalls(3);
+    EXPECT_GE(getStats().maxBusyThreads, 3U);
+}
+
+} // namespace android
@@ -0,0 +1,18 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	appopsbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libbinder_loopback \
+
+LOCAL_MODULE:= test-appopsbenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Reports the cost of AppOpsManager::checkOp() and noteOp() when the mode
+// is cached in the process, against the calls to the app ops service they
+// replace. The service is a fake running in this process behind the
+// loopback driver; it is also the context manager, and gives itself as the
+// app ops service through the driver, so that the calls aren't local.
+//
+// Usage: test-appopsbenchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <binder/AppOpsManager.h>
+#include <binder/IServiceManager.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+namespace android {
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+}
+
+using namespace android;
+
+class FakeAppOpsService : public BnAppOpsService
+{
+public:
+    FakeAppOpsService() : mNotes(0) {
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    int mNotes;
+
+    virtual int32_t checkOperation(int32_t code, int32_t uid, const String16& packageName) {
+        return AppOpsManager::MODE_ALLOWED;
+    }
+
+    virtual int32_t noteOperation(int32_t code, int32_t uid, const String16& packageName) {
+        Mutex::Autolock _l(mLock);
+        mNotes++;
+        mCondition.signal();
+        return AppOpsManager::MODE_ALLOWED;
+    }
+
+    virtual int32_t startOperation(const sp<IBinder>& token, int32_t code, int32_t uid,
+            const String16& packageName) {
+        return AppOpsManager::MODE_ALLOWED;
+    }
+
+    virtual void finishOperation(const sp<IBinder>& token, int32_t code, int32_t uid,
+            const String16& packageName) {
+    }
+
+    virtual void startWatchingMode(int32_t op, const String16& packageName,
+            const sp<IAppOpsCallback>& callback) {
+    }
+
+    virtual void stopWatchingMode(const sp<IAppOpsCallback>& callback) {
+    }
+
+    virtual sp<IBinder> getToken(const sp<IBinder>& clientToken) {
+        return clientToken;
+    }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        // the service manager calls have their own interface token
+        data.readInt32();
+        const bool serviceManagerCall = data.readString16() == IServiceManager::descriptor;
+        data.setDataPosition(0);
+        if (serviceManagerCall) {
+            if (code != IServiceManager::CHECK_SERVICE_TRANSACTION) {
+                return UNKNOWN_TRANSACTION;
+            }
+            return reply->writeStrongBinder(ProcessState::self()->getContextObject(NULL));
+        }
+        return BnAppOpsService::onTransact(code, data, reply, flags);
+    }
+};
+
+static const int32_t OP = 0;
+static const int32_t UID = 10000;
+static const String16 PACKAGE("com.example.benchmark");
+
+static void report(const char* name, nsecs_t elapsed, int iterations) {
+    printf("%-24s %8.2f us per call\n", name, double(elapsed) / iterations / 1000);
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+
+    BinderDriver::setDefault(new LoopbackBinderDriver());
+    sp<ProcessState> proc(ProcessState::self());
+    if (!proc->becomeContextManager(NULL, NULL)) {
+        fprintf(stderr, "can't become the context manager of the loopback driver\n");
+        return 1;
+    }
+    sp<FakeAppOpsService> fake = new FakeAppOpsService();
+    setTheContextObject(fake);
+    proc->startThreadPool();
+    // the modes are only cached once the pool is running
+    while (proc->getThreadPoolThreadCount() == 0) {
+        usleep(1000);
+    }
+
+    sp<IAppOpsService> service = interface_cast<IAppOpsService>(proc->getContextObject(NULL));
+    AppOpsManager appOps;
+    appOps.checkOp(OP, UID, PACKAGE);
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        appOps.checkOp(OP, UID, PACKAGE);
+    }
+    report("checkOp, cached:", systemTime(SYSTEM_TIME_MONOTONIC) - start, iterations);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        service->checkOperation(OP, UID, PACKAGE);
+    }
+    report("checkOperation:", systemTime(SYSTEM_TIME_MONOTONIC) - start, iterations);
+
+    // the one-way notes are counted once the service handled them all
+    {
+        Mutex::Autolock _l(fake->mLock);
+        fake->mNotes = 0;
+    }
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        appOps.noteOp(OP, UID, PACKAGE);
+    }
+    nsecs_t sent = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    {
+        Mutex::Autolock _l(fake->mLock);
+        while (fake->mNotes < iterations) {
+            fake->mCondition.wait(fake->mLock);
+        }
+    }
+    report("noteOp, cached:", sent, iterations);
+    report("noteOp, cached, handled:", systemTime(SYSTEM_TIME_MONOTONIC) - start, iterations);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        service->noteOperation(OP, UID, PACKAGE);
+    }
+    report("noteOperation:", systemTime(SYSTEM_TIME_MONOTONIC) - start, iterations);
+
+    String8 dump;
+    AppOpsManager::dumpCache(dump);
+    printf("%s", dump.string());
+    return 0;
+}
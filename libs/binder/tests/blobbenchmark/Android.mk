@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	blobbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libutils \
+
+LOCAL_MODULE:= test-blobbenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
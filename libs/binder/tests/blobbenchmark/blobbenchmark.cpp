@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the cost of sending a blob through a parcel: writing it with
+// writeBlob() or writePooledBlob(), filling it and reading it back with
+// readBlob(), as the sender and the receiver of a transaction would. For
+// each size, prints the time, the page faults and the ashmem regions
+// created per blob. Creating a region takes 8 syscalls on the sending side:
+// open and 2 ioctls to create it, 2 protection ioctls, mmap, munmap and
+// close.
+//
+// Usage: test-blobbenchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <binder/Binder.h>
+#include <binder/Parcel.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static long getPageFaults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+// as in Parcel.cpp
+static const size_t IN_PLACE_BLOB_LIMIT = 40 * 1024;
+
+static uint32_t gSum;
+
+static size_t getCreatedRegions() {
+    size_t created, reused;
+    Parcel::getBlobPoolStats(&created, &reused);
+    return created;
+}
+
+static void measure(size_t size, int iterations, const sp<IBinder>& pooledTarget) {
+    long faults = getPageFaults();
+    size_t regions = getCreatedRegions();
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        Parcel parcel;
+        Parcel::WritableBlob writableBlob;
+        status_t status = pooledTarget != NULL
+                ? parcel.writePooledBlob(size, pooledTarget, &writableBlob)
+                : parcel.writeBlob(size, &writableBlob);
+        if (status) {
+            fprintf(stderr, "writeBlob(%d) failed.\n", int(size));
+            exit(1);
+        }
+        memset(writableBlob.data(), i, size);
+        writableBlob.release();
+
+        parcel.setDataPosition(0);
+        Parcel::ReadableBlob readableBlob;
+        if (parcel.readBlob(size, &readableBlob)) {
+            fprintf(stderr, "readBlob(%d) failed.\n", int(size));
+            exit(1);
+        }
+        const uint8_t* data = static_cast<const uint8_t*>(readableBlob.data());
+        for (size_t j = 0; j < size; j += 4096) {
+            gSum += data[j];
+        }
+        readableBlob.release();
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    faults = getPageFaults() - faults;
+    if (pooledTarget != NULL) {
+        regions = getCreatedRegions() - regions;
+    } else {
+        // each blob too large to be written in place gets a new region
+        regions = size > IN_PLACE_BLOB_LIMIT ? iterations : 0;
+    }
+    printf("%8d bytes%s: %9.1f us, %7.1f page faults, %5.2f regions created per blob\n",
+            int(size), pooledTarget != NULL ? " pooled" : "       ",
+            double(elapsed) / 1000 / iterations, double(faults) / iterations,
+            double(regions) / iterations);
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    sp<IBinder> target = new BBinder();
+    const size_t sizes[] = { 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const int n = sizes[i] >= 1024 * 1024 ? iterations / 4 : iterations;
+        measure(sizes[i], n, NULL);
+        measure(sizes[i], n, target);
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	loopbackbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libbinder_loopback \
+
+LOCAL_MODULE:= test-loopbackbenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the cost of a binder call through the userspace loopback driver,
+// from a client thread of this process to its own thread pool: synchronous
+// calls with an empty and a 1KB reply, and one-way calls, on their own and
+// in batches. For the one-way calls it also reports how many
+// BINDER_WRITE_READ ioctls the calling thread made per call. It measures
+// libbinder and the driver protocol, not the kernel driver.
+//
+// Usage: test-loopbackbenchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <binder/Binder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <cutils/atomic.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+#include <private/binder/binder_module.h>
+
+namespace android {
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+}
+
+using namespace android;
+
+static const int ONEWAY_BATCH_SIZE = 16;
+
+// Counts the BINDER_WRITE_READ ioctls of one thread.
+class CountingBinderDriver : public LoopbackBinderDriver
+{
+public:
+    CountingBinderDriver() : mThread(0), mCount(0) {
+    }
+
+    void startCounting() {
+        android_atomic_release_store(0, &mCount);
+        android_atomic_release_store(gettid(), &mThread);
+    }
+
+    int32_t stopCounting() {
+        android_atomic_release_store(0, &mThread);
+        return android_atomic_acquire_load(&mCount);
+    }
+
+    virtual status_t ioctl(int fd, unsigned long request, void* arg) {
+        if (request == BINDER_WRITE_READ
+                && android_atomic_acquire_load(&mThread) == gettid()) {
+            android_atomic_inc(&mCount);
+        }
+        return LoopbackBinderDriver::ioctl(fd, request, arg);
+    }
+
+private:
+    volatile int32_t mThread;   // the counted thread, 0 for none
+    volatile int32_t mCount;
+};
+
+enum {
+    PING = IBinder::FIRST_CALL_TRANSACTION,
+    FILL,
+    COUNT,
+};
+
+class BenchmarkService : public BBinder
+{
+public:
+    BenchmarkService() : mCount(0) {
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    int mCount;
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case PING:
+                return NO_ERROR;
+            case FILL: {
+                const int32_t size = data.readInt32();
+                for (int32_t i = 0; i < size / int32_t(sizeof(int32_t)); i++) {
+                    reply->writeInt32(i);
+                }
+                return NO_ERROR;
+            }
+            case COUNT: {
+                Mutex::Autolock _l(mLock);
+                mCount++;
+                mCondition.signal();
+                return NO_ERROR;
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+};
+
+static void measureCalls(const char* name, const sp<IBinder>& service, uint32_t code,
+        int32_t size, int iterations) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        Parcel data, reply;
+        data.writeInt32(size);
+        service->transact(code, data, &reply);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-18s %8.1f us per call\n", name, double(elapsed) / iterations / 1000);
+}
+
+// With a batchSize, the calls are made between beginOnewayBatch() and
+// endOnewayBatch(), that many at a time.
+static void measureOnewayCalls(const char* name, const sp<IBinder>& service,
+        const sp<BenchmarkService>& local, const sp<CountingBinderDriver>& driver,
+        int batchSize, int iterations) {
+    {
+        Mutex::Autolock _l(local->mLock);
+        local->mCount = 0;
+    }
+    IPCThreadState* self = IPCThreadState::self();
+    driver->startCounting();
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        if (batchSize && i % batchSize == 0) {
+            self->beginOnewayBatch();
+        }
+        Parcel data;
+        service->transact(COUNT, data, NULL, IBinder::FLAG_ONEWAY);
+        if (batchSize && (i % batchSize == batchSize - 1 || i == iterations - 1)) {
+            self->endOnewayBatch();
+        }
+    }
+    nsecs_t sent = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    const int32_t ioctls = driver->stopCounting();
+    {
+        Mutex::Autolock _l(local->mLock);
+        while (local->mCount < iterations) {
+            local->mCondition.wait(local->mLock);
+        }
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-18s %8.1f us per call sent, %8.1f us per call handled, "
+            "%.3f ioctls per call\n", name, double(sent) / iterations / 1000,
+            double(elapsed) / iterations / 1000, double(ioctls) / iterations);
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+
+    sp<CountingBinderDriver> driver = new CountingBinderDriver();
+    BinderDriver::setDefault(driver);
+    sp<ProcessState> proc(ProcessState::self());
+    if (!proc->becomeContextManager(NULL, NULL)) {
+        fprintf(stderr, "can't become the context manager of the loopback driver\n");
+        return 1;
+    }
+    sp<BenchmarkService> local = new BenchmarkService();
+    setTheContextObject(local);
+    proc->startThreadPool();
+
+    sp<IBinder> service = proc->getContextObject(NULL);
+    measureCalls("empty reply:", service, PING, 0, iterations);
+    measureCalls("1KB reply:", service, FILL, 1024, iterations);
+    measureOnewayCalls("one-way:", service, local, driver, 0, iterations);
+    measureOnewayCalls("one-way batched:", service, local, driver,
+            ONEWAY_BATCH_SIZE, iterations);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays the same random trace of allocations and deallocations on a 1MB
+// MemoryDealer with each policy, and reports the time per allocate() and per
+// release, the failed allocations and the dealer's own statistics. The trace
+// mixes small buffers (up to 2KB) with a quarter of larger ones (up to 32KB)
+// and keeps about kLiveTarget of them alive. A release includes the madvise() that
+// gives the freed pages back, which is the same for both policies.
+//
+// Usage: test-memorydealerbenchmark [operations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryDealer.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+static const size_t kHeapSize = 1024 * 1024;
+// about 5KB each on average, so that the heap is mostly used
+static const size_t kLiveTarget = 160;
+
+// the same trace for every policy, whatever the libc
+static uint32_t nextRandom(uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static void measure(const char* name, MemoryDealer::Policy policy, int operations) {
+    sp<MemoryDealer> dealer = new MemoryDealer(kHeapSize, name, policy);
+    Vector<sp<IMemory> > live;
+    uint32_t seed = 1;
+    int failures = 0;
+
+    nsecs_t allocateTime = 0;
+    nsecs_t releaseTime = 0;
+    int allocations = 0;
+    int releases = 0;
+    for (int i = 0; i < operations; i++) {
+        // allocate three times out of four below the target, once above
+        const bool allocate = (live.size() < kLiveTarget) == (nextRandom(&seed) % 4 != 0);
+        if (live.isEmpty() || allocate) {
+            const size_t size = (nextRandom(&seed) % 4 == 0) ?
+                    1 + nextRandom(&seed) % 32768 : 1 + nextRandom(&seed) % 2048;
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            sp<IMemory> memory = dealer->allocate(size);
+            allocateTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            allocations++;
+            if (memory == NULL) {
+                failures++;
+            } else {
+                live.add(memory);
+            }
+        } else {
+            const size_t index = nextRandom(&seed) % live.size();
+            sp<IMemory> memory = live[index];
+            live.editItemAt(index) = live.top();
+            live.pop();
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            memory.clear();
+            releaseTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            releases++;
+        }
+    }
+
+    String8 result;
+    dealer->dump(result, name);
+    printf("%-16s %8.1f ns per allocate(), %8.1f ns per release, "
+            "%d failed allocations\n%s\n", name,
+            double(allocateTime) / allocations, double(releaseTime) / releases,
+            failures, result.string());
+}
+
+int main(int argc, char** argv) {
+    const int operations = argc > 1 ? atoi(argv[1]) : 400000;
+    measure("best fit:", MemoryDealer::BEST_FIT, operations);
+    measure("segregated fit:", MemoryDealer::SEGREGATED_FIT, operations);
+    return 0;
+}
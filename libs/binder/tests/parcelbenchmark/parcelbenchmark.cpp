@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports how long it takes to build a parcel and read it back, the way
+// IPCThreadState does for the data and reply of every transaction: a new
+// Parcel each time, for a typical small transaction (interface token and
+// three arguments) and for 1KB and 8KB of data.
+//
+// Usage: test-parcelbenchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <binder/Parcel.h>
+#include <utils/String16.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const String16 kDescriptor("android.os.IBenchmark");
+
+static void writeSmallTransaction(Parcel* parcel) {
+    // what writeInterfaceToken() writes, without going through IPCThreadState
+    parcel->writeInt32(0);
+    parcel->writeString16(kDescriptor);
+    parcel->writeInt32(1);
+    parcel->writeInt32(2);
+    parcel->writeInt32(3);
+}
+
+static void writeData(Parcel* parcel, size_t size) {
+    for (size_t i = 0; i < size / sizeof(int32_t); i++) {
+        parcel->writeInt32(i);
+    }
+}
+
+static int32_t readData(const Parcel& parcel) {
+    int32_t sum = 0;
+    parcel.setDataPosition(0);
+    while (parcel.dataAvail() >= sizeof(int32_t)) {
+        sum += parcel.readInt32();
+    }
+    return sum;
+}
+
+static int32_t gSum;
+
+static void measure(const char* name, size_t size, int iterations) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        Parcel parcel;
+        if (size) {
+            writeData(&parcel, size);
+        } else {
+            writeSmallTransaction(&parcel);
+        }
+        gSum += readData(parcel);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-18s %8.1f ns per parcel\n", name, double(elapsed) / iterations);
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    measure("small transaction:", 0, iterations);
+    measure("1KB:", 1024, iterations);
+    measure("8KB:", 8192, iterations / 8);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports how long a cached PermissionCache check takes when 1 to 16
+// threads check the same permission of the same uid at once, the way the
+// binder threads of a service do: by id, and by name, which interns the name
+// on each check. The first check goes to the permission controller, all the
+// others are answered by the cache.
+//
+// Usage: test-permissioncachebenchmark [checks per thread]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <binder/PermissionCache.h>
+#include <private/android_filesystem_config.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const String16 kPermission("android.permission.ACCESS_SURFACE_FLINGER");
+// a caller that isn't this process nor root, which are never checked
+static const pid_t kPid = 1;
+static const uid_t kUid = AID_SYSTEM;
+
+static int gChecks;
+static int32_t gPermissionId;
+static bool gById;
+
+static void* checkPermissions(void*) {
+    if (gById) {
+        for (int i = 0; i < gChecks; i++) {
+            PermissionCache::checkPermission(gPermissionId, kPid, kUid);
+        }
+    } else {
+        for (int i = 0; i < gChecks; i++) {
+            PermissionCache::checkPermission(kPermission, kPid, kUid);
+        }
+    }
+    return NULL;
+}
+
+static void measure(const char* name, bool byId, int threadCount) {
+    gById = byId;
+    pthread_t threads[threadCount];
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < threadCount; i++) {
+        pthread_create(&threads[i], NULL, checkPermissions, NULL);
+    }
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-8s %2d threads: %8.1f ns per check\n", name, threadCount,
+            double(elapsed) / (gChecks * threadCount));
+}
+
+int main(int argc, char** argv) {
+    gChecks = argc > 1 ? atoi(argv[1]) : 200000;
+    gPermissionId = PermissionCache::getPermissionId(kPermission);
+
+    // the one check that isn't cached
+    const bool granted = PermissionCache::checkPermission(gPermissionId, kPid, kUid);
+    printf("%s is %s for uid %d\n", String8(kPermission).string(),
+            granted ? "granted" : "denied", kUid);
+
+    for (int threadCount = 1; threadCount <= 16; threadCount *= 2) {
+        measure("by id:", true, threadCount);
+        measure("by name:", false, threadCount);
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Reports what the service cache and the wait notifications of
+// IServiceManager save, against a fake servicemanager running in this
+// process behind the loopback driver:
+// - the cost of checkService() for a registered service, from the cache and
+//   with a round trip to the service manager as before;
+// - how long getService() takes to return a service registered 100ms after
+//   it was called, when notified and when polling an older service manager,
+//   the delay a process starting before its dependencies sees at boot.
+//
+// Usage: test-servicemanagerbenchmark [iterations] [waits]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <binder/Binder.h>
+#include <binder/IServiceManager.h>
+#include <binder/LoopbackBinderDriver.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+namespace android {
+// defined in IPCThreadState.cpp
+extern void setTheContextObject(sp<BBinder> obj);
+}
+
+using namespace android;
+
+static const nsecs_t MILLIS = 1000000;
+
+class FakeServiceManager : public BBinder
+{
+public:
+    FakeServiceManager() : mSupportsWait(true) {
+    }
+
+    Mutex mLock;
+    bool mSupportsWait;
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+            uint32_t flags) {
+        switch (code) {
+            case IServiceManager::CHECK_SERVICE_TRANSACTION: {
+                data.enforceInterface(IServiceManager::descriptor);
+                Mutex::Autolock _l(mLock);
+                return reply->writeStrongBinder(mServices.valueFor(data.readString16()));
+            }
+            case IServiceManager::ADD_SERVICE_TRANSACTION: {
+                data.enforceInterface(IServiceManager::descriptor);
+                String16 name = data.readString16();
+                sp<IBinder> service = data.readStrongBinder();
+                sp<IBinder> waiter;
+                {
+                    Mutex::Autolock _l(mLock);
+                    mServices.add(name, service);
+                    waiter = mWaiters.valueFor(name);
+                    mWaiters.removeItem(name);
+                }
+                if (waiter != NULL) {
+                    Parcel notification;
+                    notification.writeString16(name);
+                    waiter->transact(IBinder::FIRST_CALL_TRANSACTION, notification,
+                            NULL, IBinder::FLAG_ONEWAY);
+                }
+                return reply->writeInt32(0);
+            }
+            case IServiceManager::WAIT_FOR_SERVICE_TRANSACTION: {
+                data.enforceInterface(IServiceManager::descriptor);
+                Mutex::Autolock _l(mLock);
+                if (!mSupportsWait) {
+                    break;
+                }
+                String16 name = data.readString16();
+                sp<IBinder> service = mServices.valueFor(name);
+                if (service == NULL) {
+                    mWaiters.add(name, data.readStrongBinder());
+                }
+                return reply->writeStrongBinder(service);
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+
+private:
+    DefaultKeyedVector<String16, sp<IBinder> > mServices;
+    DefaultKeyedVector<String16, sp<IBinder> > mWaiters;
+};
+
+static sp<IServiceManager> getServiceManager() {
+    return interface_cast<IServiceManager>(ProcessState::self()->getContextObject(NULL));
+}
+
+static void measureCachedChecks(const String16& name, int iterations) {
+    sp<IServiceManager> sm = getServiceManager();
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        sm->checkService(name);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-26s %8.2f us per call\n", "checkService, cached:",
+            double(elapsed) / iterations / 1000);
+}
+
+static void measureUncachedChecks(const String16& name, int iterations) {
+    sp<IBinder> binder = ProcessState::self()->getContextObject(NULL);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IServiceManager::descriptor);
+        data.writeString16(name);
+        binder->transact(IServiceManager::CHECK_SERVICE_TRANSACTION, data, &reply);
+        reply.readStrongBinder();
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-26s %8.2f us per call\n", "checkService, round trip:",
+            double(elapsed) / iterations / 1000);
+}
+
+struct DelayedAdd {
+    String16 name;
+    nsecs_t delay;
+};
+
+static void* addServiceAfterDelay(void* arg) {
+    DelayedAdd* add = static_cast<DelayedAdd*>(arg);
+    usleep(add->delay / 1000);
+    getServiceManager()->addService(add->name, new BBinder());
+    return NULL;
+}
+
+static void measureWaits(const char* label, const sp<FakeServiceManager>& fake,
+        bool supportsWait, int waits) {
+    {
+        Mutex::Autolock _l(fake->mLock);
+        fake->mSupportsWait = supportsWait;
+    }
+    nsecs_t total = 0, max = 0;
+    for (int i = 0; i < waits; i++) {
+        DelayedAdd add;
+        add.name = String16(String8::format("%s.%d", label, i));
+        add.delay = 100 * MILLIS;
+        pthread_t thread;
+        pthread_create(&thread, NULL, addServiceAfterDelay, &add);
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        getServiceManager()->getService(add.name);
+        nsecs_t late = systemTime(SYSTEM_TIME_MONOTONIC) - start - add.delay;
+        pthread_join(thread, NULL);
+        total += late;
+        if (max < late) {
+            max = late;
+        }
+    }
+    printf("getService, %-14s %8.2f ms late on average, %8.2f ms at most\n", label,
+            double(total) / waits / MILLIS, double(max) / MILLIS);
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+    const int waits = argc > 2 ? atoi(argv[2]) : 5;
+
+    BinderDriver::setDefault(new LoopbackBinderDriver());
+    sp<ProcessState> proc(ProcessState::self());
+    if (!proc->becomeContextManager(NULL, NULL)) {
+        fprintf(stderr, "can't become the context manager of the loopback driver\n");
+        return 1;
+    }
+    sp<FakeServiceManager> fake = new FakeServiceManager();
+    setTheContextObject(fake);
+    proc->startThreadPool();
+
+    const String16 name("benchmark");
+    getServiceManager()->addService(name, new BBinder());
+    measureCachedChecks(name, iterations);
+    measureUncachedChecks(name, iterations);
+    measureWaits("notified:", fake, true, waits);
+    measureWaits("polling:", fake, false, waits);
+    return 0;
+}
@@ -28,6 +28,7 @@ LOCAL_SRC_FILES:= \
 	SurfaceControl.cpp \
 	SurfaceComposerClient.cpp \
 	SyncFeatures.cpp \
+	YuvToRgb.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
 	libbinder \
@@ -22,6 +22,8 @@
 #include <utils/Log.h>
 #include <gui/CpuConsumer.h>
 
+#include <private/gui/YuvToRgb.h>
+
 #define CC_LOGV(x, ...) ALOGV("[%s] "x, mName.string(), ##__VA_ARGS__)
 #define CC_LOGD(x, ...) ALOGD("[%s] "x, mName.string(), ##__VA_ARGS__)
 #define CC_LOGI(x, ...) ALOGI("[%s] "x, mName.string(), ##__VA_ARGS__)
@@ -187,6 +189,75 @@ status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
     return releaseAcquiredBufferLocked(lockedIdx);
 }
 
+status_t CpuConsumer::convertLockedBuffer(const LockedBuffer& src,
+        PixelFormat dstFormat, uint32_t downscale,
+        void* dst, uint32_t dstStride) {
+    if (src.data == NULL || dst == NULL) return BAD_VALUE;
+    if (downscale != 1 && downscale != 2 && downscale != 4) return BAD_VALUE;
+
+    YuvPlanes planes;
+    planes.y = src.data;
+    planes.yStride = src.stride;
+    switch (src.format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_888:
+            planes.cb = src.dataCb;
+            planes.cr = src.dataCr;
+            planes.cStride = src.chromaStride;
+            planes.chromaStep = src.chromaStep;
+            break;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            // NV21: interleaved V/U plane right after the Y plane
+            planes.cr = src.data + src.stride * src.height;
+            planes.cb = planes.cr + 1;
+            planes.cStride = src.stride;
+            planes.chromaStep = 2;
+            break;
+        case HAL_PIXEL_FORMAT_YV12:
+            // YV12: V plane then U plane, with 16-byte aligned strides
+            planes.cStride = ((src.stride / 2) + 15) & ~15;
+            planes.cr = src.data + src.stride * src.height;
+            planes.cb = planes.cr + planes.cStride * (src.height / 2);
+            planes.chromaStep = 1;
+            break;
+        default:
+            return BAD_VALUE;
+    }
+    if (planes.cb == NULL || planes.cr == NULL) return BAD_VALUE;
+
+    // The kernels pair each 2x2 block of luma with one chroma sample, so the
+    // crop has to start on an even pixel. Widening it instead would write
+    // past the width the caller sized dst for.
+    Rect crop(src.crop);
+    if (crop.isEmpty()) {
+        crop = Rect(src.width, src.height);
+    }
+    if ((crop.left | crop.top) & 1) return BAD_VALUE;
+    const uint32_t left = crop.left;
+    const uint32_t top = crop.top;
+    const uint32_t width = crop.getWidth();
+    const uint32_t height = crop.getHeight();
+    planes.y += top * planes.yStride + left;
+    const size_t chromaOffset = (top / 2) * planes.cStride +
+            (left / 2) * planes.chromaStep;
+    planes.cb += chromaOffset;
+    planes.cr += chromaOffset;
+
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    switch (dstFormat) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+            convertYuvToRgba8888(planes, width, height, out, dstStride * 4,
+                    downscale);
+            break;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            convertYuvToRgb565(planes, width, height, out, dstStride * 2,
+                    downscale);
+            break;
+        default:
+            return BAD_VALUE;
+    }
+    return OK;
+}
+
 status_t CpuConsumer::releaseAcquiredBufferLocked(int lockedIdx) {
     status_t err;
 
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <private/gui/YuvToRgb.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// Conversion coefficients for full-range BT.601, scaled by 2^6 so that all
+// the intermediate values fit in 16 bits (which lets NEON process 8 of them
+// at a time). The scalar and NEON paths produce identical results.
+enum {
+    COEF_SHIFT = 6,
+    COEF_RV = 90,   // 1.402
+    COEF_GU = 22,   // 0.344
+    COEF_GV = 46,   // 0.714
+    COEF_BU = 113,  // 1.772
+};
+
+static inline uint8_t clampToU8(int v) {
+    v = (v + (1 << (COEF_SHIFT - 1))) >> COEF_SHIFT;
+    return v < 0 ? 0 : (v > 255 ? 255 : uint8_t(v));
+}
+
+struct Rgba8888Writer {
+    enum { BYTES_PER_PIXEL = 4 };
+    static inline void write(uint8_t* p, uint8_t r, uint8_t g, uint8_t b) {
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+        p[3] = 0xFF;
+    }
+};
+
+struct Rgb565Writer {
+    enum { BYTES_PER_PIXEL = 2 };
+    static inline void write(uint8_t* p, uint8_t r, uint8_t g, uint8_t b) {
+        *reinterpret_cast<uint16_t*>(p) =
+                uint16_t(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+    }
+};
+
+template <typename Writer>
+static inline void writePixel(uint8_t* p, int y, int u, int v) {
+    const int yy = y << COEF_SHIFT;
+    u -= 128;
+    v -= 128;
+    Writer::write(p,
+            clampToU8(yy + COEF_RV * v),
+            clampToU8(yy - COEF_GU * u - COEF_GV * v),
+            clampToU8(yy + COEF_BU * u));
+}
+
+// converts pixels [start, width) of one row at full resolution
+template <typename Writer>
+static void convertRow(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+        size_t chromaStep, uint8_t* dst, uint32_t start, uint32_t width) {
+    for (uint32_t i = start; i < width; i++) {
+        const size_t c = (i >> 1) * chromaStep;
+        writePixel<Writer>(dst + i * Writer::BYTES_PER_PIXEL, y[i], cb[c], cr[c]);
+    }
+}
+
+#if defined(__ARM_NEON__)
+// Converts the first (width & ~15) pixels of a row to RGBA8888, 16 pixels
+// (8 chroma samples) per iteration. Returns the number of pixels converted.
+static uint32_t convertRowRgba8888Neon(const uint8_t* y, const uint8_t* cb,
+        const uint8_t* cr, size_t chromaStep, uint8_t* dst, uint32_t width) {
+    if (chromaStep != 1 && !(chromaStep == 2 && (cr - cb == 1 || cb - cr == 1))) {
+        return 0;
+    }
+    const uint32_t count = width & ~15u;
+    const int16x8_t bias = vdupq_n_s16(128);
+    const uint8x16_t alpha = vdupq_n_u8(0xFF);
+    for (uint32_t i = 0; i < count; i += 16) {
+        uint8x8_t u8, v8;
+        if (chromaStep == 2) {
+            // semi-planar: pixel i uses the chroma pair at byte offset i
+            if (cb < cr) {
+                uint8x8x2_t c = vld2_u8(cb + i);
+                u8 = c.val[0];
+                v8 = c.val[1];
+            } else {
+                uint8x8x2_t c = vld2_u8(cr + i);
+                v8 = c.val[0];
+                u8 = c.val[1];
+            }
+        } else {
+            u8 = vld1_u8(cb + (i >> 1));
+            v8 = vld1_u8(cr + (i >> 1));
+        }
+        const int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), bias);
+        const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), bias);
+
+        // per chroma sample contributions, duplicated for the 2 pixels
+        // sharing it
+        const int16x8_t dr = vmulq_n_s16(v, COEF_RV);
+        const int16x8_t dg = vmlsq_n_s16(vmulq_n_s16(u, -COEF_GU), v, COEF_GV);
+        const int16x8_t db = vmulq_n_s16(u, COEF_BU);
+        const int16x8x2_t r2 = vzipq_s16(dr, dr);
+        const int16x8x2_t g2 = vzipq_s16(dg, dg);
+        const int16x8x2_t b2 = vzipq_s16(db, db);
+
+        const uint8x16_t yv = vld1q_u8(y + i);
+        const int16x8_t ylo = vreinterpretq_s16_u16(
+                vshll_n_u8(vget_low_u8(yv), COEF_SHIFT));
+        const int16x8_t yhi = vreinterpretq_s16_u16(
+                vshll_n_u8(vget_high_u8(yv), COEF_SHIFT));
+
+        uint8x16x4_t out;
+        out.val[0] = vcombine_u8(
+                vqrshrun_n_s16(vaddq_s16(ylo, r2.val[0]), COEF_SHIFT),
+                vqrshrun_n_s16(vaddq_s16(yhi, r2.val[1]), COEF_SHIFT));
+        out.val[1] = vcombine_u8(
+                vqrshrun_n_s16(vaddq_s16(ylo, g2.val[0]), COEF_SHIFT),
+                vqrshrun_n_s16(vaddq_s16(yhi, g2.val[1]), COEF_SHIFT));
+        out.val[2] = vcombine_u8(
+                vqrshrun_n_s16(vaddq_s16(ylo, b2.val[0]), COEF_SHIFT),
+                vqrshrun_n_s16(vaddq_s16(yhi, b2.val[1]), COEF_SHIFT));
+        out.val[3] = alpha;
+        vst4q_u8(dst + i * 4, out);
+    }
+    return count;
+}
+#endif
+
+template <typename Writer>
+static inline uint32_t convertRowFast(const uint8_t*, const uint8_t*,
+        const uint8_t*, size_t, uint8_t*, uint32_t) {
+    return 0;
+}
+
+#if defined(__ARM_NEON__)
+template <>
+inline uint32_t convertRowFast<Rgba8888Writer>(const uint8_t* y,
+        const uint8_t* cb, const uint8_t* cr, size_t chromaStep,
+        uint8_t* dst, uint32_t width) {
+    return convertRowRgba8888Neon(y, cb, cr, chromaStep, dst, width);
+}
+#endif
+
+template <typename Writer>
+static void convertFull(const YuvPlanes& src, uint32_t width,
+        uint32_t height, uint8_t* dst, size_t dstStride) {
+    for (uint32_t j = 0; j < height; j++) {
+        const uint8_t* y = src.y + j * src.yStride;
+        const size_t c = (j >> 1) * src.cStride;
+        const uint8_t* cb = src.cb + c;
+        const uint8_t* cr = src.cr + c;
+        uint8_t* d = dst + j * dstStride;
+        uint32_t done = convertRowFast<Writer>(y, cb, cr, src.chromaStep,
+                d, width);
+        convertRow<Writer>(y, cb, cr, src.chromaStep, d, done, width);
+    }
+}
+
+// Box-filtered downscale by 2 or 4: each output pixel averages a
+// downscale x downscale block of luma and the (downscale/2)^2 chroma
+// samples covering it.
+template <typename Writer>
+static void convertScaled(const YuvPlanes& src, uint32_t width,
+        uint32_t height, uint8_t* dst, size_t dstStride, uint32_t downscale) {
+    const uint32_t outWidth = width / downscale;
+    const uint32_t outHeight = height / downscale;
+    const uint32_t cScale = downscale >> 1;
+    const uint32_t ySamples = downscale * downscale;
+    const uint32_t cSamples = cScale * cScale;
+    for (uint32_t oj = 0; oj < outHeight; oj++) {
+        const uint8_t* yRow = src.y + oj * downscale * src.yStride;
+        const size_t cRow = oj * cScale * src.cStride;
+        uint8_t* d = dst + oj * dstStride;
+        for (uint32_t oi = 0; oi < outWidth; oi++) {
+            uint32_t ySum = 0;
+            const uint8_t* yb = yRow + oi * downscale;
+            for (uint32_t bj = 0; bj < downscale; bj++) {
+                for (uint32_t bi = 0; bi < downscale; bi++) {
+                    ySum += yb[bi];
+                }
+                yb += src.yStride;
+            }
+            uint32_t uSum = 0, vSum = 0;
+            size_t c = cRow + oi * cScale * src.chromaStep;
+            for (uint32_t bj = 0; bj < cScale; bj++) {
+                for (uint32_t bi = 0; bi < cScale; bi++) {
+                    uSum += src.cb[c + bi * src.chromaStep];
+                    vSum += src.cr[c + bi * src.chromaStep];
+                }
+                c += src.cStride;
+            }
+            writePixel<Writer>(d + oi * Writer::BYTES_PER_PIXEL,
+                    (ySum + ySamples / 2) / ySamples,
+                    (uSum + cSamples / 2) / cSamples,
+                    (vSum + cSamples / 2) / cSamples);
+        }
+    }
+}
+
+template <typename Writer>
+static void convert(const YuvPlanes& src, uint32_t width, uint32_t height,
+        uint8_t* dst, size_t dstStride, uint32_t downscale) {
+    if (downscale <= 1) {
+        convertFull<Writer>(src, width, height, dst, dstStride);
+    } else {
+        convertScaled<Writer>(src, width, height, dst, dstStride, downscale);
+    }
+}
+
+void convertYuvToRgba8888(const YuvPlanes& src, uint32_t width,
+        uint32_t height, uint8_t* dst, size_t dstStride, uint32_t downscale) {
+    convert<Rgba8888Writer>(src, width, height, dst, dstStride, downscale);
+}
+
+void convertYuvToRgb565(const YuvPlanes& src, uint32_t width,
+        uint32_t height, uint8_t* dst, size_t dstStride, uint32_t downscale) {
+    convert<Rgb565Writer>(src, width, height, dst, dstStride, downscale);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CpuConsumerConvert_test"
+//#define LOG_NDEBUG 0
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+#include <gui/CpuConsumer.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class CpuConsumerConvertTest : public ::testing::Test {
+protected:
+    // Builds the same random image as NV21 and YV12 buffers.
+    void makeImage(uint32_t w, uint32_t h) {
+        mWidth = w;
+        mHeight = h;
+        mYv12CStride = ((w / 2) + 15) & ~15;
+        mNv21.insertAt(0, w * h * 3 / 2);
+        mYv12.insertAt(0, w * h + mYv12CStride * h);
+        srand(1234);
+        for (uint32_t i = 0; i < w * h; i++) {
+            mNv21.editItemAt(i) = mYv12.editItemAt(i) = uint8_t(rand());
+        }
+        uint8_t* vu = mNv21.editArray() + w * h;
+        uint8_t* v = mYv12.editArray() + w * h;
+        uint8_t* u = v + mYv12CStride * (h / 2);
+        for (uint32_t j = 0; j < h / 2; j++) {
+            for (uint32_t i = 0; i < w / 2; i++) {
+                uint8_t cr = uint8_t(rand()), cb = uint8_t(rand());
+                vu[j * w + i * 2] = cr;
+                vu[j * w + i * 2 + 1] = cb;
+                v[j * mYv12CStride + i] = cr;
+                u[j * mYv12CStride + i] = cb;
+            }
+        }
+    }
+
+    CpuConsumer::LockedBuffer lockedBuffer(Vector<uint8_t>& data,
+            PixelFormat format) {
+        CpuConsumer::LockedBuffer b = CpuConsumer::LockedBuffer();
+        b.data = data.editArray();
+        b.width = mWidth;
+        b.height = mHeight;
+        b.stride = mWidth;
+        b.format = format;
+        b.crop = Rect(mWidth, mHeight);
+        return b;
+    }
+
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mYv12CStride;
+    Vector<uint8_t> mNv21;
+    Vector<uint8_t> mYv12;
+};
+
+TEST_F(CpuConsumerConvertTest, Nv21AndYv12GiveSameResult) {
+    makeImage(96, 48);
+    Vector<uint8_t> a, b;
+    a.insertAt(0, mWidth * mHeight * 4);
+    b.insertAt(0, mWidth * mHeight * 4);
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, a.editArray(), mWidth));
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mYv12, HAL_PIXEL_FORMAT_YV12),
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, b.editArray(), mWidth));
+    EXPECT_EQ(0, memcmp(a.array(), b.array(), a.size()));
+}
+
+TEST_F(CpuConsumerConvertTest, FlexibleMatchesNv21) {
+    makeImage(64, 32);
+    CpuConsumer::LockedBuffer flex(lockedBuffer(mNv21,
+            HAL_PIXEL_FORMAT_YCbCr_420_888));
+    flex.dataCr = mNv21.editArray() + mWidth * mHeight;
+    flex.dataCb = flex.dataCr + 1;
+    flex.chromaStride = mWidth;
+    flex.chromaStep = 2;
+
+    Vector<uint8_t> a, b;
+    a.insertAt(0, mWidth * mHeight * 2);
+    b.insertAt(0, mWidth * mHeight * 2);
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(flex,
+            HAL_PIXEL_FORMAT_RGB_565, 1, a.editArray(), mWidth));
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+            HAL_PIXEL_FORMAT_RGB_565, 1, b.editArray(), mWidth));
+    EXPECT_EQ(0, memcmp(a.array(), b.array(), a.size()));
+}
+
+TEST_F(CpuConsumerConvertTest, GrayStaysGray) {
+    makeImage(32, 16);
+    memset(mNv21.editArray() + mWidth * mHeight, 128, mWidth * mHeight / 2);
+    Vector<uint8_t> out;
+    out.insertAt(0, mWidth * mHeight * 4);
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, out.editArray(), mWidth));
+    for (uint32_t i = 0; i < mWidth * mHeight; i++) {
+        const uint8_t* p = out.array() + i * 4;
+        ASSERT_EQ(mNv21[i], p[0]) << "pixel " << i;
+        ASSERT_EQ(mNv21[i], p[1]) << "pixel " << i;
+        ASSERT_EQ(mNv21[i], p[2]) << "pixel " << i;
+        ASSERT_EQ(0xFF, p[3]) << "pixel " << i;
+    }
+}
+
+TEST_F(CpuConsumerConvertTest, DownscaleAveragesBlocks) {
+    makeImage(32, 16);
+    memset(mNv21.editArray() + mWidth * mHeight, 128, mWidth * mHeight / 2);
+    for (uint32_t j = 0; j < mHeight; j++) {
+        for (uint32_t i = 0; i < mWidth; i++) {
+            // alternate 100 and 200 so each 2x2 or 4x4 block averages to 150
+            mNv21.editItemAt(j * mWidth + i) = ((i + j) & 1) ? 200 : 100;
+        }
+    }
+    for (uint32_t scale = 2; scale <= 4; scale *= 2) {
+        const uint32_t w = mWidth / scale, h = mHeight / scale;
+        Vector<uint8_t> out;
+        out.insertAt(0, w * h * 4);
+        ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(
+                lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+                HAL_PIXEL_FORMAT_RGBA_8888, scale, out.editArray(), w));
+        for (uint32_t i = 0; i < w * h; i++) {
+            ASSERT_EQ(150, out[i * 4]) << "scale " << scale << " pixel " << i;
+        }
+    }
+}
+
+TEST_F(CpuConsumerConvertTest, RejectsUnsupportedArguments) {
+    makeImage(16, 16);
+    uint8_t out[16 * 16 * 4];
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_RGBA_8888),
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, out, 16));
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+            HAL_PIXEL_FORMAT_RGBA_8888, 3, out, 16));
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+            HAL_PIXEL_FORMAT_RGB_888, 1, out, 16));
+}
+
+TEST_F(CpuConsumerConvertTest, CropIsConvertedExactly) {
+    makeImage(32, 16);
+    Vector<uint8_t> full;
+    full.insertAt(0, mWidth * mHeight * 4);
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP),
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, full.editArray(), mWidth));
+
+    // an odd width and height must not widen the output
+    const uint32_t cropWidth = 7, cropHeight = 5, dstStride = cropWidth + 1;
+    CpuConsumer::LockedBuffer b =
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP);
+    b.crop = Rect(4, 2, 4 + cropWidth, 2 + cropHeight);
+    Vector<uint8_t> out;
+    out.insertAt(0xee, 0, dstStride * cropHeight * 4);
+    ASSERT_EQ(OK, CpuConsumer::convertLockedBuffer(b,
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, out.editArray(), dstStride));
+    for (uint32_t j = 0; j < cropHeight; j++) {
+        EXPECT_EQ(0, memcmp(&out[j * dstStride * 4],
+                &full[((j + 2) * mWidth + 4) * 4], cropWidth * 4))
+                << "row " << j;
+        EXPECT_EQ(0xee, out[(j * dstStride + cropWidth) * 4])
+                << "row " << j << " was written past the crop";
+    }
+}
+
+TEST_F(CpuConsumerConvertTest, RejectsOddCropOrigin) {
+    makeImage(16, 16);
+    uint8_t out[16 * 16 * 4];
+    CpuConsumer::LockedBuffer b =
+            lockedBuffer(mNv21, HAL_PIXEL_FORMAT_YCrCb_420_SP);
+    b.crop = Rect(1, 0, 9, 8);
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertLockedBuffer(b,
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, out, 16));
+    b.crop = Rect(0, 3, 8, 11);
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertLockedBuffer(b,
+            HAL_PIXEL_FORMAT_RGBA_8888, 1, out, 16));
+}
+
+} // namespace android
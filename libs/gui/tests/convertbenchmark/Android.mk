@@ -0,0 +1,16 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	convertbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libgui \
+	libui \
+	libutils \
+
+LOCAL_MODULE:= test-convertbenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the per-frame cost of CpuConsumer::convertLockedBuffer() on a 1080p
+// NV21 frame, to compare against the 33ms budget of 30fps.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gui/CpuConsumer.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+int main(int argc, char** argv) {
+    const uint32_t width = 1920, height = 1080;
+    const int frames = argc > 1 ? atoi(argv[1]) : 30;
+
+    Vector<uint8_t> nv21;
+    nv21.insertAt(0, width * height * 3 / 2);
+    srand(1234);
+    for (size_t i = 0; i < nv21.size(); i++) {
+        nv21.editItemAt(i) = uint8_t(rand());
+    }
+
+    CpuConsumer::LockedBuffer src = CpuConsumer::LockedBuffer();
+    src.data = nv21.editArray();
+    src.width = width;
+    src.height = height;
+    src.stride = width;
+    src.format = HAL_PIXEL_FORMAT_YCrCb_420_SP;
+    src.crop = Rect(width, height);
+
+    const PixelFormat formats[] = {
+        HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_RGB_565
+    };
+    const uint32_t scales[] = { 1, 2, 4 };
+    Vector<uint8_t> out;
+    out.insertAt(0, width * height * 4);
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (int i = 0; i < frames; i++) {
+                status_t err = CpuConsumer::convertLockedBuffer(src,
+                        formats[f], scales[s], out.editArray(),
+                        width / scales[s]);
+                if (err != NO_ERROR) {
+                    fprintf(stderr, "conversion failed: %d\n", err);
+                    return 1;
+                }
+            }
+            nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            printf("NV21 1080p -> format %d, 1/%u: %.2f ms/frame\n",
+                    formats[f], scales[s], elapsed / 1000000.0 / frames);
+        }
+    }
+    return 0;
+}
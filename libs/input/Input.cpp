@@ -19,6 +19,13 @@
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 #include <input/Input.h>
 
@@ -28,6 +35,49 @@
 
 namespace android {
 
+/*
+ * 4-wide float operations used to transform and scale the samples of motion events.
+ * PointerCoords values are not aligned, so only unaligned loads and stores are used.
+ */
+
+#if defined(__ARM_NEON__)
+
+typedef float32x4_t simd4f;
+
+static inline simd4f load(const float* p) { return vld1q_f32(p); }
+static inline void store(float* p, simd4f v) { vst1q_f32(p, v); }
+static inline simd4f splat(float f) { return vdupq_n_f32(f); }
+static inline simd4f add(simd4f a, simd4f b) { return vaddq_f32(a, b); }
+static inline simd4f sub(simd4f a, simd4f b) { return vsubq_f32(a, b); }
+static inline simd4f mul(simd4f a, simd4f b) { return vmulq_f32(a, b); }
+// returns v * f, except where v is 0 or f is 1, where v is left alone
+static inline simd4f scale(simd4f v, simd4f f) {
+    uint32x4_t keep = vorrq_u32(vceqq_f32(v, vdupq_n_f32(0)), vceqq_f32(f, vdupq_n_f32(1)));
+    return vbslq_f32(keep, v, vmulq_f32(v, f));
+}
+#define HAS_SIMD 1
+
+#elif defined(__SSE__)
+
+typedef __m128 simd4f;
+
+static inline simd4f load(const float* p) { return _mm_loadu_ps(p); }
+static inline void store(float* p, simd4f v) { _mm_storeu_ps(p, v); }
+static inline simd4f splat(float f) { return _mm_set1_ps(f); }
+static inline simd4f add(simd4f a, simd4f b) { return _mm_add_ps(a, b); }
+static inline simd4f sub(simd4f a, simd4f b) { return _mm_sub_ps(a, b); }
+static inline simd4f mul(simd4f a, simd4f b) { return _mm_mul_ps(a, b); }
+// returns v * f, except where v is 0 or f is 1, where v is left alone
+static inline simd4f scale(simd4f v, simd4f f) {
+    simd4f keep = _mm_or_ps(_mm_cmpeq_ps(v, _mm_setzero_ps()), _mm_cmpeq_ps(f, _mm_set1_ps(1)));
+    return _mm_or_ps(_mm_and_ps(keep, v), _mm_andnot_ps(keep, _mm_mul_ps(v, f)));
+}
+#define HAS_SIMD 1
+
+#else
+#define HAS_SIMD 0
+#endif
+
 // --- InputEvent ---
 
 void InputEvent::initialize(int32_t deviceId, int32_t source) {
@@ -222,20 +272,14 @@ status_t PointerCoords::readFromParcel(Parcel* parcel) {
         return BAD_VALUE;
     }
 
-    for (uint32_t i = 0; i < count; i++) {
-        values[i] = parcel->readFloat();
-    }
-    return OK;
+    return parcel->readFloatValues(values, count);
 }
 
 status_t PointerCoords::writeToParcel(Parcel* parcel) const {
     parcel->writeInt64(bits);
 
     uint32_t count = __builtin_popcountll(bits);
-    for (uint32_t i = 0; i < count; i++) {
-        parcel->writeFloat(values[i]);
-    }
-    return OK;
+    return parcel->writeFloatValues(values, count);
 }
 #endif
 
@@ -407,15 +451,62 @@ void MotionEvent::offsetLocation(float xOffset, float yOffset) {
     mYOffset += yOffset;
 }
 
+// The axes scaled by PointerCoords::scale().
+static const uint64_t SCALED_AXES_BITS = (1ULL << AMOTION_EVENT_AXIS_X)
+        | (1ULL << AMOTION_EVENT_AXIS_Y)
+        | (1ULL << AMOTION_EVENT_AXIS_TOUCH_MAJOR)
+        | (1ULL << AMOTION_EVENT_AXIS_TOUCH_MINOR)
+        | (1ULL << AMOTION_EVENT_AXIS_TOOL_MAJOR)
+        | (1ULL << AMOTION_EVENT_AXIS_TOOL_MINOR);
+
+// Multiplies the values by their factors, leaving zeros alone like PointerCoords::scale().
+// The values of the axes that aren't scaled have a factor of 1.
+static void scaleValues(float* values, const float* factors, uint32_t count) {
+    uint32_t i = 0;
+#if HAS_SIMD
+    for ( ; i + 4 <= count; i += 4) {
+        store(values + i, scale(load(values + i), load(factors + i)));
+    }
+#endif
+    for ( ; i < count; i++) {
+        if (values[i] != 0 && factors[i] != 1) {
+            values[i] *= factors[i];
+        }
+    }
+}
+
 void MotionEvent::scale(float scaleFactor) {
     mXOffset *= scaleFactor;
     mYOffset *= scaleFactor;
     mXPrecision *= scaleFactor;
     mYPrecision *= scaleFactor;
 
+    // The samples of a pointer nearly always have the same axes, so the factors of
+    // its values are only worked out again when they change.
+    size_t pointerCount = getPointerCount();
+    float factors[MAX_POINTERS][PointerCoords::MAX_AXES];
+    uint64_t factorsBits[MAX_POINTERS];
+    uint32_t counts[MAX_POINTERS];
+    for (size_t i = 0; i < pointerCount; i++) {
+        factorsBits[i] = 0;
+        counts[i] = 0;
+    }
+    PointerCoords* coords = mSamplePointerCoords.editArray();
     size_t numSamples = mSamplePointerCoords.size();
     for (size_t i = 0; i < numSamples; i++) {
-        mSamplePointerCoords.editItemAt(i).scale(scaleFactor);
+        PointerCoords& c = coords[i];
+        size_t pointerIndex = i % pointerCount;
+        if (c.bits != factorsBits[pointerIndex]) {
+            factorsBits[pointerIndex] = c.bits;
+            uint32_t count = 0;
+            for (uint64_t bits = c.bits; bits && count < PointerCoords::MAX_AXES;
+                    bits &= bits - 1) {
+                factors[pointerIndex][count++] =
+                        bits & -bits & SCALED_AXES_BITS ? scaleFactor : 1;
+            }
+            counts[pointerIndex] = count;
+        }
+        scaleValues(c.values, factors[pointerIndex], counts[pointerIndex]);
     }
 }
 
@@ -431,6 +522,53 @@ static void transformPoint(const float matrix[9], float x, float y, float *outX,
     *outY = newY * newZ;
 }
 
+// Number of samples transformed together by MotionEvent::transform().
+static const size_t TRANSFORM_BLOCK_SIZE = 32;
+
+// Transforms count points given relative to (xOffset, yOffset), and makes them
+// relative to (newXOffset, newYOffset), with the same results as transformPoint().
+static void transformPoints(const float matrix[9], float xOffset, float yOffset,
+        float newXOffset, float newYOffset, float* xs, float* ys, size_t count) {
+    size_t i = 0;
+    if (matrix[6] != 0 || matrix[7] != 0 || matrix[8] != 1) {
+        // Perspective transforms are rare, keep the division scalar.
+        for ( ; i < count; i++) {
+            transformPoint(matrix, xs[i] + xOffset, ys[i] + yOffset, &xs[i], &ys[i]);
+            xs[i] -= newXOffset;
+            ys[i] -= newYOffset;
+        }
+        return;
+    }
+
+    // The Z computed by transformPoint() is then 1, or NaN if the point isn't finite,
+    // so multiplying by it gives the same results as multiplying by its inverse.
+#if HAS_SIMD
+    const simd4f m0 = splat(matrix[0]), m1 = splat(matrix[1]), m2 = splat(matrix[2]);
+    const simd4f m3 = splat(matrix[3]), m4 = splat(matrix[4]), m5 = splat(matrix[5]);
+    const simd4f m6 = splat(matrix[6]), m7 = splat(matrix[7]), m8 = splat(matrix[8]);
+    const simd4f xo = splat(xOffset), yo = splat(yOffset);
+    const simd4f nxo = splat(newXOffset), nyo = splat(newYOffset);
+    for ( ; i + 4 <= count; i += 4) {
+        simd4f x = add(load(xs + i), xo);
+        simd4f y = add(load(ys + i), yo);
+        simd4f newX = add(add(mul(m0, x), mul(m1, y)), m2);
+        simd4f newY = add(add(mul(m3, x), mul(m4, y)), m5);
+        simd4f newZ = add(add(mul(m6, x), mul(m7, y)), m8);
+        store(xs + i, sub(mul(newX, newZ), nxo));
+        store(ys + i, sub(mul(newY, newZ), nyo));
+    }
+#endif
+    for ( ; i < count; i++) {
+        float x = xs[i] + xOffset;
+        float y = ys[i] + yOffset;
+        float newX = matrix[0] * x + matrix[1] * y + matrix[2];
+        float newY = matrix[3] * x + matrix[4] * y + matrix[5];
+        float newZ = matrix[6] * x + matrix[7] * y + matrix[8];
+        xs[i] = newX * newZ - newXOffset;
+        ys[i] = newY * newZ - newYOffset;
+    }
+}
+
 static float transformAngle(const float matrix[9], float angleRadians,
         float originX, float originY) {
     // Construct and transform a vector oriented at the specified clockwise angle from vertical.
@@ -470,19 +608,62 @@ void MotionEvent::transform(const float matrix[9]) {
     float originX, originY;
     transformPoint(matrix, 0, 0, &originX, &originY);
 
-    // Apply the transformation to all samples.
+    // Apply the transformation to all samples.  The samples with both X and Y,
+    // which are then the first two values, have them gathered block by block and
+    // transformed several at a time.  Successive samples usually have the same
+    // orientation so the last one transformed is remembered.
+    const uint64_t xyBits = (1ULL << AMOTION_EVENT_AXIS_X) | (1ULL << AMOTION_EVENT_AXIS_Y);
+    float orientation = 0;
+    float transformedOrientation = transformAngle(matrix, orientation, originX, originY);
+    PointerCoords* coords = mSamplePointerCoords.editArray();
     size_t numSamples = mSamplePointerCoords.size();
-    for (size_t i = 0; i < numSamples; i++) {
-        PointerCoords& c = mSamplePointerCoords.editItemAt(i);
-        float x = c.getAxisValue(AMOTION_EVENT_AXIS_X) + oldXOffset;
-        float y = c.getAxisValue(AMOTION_EVENT_AXIS_Y) + oldYOffset;
-        transformPoint(matrix, x, y, &x, &y);
-        c.setAxisValue(AMOTION_EVENT_AXIS_X, x - mXOffset);
-        c.setAxisValue(AMOTION_EVENT_AXIS_Y, y - mYOffset);
+    for (size_t start = 0; start < numSamples; start += TRANSFORM_BLOCK_SIZE) {
+        float xs[TRANSFORM_BLOCK_SIZE];
+        float ys[TRANSFORM_BLOCK_SIZE];
+        PointerCoords* gathered[TRANSFORM_BLOCK_SIZE];
+        size_t gatheredCount = 0;
+
+        size_t end = start + TRANSFORM_BLOCK_SIZE < numSamples
+                ? start + TRANSFORM_BLOCK_SIZE : numSamples;
+        for (size_t i = start; i < end; i++) {
+            PointerCoords& c = coords[i];
+            if ((c.bits & xyBits) == xyBits) {
+                xs[gatheredCount] = c.values[0];
+                ys[gatheredCount] = c.values[1];
+                gathered[gatheredCount++] = &c;
+            } else {
+                float x = c.getAxisValue(AMOTION_EVENT_AXIS_X) + oldXOffset;
+                float y = c.getAxisValue(AMOTION_EVENT_AXIS_Y) + oldYOffset;
+                transformPoint(matrix, x, y, &x, &y);
+                c.setAxisValue(AMOTION_EVENT_AXIS_X, x - mXOffset);
+                c.setAxisValue(AMOTION_EVENT_AXIS_Y, y - mYOffset);
+            }
+
+            // Orientation follows X and Y, so setting it leaves them in place.
+            float value = c.getAxisValue(AMOTION_EVENT_AXIS_ORIENTATION);
+            if (memcmp(&value, &orientation, sizeof(float))) {
+                orientation = value;
+                transformedOrientation = transformAngle(matrix, value, originX, originY);
+            }
+            c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, transformedOrientation);
+        }
 
-        float orientation = c.getAxisValue(AMOTION_EVENT_AXIS_ORIENTATION);
-        c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION,
-                transformAngle(matrix, orientation, originX, originY));
+        transformPoints(matrix, oldXOffset, oldYOffset, mXOffset, mYOffset,
+                xs, ys, gatheredCount);
+        for (size_t i = 0; i < gatheredCount; i++) {
+            gathered[i]->values[0] = xs[i];
+            gathered[i]->values[1] = ys[i];
+        }
+    }
+}
+
+void MotionEvent::reserveSamples(size_t sampleCount) {
+    if (sampleCount > mSampleEventTimes.capacity()) {
+        mSampleEventTimes.setCapacity(sampleCount);
+    }
+    size_t coordsCount = sampleCount * getPointerCount();
+    if (coordsCount > mSamplePointerCoords.capacity()) {
+        mSamplePointerCoords.setCapacity(coordsCount);
     }
 }
 
@@ -494,17 +675,26 @@ status_t MotionEvent::readFromParcel(Parcel* parcel) {
         return BAD_VALUE;
     }
 
-    mDeviceId = parcel->readInt32();
-    mSource = parcel->readInt32();
-    mAction = parcel->readInt32();
-    mFlags = parcel->readInt32();
-    mEdgeFlags = parcel->readInt32();
-    mMetaState = parcel->readInt32();
-    mButtonState = parcel->readInt32();
-    mXOffset = parcel->readFloat();
-    mYOffset = parcel->readFloat();
-    mXPrecision = parcel->readFloat();
-    mYPrecision = parcel->readFloat();
+    int32_t header[7];
+    float transform[4];
+    status_t status = parcel->readInt32Values(header, 7);
+    if (!status) {
+        status = parcel->readFloatValues(transform, 4);
+    }
+    if (status) {
+        return status;
+    }
+    mDeviceId = header[0];
+    mSource = header[1];
+    mAction = header[2];
+    mFlags = header[3];
+    mEdgeFlags = header[4];
+    mMetaState = header[5];
+    mButtonState = header[6];
+    mXOffset = transform[0];
+    mYOffset = transform[1];
+    mXPrecision = transform[2];
+    mYPrecision = transform[3];
     mDownTime = parcel->readInt64();
 
     mPointerProperties.clear();
@@ -514,18 +704,23 @@ status_t MotionEvent::readFromParcel(Parcel* parcel) {
     mSamplePointerCoords.clear();
     mSamplePointerCoords.setCapacity(sampleCount * pointerCount);
 
+    int32_t properties[MAX_POINTERS * 2];
+    status = parcel->readInt32Values(properties, pointerCount * 2);
+    if (status) {
+        return status;
+    }
     for (size_t i = 0; i < pointerCount; i++) {
         mPointerProperties.push();
-        PointerProperties& properties = mPointerProperties.editTop();
-        properties.id = parcel->readInt32();
-        properties.toolType = parcel->readInt32();
+        PointerProperties& p = mPointerProperties.editTop();
+        p.id = properties[i * 2];
+        p.toolType = properties[i * 2 + 1];
     }
 
     while (sampleCount-- > 0) {
         mSampleEventTimes.push(parcel->readInt64());
         for (size_t i = 0; i < pointerCount; i++) {
             mSamplePointerCoords.push();
-            status_t status = mSamplePointerCoords.editTop().readFromParcel(parcel);
+            status = mSamplePointerCoords.editTop().readFromParcel(parcel);
             if (status) {
                 return status;
             }
@@ -538,33 +733,40 @@ status_t MotionEvent::writeToParcel(Parcel* parcel) const {
     size_t pointerCount = mPointerProperties.size();
     size_t sampleCount = mSampleEventTimes.size();
 
-    parcel->writeInt32(pointerCount);
-    parcel->writeInt32(sampleCount);
-
-    parcel->writeInt32(mDeviceId);
-    parcel->writeInt32(mSource);
-    parcel->writeInt32(mAction);
-    parcel->writeInt32(mFlags);
-    parcel->writeInt32(mEdgeFlags);
-    parcel->writeInt32(mMetaState);
-    parcel->writeInt32(mButtonState);
-    parcel->writeFloat(mXOffset);
-    parcel->writeFloat(mYOffset);
-    parcel->writeFloat(mXPrecision);
-    parcel->writeFloat(mYPrecision);
+    // Reserve the space for the whole event up front, so that the parcel
+    // grows at most once.
+    size_t size = 13 * sizeof(int32_t) + sizeof(int64_t)
+            + pointerCount * 2 * sizeof(int32_t)
+            + sampleCount * sizeof(int64_t);
+    const PointerCoords* pc = mSamplePointerCoords.array();
+    for (size_t i = 0; i < sampleCount * pointerCount; i++) {
+        size += sizeof(int64_t) + __builtin_popcountll(pc[i].bits) * sizeof(float);
+    }
+    status_t status = parcel->setDataCapacity(parcel->dataPosition() + size);
+    if (status) {
+        return status;
+    }
+
+    const int32_t header[] = {
+        int32_t(pointerCount), int32_t(sampleCount),
+        mDeviceId, mSource, mAction, mFlags, mEdgeFlags, mMetaState, mButtonState
+    };
+    const float transform[] = { mXOffset, mYOffset, mXPrecision, mYPrecision };
+    parcel->writeInt32Values(header, 9);
+    parcel->writeFloatValues(transform, 4);
     parcel->writeInt64(mDownTime);
 
+    int32_t properties[MAX_POINTERS * 2];
     for (size_t i = 0; i < pointerCount; i++) {
-        const PointerProperties& properties = mPointerProperties.itemAt(i);
-        parcel->writeInt32(properties.id);
-        parcel->writeInt32(properties.toolType);
+        properties[i * 2] = mPointerProperties.itemAt(i).id;
+        properties[i * 2 + 1] = mPointerProperties.itemAt(i).toolType;
     }
+    parcel->writeInt32Values(properties, pointerCount * 2);
 
-    const PointerCoords* pc = mSamplePointerCoords.array();
     for (size_t h = 0; h < sampleCount; h++) {
         parcel->writeInt64(mSampleEventTimes.itemAt(h));
         for (size_t i = 0; i < pointerCount; i++) {
-            status_t status = (pc++)->writeToParcel(parcel);
+            status = (pc++)->writeToParcel(parcel);
             if (status) {
                 return status;
             }
@@ -594,33 +796,79 @@ bool MotionEvent::isTouchEvent(int32_t source, int32_t action) {
 
 // --- PooledInputEventFactory ---
 
+// Motion events that can hold more pointer coordinates than this are not pooled, to
+// bound the memory held by the pool.
+static const size_t MAX_POOLED_POINTER_COORDS = 1024;
+
 PooledInputEventFactory::PooledInputEventFactory(size_t maxPoolSize) :
-        mMaxPoolSize(maxPoolSize) {
+        mMaxPoolSize(maxPoolSize), mKeyEventCount(0), mMotionEventCount(0) {
+    mKeyEventPool = new KeyEvent*[maxPoolSize];
+    for (size_t i = 0; i < MOTION_EVENT_SIZE_CLASSES; i++) {
+        mMotionEventPools[i] = new MotionEvent*[maxPoolSize];
+        mMotionEventCounts[i] = 0;
+    }
 }
 
 PooledInputEventFactory::~PooledInputEventFactory() {
-    for (size_t i = 0; i < mKeyEventPool.size(); i++) {
-        delete mKeyEventPool.itemAt(i);
+    for (size_t i = 0; i < mKeyEventCount; i++) {
+        delete mKeyEventPool[i];
     }
-    for (size_t i = 0; i < mMotionEventPool.size(); i++) {
-        delete mMotionEventPool.itemAt(i);
+    delete[] mKeyEventPool;
+    for (size_t i = 0; i < MOTION_EVENT_SIZE_CLASSES; i++) {
+        for (size_t j = 0; j < mMotionEventCounts[i]; j++) {
+            delete mMotionEventPools[i][j];
+        }
+        delete[] mMotionEventPools[i];
+    }
+}
+
+ssize_t PooledInputEventFactory::getSizeClass(size_t pointerCoordsCount) {
+    if (pointerCoordsCount <= 4) {
+        return 0;
     }
+    if (pointerCoordsCount <= 16) {
+        return 1;
+    }
+    if (pointerCoordsCount <= 64) {
+        return 2;
+    }
+    if (pointerCoordsCount <= MAX_POOLED_POINTER_COORDS) {
+        return 3;
+    }
+    return -1;
 }
 
 KeyEvent* PooledInputEventFactory::createKeyEvent() {
-    if (!mKeyEventPool.isEmpty()) {
-        KeyEvent* event = mKeyEventPool.top();
-        mKeyEventPool.pop();
-        return event;
+    if (mKeyEventCount) {
+        return mKeyEventPool[--mKeyEventCount];
     }
     return new KeyEvent();
 }
 
 MotionEvent* PooledInputEventFactory::createMotionEvent() {
-    if (!mMotionEventPool.isEmpty()) {
-        MotionEvent* event = mMotionEventPool.top();
-        mMotionEventPool.pop();
-        return event;
+    return createMotionEventForSamples(1, 1);
+}
+
+MotionEvent* PooledInputEventFactory::createMotionEventForSamples(size_t pointerCount,
+        size_t sampleCount) {
+    if (mMotionEventCount) {
+        // Use the smallest event that has room for the samples, or else the largest one.
+        ssize_t sizeClass = getSizeClass(pointerCount * sampleCount);
+        if (sizeClass < 0) {
+            sizeClass = MOTION_EVENT_SIZE_CLASSES - 1;
+        }
+        for (size_t i = sizeClass; i < MOTION_EVENT_SIZE_CLASSES; i++) {
+            if (mMotionEventCounts[i]) {
+                mMotionEventCount -= 1;
+                return mMotionEventPools[i][--mMotionEventCounts[i]];
+            }
+        }
+        for (size_t i = sizeClass; i-- > 0; ) {
+            if (mMotionEventCounts[i]) {
+                mMotionEventCount -= 1;
+                return mMotionEventPools[i][--mMotionEventCounts[i]];
+            }
+        }
     }
     return new MotionEvent();
 }
@@ -628,15 +876,20 @@ MotionEvent* PooledInputEventFactory::createMotionEvent() {
 void PooledInputEventFactory::recycle(InputEvent* event) {
     switch (event->getType()) {
     case AINPUT_EVENT_TYPE_KEY:
-        if (mKeyEventPool.size() < mMaxPoolSize) {
-            mKeyEventPool.push(static_cast<KeyEvent*>(event));
+        if (mKeyEventCount < mMaxPoolSize) {
+            mKeyEventPool[mKeyEventCount++] = static_cast<KeyEvent*>(event);
             return;
         }
         break;
     case AINPUT_EVENT_TYPE_MOTION:
-        if (mMotionEventPool.size() < mMaxPoolSize) {
-            mMotionEventPool.push(static_cast<MotionEvent*>(event));
-            return;
+        if (mMotionEventCount < mMaxPoolSize) {
+            MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+            ssize_t sizeClass = getSizeClass(motionEvent->getSamplePointerCoordsCapacity());
+            if (sizeClass >= 0) {
+                mMotionEventPools[sizeClass][mMotionEventCounts[sizeClass]++] = motionEvent;
+                mMotionEventCount += 1;
+                return;
+            }
         }
         break;
     }
@@ -25,6 +25,7 @@
 #include <math.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <cutils/log.h>
@@ -40,6 +41,10 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Maximum number of messages sent or received with a single system call.  A few dozen
+// messages fit in the socket buffer, but a frame rarely brings more than a few.
+static const size_t MAX_MESSAGE_BATCH = 16;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
@@ -54,6 +59,14 @@ static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 // far into the future.  This time is further bounded by 50% of the last time delta.
 static const nsecs_t RESAMPLE_MAX_PREDICTION = 8 * NANOS_PER_MS;
 
+// Maximum time to predict forward from the last known state with predictive resampling.
+// Predicting further than a couple of frames ahead overshoots more than it helps.
+static const nsecs_t RESAMPLE_PREDICTIVE_MAX_PREDICTION = 24 * NANOS_PER_MS;
+
+// Velocity tracker strategy used for predictive resampling.  It is queried on every
+// frame, so it must be cheap to update and query.
+static const char* RESAMPLE_PREDICTIVE_STRATEGY = "ilsq2";
+
 template<typename T>
 inline static T min(const T& a, const T& b) {
     return a < b ? a : b;
@@ -63,6 +76,32 @@ inline static float lerp(float a, float b, float alpha) {
     return a + alpha * (b - a);
 }
 
+inline static float evaluatePolynomial(const float* coeff, uint32_t degree, float t) {
+    float value = 0;
+    for (uint32_t i = degree + 1; i-- > 0; ) {
+        value = value * t + coeff[i];
+    }
+    return value;
+}
+
+static nsecs_t getEventTime(const InputMessage& msg) {
+    switch (msg.header.type) {
+    case InputMessage::TYPE_KEY:
+        return msg.body.key.eventTime;
+    case InputMessage::TYPE_MOTION:
+        return msg.body.motion.eventTime;
+    case InputMessage::TYPE_MOTION_COMPACT:
+        return msg.body.motionCompact.eventTime;
+    }
+    return 0;
+}
+
+// Gets the delay of a message from its event time to the given time, which is never 0.
+static uint32_t getDelay(nsecs_t eventTime, nsecs_t time) {
+    nsecs_t delay = (time - eventTime) / 1000;
+    return delay < 1 ? 1 : delay > nsecs_t(0xffffffff) ? 0xffffffffu : uint32_t(delay);
+}
+
 // --- InputMessage ---
 
 bool InputMessage::isValid(size_t actualSize) const {
@@ -73,6 +112,10 @@ bool InputMessage::isValid(size_t actualSize) const {
         case TYPE_MOTION:
             return body.motion.pointerCount > 0
                     && body.motion.pointerCount <= MAX_POINTERS;
+        case TYPE_MOTION_COMPACT:
+            return body.motionCompact.pointerCount > 0
+                    && body.motionCompact.pointerCount <= MAX_POINTERS
+                    && body.motionCompact.dataSize <= sizeof(body.motionCompact.data);
         case TYPE_FINISHED:
             return true;
         }
@@ -86,15 +129,257 @@ size_t InputMessage::size() const {
         return sizeof(Header) + body.key.size();
     case TYPE_MOTION:
         return sizeof(Header) + body.motion.size();
+    case TYPE_MOTION_COMPACT:
+        return sizeof(Header) + body.motionCompact.size();
     case TYPE_FINISHED:
         return sizeof(Header) + body.finished.size();
     }
     return sizeof(Header);
 }
 
+static inline uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float bitsFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline bool writeVarint(uint8_t*& p, const uint8_t* end, uint64_t value) {
+    do {
+        if (p == end) {
+            return false;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        *p++ = value ? byte | 0x80 : byte;
+    } while (value);
+    return true;
+}
+
+static inline bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t* outValue) {
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *outValue = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool canDeltaEncode(const InputMessage::Body::Motion& motion,
+        const InputMessage::Body::Motion& previous) {
+    if (motion.pointerCount != previous.pointerCount) {
+        return false;
+    }
+    for (size_t i = 0; i < motion.pointerCount; i++) {
+        const InputMessage::Body::Motion::Pointer& pointer = motion.pointers[i];
+        const InputMessage::Body::Motion::Pointer& previousPointer = previous.pointers[i];
+        if (pointer.properties != previousPointer.properties
+                || pointer.coords.bits != previousPointer.coords.bits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InputMessage::encodeCompactMotion(const InputMessage& msg, const InputMessage* previous) {
+    const Body::Motion& motion = msg.body.motion;
+    bool delta = previous && previous->header.type == TYPE_MOTION
+            && canDeltaEncode(motion, previous->body.motion);
+
+    header.type = TYPE_MOTION_COMPACT;
+    header.delay = msg.header.delay;
+    body.motionCompact.seq = motion.seq;
+    body.motionCompact.eventTime = motion.eventTime;
+    body.motionCompact.deviceId = motion.deviceId;
+    body.motionCompact.source = motion.source;
+    body.motionCompact.action = motion.action;
+    body.motionCompact.flags = motion.flags;
+    body.motionCompact.metaState = motion.metaState;
+    body.motionCompact.buttonState = motion.buttonState;
+    body.motionCompact.edgeFlags = motion.edgeFlags;
+    body.motionCompact.downTime = motion.downTime;
+    body.motionCompact.xOffset = motion.xOffset;
+    body.motionCompact.yOffset = motion.yOffset;
+    body.motionCompact.xPrecision = motion.xPrecision;
+    body.motionCompact.yPrecision = motion.yPrecision;
+    body.motionCompact.pointerCount = motion.pointerCount;
+    body.motionCompact.delta = delta;
+
+    uint8_t* p = body.motionCompact.data;
+    const uint8_t* end = p + sizeof(body.motionCompact.data);
+    for (size_t i = 0; i < motion.pointerCount; i++) {
+        const PointerProperties& properties = motion.pointers[i].properties;
+        const PointerCoords& coords = motion.pointers[i].coords;
+        uint32_t count = __builtin_popcountll(coords.bits);
+        if (delta) {
+            const PointerCoords& previousCoords = previous->body.motion.pointers[i].coords;
+            for (uint32_t j = 0; j < count; j++) {
+                if (!writeVarint(p, end,
+                        floatBits(coords.values[j]) ^ floatBits(previousCoords.values[j]))) {
+                    return false;
+                }
+            }
+        } else {
+            if (!writeVarint(p, end, uint32_t(properties.id))
+                    || !writeVarint(p, end, uint32_t(properties.toolType))
+                    || !writeVarint(p, end, coords.bits)
+                    || size_t(end - p) < count * sizeof(float)) {
+                return false;
+            }
+            memcpy(p, coords.values, count * sizeof(float));
+            p += count * sizeof(float);
+        }
+    }
+    body.motionCompact.dataSize = p - body.motionCompact.data;
+    return size() < msg.size();
+}
+
+status_t InputMessage::decodeCompactMotion(InputMessage* outMsg,
+        const InputMessage* previous) const {
+    const Body::MotionCompact& compact = body.motionCompact;
+    if (compact.delta && !(previous && previous->header.type == TYPE_MOTION
+            && previous->body.motion.pointerCount == compact.pointerCount)) {
+        return BAD_VALUE;
+    }
+
+    Body::Motion& motion = outMsg->body.motion;
+    outMsg->header.type = TYPE_MOTION;
+    outMsg->header.delay = header.delay;
+    motion.seq = compact.seq;
+    motion.eventTime = compact.eventTime;
+    motion.deviceId = compact.deviceId;
+    motion.source = compact.source;
+    motion.action = compact.action;
+    motion.flags = compact.flags;
+    motion.metaState = compact.metaState;
+    motion.buttonState = compact.buttonState;
+    motion.edgeFlags = compact.edgeFlags;
+    motion.downTime = compact.downTime;
+    motion.xOffset = compact.xOffset;
+    motion.yOffset = compact.yOffset;
+    motion.xPrecision = compact.xPrecision;
+    motion.yPrecision = compact.yPrecision;
+    motion.pointerCount = compact.pointerCount;
+
+    const uint8_t* p = compact.data;
+    const uint8_t* end = p + compact.dataSize;
+    for (size_t i = 0; i < compact.pointerCount; i++) {
+        PointerProperties& properties = motion.pointers[i].properties;
+        PointerCoords& coords = motion.pointers[i].coords;
+        if (compact.delta) {
+            const Body::Motion::Pointer& previousPointer = previous->body.motion.pointers[i];
+            properties.copyFrom(previousPointer.properties);
+            coords.bits = previousPointer.coords.bits;
+            uint32_t count = __builtin_popcountll(coords.bits);
+            for (uint32_t j = 0; j < count; j++) {
+                uint64_t value;
+                if (!readVarint(p, end, &value) || value > 0xffffffffULL) {
+                    return BAD_VALUE;
+                }
+                coords.values[j] = bitsFloat(
+                        uint32_t(value) ^ floatBits(previousPointer.coords.values[j]));
+            }
+        } else {
+            uint64_t id, toolType;
+            if (!readVarint(p, end, &id) || !readVarint(p, end, &toolType)
+                    || !readVarint(p, end, &coords.bits)) {
+                return BAD_VALUE;
+            }
+            uint32_t count = __builtin_popcountll(coords.bits);
+            if (count > PointerCoords::MAX_AXES || size_t(end - p) < count * sizeof(float)) {
+                return BAD_VALUE;
+            }
+            properties.id = int32_t(id);
+            properties.toolType = int32_t(toolType);
+            memcpy(coords.values, p, count * sizeof(float));
+            p += count * sizeof(float);
+        }
+    }
+    return p == end ? OK : BAD_VALUE;
+}
+
+
+// --- InputLatencyHistogram ---
+
+void InputLatencyHistogram::add(nsecs_t latency) {
+    uint32_t us = latency > 0 ? uint32_t(min(latency / 1000, nsecs_t(0xffffffff))) : 0;
+    size_t bucket = 0;
+    while (us > 1 && bucket < BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    counts[bucket]++;
+}
+
+uint64_t InputLatencyHistogram::getCount() const {
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        count += counts[i];
+    }
+    return count;
+}
+
+uint32_t InputLatencyHistogram::percentile(uint32_t percent) const {
+    uint64_t target = (getCount() * percent + 99) / 100;
+    if (!target) {
+        return 0;
+    }
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        sum += counts[i];
+        if (sum >= target) {
+            return 2u << i;
+        }
+    }
+    return 2u << (BUCKETS - 1);
+}
+
 
 // --- InputChannel ---
 
+// The kernel's struct mmsghdr, which the C library may not declare.  sendmmsg() and
+// recvmmsg() are called through syscall() since it may not export them either.
+struct MultipleMessageHeader {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+// Set once the kernel has returned ENOSYS for sendmmsg() or recvmmsg(), from then on
+// the messages are sent and received one at a time.
+static volatile bool gMultipleMessagesUnsupported;
+
+static int sendMultipleMessages(int fd, MultipleMessageHeader* msgs, size_t count,
+        int flags) {
+#ifdef __NR_sendmmsg
+    return syscall(__NR_sendmmsg, fd, msgs, count, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int receiveMultipleMessages(int fd, MultipleMessageHeader* msgs, size_t count,
+        int flags) {
+#ifdef __NR_recvmmsg
+    return syscall(__NR_recvmmsg, fd, msgs, count, flags, NULL);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 InputChannel::InputChannel(const String8& name, int fd) :
         mName(name), mFd(fd) {
 #if DEBUG_CHANNEL_LIFECYCLE
@@ -220,6 +505,155 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count,
+        size_t* outSent) {
+    *outSent = 0;
+    while (*outSent < count) {
+        if (gMultipleMessagesUnsupported) {
+            status_t status = sendMessage(&msgs[*outSent]);
+            if (status) {
+                return status;
+            }
+            *outSent += 1;
+            continue;
+        }
+
+        MultipleMessageHeader mmsgs[MAX_MESSAGE_BATCH];
+        struct iovec iovs[MAX_MESSAGE_BATCH];
+        size_t n = min(count - *outSent, MAX_MESSAGE_BATCH);
+        memset(mmsgs, 0, sizeof(MultipleMessageHeader) * n);
+        for (size_t i = 0; i < n; i++) {
+            const InputMessage* msg = &msgs[*outSent + i];
+            iovs[i].iov_base = const_cast<InputMessage*>(msg);
+            iovs[i].iov_len = msg->size();
+            mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+            mmsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int nSent;
+        do {
+            nSent = sendMultipleMessages(mFd, mmsgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            int error = errno;
+            if (error == ENOSYS) {
+                gMultipleMessagesUnsupported = true;
+                continue;
+            }
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ error sending %d messages, errno=%d", mName.string(),
+                    n, error);
+#endif
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return WOULD_BLOCK;
+            }
+            if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED
+                    || error == ECONNRESET) {
+                return DEAD_OBJECT;
+            }
+            return -error;
+        }
+
+        for (int i = 0; i < nSent; i++) {
+            if (mmsgs[i].msg_len != iovs[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.string(), msgs[*outSent].header.type);
+#endif
+                return DEAD_OBJECT;
+            }
+            *outSent += 1;
+        }
+        // If fewer messages than requested were sent, the next call reports why.
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ sent %d messages", mName.string(), count);
+#endif
+    return OK;
+}
+
+status_t InputChannel::receiveMessages(InputMessage* msgs, size_t count,
+        size_t* outReceived) {
+    *outReceived = 0;
+    if (gMultipleMessagesUnsupported) {
+        while (*outReceived < count) {
+            status_t status = receiveMessage(&msgs[*outReceived]);
+            if (status == BAD_VALUE || (status && *outReceived == 0)) {
+                return status;
+            }
+            if (status) {
+                // Return the messages received so far, the error is reported next time.
+                break;
+            }
+            *outReceived += 1;
+        }
+        return OK;
+    }
+
+    MultipleMessageHeader mmsgs[MAX_MESSAGE_BATCH];
+    struct iovec iovs[MAX_MESSAGE_BATCH];
+    size_t n = min(count, MAX_MESSAGE_BATCH);
+    memset(mmsgs, 0, sizeof(MultipleMessageHeader) * n);
+    for (size_t i = 0; i < n; i++) {
+        iovs[i].iov_base = &msgs[i];
+        iovs[i].iov_len = sizeof(InputMessage);
+        mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        mmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nRead;
+    do {
+        nRead = receiveMultipleMessages(mFd, mmsgs, n, MSG_DONTWAIT);
+    } while (nRead == -1 && errno == EINTR);
+
+    if (nRead < 0) {
+        int error = errno;
+        if (error == ENOSYS) {
+            gMultipleMessagesUnsupported = true;
+            return receiveMessages(msgs, count, outReceived);
+        }
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed, errno=%d", mName.string(), errno);
+#endif
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+
+    for (int i = 0; i < nRead; i++) {
+        if (mmsgs[i].msg_len == 0) { // check for EOF
+            // Return the messages received before it, the EOF is reported next time.
+            break;
+        }
+        if (!msgs[i].isValid(mmsgs[i].msg_len)) {
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ received invalid message", mName.string());
+#endif
+            return BAD_VALUE;
+        }
+        *outReceived += 1;
+    }
+
+    if (*outReceived == 0) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed because peer was closed",
+                mName.string());
+#endif
+        return DEAD_OBJECT;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received %d messages", mName.string(), *outReceived);
+#endif
+    return OK;
+}
+
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
     return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
@@ -229,7 +663,9 @@ sp<InputChannel> InputChannel::dup() const {
 // --- InputPublisher ---
 
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mCompactMotion(false), mTrackLatency(false), mLastMotionValid(false),
+        mMotionSamples(0), mMotionBytes(0), mBatching(false),
+        mReceiveIndex(0), mReceiveCount(0) {
 }
 
 InputPublisher::~InputPublisher() {
@@ -263,6 +699,7 @@ status_t InputPublisher::publishKeyEvent(
 
     InputMessage msg;
     msg.header.type = InputMessage::TYPE_KEY;
+    msg.header.delay = 0;
     msg.body.key.seq = seq;
     msg.body.key.deviceId = deviceId;
     msg.body.key.source = source;
@@ -274,7 +711,7 @@ status_t InputPublisher::publishKeyEvent(
     msg.body.key.repeatCount = repeatCount;
     msg.body.key.downTime = downTime;
     msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    return publishMessage(msg);
 }
 
 status_t InputPublisher::publishMotionEvent(
@@ -319,6 +756,7 @@ status_t InputPublisher::publishMotionEvent(
 
     InputMessage msg;
     msg.header.type = InputMessage::TYPE_MOTION;
+    msg.header.delay = 0;
     msg.body.motion.seq = seq;
     msg.body.motion.deviceId = deviceId;
     msg.body.motion.source = source;
@@ -338,7 +776,88 @@ status_t InputPublisher::publishMotionEvent(
         msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
         msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
     }
-    return mChannel->sendMessage(&msg);
+    return publishMessage(msg);
+}
+
+status_t InputPublisher::publishMessage(InputMessage& msg) {
+    if (mTrackLatency && !mBatching) {
+        // The events of a batch are stamped when it is sent.
+        msg.header.delay = getDelay(getEventTime(msg), systemTime(SYSTEM_TIME_MONOTONIC));
+    }
+
+    const InputMessage* wireMsg = &msg;
+    InputMessage compactMsg;
+    if (mCompactMotion && msg.header.type == InputMessage::TYPE_MOTION
+            && compactMsg.encodeCompactMotion(msg,
+                    mBatching && mLastMotionValid ? &mLastMotion : NULL)) {
+        wireMsg = &compactMsg;
+    }
+
+    if (mBatching) {
+        mBatch.push(*wireMsg);
+        // Only a motion event immediately followed by another one in the same batch
+        // is used as a reference, so that the consumer always has it.
+        mLastMotionValid = msg.header.type == InputMessage::TYPE_MOTION;
+        if (mLastMotionValid) {
+            memcpy(&mLastMotion, &msg, msg.size());
+        }
+        return OK;
+    }
+
+    status_t result = mChannel->sendMessage(wireMsg);
+    if (!result) {
+        messageSent(*wireMsg);
+    }
+    return result;
+}
+
+void InputPublisher::messageSent(const InputMessage& msg) {
+    if (msg.header.type == InputMessage::TYPE_MOTION
+            || msg.header.type == InputMessage::TYPE_MOTION_COMPACT) {
+        mMotionSamples += 1;
+        mMotionBytes += msg.size();
+    }
+}
+
+void InputPublisher::setCompactMotionEncoding(bool enabled) {
+    mCompactMotion = enabled;
+}
+
+void InputPublisher::getMotionStats(uint64_t* outSamples, uint64_t* outBytes) const {
+    *outSamples = mMotionSamples;
+    *outBytes = mMotionBytes;
+}
+
+void InputPublisher::setLatencyTracking(bool enabled) {
+    mTrackLatency = enabled;
+}
+
+void InputPublisher::beginBatch() {
+    mBatching = true;
+    mLastMotionValid = false;
+}
+
+status_t InputPublisher::endBatch(size_t* outPublished) {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ endBatch: %d events",
+            mChannel->getName().string(), mBatch.size());
+#endif
+
+    mBatching = false;
+    mLastMotionValid = false;
+    if (mTrackLatency) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < mBatch.size(); i++) {
+            InputMessage& msg = mBatch.editItemAt(i);
+            msg.header.delay = getDelay(getEventTime(msg), now);
+        }
+    }
+    status_t result = mChannel->sendMessages(mBatch.array(), mBatch.size(), outPublished);
+    for (size_t i = 0; i < *outPublished; i++) {
+        messageSent(mBatch.itemAt(i));
+    }
+    mBatch.clear();
+    return result;
 }
 
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
@@ -347,13 +866,13 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
             mChannel->getName().string());
 #endif
 
-    InputMessage msg;
-    status_t result = mChannel->receiveMessage(&msg);
+    status_t result = fillReceiveBuffer(MAX_MESSAGE_BATCH);
     if (result) {
         *outSeq = 0;
         *outHandled = false;
         return result;
     }
+    const InputMessage& msg = mReceiveBuffer.itemAt(mReceiveIndex++);
     if (msg.header.type != InputMessage::TYPE_FINISHED) {
         ALOGE("channel '%s' publisher ~ Received unexpected message of type %d from consumer",
                 mChannel->getName().string(), msg.header.type);
@@ -364,14 +883,99 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
     return OK;
 }
 
+status_t InputPublisher::receiveFinishedSignals(uint32_t* outSeqs, bool* outHandled,
+        size_t maxCount, size_t* outCount) {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ receiveFinishedSignals",
+            mChannel->getName().string());
+#endif
+
+    *outCount = 0;
+    status_t result = fillReceiveBuffer(maxCount);
+    if (result) {
+        return result;
+    }
+    while (*outCount < maxCount && mReceiveIndex < mReceiveCount) {
+        const InputMessage& msg = mReceiveBuffer.itemAt(mReceiveIndex++);
+        if (msg.header.type != InputMessage::TYPE_FINISHED) {
+            ALOGE("channel '%s' publisher ~ Received unexpected message of type %d from "
+                    "consumer", mChannel->getName().string(), msg.header.type);
+            return UNKNOWN_ERROR;
+        }
+        outSeqs[*outCount] = msg.body.finished.seq;
+        outHandled[*outCount] = msg.body.finished.handled;
+        *outCount += 1;
+    }
+    return OK;
+}
+
+status_t InputPublisher::fillReceiveBuffer(size_t maxCount) {
+    if (mReceiveIndex < mReceiveCount) {
+        return OK;
+    }
+    if (mReceiveBuffer.isEmpty()) {
+        mReceiveBuffer.insertAt(0, MAX_MESSAGE_BATCH);
+    }
+    mReceiveIndex = 0;
+    mReceiveCount = 0;
+    return mChannel->receiveMessages(mReceiveBuffer.editArray(),
+            min(maxCount, mReceiveBuffer.size()), &mReceiveCount);
+}
+
 // --- InputConsumer ---
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
-        mChannel(channel), mMsgDeferred(false) {
+        mResampleMode(RESAMPLE_LINEAR), mFrameLatency(0), mTrackLatency(false),
+        mChannel(channel), mMsgDeferred(false), mReceiveIndex(0), mReceiveCount(0),
+        mLastMotionValid(false) {
+    memset(&mResampleStats, 0, sizeof(mResampleStats));
+    memset(&mLatencyStats, 0, sizeof(mLatencyStats));
 }
 
 InputConsumer::~InputConsumer() {
+    for (size_t i = 0; i < mVelocityTrackers.size(); i++) {
+        delete mVelocityTrackers.valueAt(i);
+    }
+}
+
+void InputConsumer::setResampleMode(ResampleMode mode, nsecs_t frameLatency) {
+    mResampleMode = mode;
+    mFrameLatency = frameLatency;
+}
+
+void InputConsumer::getResampleStats(ResampleStats* outStats) const {
+    *outStats = mResampleStats;
+}
+
+void InputConsumer::setLatencyTracking(bool enabled) {
+    if (enabled && !mTrackLatency) {
+        memset(&mLatencyStats, 0, sizeof(mLatencyStats));
+    }
+    mTrackLatency = enabled;
+    mConsumedEvents.clear();
+}
+
+void InputConsumer::getLatencyStats(LatencyStats* outStats) const {
+    *outStats = mLatencyStats;
+}
+
+static void dumpLatencyHistogram(String8& dump, const char* name,
+        const InputLatencyHistogram& histogram) {
+    dump.appendFormat("    %-10s %8llu %8u %8u %8u\n", name,
+            (unsigned long long)histogram.getCount(), histogram.percentile(50),
+            histogram.percentile(90), histogram.percentile(99));
+}
+
+void InputConsumer::dumpLatencyStats(String8& dump) const {
+    dump.appendFormat("  Latency of channel '%s' (%s):\n", mChannel->getName().string(),
+            mTrackLatency ? "enabled" : "disabled");
+    dump.append("    stage         count  p50(us)  p90(us)  p99(us)\n");
+    dumpLatencyHistogram(dump, "dispatch", mLatencyStats.dispatch);
+    dumpLatencyHistogram(dump, "queue", mLatencyStats.queue);
+    dumpLatencyHistogram(dump, "batching", mLatencyStats.batching);
+    dumpLatencyHistogram(dump, "handling", mLatencyStats.handling);
+    dumpLatencyHistogram(dump, "total", mLatencyStats.total);
 }
 
 bool InputConsumer::isTouchResamplingEnabled() {
@@ -408,7 +1012,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result) {
                 // Consume the next batched event unless batches are being held for later.
                 if (consumeBatches || result != WOULD_BLOCK) {
@@ -433,6 +1037,10 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             initializeKeyEvent(keyEvent, &mMsg);
             *outSeq = mMsg.body.key.seq;
             *outEvent = keyEvent;
+            if (mTrackLatency) {
+                messageConsumed(&mMsg);
+                eventConsumed(&mMsg);
+            }
 #if DEBUG_TRANSPORT_ACTIONS
             ALOGD("channel '%s' consumer ~ consumed key event, seq=%u",
                     mChannel->getName().string(), *outSeq);
@@ -457,7 +1065,6 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
                     mMsgDeferred = true;
                     status_t result = consumeSamples(factory,
                             batch, batch.samples.size(), outSeq, outEvent);
-                    mBatches.removeAt(batchIndex);
                     if (result) {
                         return result;
                     }
@@ -473,8 +1080,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             // Start a new batch if needed.
             if (mMsg.body.motion.action == AMOTION_EVENT_ACTION_MOVE
                     || mMsg.body.motion.action == AMOTION_EVENT_ACTION_HOVER_MOVE) {
-                mBatches.push();
-                Batch& batch = mBatches.editTop();
+                Batch& batch = addBatch();
                 batch.samples.push(mMsg);
 #if DEBUG_TRANSPORT_ACTIONS
                 ALOGD("channel '%s' consumer ~ started batch event",
@@ -483,13 +1089,18 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
                 break;
             }
 
-            MotionEvent* motionEvent = factory->createMotionEvent();
+            MotionEvent* motionEvent = factory->createMotionEventForSamples(
+                    mMsg.body.motion.pointerCount, 1);
             if (! motionEvent) return NO_MEMORY;
 
             updateTouchState(&mMsg);
             initializeMotionEvent(motionEvent, &mMsg);
             *outSeq = mMsg.body.motion.seq;
             *outEvent = motionEvent;
+            if (mTrackLatency) {
+                messageConsumed(&mMsg);
+                eventConsumed(&mMsg);
+            }
 #if DEBUG_TRANSPORT_ACTIONS
             ALOGD("channel '%s' consumer ~ consumed motion event, seq=%u",
                     mChannel->getName().string(), *outSeq);
@@ -506,21 +1117,106 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
     return OK;
 }
 
+status_t InputConsumer::receiveMessage(InputMessage* msg) {
+    if (mReceiveIndex == mReceiveCount) {
+        // Drain the channel, as the messages that follow are likely to be batched
+        // with this one.
+        if (mReceiveBuffer.isEmpty()) {
+            mReceiveBuffer.insertAt(0, MAX_MESSAGE_BATCH);
+        }
+        size_t count;
+        status_t result = mChannel->receiveMessages(mReceiveBuffer.editArray(),
+                mReceiveBuffer.size(), &count);
+        if (result) {
+            return result;
+        }
+        mReceiveIndex = 0;
+        mReceiveCount = count;
+    }
+    const InputMessage& next = mReceiveBuffer.itemAt(mReceiveIndex++);
+    if (next.header.type == InputMessage::TYPE_MOTION_COMPACT) {
+        status_t result = next.decodeCompactMotion(msg, mLastMotionValid ? &mLastMotion : NULL);
+        if (result) {
+            ALOGE("channel '%s' consumer ~ Received malformed compact motion event",
+                    mChannel->getName().string());
+            mLastMotionValid = false;
+            return result;
+        }
+    } else {
+        memcpy(msg, &next, next.size());
+    }
+    mLastMotionValid = msg->header.type == InputMessage::TYPE_MOTION;
+    if (mLastMotionValid) {
+        memcpy(&mLastMotion, msg, msg->size());
+    }
+    if (mTrackLatency) {
+        messageReceived(msg);
+    }
+    return OK;
+}
+
+void InputConsumer::messageReceived(InputMessage* msg) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t eventTime = getEventTime(*msg);
+    if (msg->header.delay) {
+        nsecs_t publishDelay = nsecs_t(msg->header.delay) * 1000;
+        mLatencyStats.dispatch.add(publishDelay);
+        mLatencyStats.queue.add(now - eventTime - publishDelay);
+    }
+    msg->header.delay = getDelay(eventTime, now);
+}
+
+void InputConsumer::messageConsumed(const InputMessage* msg) {
+    // Messages received before latency tracking was enabled are not counted.
+    if (msg->header.delay) {
+        nsecs_t receiveDelay = nsecs_t(msg->header.delay) * 1000;
+        mLatencyStats.batching.add(
+                systemTime(SYSTEM_TIME_MONOTONIC) - getEventTime(*msg) - receiveDelay);
+    }
+}
+
+void InputConsumer::eventConsumed(const InputMessage* msg) {
+    ConsumedEvent event;
+    event.seq = msg->header.type == InputMessage::TYPE_KEY
+            ? msg->body.key.seq : msg->body.motion.seq;
+    event.eventTime = getEventTime(*msg);
+    event.consumeTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    mConsumedEvents.push(event);
+}
+
+void InputConsumer::eventFinished(uint32_t seq) {
+    for (size_t i = mConsumedEvents.size(); i-- > 0; ) {
+        const ConsumedEvent& event = mConsumedEvents.itemAt(i);
+        if (event.seq == seq) {
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            mLatencyStats.handling.add(now - event.consumeTime);
+            mLatencyStats.total.add(now - event.eventTime);
+            mConsumedEvents.removeAt(i);
+            break;
+        }
+    }
+}
+
 status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
         nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent) {
     status_t result;
     for (size_t i = mBatches.size(); i-- > 0; ) {
         Batch& batch = mBatches.editItemAt(i);
+        if (batch.samples.isEmpty()) {
+            continue;
+        }
         if (frameTime < 0) {
-            result = consumeSamples(factory, batch, batch.samples.size(),
+            return consumeSamples(factory, batch, batch.samples.size(),
                     outSeq, outEvent);
-            mBatches.removeAt(i);
-            return result;
         }
 
         nsecs_t sampleTime = frameTime;
         if (mResampleTouch) {
-            sampleTime -= RESAMPLE_LATENCY;
+            if (mResampleMode == RESAMPLE_PREDICTIVE) {
+                sampleTime += mFrameLatency;
+            } else {
+                sampleTime -= RESAMPLE_LATENCY;
+            }
         }
         ssize_t split = findSampleNoLaterThan(batch, sampleTime);
         if (split < 0) {
@@ -528,13 +1224,7 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
         }
 
         result = consumeSamples(factory, batch, split + 1, outSeq, outEvent);
-        const InputMessage* next;
-        if (batch.samples.isEmpty()) {
-            mBatches.removeAt(i);
-            next = NULL;
-        } else {
-            next = &batch.samples.itemAt(0);
-        }
+        const InputMessage* next = batch.samples.isEmpty() ? NULL : &batch.samples.itemAt(0);
         if (!result && mResampleTouch) {
             resampleTouchState(sampleTime, static_cast<MotionEvent*>(*outEvent), next);
         }
@@ -546,13 +1236,22 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
 
 status_t InputConsumer::consumeSamples(InputEventFactoryInterface* factory,
         Batch& batch, size_t count, uint32_t* outSeq, InputEvent** outEvent) {
-    MotionEvent* motionEvent = factory->createMotionEvent();
+    // Leave room for a resampled sample.
+    size_t sampleCount = mResampleTouch ? count + 1 : count;
+    MotionEvent* motionEvent = factory->createMotionEventForSamples(
+            batch.samples.itemAt(0).body.motion.pointerCount, sampleCount);
     if (! motionEvent) return NO_MEMORY;
 
     uint32_t chain = 0;
     for (size_t i = 0; i < count; i++) {
         InputMessage& msg = batch.samples.editItemAt(i);
         updateTouchState(&msg);
+        if (mTrackLatency) {
+            messageConsumed(&msg);
+            if (i + 1 == count) {
+                eventConsumed(&msg);
+            }
+        }
         if (i) {
             SeqChain seqChain;
             seqChain.seq = msg.body.motion.seq;
@@ -561,6 +1260,7 @@ status_t InputConsumer::consumeSamples(InputEventFactoryInterface* factory,
             addSample(motionEvent, &msg);
         } else {
             initializeMotionEvent(motionEvent, &msg);
+            motionEvent->reserveSamples(sampleCount);
         }
         chain = msg.body.motion.seq;
     }
@@ -594,6 +1294,15 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         TouchState& touchState = mTouchStates.editItemAt(index);
         touchState.initialize(deviceId, source);
         touchState.addHistory(msg);
+
+        VelocityTracker* velocityTracker = findVelocityTracker(deviceId, source);
+        if (velocityTracker) {
+            velocityTracker->clear();
+        } else if (mResampleMode == RESAMPLE_PREDICTIVE) {
+            velocityTracker = new VelocityTracker(RESAMPLE_PREDICTIVE_STRATEGY);
+            mVelocityTrackers.add(getTouchKey(deviceId, source), velocityTracker);
+        }
+        addVelocityMovement(velocityTracker, msg);
         break;
     }
 
@@ -601,7 +1310,9 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         ssize_t index = findTouchState(deviceId, source);
         if (index >= 0) {
             TouchState& touchState = mTouchStates.editItemAt(index);
+            measurePrediction(touchState, msg);
             touchState.addHistory(msg);
+            addVelocityMovement(findVelocityTracker(deviceId, source), msg);
             if (eventTime < touchState.lastResample.eventTime) {
                 rewriteMessage(touchState, msg);
             } else {
@@ -617,6 +1328,12 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
             rewriteMessage(touchState, msg);
+            VelocityTracker* velocityTracker = findVelocityTracker(deviceId, source);
+            if (velocityTracker) {
+                velocityTracker->clearPointers(
+                        BitSet32(BitSet32::valueForBit(msg->body.motion.getActionId())));
+                addVelocityMovement(velocityTracker, msg);
+            }
         }
         break;
     }
@@ -627,6 +1344,11 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             rewriteMessage(touchState, msg);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
+            VelocityTracker* velocityTracker = findVelocityTracker(deviceId, source);
+            if (velocityTracker) {
+                velocityTracker->clearPointers(
+                        BitSet32(BitSet32::valueForBit(msg->body.motion.getActionId())));
+            }
         }
         break;
     }
@@ -654,6 +1376,11 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
 }
 
 void InputConsumer::rewriteMessage(const TouchState& state, InputMessage* msg) {
+    if (state.lastResamplePredicted && mResampleMode == RESAMPLE_PREDICTIVE) {
+        // The prediction can be well ahead of the samples that follow it, which are
+        // left where they are as the application tracks their velocity too.
+        return;
+    }
     for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
         uint32_t id = msg->body.motion.pointers[i].properties.id;
         if (state.lastResample.idBits.hasBit(id)) {
@@ -672,6 +1399,72 @@ void InputConsumer::rewriteMessage(const TouchState& state, InputMessage* msg) {
     }
 }
 
+void InputConsumer::addVelocityMovement(VelocityTracker* velocityTracker,
+        const InputMessage* msg) {
+    if (!velocityTracker) {
+        return;
+    }
+
+    BitSet32 idBits;
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        idBits.markBit(msg->body.motion.pointers[i].properties.id);
+    }
+    VelocityTracker::Position positions[MAX_POINTERS];
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        uint32_t index = idBits.getIndexOfBit(msg->body.motion.pointers[i].properties.id);
+        const PointerCoords& coords = msg->body.motion.pointers[i].coords;
+        positions[index].x = coords.getX();
+        positions[index].y = coords.getY();
+    }
+    velocityTracker->addMovement(msg->body.motion.eventTime, idBits, positions);
+}
+
+void InputConsumer::measurePrediction(TouchState& touchState, const InputMessage* msg) {
+    // Compare the last extrapolated touch with the first real sample at or after its
+    // time, interpolated back to that time from the sample before.
+    const History& prediction = touchState.lastResample;
+    nsecs_t eventTime = msg->body.motion.eventTime;
+    if (!touchState.lastResamplePredicted || eventTime < prediction.eventTime) {
+        return;
+    }
+    touchState.lastResamplePredicted = false;
+
+    const History* previous = touchState.historySize ? touchState.getHistory(0) : NULL;
+    float alpha = 1;
+    if (previous && eventTime > previous->eventTime
+            && prediction.eventTime > previous->eventTime) {
+        alpha = float(prediction.eventTime - previous->eventTime)
+                / (eventTime - previous->eventTime);
+    }
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        uint32_t id = msg->body.motion.pointers[i].properties.id;
+        if (!prediction.idBits.hasBit(id)) {
+            continue;
+        }
+        const PointerCoords& coords = msg->body.motion.pointers[i].coords;
+        float x = coords.getX();
+        float y = coords.getY();
+        if (previous && previous->idBits.hasBit(id)) {
+            const PointerCoords& previousCoords = previous->getPointerById(id);
+            x = lerp(previousCoords.getX(), x, alpha);
+            y = lerp(previousCoords.getY(), y, alpha);
+        }
+        const PointerCoords& predictedCoords = prediction.getPointerById(id);
+        float dx = predictedCoords.getX() - x;
+        float dy = predictedCoords.getY() - y;
+        float error = sqrtf(dx * dx + dy * dy);
+#if DEBUG_RESAMPLING
+        ALOGD("[%d] - prediction error %0.3f", id, error);
+#endif
+        mResampleStats.measuredPointers += 1;
+        mResampleStats.error += error;
+        mResampleStats.squaredError += double(error) * error;
+        if (error > mResampleStats.maxError) {
+            mResampleStats.maxError = error;
+        }
+    }
+}
+
 void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     const InputMessage* next) {
     if (!mResampleTouch
@@ -709,6 +1502,16 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         }
     }
 
+    VelocityTracker* velocityTracker = !next && mResampleMode == RESAMPLE_PREDICTIVE
+            ? findVelocityTracker(event->getDeviceId(), event->getSource()) : NULL;
+    if (velocityTracker) {
+        if (predictTouchState(touchState, *velocityTracker, sampleTime, event)) {
+            event->addSample(touchState.lastResample.eventTime,
+                    touchState.lastResample.pointers);
+        }
+        return;
+    }
+
     // Find the data to use for resampling.
     const History* other;
     History future;
@@ -757,6 +1560,11 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     // Resample touch coordinates.
     touchState.lastResample.eventTime = sampleTime;
     touchState.lastResample.idBits.clear();
+    touchState.lastResamplePredicted = !next;
+    if (!next) {
+        mResampleStats.predictions += 1;
+        mResampleStats.predictionTime += sampleTime - current->eventTime;
+    }
     for (size_t i = 0; i < pointerCount; i++) {
         uint32_t id = event->getPointerId(i);
         touchState.lastResample.idToIndex[id] = i;
@@ -792,6 +1600,67 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     event->addSample(sampleTime, touchState.lastResample.pointers);
 }
 
+bool InputConsumer::predictTouchState(TouchState& touchState,
+        const VelocityTracker& velocityTracker, nsecs_t sampleTime, const MotionEvent* event) {
+    const History* current = touchState.getHistory(0);
+    nsecs_t maxPredict = current->eventTime + RESAMPLE_PREDICTIVE_MAX_PREDICTION;
+    if (sampleTime > maxPredict) {
+#if DEBUG_RESAMPLING
+        ALOGD("Sample time is too far in the future, adjusting prediction "
+                "from %lld to %lld ns.",
+                sampleTime - current->eventTime, maxPredict - current->eventTime);
+#endif
+        sampleTime = maxPredict;
+    }
+    if (sampleTime <= current->eventTime) {
+#if DEBUG_RESAMPLING
+        ALOGD("Not resampled, sample time is not after the last sample.");
+#endif
+        return false;
+    }
+
+    touchState.lastResample.eventTime = sampleTime;
+    touchState.lastResample.idBits.clear();
+    touchState.lastResamplePredicted = true;
+    size_t pointerCount = event->getPointerCount();
+    for (size_t i = 0; i < pointerCount; i++) {
+        uint32_t id = event->getPointerId(i);
+        touchState.lastResample.idToIndex[id] = i;
+        touchState.lastResample.idBits.markBit(id);
+        PointerCoords& resampledCoords = touchState.lastResample.pointers[i];
+        const PointerCoords& currentCoords = current->getPointerById(id);
+        resampledCoords.copyFrom(currentCoords);
+
+        VelocityTracker::Estimator estimator;
+        if (!shouldResampleTool(event->getToolType(i))
+                || !velocityTracker.getEstimator(id, &estimator)
+                || estimator.degree < 1) {
+            continue;
+        }
+
+        // Move the pointer along the estimated curve, from the last sample, less far
+        // the less the samples fit it so that noise isn't amplified.
+        float confidence = estimator.confidence > 0 ? min(estimator.confidence, 1.0f) : 0;
+        float from = (current->eventTime - estimator.time) * 0.000000001f;
+        float to = from + (sampleTime - current->eventTime) * 0.000000001f * confidence;
+        resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X, currentCoords.getX()
+                + evaluatePolynomial(estimator.xCoeff, estimator.degree, to)
+                - evaluatePolynomial(estimator.xCoeff, estimator.degree, from));
+        resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, currentCoords.getY()
+                + evaluatePolynomial(estimator.yCoeff, estimator.degree, to)
+                - evaluatePolynomial(estimator.yCoeff, estimator.degree, from));
+#if DEBUG_RESAMPLING
+        ALOGD("[%d] - out (%0.3f, %0.3f), cur (%0.3f, %0.3f), confidence %0.3f",
+                id, resampledCoords.getX(), resampledCoords.getY(),
+                currentCoords.getX(), currentCoords.getY(), confidence);
+#endif
+    }
+
+    mResampleStats.predictions += 1;
+    mResampleStats.predictionTime += sampleTime - current->eventTime;
+    return true;
+}
+
 bool InputConsumer::shouldResampleTool(int32_t toolType) {
     return toolType == AMOTION_EVENT_TOOL_TYPE_FINGER
             || toolType == AMOTION_EVENT_TOOL_TYPE_UNKNOWN;
@@ -808,59 +1677,93 @@ status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
         return BAD_VALUE;
     }
 
-    // Send finished signals for the batch sequence chain first.
+    if (mTrackLatency) {
+        eventFinished(seq);
+    }
+
+    // Send the finished signals for the batch sequence chain first, and the one for
+    // the last message in the batch, a few at a time.  The chain can be long when the
+    // application is late, so the messages are built in a buffer of a fixed size.
+    // mFinishedSeqs holds the sequence numbers from the last to the first one.
     size_t seqChainCount = mSeqChains.size();
-    if (seqChainCount) {
-        uint32_t currentSeq = seq;
-        uint32_t chainSeqs[seqChainCount];
-        size_t chainIndex = 0;
-        for (size_t i = seqChainCount; i-- > 0; ) {
-             const SeqChain& seqChain = mSeqChains.itemAt(i);
-             if (seqChain.seq == currentSeq) {
-                 currentSeq = seqChain.chain;
-                 chainSeqs[chainIndex++] = currentSeq;
-                 mSeqChains.removeAt(i);
-             }
-        }
-        status_t status = OK;
-        while (!status && chainIndex-- > 0) {
-            status = sendUnchainedFinishedSignal(chainSeqs[chainIndex], handled);
-        }
-        if (status) {
-            // An error occurred so at least one signal was not sent, reconstruct the chain.
-            do {
-                SeqChain seqChain;
-                seqChain.seq = chainIndex != 0 ? chainSeqs[chainIndex - 1] : seq;
-                seqChain.chain = chainSeqs[chainIndex];
-                mSeqChains.push(seqChain);
-            } while (chainIndex-- > 0);
-            return status;
-        }
-    }
-
-    // Send finished signal for the last message in the batch.
-    return sendUnchainedFinishedSignal(seq, handled);
+    if (!seqChainCount) {
+        return sendUnchainedFinishedSignal(seq, handled);
+    }
+    mFinishedSeqs.clear();
+    mFinishedSeqs.push(seq);
+    uint32_t currentSeq = seq;
+    for (size_t i = seqChainCount; i-- > 0; ) {
+         const SeqChain& seqChain = mSeqChains.itemAt(i);
+         if (seqChain.seq == currentSeq) {
+             currentSeq = seqChain.chain;
+             mFinishedSeqs.push(currentSeq);
+             mSeqChains.removeAt(i);
+         }
+    }
+    size_t count = mFinishedSeqs.size();
+    if (count == 1) {
+        return sendUnchainedFinishedSignal(seq, handled);
+    }
+
+    if (mFinishedBuffer.isEmpty()) {
+        mFinishedBuffer.insertAt(0, MAX_MESSAGE_BATCH);
+    }
+    InputMessage* msgs = mFinishedBuffer.editArray();
+    size_t sent = 0;
+    status_t status = OK;
+    while (!status && sent < count) {
+        size_t n = min(count - sent, MAX_MESSAGE_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            msgs[i].header.type = InputMessage::TYPE_FINISHED;
+            msgs[i].header.delay = 0;
+            msgs[i].body.finished.seq = mFinishedSeqs[count - 1 - sent - i];
+            msgs[i].body.finished.handled = handled;
+        }
+        size_t chunkSent;
+        status = mChannel->sendMessages(msgs, n, &chunkSent);
+        sent += chunkSent;
+    }
+    if (status) {
+        // An error occurred so at least one signal was not sent, reconstruct the chain
+        // of the ones before the last.
+        for (size_t i = count - sent; i-- > 1; ) {
+            SeqChain seqChain;
+            seqChain.seq = mFinishedSeqs[i - 1];
+            seqChain.chain = mFinishedSeqs[i];
+            mSeqChains.push(seqChain);
+        }
+    }
+    return status;
 }
 
 status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled) {
     InputMessage msg;
     msg.header.type = InputMessage::TYPE_FINISHED;
+    msg.header.delay = 0;
     msg.body.finished.seq = seq;
     msg.body.finished.handled = handled;
     return mChannel->sendMessage(&msg);
 }
 
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    return mMsgDeferred || mReceiveIndex < mReceiveCount;
 }
 
 bool InputConsumer::hasPendingBatch() const {
-    return !mBatches.isEmpty();
+    for (size_t i = 0; i < mBatches.size(); i++) {
+        if (!mBatches.itemAt(i).samples.isEmpty()) {
+            return true;
+        }
+    }
+    return false;
 }
 
 ssize_t InputConsumer::findBatch(int32_t deviceId, int32_t source) const {
     for (size_t i = 0; i < mBatches.size(); i++) {
         const Batch& batch = mBatches.itemAt(i);
+        if (batch.samples.isEmpty()) {
+            continue;
+        }
         const InputMessage& head = batch.samples.itemAt(0);
         if (head.body.motion.deviceId == deviceId && head.body.motion.source == source) {
             return i;
@@ -869,6 +1772,16 @@ ssize_t InputConsumer::findBatch(int32_t deviceId, int32_t source) const {
     return -1;
 }
 
+InputConsumer::Batch& InputConsumer::addBatch() {
+    for (size_t i = 0; i < mBatches.size(); i++) {
+        if (mBatches.itemAt(i).samples.isEmpty()) {
+            return mBatches.editItemAt(i);
+        }
+    }
+    mBatches.push();
+    return mBatches.editTop();
+}
+
 ssize_t InputConsumer::findTouchState(int32_t deviceId, int32_t source) const {
     for (size_t i = 0; i < mTouchStates.size(); i++) {
         const TouchState& touchState = mTouchStates.itemAt(i);
@@ -879,6 +1792,15 @@ ssize_t InputConsumer::findTouchState(int32_t deviceId, int32_t source) const {
     return -1;
 }
 
+int64_t InputConsumer::getTouchKey(int32_t deviceId, int32_t source) {
+    return (int64_t(deviceId) << 32) | uint32_t(source);
+}
+
+VelocityTracker* InputConsumer::findVelocityTracker(int32_t deviceId, int32_t source) const {
+    ssize_t index = mVelocityTrackers.indexOfKey(getTouchKey(deviceId, source));
+    return index >= 0 ? mVelocityTrackers.valueAt(index) : NULL;
+}
+
 void InputConsumer::initializeKeyEvent(KeyEvent* event, const InputMessage* msg) {
     event->initialize(
             msg->body.key.deviceId,
@@ -109,6 +109,156 @@ status_t KeyCharacterMap::load(const String8& filename,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    // If the image can't be used, parsing the file reports why.
+    KeyMapImage* image;
+    if (!KeyMapImage::open(filename, KeyMapImage::MAGIC_KEY_CHARACTER_MAP, &image)) {
+        status_t status = load(image, format, outMap);
+        delete image;
+        if (!status) {
+            return OK;
+        }
+    }
+    return loadText(filename, format, outMap);
+}
+
+status_t KeyCharacterMap::compile(const String8& filename, Format format,
+        const String8& imageFilename) {
+    sp<KeyCharacterMap> map;
+    status_t status = loadText(filename, format, &map);
+    if (status) {
+        return status;
+    }
+
+    ImageInfo info;
+    info.type = map->mType;
+
+    Vector<ImageKey> keys;
+    Vector<ImageBehavior> behaviors;
+    keys.setCapacity(map->mKeys.size());
+    for (size_t i = 0; i < map->mKeys.size(); i++) {
+        const Key* key = map->mKeys.valueAt(i);
+        ImageKey entry;
+        entry.keyCode = map->mKeys.keyAt(i);
+        entry.label = key->label;
+        entry.number = key->number;
+        entry.firstBehavior = behaviors.size();
+        for (const Behavior* behavior = key->firstBehavior; behavior;
+                behavior = behavior->next) {
+            ImageBehavior behaviorEntry;
+            behaviorEntry.metaState = behavior->metaState;
+            behaviorEntry.fallbackKeyCode = behavior->fallbackKeyCode;
+            behaviorEntry.character = behavior->character;
+            behaviorEntry.reserved = 0;
+            behaviors.add(behaviorEntry);
+        }
+        entry.behaviorCount = behaviors.size() - entry.firstBehavior;
+        keys.add(entry);
+    }
+
+    Vector<ImageKeyMapping> keysByScanCode;
+    Vector<ImageKeyMapping> keysByUsageCode;
+    addKeyMappings(map->mKeysByScanCode, &keysByScanCode);
+    addKeyMappings(map->mKeysByUsageCode, &keysByUsageCode);
+
+    KeyMapImage::Table tables[TABLE_COUNT];
+    tables[TABLE_INFO].data = &info;
+    tables[TABLE_INFO].count = 1;
+    tables[TABLE_INFO].entrySize = sizeof(ImageInfo);
+    tables[TABLE_KEYS].data = keys.array();
+    tables[TABLE_KEYS].count = keys.size();
+    tables[TABLE_KEYS].entrySize = sizeof(ImageKey);
+    tables[TABLE_BEHAVIORS].data = behaviors.array();
+    tables[TABLE_BEHAVIORS].count = behaviors.size();
+    tables[TABLE_BEHAVIORS].entrySize = sizeof(ImageBehavior);
+    tables[TABLE_KEYS_BY_SCAN_CODE].data = keysByScanCode.array();
+    tables[TABLE_KEYS_BY_SCAN_CODE].count = keysByScanCode.size();
+    tables[TABLE_KEYS_BY_SCAN_CODE].entrySize = sizeof(ImageKeyMapping);
+    tables[TABLE_KEYS_BY_USAGE_CODE].data = keysByUsageCode.array();
+    tables[TABLE_KEYS_BY_USAGE_CODE].count = keysByUsageCode.size();
+    tables[TABLE_KEYS_BY_USAGE_CODE].entrySize = sizeof(ImageKeyMapping);
+    return KeyMapImage::write(filename, imageFilename, KeyMapImage::MAGIC_KEY_CHARACTER_MAP,
+            tables, TABLE_COUNT);
+}
+
+void KeyCharacterMap::addKeyMappings(const KeyedVector<int32_t, int32_t>& mappings,
+        Vector<ImageKeyMapping>* outEntries) {
+    outEntries->setCapacity(mappings.size());
+    for (size_t i = 0; i < mappings.size(); i++) {
+        ImageKeyMapping entry;
+        entry.code = mappings.keyAt(i);
+        entry.keyCode = mappings.valueAt(i);
+        outEntries->add(entry);
+    }
+}
+
+status_t KeyCharacterMap::load(const KeyMapImage* image,
+        Format format, sp<KeyCharacterMap>* outMap) {
+    size_t infoCount, keyCount, behaviorCount;
+    const ImageInfo* info = static_cast<const ImageInfo*>(
+            image->getTable(TABLE_INFO, sizeof(ImageInfo), &infoCount));
+    const ImageKey* keys = static_cast<const ImageKey*>(
+            image->getTable(TABLE_KEYS, sizeof(ImageKey), &keyCount));
+    const ImageBehavior* behaviors = static_cast<const ImageBehavior*>(
+            image->getTable(TABLE_BEHAVIORS, sizeof(ImageBehavior), &behaviorCount));
+    if (infoCount != 1 || !keys || !behaviors) {
+        ALOGE("Malformed key character map image.");
+        return BAD_VALUE;
+    }
+
+    // The format restricts the type as when parsing.
+    if ((format == FORMAT_BASE && info->type == KEYBOARD_TYPE_OVERLAY)
+            || (format == FORMAT_OVERLAY && info->type != KEYBOARD_TYPE_OVERLAY)) {
+        return BAD_VALUE;
+    }
+
+    sp<KeyCharacterMap> map = new KeyCharacterMap();
+    map->mType = info->type;
+    map->mKeys.setCapacity(keyCount);
+    for (size_t i = 0; i < keyCount; i++) {
+        const ImageKey& entry = keys[i];
+        if (entry.firstBehavior > behaviorCount
+                || entry.behaviorCount > behaviorCount - entry.firstBehavior) {
+            ALOGE("Malformed key character map image.");
+            return BAD_VALUE;
+        }
+
+        Key* key = new Key();
+        key->label = entry.label;
+        key->number = entry.number;
+        Behavior** link = &key->firstBehavior;
+        for (uint32_t j = 0; j < entry.behaviorCount; j++) {
+            const ImageBehavior& behaviorEntry = behaviors[entry.firstBehavior + j];
+            Behavior* behavior = new Behavior();
+            behavior->metaState = behaviorEntry.metaState;
+            behavior->character = behaviorEntry.character;
+            behavior->fallbackKeyCode = behaviorEntry.fallbackKeyCode;
+            *link = behavior;
+            link = &behavior->next;
+        }
+        map->mKeys.add(entry.keyCode, key);
+    }
+    loadKeyMappings(image, TABLE_KEYS_BY_SCAN_CODE, &map->mKeysByScanCode);
+    loadKeyMappings(image, TABLE_KEYS_BY_USAGE_CODE, &map->mKeysByUsageCode);
+
+    *outMap = map;
+    return OK;
+}
+
+void KeyCharacterMap::loadKeyMappings(const KeyMapImage* image, size_t table,
+        KeyedVector<int32_t, int32_t>* outMappings) {
+    size_t count;
+    const ImageKeyMapping* entries = static_cast<const ImageKeyMapping*>(
+            image->getTable(table, sizeof(ImageKeyMapping), &count));
+    outMappings->setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        outMappings->add(entries[i].code, entries[i].keyCode);
+    }
+}
+
+status_t KeyCharacterMap::loadText(const String8& filename,
+        Format format, sp<KeyCharacterMap>* outMap) {
+    outMap->clear();
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -40,17 +40,119 @@ namespace android {
 
 static const char* WHITESPACE = " \t\r";
 
+// Finds the entry with the specified code in a table of an image.
+template<typename T>
+static const T* findImageEntry(const T* entries, size_t count, int32_t code) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].code < code) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < count && entries[low].code == code ? &entries[low] : NULL;
+}
+
 // --- KeyLayoutMap ---
 
-KeyLayoutMap::KeyLayoutMap() {
+KeyLayoutMap::KeyLayoutMap() :
+        mImage(NULL),
+        mImageKeysByScanCode(NULL), mImageKeysByScanCodeCount(0),
+        mImageKeysByUsageCode(NULL), mImageKeysByUsageCodeCount(0),
+        mImageAxes(NULL), mImageAxesCount(0) {
 }
 
 KeyLayoutMap::~KeyLayoutMap() {
+    delete mImage;
 }
 
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    KeyMapImage* image;
+    if (!KeyMapImage::open(filename, KeyMapImage::MAGIC_KEY_LAYOUT_MAP, &image)) {
+        sp<KeyLayoutMap> map = new KeyLayoutMap();
+        if (!map->setImage(image)) {
+            *outMap = map;
+            return NO_ERROR;
+        }
+        ALOGE("Malformed key layout map image for %s.", filename.string());
+    }
+    return loadText(filename, outMap);
+}
+
+status_t KeyLayoutMap::setImage(KeyMapImage* image) {
+    mImage = image;
+    mImageKeysByScanCode = static_cast<const ImageKey*>(image->getTable(
+            TABLE_KEYS_BY_SCAN_CODE, sizeof(ImageKey), &mImageKeysByScanCodeCount));
+    mImageKeysByUsageCode = static_cast<const ImageKey*>(image->getTable(
+            TABLE_KEYS_BY_USAGE_CODE, sizeof(ImageKey), &mImageKeysByUsageCodeCount));
+    mImageAxes = static_cast<const ImageAxis*>(image->getTable(
+            TABLE_AXES, sizeof(ImageAxis), &mImageAxesCount));
+    if (!mImageKeysByScanCode || !mImageKeysByUsageCode || !mImageAxes) {
+        return BAD_VALUE;
+    }
+    return NO_ERROR;
+}
+
+status_t KeyLayoutMap::compile(const String8& filename, const String8& imageFilename) {
+    sp<KeyLayoutMap> map;
+    status_t status = loadText(filename, &map);
+    if (status) {
+        return status;
+    }
+
+    // KeyedVectors are sorted by key, so the tables come out sorted by code.
+    Vector<ImageKey> keysByScanCode;
+    keysByScanCode.setCapacity(map->mKeysByScanCode.size());
+    for (size_t i = 0; i < map->mKeysByScanCode.size(); i++) {
+        ImageKey entry;
+        entry.code = map->mKeysByScanCode.keyAt(i);
+        entry.key = map->mKeysByScanCode.valueAt(i);
+        keysByScanCode.add(entry);
+    }
+    Vector<ImageKey> keysByUsageCode;
+    keysByUsageCode.setCapacity(map->mKeysByUsageCode.size());
+    for (size_t i = 0; i < map->mKeysByUsageCode.size(); i++) {
+        ImageKey entry;
+        entry.code = map->mKeysByUsageCode.keyAt(i);
+        entry.key = map->mKeysByUsageCode.valueAt(i);
+        keysByUsageCode.add(entry);
+    }
+    Vector<ImageAxis> axes;
+    axes.setCapacity(map->mAxes.size());
+    for (size_t i = 0; i < map->mAxes.size(); i++) {
+        const AxisInfo& axisInfo = map->mAxes.valueAt(i);
+        ImageAxis entry;
+        entry.code = map->mAxes.keyAt(i);
+        entry.mode = axisInfo.mode;
+        entry.axis = axisInfo.axis;
+        entry.highAxis = axisInfo.highAxis;
+        entry.splitValue = axisInfo.splitValue;
+        entry.flatOverride = axisInfo.flatOverride;
+        axes.add(entry);
+    }
+
+    KeyMapImage::Table tables[TABLE_COUNT];
+    tables[TABLE_KEYS_BY_SCAN_CODE].data = keysByScanCode.array();
+    tables[TABLE_KEYS_BY_SCAN_CODE].count = keysByScanCode.size();
+    tables[TABLE_KEYS_BY_SCAN_CODE].entrySize = sizeof(ImageKey);
+    tables[TABLE_KEYS_BY_USAGE_CODE].data = keysByUsageCode.array();
+    tables[TABLE_KEYS_BY_USAGE_CODE].count = keysByUsageCode.size();
+    tables[TABLE_KEYS_BY_USAGE_CODE].entrySize = sizeof(ImageKey);
+    tables[TABLE_AXES].data = axes.array();
+    tables[TABLE_AXES].count = axes.size();
+    tables[TABLE_AXES].entrySize = sizeof(ImageAxis);
+    return KeyMapImage::write(filename, imageFilename, KeyMapImage::MAGIC_KEY_LAYOUT_MAP,
+            tables, TABLE_COUNT);
+}
+
+status_t KeyLayoutMap::loadText(const String8& filename, sp<KeyLayoutMap>* outMap) {
+    outMap->clear();
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -104,6 +206,19 @@ status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
 }
 
 const KeyLayoutMap::Key* KeyLayoutMap::getKey(int32_t scanCode, int32_t usageCode) const {
+    if (mImage) {
+        const ImageKey* entry = NULL;
+        if (usageCode) {
+            entry = findImageEntry(mImageKeysByUsageCode, mImageKeysByUsageCodeCount,
+                    usageCode);
+        }
+        if (!entry && scanCode) {
+            entry = findImageEntry(mImageKeysByScanCode, mImageKeysByScanCodeCount,
+                    scanCode);
+        }
+        return entry ? &entry->key : NULL;
+    }
+
     if (usageCode) {
         ssize_t index = mKeysByUsageCode.indexOfKey(usageCode);
         if (index >= 0) {
@@ -120,6 +235,12 @@ const KeyLayoutMap::Key* KeyLayoutMap::getKey(int32_t scanCode, int32_t usageCod
 }
 
 status_t KeyLayoutMap::findScanCodesForKey(int32_t keyCode, Vector<int32_t>* outScanCodes) const {
+    for (size_t i = 0; i < mImageKeysByScanCodeCount; i++) {
+        if (mImageKeysByScanCode[i].key.keyCode == keyCode) {
+            outScanCodes->add(mImageKeysByScanCode[i].code);
+        }
+    }
+
     const size_t N = mKeysByScanCode.size();
     for (size_t i=0; i<N; i++) {
         if (mKeysByScanCode.valueAt(i).keyCode == keyCode) {
@@ -130,15 +251,30 @@ status_t KeyLayoutMap::findScanCodesForKey(int32_t keyCode, Vector<int32_t>* out
 }
 
 status_t KeyLayoutMap::mapAxis(int32_t scanCode, AxisInfo* outAxisInfo) const {
-    ssize_t index = mAxes.indexOfKey(scanCode);
-    if (index < 0) {
+    if (mImage) {
+        const ImageAxis* entry = findImageEntry(mImageAxes, mImageAxesCount, scanCode);
+        if (!entry) {
 #if DEBUG_MAPPING
-        ALOGD("mapAxis: scanCode=%d ~ Failed.", scanCode);
+            ALOGD("mapAxis: scanCode=%d ~ Failed.", scanCode);
 #endif
-        return NAME_NOT_FOUND;
-    }
+            return NAME_NOT_FOUND;
+        }
+        outAxisInfo->mode = AxisInfo::Mode(entry->mode);
+        outAxisInfo->axis = entry->axis;
+        outAxisInfo->highAxis = entry->highAxis;
+        outAxisInfo->splitValue = entry->splitValue;
+        outAxisInfo->flatOverride = entry->flatOverride;
+    } else {
+        ssize_t index = mAxes.indexOfKey(scanCode);
+        if (index < 0) {
+#if DEBUG_MAPPING
+            ALOGD("mapAxis: scanCode=%d ~ Failed.", scanCode);
+#endif
+            return NAME_NOT_FOUND;
+        }
 
-    *outAxisInfo = mAxes.valueAt(index);
+        *outAxisInfo = mAxes.valueAt(index);
+    }
 
 #if DEBUG_MAPPING
     ALOGD("mapAxis: scanCode=%d ~ Result mode=%d, axis=%d, highAxis=%d, "
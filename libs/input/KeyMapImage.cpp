@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "KeyMapImage"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <input/KeyMapImage.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Alignment of the tables in an image.
+static const size_t TABLE_ALIGNMENT = 4;
+
+static inline size_t align(size_t size) {
+    return (size + TABLE_ALIGNMENT - 1) & ~(TABLE_ALIGNMENT - 1);
+}
+
+// --- KeyMapImage ---
+
+KeyMapImage::KeyMapImage(void* data, size_t size) :
+        mData(data), mSize(size) {
+}
+
+KeyMapImage::~KeyMapImage() {
+    munmap(mData, mSize);
+}
+
+String8 KeyMapImage::getImagePath(const String8& filename) {
+    String8 path(filename);
+    path.append(".bin");
+    return path;
+}
+
+status_t KeyMapImage::open(const String8& filename, uint32_t magic, KeyMapImage** outImage) {
+    *outImage = NULL;
+
+    String8 imageFilename(getImagePath(filename));
+    int fd = ::open(imageFilename.string(), O_RDONLY);
+    if (fd < 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    struct stat stat;
+    void* data = MAP_FAILED;
+    if (!fstat(fd, &stat) && size_t(stat.st_size) >= sizeof(Header)) {
+        data = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ALOGE("Error mapping key map image %s.", imageFilename.string());
+        return BAD_VALUE;
+    }
+
+    KeyMapImage* image = new KeyMapImage(data, stat.st_size);
+    const Header* header = static_cast<const Header*>(data);
+    if (header->magic != magic) {
+        ALOGE("Malformed key map image %s.", imageFilename.string());
+        delete image;
+        return BAD_VALUE;
+    }
+    // The layout of the rest of the header depends on the version.
+    if (header->version != VERSION) {
+        ALOGW("Ignoring key map image %s of version %d, expected version %d.",
+                imageFilename.string(), header->version, VERSION);
+        delete image;
+        return NAME_NOT_FOUND;
+    }
+
+    if (header->size != image->mSize
+            || header->tableCount > (image->mSize - sizeof(Header)) / sizeof(TableHeader)) {
+        ALOGE("Malformed key map image %s.", imageFilename.string());
+        delete image;
+        return BAD_VALUE;
+    }
+    const TableHeader* tables = reinterpret_cast<const TableHeader*>(header + 1);
+    for (uint32_t i = 0; i < header->tableCount; i++) {
+        const TableHeader& table = tables[i];
+        if (table.offset % TABLE_ALIGNMENT || table.offset > image->mSize
+                || (table.entrySize && table.count > (image->mSize - table.offset)
+                        / table.entrySize)) {
+            ALOGE("Malformed key map image %s.", imageFilename.string());
+            delete image;
+            return BAD_VALUE;
+        }
+    }
+
+    struct stat sourceStat;
+    if (::stat(filename.string(), &sourceStat)) {
+        status_t status = -errno;
+        delete image;
+        return status;
+    }
+    if (off_t(header->sourceSize) != sourceStat.st_size
+            || sourceStat.st_mtime > stat.st_mtime) {
+        ALOGW("Ignoring key map image %s, %s has changed since it was compiled.",
+                imageFilename.string(), filename.string());
+        delete image;
+        return NAME_NOT_FOUND;
+    }
+
+    *outImage = image;
+    return OK;
+}
+
+status_t KeyMapImage::write(const String8& filename, const String8& imageFilename,
+        uint32_t magic, const Table* tables, size_t tableCount) {
+    Header header;
+    header.magic = magic;
+    header.version = VERSION;
+    header.tableCount = tableCount;
+    struct stat sourceStat;
+    if (::stat(filename.string(), &sourceStat)) {
+        status_t status = -errno;
+        ALOGE("Error %d reading key map file %s.", status, filename.string());
+        return status;
+    }
+    header.sourceSize = sourceStat.st_size;
+
+    size_t size = align(sizeof(Header) + tableCount * sizeof(TableHeader));
+    Vector<TableHeader> tableHeaders;
+    tableHeaders.setCapacity(tableCount);
+    for (size_t i = 0; i < tableCount; i++) {
+        TableHeader tableHeader;
+        tableHeader.offset = size;
+        tableHeader.count = tables[i].count;
+        tableHeader.entrySize = tables[i].entrySize;
+        tableHeaders.add(tableHeader);
+        size = align(size + tables[i].count * tables[i].entrySize);
+    }
+    header.size = size;
+
+    Vector<uint8_t> image;
+    image.insertAt(uint8_t(0), 0, size);
+    uint8_t* data = image.editArray();
+    memcpy(data, &header, sizeof(Header));
+    memcpy(data + sizeof(Header), tableHeaders.array(), tableCount * sizeof(TableHeader));
+    for (size_t i = 0; i < tableCount; i++) {
+        if (tables[i].count) {
+            memcpy(data + tableHeaders[i].offset, tables[i].data,
+                    tables[i].count * tables[i].entrySize);
+        }
+    }
+
+    status_t status = OK;
+    int fd = ::open(imageFilename.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        status = -errno;
+        ALOGE("Error %d creating key map image %s.", status, imageFilename.string());
+        return status;
+    }
+    for (size_t written = 0; written < size; ) {
+        ssize_t nWrite;
+        do {
+            nWrite = ::write(fd, data + written, size - written);
+        } while (nWrite == -1 && errno == EINTR);
+        if (nWrite < 0) {
+            status = -errno;
+            ALOGE("Error %d writing key map image %s.", status, imageFilename.string());
+            break;
+        }
+        written += nWrite;
+    }
+    ::close(fd);
+    return status;
+}
+
+const void* KeyMapImage::getTable(size_t index, size_t entrySize, size_t* outCount) const {
+    const Header* header = static_cast<const Header*>(mData);
+    const TableHeader* tables = reinterpret_cast<const TableHeader*>(header + 1);
+    if (index >= header->tableCount || tables[index].entrySize != entrySize) {
+        *outCount = 0;
+        return NULL;
+    }
+    *outCount = tables[index].count;
+    return static_cast<const uint8_t*>(mData) + tables[index].offset;
+}
+
+} // namespace android
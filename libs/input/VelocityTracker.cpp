@@ -160,6 +160,17 @@ VelocityTrackerStrategy* VelocityTracker::createStrategy(const char* strategy) {
         // of the velocity when the finger is released.
         return new LeastSquaresVelocityTrackerStrategy(3);
     }
+    if (!strcmp("ilsq1", strategy)) {
+        // 1st order least squares, computed incrementally.  Quality: same as 'lsq1'.
+        return new IncrementalLeastSquaresVelocityTrackerStrategy(1);
+    }
+    if (!strcmp("ilsq2", strategy)) {
+        // 2nd order least squares, computed incrementally.  Quality: same as 'lsq2'.
+        // Fits the same polynomial as 'lsq2' up to rounding, but adding a movement
+        // and getting the velocity take constant time instead of refitting the
+        // whole history on each query.
+        return new IncrementalLeastSquaresVelocityTrackerStrategy(2);
+    }
     if (!strcmp("wlsq2-delta", strategy)) {
         // 2nd order weighted least squares, delta weighting.  Quality: EXPERIMENTAL
         return new LeastSquaresVelocityTrackerStrategy(2,
@@ -690,6 +701,236 @@ float LeastSquaresVelocityTrackerStrategy::chooseWeight(uint32_t index) const {
 }
 
 
+// --- IncrementalLeastSquaresVelocityTrackerStrategy ---
+
+const nsecs_t IncrementalLeastSquaresVelocityTrackerStrategy::HORIZON;
+const uint32_t IncrementalLeastSquaresVelocityTrackerStrategy::HISTORY_SIZE;
+
+IncrementalLeastSquaresVelocityTrackerStrategy::IncrementalLeastSquaresVelocityTrackerStrategy(
+        uint32_t degree) :
+        mDegree(degree) {
+}
+
+IncrementalLeastSquaresVelocityTrackerStrategy::~IncrementalLeastSquaresVelocityTrackerStrategy() {
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::clear() {
+    mPointerIdBits.clear();
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::clearPointers(BitSet32 idBits) {
+    mPointerIdBits.value &= ~idBits.value;
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime,
+        BitSet32 idBits, const VelocityTracker::Position* positions) {
+    uint32_t index = 0;
+    for (BitSet32 iterIdBits(idBits); !iterIdBits.isEmpty();) {
+        uint32_t id = iterIdBits.clearFirstMarkedBit();
+        State& state = mPointerState[id];
+        const VelocityTracker::Position& position = positions[index++];
+        if (mPointerIdBits.hasBit(id)) {
+            addSample(state, eventTime, position.x, position.y);
+        } else {
+            initState(state, eventTime, position.x, position.y);
+        }
+    }
+
+    // As with lsq, the samples of a pointer must be in consecutive movements.
+    mPointerIdBits = idBits;
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::initState(State& state,
+        nsecs_t eventTime, float x, float y) {
+    state.oldest = 0;
+    state.count = 0;
+    state.removed = 0;
+    state.originTime = eventTime;
+    state.originX = x;
+    state.originY = y;
+    for (uint32_t k = 0; k < 5; k++) {
+        state.st[k] = 0;
+    }
+    for (uint32_t k = 0; k < 3; k++) {
+        state.sx[k] = 0;
+        state.sy[k] = 0;
+    }
+    state.sxx = 0;
+    state.syy = 0;
+    addSample(state, eventTime, x, y);
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::addSample(State& state,
+        nsecs_t eventTime, float x, float y) {
+    // Drop the samples that lsq would not look at once this one is the newest.
+    while (state.count && (state.count == HISTORY_SIZE
+            || eventTime - state.samples[state.oldest].eventTime > HORIZON)) {
+        accumulate(state, state.samples[state.oldest], -1);
+        state.oldest = (state.oldest + 1) % HISTORY_SIZE;
+        state.count -= 1;
+        state.removed += 1;
+    }
+
+    Sample& sample = state.samples[(state.oldest + state.count) % HISTORY_SIZE];
+    sample.eventTime = eventTime;
+    sample.x = x;
+    sample.y = y;
+    state.count += 1;
+
+    // Subtracting the samples that leave the window accumulates rounding errors, and
+    // the times get larger as the origin falls behind, so once a whole window has been
+    // replaced the sums are computed again relative to the oldest sample.
+    if (state.removed >= HISTORY_SIZE) {
+        recomputeSums(state);
+    } else {
+        accumulate(state, sample, 1);
+    }
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::accumulate(State& state,
+        const Sample& sample, double sign) {
+    double t = (sample.eventTime - state.originTime) * 0.000000001;
+    double x = double(sample.x) - state.originX;
+    double y = double(sample.y) - state.originY;
+    double term = sign;
+    for (uint32_t k = 0; k < 5; k++) {
+        state.st[k] += term;
+        if (k < 3) {
+            state.sx[k] += term * x;
+            state.sy[k] += term * y;
+        }
+        term *= t;
+    }
+    state.sxx += sign * x * x;
+    state.syy += sign * y * y;
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::recomputeSums(State& state) {
+    const Sample& oldest = state.samples[state.oldest];
+    state.originTime = oldest.eventTime;
+    state.originX = oldest.x;
+    state.originY = oldest.y;
+    for (uint32_t k = 0; k < 5; k++) {
+        state.st[k] = 0;
+    }
+    for (uint32_t k = 0; k < 3; k++) {
+        state.sx[k] = 0;
+        state.sy[k] = 0;
+    }
+    state.sxx = 0;
+    state.syy = 0;
+    for (uint32_t i = 0; i < state.count; i++) {
+        accumulate(state, state.samples[(state.oldest + i) % HISTORY_SIZE], 1);
+    }
+    state.removed = 0;
+}
+
+/**
+ * Solves L Lt B = R for B, where L is the n by n lower triangular Cholesky factor of
+ * the normal equations of a least squares problem, and R their right hand side.
+ *
+ * Returns the coefficient of determination of the fit, computed from the sum of
+ * squares of the data (syy) as solveLeastSquares() computes it from the data itself.
+ */
+static float solveCholesky(const double l[3][3], const double* r, uint32_t n,
+        double sum, double syy, double* outB) {
+    double z[3];
+    for (uint32_t i = 0; i < n; i++) {
+        z[i] = r[i];
+        for (uint32_t j = 0; j < i; j++) {
+            z[i] -= l[i][j] * z[j];
+        }
+        z[i] /= l[i][i];
+    }
+    for (uint32_t i = n; i-- != 0; ) {
+        outB[i] = z[i];
+        for (uint32_t j = i + 1; j < n; j++) {
+            outB[i] -= l[j][i] * outB[j];
+        }
+        outB[i] /= l[i][i];
+    }
+
+    // For the least squares solution, the residual sum of squares is syy - B . R.
+    double sserr = syy;
+    for (uint32_t i = 0; i < n; i++) {
+        sserr -= outB[i] * r[i];
+    }
+    double sstot = syy - r[0] * r[0] / sum;
+    return sstot > 0.000001 ? float(1 - sserr / sstot) : 1;
+}
+
+bool IncrementalLeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
+        VelocityTracker::Estimator* outEstimator) const {
+    outEstimator->clear();
+
+    if (!mPointerIdBits.hasBit(id)) {
+        return false;
+    }
+
+    const State& state = mPointerState[id];
+    const Sample& newest = state.samples[(state.oldest + state.count - 1) % HISTORY_SIZE];
+    outEstimator->time = newest.eventTime;
+
+    uint32_t degree = mDegree;
+    if (degree > state.count - 1) {
+        degree = state.count - 1;
+    }
+    if (degree >= 1) {
+        // Factor the normal equations, whose matrix holds the sums of the powers of t.
+        // The diagonal of the factor holds the norms of the columns of powers of t once
+        // orthogonalized, which lsq compares with the same threshold.
+        uint32_t n = degree + 1;
+        double l[3][3];
+        bool solvable = true;
+        for (uint32_t j = 0; j < n && solvable; j++) {
+            double d = state.st[2 * j];
+            for (uint32_t k = 0; k < j; k++) {
+                d -= l[j][k] * l[j][k];
+            }
+            if (!(d > 0) || sqrt(d) < 0.000001) {
+                solvable = false;
+                break;
+            }
+            l[j][j] = sqrt(d);
+            for (uint32_t i = j + 1; i < n; i++) {
+                double v = state.st[i + j];
+                for (uint32_t k = 0; k < j; k++) {
+                    v -= l[i][k] * l[j][k];
+                }
+                l[i][j] = v / l[j][j];
+            }
+        }
+
+        if (solvable) {
+            double xb[3] = { 0, 0, 0 };
+            double yb[3] = { 0, 0, 0 };
+            float xdet = solveCholesky(l, state.sx, n, state.st[0], state.sxx, xb);
+            float ydet = solveCholesky(l, state.sy, n, state.st[0], state.syy, yb);
+
+            // Re-express the polynomials in terms of the time relative to the newest
+            // sample, as lsq does.
+            double t = (newest.eventTime - state.originTime) * 0.000000001;
+            outEstimator->xCoeff[0] = float(state.originX + xb[0] + (xb[1] + xb[2] * t) * t);
+            outEstimator->yCoeff[0] = float(state.originY + yb[0] + (yb[1] + yb[2] * t) * t);
+            outEstimator->xCoeff[1] = float(xb[1] + 2 * xb[2] * t);
+            outEstimator->yCoeff[1] = float(yb[1] + 2 * yb[2] * t);
+            outEstimator->xCoeff[2] = float(xb[2]);
+            outEstimator->yCoeff[2] = float(yb[2]);
+            outEstimator->degree = degree;
+            outEstimator->confidence = xdet * ydet;
+            return true;
+        }
+    }
+
+    // No velocity data available for this pointer, but we do have its current position.
+    outEstimator->xCoeff[0] = newest.x;
+    outEstimator->yCoeff[0] = newest.y;
+    outEstimator->degree = 0;
+    outEstimator->confidence = 1;
+    return true;
+}
+
+
 // --- IntegratingVelocityTrackerStrategy ---
 
 IntegratingVelocityTrackerStrategy::IntegratingVelocityTrackerStrategy(uint32_t degree) :
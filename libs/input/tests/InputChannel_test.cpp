@@ -155,5 +155,79 @@ TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
             << "sendMessage should have returned DEAD_OBJECT";
 }
 
+TEST_F(InputChannelTest, SendAndReceiveMessages_TransfersAllMessagesInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    const size_t count = 20;
+    InputMessage serverMsgs[count];
+    memset(serverMsgs, 0, sizeof(serverMsgs));
+    for (size_t i = 0; i < count; i++) {
+        serverMsgs[i].header.type = InputMessage::TYPE_KEY;
+        serverMsgs[i].body.key.seq = i + 1;
+    }
+    size_t sent = 0;
+    EXPECT_EQ(OK, serverChannel->sendMessages(serverMsgs, count, &sent))
+            << "server channel should be able to send messages to client channel";
+    EXPECT_EQ(count, sent)
+            << "server channel should have sent all the messages";
+
+    InputMessage clientMsgs[count];
+    size_t received = 0;
+    while (received < count) {
+        size_t n = 0;
+        ASSERT_EQ(OK, clientChannel->receiveMessages(clientMsgs + received,
+                count - received, &n))
+                << "client channel should be able to receive messages from server channel";
+        ASSERT_GT(n, 0U)
+                << "client channel should have received at least one message";
+        received += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(InputMessage::TYPE_KEY, clientMsgs[i].header.type)
+                << "client channel should receive the messages in order";
+        EXPECT_EQ(i + 1, clientMsgs[i].body.key.seq)
+                << "client channel should receive the messages in order";
+    }
+
+    size_t n = 0;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessages(clientMsgs, count, &n))
+            << "receiveMessages should have returned WOULD_BLOCK";
+}
+
+TEST_F(InputChannelTest, SendAndReceiveMessages_WhenPeerClosed_ReturnsAnError) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage msgs[2];
+    memset(msgs, 0, sizeof(msgs));
+    msgs[0].header.type = InputMessage::TYPE_KEY;
+    msgs[1].header.type = InputMessage::TYPE_KEY;
+    size_t sent = 0;
+    ASSERT_EQ(OK, serverChannel->sendMessages(msgs, 2, &sent));
+
+    serverChannel.clear(); // close server channel
+
+    size_t received = 0;
+    EXPECT_EQ(OK, clientChannel->receiveMessages(msgs, 2, &received))
+            << "receiveMessages should return the messages sent before the peer was closed";
+    EXPECT_EQ(2U, received);
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessages(msgs, 2, &received))
+            << "receiveMessages should have returned DEAD_OBJECT";
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->sendMessages(msgs, 2, &sent))
+            << "sendMessages should have returned DEAD_OBJECT";
+    EXPECT_EQ(0U, sent);
+}
+
 
 } // namespace android
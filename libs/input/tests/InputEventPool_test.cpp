@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+#include <input/Input.h>
+#include <input/InputTransport.h>
+#include <utils/Timers.h>
+
+// Counts the heap allocations of this test program, by interposing the allocator
+// entry points in front of the ones of libc.
+static volatile int32_t gAllocationCount;
+
+extern "C" {
+void* dlmalloc(size_t bytes);
+void* dlcalloc(size_t count, size_t bytes);
+void* dlrealloc(void* ptr, size_t bytes);
+
+void* malloc(size_t bytes) {
+    gAllocationCount += 1;
+    return dlmalloc(bytes);
+}
+
+void* calloc(size_t count, size_t bytes) {
+    gAllocationCount += 1;
+    return dlcalloc(count, bytes);
+}
+
+void* realloc(void* ptr, size_t bytes) {
+    gAllocationCount += 1;
+    return dlrealloc(ptr, bytes);
+}
+}
+
+namespace android {
+
+static const nsecs_t MILLIS = 1000000;
+
+static void initializeMotionEvent(MotionEvent* event, int32_t action, nsecs_t eventTime,
+        size_t pointerCount) {
+    PointerProperties pointerProperties[MAX_POINTERS];
+    PointerCoords pointerCoords[MAX_POINTERS];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerCoords[i].clear();
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 10 * i);
+    }
+    event->initialize(1, AINPUT_SOURCE_TOUCHSCREEN, action, 0, 0, 0, 0,
+            0, 0, 1, 1, 0, eventTime, pointerCount, pointerProperties, pointerCoords);
+}
+
+static void addSamples(MotionEvent* event, size_t sampleCount) {
+    PointerCoords pointerCoords[MAX_POINTERS];
+    for (size_t i = 0; i < event->getPointerCount(); i++) {
+        pointerCoords[i].clear();
+    }
+    for (size_t i = 0; i < sampleCount; i++) {
+        event->addSample(event->getEventTime() + MILLIS, pointerCoords);
+    }
+}
+
+TEST(InputEventPoolTest, MotionEvent_KeepsStorageWhenInitialized) {
+    MotionEvent event;
+    initializeMotionEvent(&event, AMOTION_EVENT_ACTION_MOVE, 0, 2);
+    addSamples(&event, 20);
+    const PointerCoords* coords = event.getSamplePointerCoords();
+    size_t capacity = event.getSamplePointerCoordsCapacity();
+
+    int32_t allocationCount = gAllocationCount;
+    initializeMotionEvent(&event, AMOTION_EVENT_ACTION_MOVE, 0, 2);
+    addSamples(&event, 10);
+    allocationCount = gAllocationCount - allocationCount;
+
+    EXPECT_EQ(0, allocationCount)
+            << "initializing an event again should not allocate";
+    EXPECT_EQ(coords, event.getSamplePointerCoords());
+    EXPECT_EQ(capacity, event.getSamplePointerCoordsCapacity());
+    EXPECT_EQ(2U, event.getPointerCount());
+    EXPECT_EQ(10U, event.getHistorySize());
+}
+
+TEST(InputEventPoolTest, PooledInputEventFactory_ReusesEventsBySize) {
+    PooledInputEventFactory factory;
+
+    MotionEvent* large = factory.createMotionEvent();
+    initializeMotionEvent(large, AMOTION_EVENT_ACTION_MOVE, 0, 1);
+    addSamples(large, 30);
+    MotionEvent* small = factory.createMotionEvent();
+    initializeMotionEvent(small, AMOTION_EVENT_ACTION_DOWN, 0, 1);
+    factory.recycle(large);
+    factory.recycle(small);
+
+    EXPECT_EQ(large, factory.createMotionEventForSamples(1, 20))
+            << "a batch should get the event that can hold it";
+    EXPECT_EQ(small, factory.createMotionEventForSamples(1, 1));
+    factory.recycle(large);
+    EXPECT_EQ(large, factory.createMotionEvent())
+            << "an event should be reused even if it is larger than needed";
+
+    KeyEvent* key = factory.createKeyEvent();
+    factory.recycle(key);
+    EXPECT_EQ(key, factory.createKeyEvent());
+
+    delete large;
+    delete small;
+    delete key;
+}
+
+TEST(InputEventPoolTest, PooledInputEventFactory_DoesNotPoolHugeEvents) {
+    PooledInputEventFactory factory;
+
+    MotionEvent* huge = factory.createMotionEvent();
+    initializeMotionEvent(huge, AMOTION_EVENT_ACTION_MOVE, 0, MAX_POINTERS);
+    addSamples(huge, 100);
+    factory.recycle(huge);
+
+    MotionEvent* event = factory.createMotionEvent();
+    EXPECT_EQ(0U, event->getSamplePointerCoordsCapacity())
+            << "an event holding too many samples should have been deleted";
+    delete event;
+}
+
+// A stylus reporting at 1000 Hz to an application drawing at 60 Hz: each frame,
+// the consumer batches about 16 samples and resamples them.
+TEST(InputEventPoolTest, ConsumeStylusStream_DoesNotAllocate) {
+    sp<InputChannel> serverChannel, clientChannel;
+    ASSERT_EQ(OK, InputChannel::openInputChannelPair(String8("stylus"),
+            serverChannel, clientChannel));
+    InputPublisher publisher(serverChannel);
+    InputConsumer consumer(clientChannel);
+    PooledInputEventFactory factory;
+
+    const nsecs_t sampleInterval = 1 * MILLIS;
+    const nsecs_t frameInterval = 16666667;
+    const size_t warmUpFrames = 30;
+    const size_t frameCount = 120;
+
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_STYLUS;
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+
+    uint32_t seq = 1;
+    nsecs_t downTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t eventTime = downTime;
+    int32_t action = AMOTION_EVENT_ACTION_DOWN;
+    int32_t warmUpAllocationCount = 0;
+    int32_t allocationCount = 0;
+    size_t eventCount = 0;
+    status_t status = OK;
+    for (size_t frame = 0; frame < warmUpFrames + frameCount && !status; frame++) {
+        int32_t frameAllocationCount = gAllocationCount;
+        nsecs_t frameTime = downTime + (frame + 1) * frameInterval;
+        for (; eventTime <= frameTime && !status; eventTime += sampleInterval) {
+            float t = (eventTime - downTime) * 1e-9f;
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 500 + 200 * cosf(t * 5));
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, 500 + 200 * sinf(t * 5));
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 0.5f + 0.2f * sinf(t));
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_TILT, 0.3f);
+            status = publisher.publishMotionEvent(seq++, 1, AINPUT_SOURCE_STYLUS,
+                    action, 0, 0, 0, 0, 0, 0, 1, 1, downTime, eventTime,
+                    1, &pointerProperties, &pointerCoords);
+            action = AMOTION_EVENT_ACTION_MOVE;
+        }
+
+        for (;;) {
+            uint32_t consumeSeq;
+            InputEvent* event;
+            status = consumer.consume(&factory, true /*consumeBatches*/, frameTime,
+                    &consumeSeq, &event);
+            if (status) {
+                break;
+            }
+            eventCount += 1;
+            factory.recycle(event);
+            status = consumer.sendFinishedSignal(consumeSeq, true);
+            if (status) {
+                break;
+            }
+        }
+        if (status == WOULD_BLOCK) {
+            status = OK;
+        }
+
+        while (!status) {
+            uint32_t finishedSeqs[16];
+            bool handled[16];
+            size_t count;
+            status = publisher.receiveFinishedSignals(finishedSeqs, handled, 16, &count);
+        }
+        if (status == WOULD_BLOCK) {
+            status = OK;
+        }
+
+        frameAllocationCount = gAllocationCount - frameAllocationCount;
+        if (frame < warmUpFrames) {
+            warmUpAllocationCount += frameAllocationCount;
+        } else {
+            allocationCount += frameAllocationCount;
+        }
+    }
+    ASSERT_EQ(OK, status);
+
+    RecordProperty("warmUpAllocations", warmUpAllocationCount);
+    RecordProperty("allocations", allocationCount);
+    EXPECT_EQ(1 + warmUpFrames + frameCount, eventCount)
+            << "consumer should have consumed the down and one batch per frame";
+    EXPECT_EQ(0, allocationCount)
+            << "consuming the stream should not allocate once the pool is warmed up";
+}
+
+} // namespace android
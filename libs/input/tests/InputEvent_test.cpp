@@ -15,6 +15,7 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include <binder/Parcel.h>
 #include <gtest/gtest.h>
@@ -518,6 +519,50 @@ TEST_F(MotionEventTest, Parcel) {
     ASSERT_NO_FATAL_FAILURE(assertEqualsEventWithHistory(&outEvent));
 }
 
+TEST_F(MotionEventTest, ParcelFormatMatchesPerValueWrites) {
+    MotionEvent event;
+    initializeEventWithHistory(&event);
+    Parcel parcel;
+    event.writeToParcel(&parcel);
+
+    // The layout MotionEvent has always used, one value at a time.
+    Parcel expected;
+    expected.writeInt32(event.getPointerCount());
+    expected.writeInt32(event.getHistorySize() + 1);
+    expected.writeInt32(event.getDeviceId());
+    expected.writeInt32(event.getSource());
+    expected.writeInt32(event.getAction());
+    expected.writeInt32(event.getFlags());
+    expected.writeInt32(event.getEdgeFlags());
+    expected.writeInt32(event.getMetaState());
+    expected.writeInt32(event.getButtonState());
+    expected.writeFloat(event.getXOffset());
+    expected.writeFloat(event.getYOffset());
+    expected.writeFloat(event.getXPrecision());
+    expected.writeFloat(event.getYPrecision());
+    expected.writeInt64(event.getDownTime());
+    for (size_t i = 0; i < event.getPointerCount(); i++) {
+        expected.writeInt32(event.getPointerProperties(i)->id);
+        expected.writeInt32(event.getPointerProperties(i)->toolType);
+    }
+    for (size_t h = 0; h <= event.getHistorySize(); h++) {
+        expected.writeInt64(h < event.getHistorySize()
+                ? event.getHistoricalEventTime(h) : event.getEventTime());
+        for (size_t i = 0; i < event.getPointerCount(); i++) {
+            const PointerCoords* coords = h < event.getHistorySize()
+                    ? event.getHistoricalRawPointerCoords(i, h)
+                    : event.getRawPointerCoords(i);
+            expected.writeInt64(coords->bits);
+            for (uint32_t v = 0; v < uint32_t(__builtin_popcountll(coords->bits)); v++) {
+                expected.writeFloat(coords->values[v]);
+            }
+        }
+    }
+
+    ASSERT_EQ(expected.dataSize(), parcel.dataSize());
+    ASSERT_EQ(0, memcmp(expected.data(), parcel.data(), parcel.dataSize()));
+}
+
 static void setRotationMatrix(float matrix[9], float angle) {
     float sin = sinf(angle);
     float cos = cosf(angle);
@@ -591,4 +636,100 @@ TEST_F(MotionEventTest, Transform) {
     ASSERT_NEAR(originalRawY, event.getRawY(0), 0.001);
 }
 
+// Builds an event with enough samples to span several transform blocks, in which the
+// second pointer sometimes has no Y and the orientation changes every few samples.
+static void initializeEventWithLongHistory(MotionEvent* event, size_t sampleCount) {
+    const size_t pointerCount = 2;
+    PointerProperties pointerProperties[pointerCount];
+    PointerCoords pointerCoords[pointerCount];
+    for (size_t j = 0; j < sampleCount; j++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            pointerProperties[i].clear();
+            pointerProperties[i].id = i;
+            PointerCoords& c = pointerCoords[i];
+            c.clear();
+            c.setAxisValue(AMOTION_EVENT_AXIS_X, 10.5f * j + 100 * i);
+            if (i == 0 || j % 3) {
+                c.setAxisValue(AMOTION_EVENT_AXIS_Y, -3.25f * j + 7);
+            }
+            c.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, j % 2 ? 0.5f : 0);
+            c.setAxisValue(AMOTION_EVENT_AXIS_SIZE, 0.25f);
+            c.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, 1.5f + j);
+            c.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, 2.5f * i);
+            c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, 0.1f * (j / 4));
+        }
+        if (j == 0) {
+            event->initialize(2, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE,
+                    0, 0, 0, 0, 5, -8, 1, 1, 0, j,
+                    pointerCount, pointerProperties, pointerCoords);
+        } else {
+            event->addSample(j, pointerCoords);
+        }
+    }
+}
+
+TEST_F(MotionEventTest, TransformMatchesEachSampleTransformedAlone) {
+    const size_t sampleCount = 70;
+    MotionEvent event;
+    initializeEventWithLongHistory(&event, sampleCount);
+    float matrix[9];
+    setRotationMatrix(matrix, 0.3f);
+    matrix[2] = 12;
+    matrix[5] = -4;
+
+    MotionEvent transformed;
+    transformed.copyFrom(&event, true /*keepHistory*/);
+    transformed.transform(matrix);
+
+    float perspective[9];
+    memcpy(perspective, matrix, sizeof(perspective));
+    perspective[6] = 0.001f;
+    MotionEvent projected;
+    projected.copyFrom(&event, true /*keepHistory*/);
+    projected.transform(perspective);
+
+    for (size_t j = 0; j < sampleCount; j++) {
+        MotionEvent sample;
+        sample.initialize(2, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE,
+                0, 0, 0, 0, event.getXOffset(), event.getYOffset(), 1, 1, 0, j,
+                event.getPointerCount(), event.getPointerProperties(),
+                event.getHistoricalRawPointerCoords(0, j));
+        MotionEvent projectedSample;
+        projectedSample.copyFrom(&sample, false /*keepHistory*/);
+        sample.transform(matrix);
+        projectedSample.transform(perspective);
+
+        for (size_t i = 0; i < event.getPointerCount(); i++) {
+            SCOPED_TRACE(j * event.getPointerCount() + i);
+            EXPECT_NEAR(sample.getX(i), transformed.getHistoricalX(i, j), 0.001);
+            EXPECT_NEAR(sample.getY(i), transformed.getHistoricalY(i, j), 0.001);
+            EXPECT_EQ(sample.getOrientation(i), transformed.getHistoricalOrientation(i, j));
+            EXPECT_EQ(sample.getPressure(i), transformed.getHistoricalPressure(i, j));
+            EXPECT_NEAR(projectedSample.getX(i), projected.getHistoricalX(i, j), 0.001);
+            EXPECT_NEAR(projectedSample.getY(i), projected.getHistoricalY(i, j), 0.001);
+            EXPECT_EQ(projectedSample.getOrientation(i),
+                    projected.getHistoricalOrientation(i, j));
+        }
+    }
+}
+
+TEST_F(MotionEventTest, ScaleMatchesPointerCoordsScale) {
+    const size_t sampleCount = 70;
+    MotionEvent event;
+    initializeEventWithLongHistory(&event, sampleCount);
+    MotionEvent scaled;
+    scaled.copyFrom(&event, true /*keepHistory*/);
+    scaled.scale(1.75f);
+
+    for (size_t j = 0; j < sampleCount; j++) {
+        for (size_t i = 0; i < event.getPointerCount(); i++) {
+            SCOPED_TRACE(j * event.getPointerCount() + i);
+            PointerCoords expected;
+            expected.copyFrom(*event.getHistoricalRawPointerCoords(i, j));
+            expected.scale(1.75f);
+            EXPECT_TRUE(expected == *scaled.getHistoricalRawPointerCoords(i, j));
+        }
+    }
+}
+
 } // namespace android
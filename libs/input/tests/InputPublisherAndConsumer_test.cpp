@@ -16,6 +16,8 @@
 
 #include "TestHelpers.h"
 
+#include <math.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <time.h>
@@ -60,6 +62,17 @@ protected:
 
     void PublishAndConsumeKeyEvent();
     void PublishAndConsumeMotionEvent();
+    void PublishAndConsumeMotionBatch(uint64_t* outBytesPerSample);
+
+    struct ReplayResult {
+        float meanError;        // distance to the finger when frames are presented
+        nsecs_t meanLatency;    // age of the positions when frames are presented
+        size_t realSamples;     // historical samples delivered
+        size_t movedSamples;    // historical samples not where the panel reported them
+        InputConsumer::ResampleStats stats;
+    };
+    void ReplayTouchStream(int gesture, InputConsumer::ResampleMode mode,
+            ReplayResult* outResult);
 };
 
 TEST_F(InputPublisherAndConsumerTest, GetChannel_ReturnsTheChannel) {
@@ -277,6 +290,501 @@ TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountGreater
             << "publisher publishMotionEvent should return BAD_VALUE";
 }
 
+TEST_F(InputPublisherAndConsumerTest, PublishBatchedKeyEvents_EndToEnd) {
+    status_t status;
+    const size_t count = 5;
+
+    mPublisher->beginBatch();
+    for (size_t i = 0; i < count; i++) {
+        status = mPublisher->publishKeyEvent(i + 1, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A + i, 30 + i, 0, 0, 3, 4 + i);
+        ASSERT_EQ(OK, status)
+                << "publisher publishKeyEvent should return OK while batching";
+    }
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event);
+    ASSERT_EQ(WOULD_BLOCK, status)
+            << "consumer consume should return WOULD_BLOCK until the batch is published";
+
+    size_t published = 0;
+    status = mPublisher->endBatch(&published);
+    ASSERT_EQ(OK, status)
+            << "publisher endBatch should return OK";
+    ASSERT_EQ(count, published)
+            << "publisher endBatch should have published all the events";
+
+    for (size_t i = 0; i < count; i++) {
+        status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event);
+        ASSERT_EQ(OK, status)
+                << "consumer consume should return OK";
+        ASSERT_EQ(AINPUT_EVENT_TYPE_KEY, event->getType())
+                << "consumer should have returned a key event";
+        EXPECT_EQ(i + 1, consumeSeq);
+        EXPECT_EQ(int32_t(AKEYCODE_A + i), static_cast<KeyEvent*>(event)->getKeyCode());
+        EXPECT_EQ(nsecs_t(4 + i), static_cast<KeyEvent*>(event)->getEventTime());
+        EXPECT_EQ(i + 1 < count, mConsumer->hasDeferredEvent())
+                << "consumer should report the buffered events as deferred";
+
+        status = mConsumer->sendFinishedSignal(consumeSeq, i % 2 == 0);
+        ASSERT_EQ(OK, status)
+                << "consumer sendFinishedSignal should return OK";
+    }
+
+    uint32_t finishedSeqs[count];
+    bool handled[count];
+    size_t finished = 0;
+    while (finished < count) {
+        size_t n = 0;
+        status = mPublisher->receiveFinishedSignals(finishedSeqs + finished,
+                handled + finished, count - finished, &n);
+        ASSERT_EQ(OK, status)
+                << "publisher receiveFinishedSignals should return OK";
+        finished += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(i + 1, finishedSeqs[i])
+                << "publisher should receive the finished signals in order";
+        EXPECT_EQ(i % 2 == 0, handled[i])
+                << "publisher should receive the consumer's reply";
+    }
+}
+
+void InputPublisherAndConsumerTest::PublishAndConsumeMotionBatch(
+        uint64_t* outBytesPerSample) {
+    status_t status;
+
+    const size_t sampleCount = 8;
+    const size_t pointerCount = 10;
+    PointerProperties pointerProperties[pointerCount];
+    PointerCoords pointerCoords[sampleCount][pointerCount];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerProperties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    }
+    for (size_t j = 0; j < sampleCount; j++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            PointerCoords& coords = pointerCoords[j][i];
+            coords.clear();
+            coords.setAxisValue(AMOTION_EVENT_AXIS_X, 100.25f * i + 3.1f * j);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_Y, 200.5f * i - 1.7f * j);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 0.5f + 0.01f * j);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_SIZE, 0.25f);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, 1.5f * i);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MINOR, j % 2 ? 1e-40f : 1.25f);
+        }
+    }
+
+    uint64_t samplesBefore, bytesBefore;
+    mPublisher->getMotionStats(&samplesBefore, &bytesBefore);
+
+    mPublisher->beginBatch();
+    for (size_t j = 0; j < sampleCount; j++) {
+        status = mPublisher->publishMotionEvent(j + 1, 1, AINPUT_SOURCE_TOUCHSCREEN,
+                AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 1, 1, 3, 4 + j,
+                pointerCount, pointerProperties, pointerCoords[j]);
+        ASSERT_EQ(OK, status)
+                << "publisher publishMotionEvent should return OK";
+    }
+    size_t published;
+    status = mPublisher->endBatch(&published);
+    ASSERT_EQ(OK, status)
+            << "publisher endBatch should return OK";
+
+    uint64_t samples, bytes;
+    mPublisher->getMotionStats(&samples, &bytes);
+    ASSERT_EQ(sampleCount, samples - samplesBefore)
+            << "publisher should have counted the motion samples sent";
+    *outBytesPerSample = (bytes - bytesBefore) / sampleCount;
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event);
+    ASSERT_EQ(OK, status)
+            << "consumer consume should return OK";
+    ASSERT_EQ(AINPUT_EVENT_TYPE_MOTION, event->getType())
+            << "consumer should have returned a motion event";
+
+    MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+    ASSERT_EQ(sampleCount, motionEvent->getHistorySize() + 1)
+            << "consumer should have batched all the samples";
+    ASSERT_EQ(pointerCount, motionEvent->getPointerCount());
+    for (size_t j = 0; j < sampleCount; j++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            SCOPED_TRACE(j * pointerCount + i);
+            EXPECT_EQ(pointerProperties[i].id, motionEvent->getPointerId(i));
+            EXPECT_TRUE(pointerCoords[j][i] == *(j + 1 < sampleCount
+                    ? motionEvent->getHistoricalRawPointerCoords(i, j)
+                    : motionEvent->getRawPointerCoords(i)))
+                    << "consumer should have received exactly the coordinates sent";
+        }
+    }
+
+    status = mConsumer->sendFinishedSignal(consumeSeq, true);
+    ASSERT_EQ(OK, status)
+            << "consumer sendFinishedSignal should return OK";
+
+    uint32_t finishedSeqs[sampleCount];
+    bool handled[sampleCount];
+    size_t finished = 0;
+    while (finished < sampleCount) {
+        size_t count;
+        status = mPublisher->receiveFinishedSignals(finishedSeqs + finished,
+                handled + finished, sampleCount - finished, &count);
+        ASSERT_EQ(OK, status)
+                << "publisher receiveFinishedSignals should return OK";
+        finished += count;
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, ReceiveFinishedSignal_DrainsBufferedSignalsInOrder) {
+    const size_t count = 6;
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(OK, mPublisher->publishKeyEvent(i + 1, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 30, 0, 0, 3, 4));
+        uint32_t consumeSeq;
+        InputEvent* event;
+        ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event));
+        ASSERT_EQ(OK, mConsumer->sendFinishedSignal(consumeSeq, i % 2 == 0));
+    }
+
+    // The first call reads all the signals, which the next calls return one by one
+    // or several at a time.
+    uint32_t finishedSeq;
+    bool handled;
+    ASSERT_EQ(OK, mPublisher->receiveFinishedSignal(&finishedSeq, &handled));
+    EXPECT_EQ(1U, finishedSeq);
+    EXPECT_TRUE(handled);
+    uint32_t finishedSeqs[2];
+    bool handledSignals[2];
+    size_t n;
+    ASSERT_EQ(OK, mPublisher->receiveFinishedSignals(finishedSeqs, handledSignals, 2, &n));
+    ASSERT_EQ(2U, n);
+    EXPECT_EQ(2U, finishedSeqs[0]);
+    EXPECT_FALSE(handledSignals[0]);
+    EXPECT_EQ(3U, finishedSeqs[1]);
+    EXPECT_TRUE(handledSignals[1]);
+    for (size_t i = 3; i < count; i++) {
+        ASSERT_EQ(OK, mPublisher->receiveFinishedSignal(&finishedSeq, &handled));
+        EXPECT_EQ(i + 1, finishedSeq)
+                << "publisher should receive the finished signals in order";
+        EXPECT_EQ(i % 2 == 0, handled);
+    }
+    EXPECT_EQ(WOULD_BLOCK, mPublisher->receiveFinishedSignal(&finishedSeq, &handled))
+            << "publisher receiveFinishedSignal should return WOULD_BLOCK once drained";
+}
+
+// An application late by a few frames on a fast touch screen finishes a batch of
+// hundreds of samples at once.
+TEST_F(InputPublisherAndConsumerTest, SendFinishedSignal_LongChain_FinishesAllInOrder) {
+    const size_t rounds = 20;
+    const size_t samplesPerRound = 25;
+    const size_t sampleCount = rounds * samplesPerRound;
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+
+    uint32_t seq = 1;
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t j = 0; j < samplesPerRound; j++, seq++) {
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, seq);
+            ASSERT_EQ(OK, mPublisher->publishMotionEvent(seq, 1, AINPUT_SOURCE_TOUCHSCREEN,
+                    AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 1, 1, 3, seq,
+                    1, &pointerProperties, &pointerCoords));
+        }
+        uint32_t consumeSeq;
+        InputEvent* event;
+        ASSERT_EQ(WOULD_BLOCK, mConsumer->consume(&mEventFactory, false /*consumeBatches*/,
+                -1, &consumeSeq, &event))
+                << "consumer should have batched the samples";
+    }
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    ASSERT_EQ(sampleCount, consumeSeq);
+
+    // The signals don't all fit in the socket buffer.  When it is full, the consumer
+    // keeps the chain of the ones not sent, and finishes them when asked again.
+    uint32_t finishedSeqs[sampleCount];
+    bool handled[sampleCount];
+    size_t finished = 0;
+    status_t status;
+    size_t attempts = 0;
+    do {
+        status = mConsumer->sendFinishedSignal(consumeSeq, true);
+        ASSERT_TRUE(status == OK || status == WOULD_BLOCK)
+                << "consumer sendFinishedSignal should return OK or WOULD_BLOCK";
+        attempts++;
+        size_t count;
+        while (finished < sampleCount && mPublisher->receiveFinishedSignals(
+                finishedSeqs + finished, handled + finished, sampleCount - finished,
+                &count) == OK) {
+            finished += count;
+        }
+    } while (status == WOULD_BLOCK && attempts < sampleCount);
+    ASSERT_EQ(OK, status);
+    ASSERT_EQ(sampleCount, finished)
+            << "publisher should have received a finished signal per sample";
+    for (size_t i = 0; i < sampleCount; i++) {
+        EXPECT_EQ(i + 1, finishedSeqs[i])
+                << "publisher should receive the finished signals in order";
+        EXPECT_TRUE(handled[i]);
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishCompactMotionEvents_EndToEnd) {
+    uint64_t fullBytesPerSample, compactBytesPerSample;
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionBatch(&fullBytesPerSample));
+
+    mPublisher->setCompactMotionEncoding(true);
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionBatch(&compactBytesPerSample));
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+
+    RecordProperty("fullBytesPerSample", int(fullBytesPerSample));
+    RecordProperty("compactBytesPerSample", int(compactBytesPerSample));
+    EXPECT_LT(compactBytesPerSample, fullBytesPerSample / 2)
+            << "compact encoding should take less than half the bytes for 10 pointers";
+}
+
+// Synthetic touch streams, as no recordings are available: the position of the finger
+// at a given time since it went down, for a fling that decelerates, a finger going
+// round in circles, and a scroll going back and forth.
+enum {
+    GESTURE_FLING,
+    GESTURE_CIRCLE,
+    GESTURE_SCROLL,
+    GESTURE_COUNT,
+};
+
+static void getGesturePosition(int gesture, nsecs_t time, float* outX, float* outY) {
+    float t = time * 0.000000001f;
+    switch (gesture) {
+    case GESTURE_FLING: {
+        float progress = 1 - expf(-t * 4);
+        *outX = 200 + 300 * progress;
+        *outY = 1600 - 1200 * progress;
+        break;
+    }
+    case GESTURE_CIRCLE:
+        *outX = 500 + 250 * cosf(t * 6);
+        *outY = 900 + 250 * sinf(t * 6);
+        break;
+    case GESTURE_SCROLL:
+        *outX = 540;
+        *outY = 1000 + 400 * sinf(t * 4);
+        break;
+    }
+}
+
+void InputPublisherAndConsumerTest::ReplayTouchStream(int gesture,
+        InputConsumer::ResampleMode mode, ReplayResult* outResult) {
+    // A 120 Hz touch panel, with a little jitter in the timing and positions rounded
+    // to the pixel, and a 60 Hz display which presents frames 20 ms after they start.
+    const nsecs_t downTime = 1000000000LL;
+    const nsecs_t gestureTime = 600000000LL;
+    const nsecs_t samplePeriod = 8333333;
+    const nsecs_t framePeriod = 16666667;
+    const nsecs_t frameLatency = 20000000;
+    mConsumer->setResampleMode(mode, frameLatency);
+
+    PointerProperties properties;
+    properties.clear();
+    properties.id = 0;
+    properties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+
+    double errorSum = 0;
+    double latencySum = 0;
+    size_t frames = 0;
+    outResult->realSamples = 0;
+    outResult->movedSamples = 0;
+    uint32_t seq = 1;
+    nsecs_t sampleTime = downTime;
+    for (nsecs_t frameTime = downTime; frameTime < downTime + gestureTime;
+            frameTime += framePeriod) {
+        // Publish the samples the panel reported before the frame.
+        while (sampleTime <= frameTime) {
+            float x, y;
+            getGesturePosition(gesture, sampleTime - downTime, &x, &y);
+            PointerCoords coords;
+            coords.clear();
+            coords.setAxisValue(AMOTION_EVENT_AXIS_X, floorf(x + 0.5f));
+            coords.setAxisValue(AMOTION_EVENT_AXIS_Y, floorf(y + 0.5f));
+            int32_t action = sampleTime == downTime
+                    ? AMOTION_EVENT_ACTION_DOWN : AMOTION_EVENT_ACTION_MOVE;
+            status_t status = mPublisher->publishMotionEvent(seq++, 1,
+                    AINPUT_SOURCE_TOUCHSCREEN, action, 0, 0, 0, 0, 0, 0, 1, 1,
+                    downTime, sampleTime, 1, &properties, &coords);
+            ASSERT_EQ(OK, status)
+                    << "publisher publishMotionEvent should return OK";
+            sampleTime += samplePeriod + (seq % 3) * 300000 - 300000;
+        }
+
+        // Consume them as the application would when the frame starts, and draw the
+        // last position.
+        bool consumed = false;
+        float drawnX = 0, drawnY = 0;
+        nsecs_t drawnTime = 0;
+        for (;;) {
+            uint32_t consumeSeq;
+            InputEvent* event;
+            status_t status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/,
+                    frameTime, &consumeSeq, &event);
+            if (status == WOULD_BLOCK) {
+                break;
+            }
+            ASSERT_EQ(OK, status)
+                    << "consumer consume should return OK";
+            MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+            consumed = true;
+            // Only the last sample may be resampled, the ones before it are real.
+            for (size_t h = 0; h < motionEvent->getHistorySize(); h++) {
+                float x, y;
+                getGesturePosition(gesture,
+                        motionEvent->getHistoricalEventTime(h) - downTime, &x, &y);
+                if (motionEvent->getHistoricalRawX(0, h) != floorf(x + 0.5f)
+                        || motionEvent->getHistoricalRawY(0, h) != floorf(y + 0.5f)) {
+                    outResult->movedSamples += 1;
+                }
+                outResult->realSamples += 1;
+            }
+            drawnX = motionEvent->getRawX(0);
+            drawnY = motionEvent->getRawY(0);
+            drawnTime = motionEvent->getEventTime();
+            ASSERT_EQ(OK, mConsumer->sendFinishedSignal(consumeSeq, true))
+                    << "consumer sendFinishedSignal should return OK";
+        }
+        uint32_t finishedSeqs[16];
+        bool handled[16];
+        size_t count;
+        do {
+            mPublisher->receiveFinishedSignals(finishedSeqs, handled, 16, &count);
+        } while (count);
+
+        // Compare it with where the finger is when the frame is presented.
+        if (consumed && frameTime > downTime + 4 * framePeriod) {
+            nsecs_t presentTime = frameTime + frameLatency;
+            float x, y;
+            getGesturePosition(gesture, presentTime - downTime, &x, &y);
+            errorSum += sqrtf((drawnX - x) * (drawnX - x) + (drawnY - y) * (drawnY - y));
+            latencySum += presentTime - drawnTime;
+            frames += 1;
+        }
+    }
+    ASSERT_GT(frames, 0U);
+
+    outResult->meanError = errorSum / frames;
+    outResult->meanLatency = nsecs_t(latencySum / frames);
+    mConsumer->getResampleStats(&outResult->stats);
+}
+
+TEST_F(InputPublisherAndConsumerTest, ResampleTouches_PredictiveReplay) {
+    static const char* names[GESTURE_COUNT] = { "fling", "circle", "scroll" };
+    for (int gesture = 0; gesture < GESTURE_COUNT; gesture++) {
+        SCOPED_TRACE(names[gesture]);
+        ReplayResult linear, predictive;
+        TearDown();
+        SetUp();
+        ASSERT_NO_FATAL_FAILURE(ReplayTouchStream(gesture,
+                InputConsumer::RESAMPLE_LINEAR, &linear));
+        TearDown();
+        SetUp();
+        ASSERT_NO_FATAL_FAILURE(ReplayTouchStream(gesture,
+                InputConsumer::RESAMPLE_PREDICTIVE, &predictive));
+
+        EXPECT_GT(linear.stats.measuredPointers, 0U)
+                << "consumer should have measured the linear extrapolations";
+        EXPECT_GT(predictive.stats.predictions, 0U)
+                << "consumer should have predicted touches";
+        EXPECT_GT(predictive.stats.measuredPointers, 0U)
+                << "consumer should have measured the predictions";
+        EXPECT_GT(predictive.realSamples, 0U)
+                << "consumer should have delivered historical samples";
+        EXPECT_EQ(0U, predictive.movedSamples)
+                << "samples older than a prediction should not be moved to it";
+        EXPECT_LT(predictive.meanLatency, linear.meanLatency)
+                << "predicted touches should be closer to the present time";
+        EXPECT_LT(predictive.meanError, linear.meanError)
+                << "predicted touches should be closer to the finger when presented";
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, TrackLatency_RecordsEachStage) {
+    const size_t count = 4;
+    const nsecs_t millis = 1000000;
+    mPublisher->setLatencyTracking(true);
+    mConsumer->setLatencyTracking(true);
+
+    // Published 2ms after the event time, received 1ms later, finished 1ms after that.
+    nsecs_t eventTime = systemTime(SYSTEM_TIME_MONOTONIC) - 2 * millis;
+    mPublisher->beginBatch();
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(OK, mPublisher->publishKeyEvent(i + 1, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 30, 0, 0, eventTime, eventTime));
+    }
+    size_t published;
+    ASSERT_EQ(OK, mPublisher->endBatch(&published));
+    usleep(1000);
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t consumeSeq;
+        InputEvent* event;
+        ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event));
+        usleep(1000);
+        ASSERT_EQ(OK, mConsumer->sendFinishedSignal(consumeSeq, true));
+    }
+    uint32_t finishedSeqs[count];
+    bool handled[count];
+    for (size_t finished = 0; finished < count; ) {
+        size_t received;
+        ASSERT_EQ(OK, mPublisher->receiveFinishedSignals(finishedSeqs + finished,
+                handled + finished, count - finished, &received));
+        finished += received;
+    }
+
+    InputConsumer::LatencyStats stats;
+    mConsumer->getLatencyStats(&stats);
+    EXPECT_EQ(count, stats.dispatch.getCount());
+    EXPECT_EQ(count, stats.queue.getCount());
+    EXPECT_EQ(count, stats.batching.getCount());
+    EXPECT_EQ(count, stats.handling.getCount());
+    EXPECT_EQ(count, stats.total.getCount());
+    EXPECT_LE(2048U, stats.dispatch.percentile(50));
+    EXPECT_LE(1024U, stats.queue.percentile(50));
+    EXPECT_LE(1024U, stats.handling.percentile(99));
+    EXPECT_LE(4096U, stats.total.percentile(50));
+
+    // Events that are not stamped by the publisher are only measured by the consumer.
+    mPublisher->setLatencyTracking(false);
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
+    mConsumer->getLatencyStats(&stats);
+    EXPECT_EQ(count, stats.dispatch.getCount());
+    EXPECT_EQ(count, stats.queue.getCount());
+    EXPECT_EQ(count + 1, stats.batching.getCount());
+    EXPECT_EQ(count + 1, stats.handling.getCount());
+
+    // Nothing is measured once the consumer stops tracking latency.
+    mConsumer->setLatencyTracking(false);
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+    mConsumer->getLatencyStats(&stats);
+    EXPECT_EQ(count + 1, stats.batching.getCount());
+    EXPECT_EQ(count + 1, stats.total.getCount());
+
+    String8 dump;
+    mConsumer->dumpLatencyStats(dump);
+    EXPECT_TRUE(strstr(dump.string(), "total") != NULL);
+}
+
 TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
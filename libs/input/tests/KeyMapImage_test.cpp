@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <android/keycodes.h>
+#include <gtest/gtest.h>
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+#include <input/KeyMapImage.h>
+
+namespace android {
+
+// The stock key maps, compiled when they are available.
+static const char* STOCK_KEY_LAYOUT_MAP = "/system/usr/keylayout/Generic.kl";
+static const char* STOCK_KEY_CHARACTER_MAP = "/system/usr/keychars/Generic.kcm";
+
+// Excerpts of the stock key maps otherwise.
+static const char* KEY_LAYOUT_MAP =
+        "# Generic key layout excerpt\n"
+        "key 1     ESCAPE\n"
+        "key 2     1\n"
+        "key 3     2\n"
+        "key 4     3\n"
+        "key 14    DEL\n"
+        "key 15    TAB\n"
+        "key 16    Q\n"
+        "key 17    W\n"
+        "key 18    E\n"
+        "key 19    R\n"
+        "key 28    ENTER\n"
+        "key 29    CTRL_LEFT\n"
+        "key 30    A\n"
+        "key 42    SHIFT_LEFT\n"
+        "key 56    ALT_LEFT\n"
+        "key 57    SPACE\n"
+        "key 58    CAPS_LOCK\n"
+        "key 113   VOLUME_MUTE\n"
+        "key 114   VOLUME_DOWN\n"
+        "key 115   VOLUME_UP\n"
+        "key 116   POWER             WAKE\n"
+        "key 139   MENU              WAKE_DROPPED\n"
+        "key 158   BACK              WAKE_DROPPED\n"
+        "key 172   HOME              WAKE\n"
+        "key 304   BUTTON_A\n"
+        "key 305   BUTTON_B\n"
+        "key usage 0x0c0067 WINDOW\n"
+        "key usage 0x0c006F BRIGHTNESS_UP\n"
+        "key usage 0x0c0070 BRIGHTNESS_DOWN\n"
+        "axis 0x00 X\n"
+        "axis 0x01 Y\n"
+        "axis 0x02 split 0x7f LTRIGGER RTRIGGER\n"
+        "axis 0x05 invert RZ\n"
+        "axis 0x10 HAT_X flat 1\n"
+        "axis 0x11 HAT_Y\n";
+
+static const char* KEY_CHARACTER_MAP =
+        "# Generic key character map excerpt\n"
+        "type FULL\n"
+        "\n"
+        "key A {\n"
+        "    label:                              'A'\n"
+        "    base:                               'a'\n"
+        "    shift, capslock:                    'A'\n"
+        "}\n"
+        "\n"
+        "key B {\n"
+        "    label:                              'B'\n"
+        "    base:                               'b'\n"
+        "    shift, capslock:                    'B'\n"
+        "}\n"
+        "\n"
+        "key 1 {\n"
+        "    label:                              '1'\n"
+        "    base:                               '1'\n"
+        "    shift:                              '!'\n"
+        "}\n"
+        "\n"
+        "key 2 {\n"
+        "    label:                              '2'\n"
+        "    base:                               '2'\n"
+        "    shift:                              '@'\n"
+        "    ralt:                               '\\u20ac'\n"
+        "}\n"
+        "\n"
+        "key SPACE {\n"
+        "    label:                              ' '\n"
+        "    base:                               ' '\n"
+        "    alt, meta:                          fallback SEARCH\n"
+        "    ctrl:                               fallback LANGUAGE_SWITCH\n"
+        "}\n"
+        "\n"
+        "key ENTER {\n"
+        "    label:                              '\\n'\n"
+        "    base:                               '\\n'\n"
+        "}\n"
+        "\n"
+        "key ESCAPE {\n"
+        "    base:                               fallback BACK\n"
+        "    alt, meta:                          fallback HOME\n"
+        "    ctrl:                               fallback MENU\n"
+        "}\n"
+        "\n"
+        "key NUMPAD_7 {\n"
+        "    label:                              '7'\n"
+        "    base:                               fallback MOVE_HOME\n"
+        "    numlock:                            '7'\n"
+        "}\n";
+
+class KeyMapImageTest : public testing::Test {
+protected:
+    String8 mDir;
+    String8 mKeyLayoutFile;
+    String8 mKeyCharacterMapFile;
+
+    virtual void SetUp() {
+        const char* tmpDir = getenv("TMPDIR");
+        String8 dir(tmpDir ? tmpDir : "/data/local/tmp");
+        dir.append("/KeyMapImageTest.XXXXXX");
+        char path[PATH_MAX];
+        strcpy(path, dir.string());
+        ASSERT_TRUE(mkdtemp(path) != NULL);
+        mDir.setTo(path);
+
+        mKeyLayoutFile = mDir;
+        mKeyLayoutFile.append("/Generic.kl");
+        mKeyCharacterMapFile = mDir;
+        mKeyCharacterMapFile.append("/Generic.kcm");
+        ASSERT_NO_FATAL_FAILURE(copyOrWriteFile(STOCK_KEY_LAYOUT_MAP, KEY_LAYOUT_MAP,
+                mKeyLayoutFile));
+        ASSERT_NO_FATAL_FAILURE(copyOrWriteFile(STOCK_KEY_CHARACTER_MAP, KEY_CHARACTER_MAP,
+                mKeyCharacterMapFile));
+    }
+
+    virtual void TearDown() {
+        const String8* files[] = { &mKeyLayoutFile, &mKeyCharacterMapFile };
+        for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+            unlink(files[i]->string());
+            unlink(KeyMapImage::getImagePath(*files[i]).string());
+        }
+        rmdir(mDir.string());
+    }
+
+    static void writeFile(const String8& filename, const char* data, size_t size) {
+        int fd = open(filename.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(ssize_t(size), write(fd, data, size));
+        close(fd);
+    }
+
+    static void copyOrWriteFile(const char* stockFilename, const char* contents,
+            const String8& filename) {
+        String8 data;
+        FILE* file = fopen(stockFilename, "r");
+        if (file) {
+            char buffer[4096];
+            size_t nRead;
+            while ((nRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+                data.append(buffer, nRead);
+            }
+            fclose(file);
+        } else {
+            data.setTo(contents);
+        }
+        writeFile(filename, data.string(), data.length());
+    }
+
+    static size_t getFileSize(const String8& filename) {
+        struct stat st;
+        return stat(filename.string(), &st) ? 0 : st.st_size;
+    }
+
+    static void assertSameKeyLayoutMaps(const sp<KeyLayoutMap>& expected,
+            const sp<KeyLayoutMap>& actual) {
+        for (int32_t scanCode = 0; scanCode < 0x300; scanCode++) {
+            const int32_t usageCodes[] = { 0, 0x0c0067, 0x0c006f, 0x0c0070, 0x0c0071 };
+            for (size_t i = 0; i < sizeof(usageCodes) / sizeof(usageCodes[0]); i++) {
+                int32_t expectedKeyCode, actualKeyCode;
+                uint32_t expectedFlags, actualFlags;
+                ASSERT_EQ(expected->mapKey(scanCode, usageCodes[i],
+                                &expectedKeyCode, &expectedFlags),
+                        actual->mapKey(scanCode, usageCodes[i], &actualKeyCode, &actualFlags))
+                        << "scan code " << scanCode << ", usage code " << usageCodes[i];
+                ASSERT_EQ(expectedKeyCode, actualKeyCode);
+                ASSERT_EQ(expectedFlags, actualFlags);
+            }
+
+            AxisInfo expectedAxis, actualAxis;
+            ASSERT_EQ(expected->mapAxis(scanCode, &expectedAxis),
+                    actual->mapAxis(scanCode, &actualAxis)) << "axis " << scanCode;
+            ASSERT_EQ(expectedAxis.mode, actualAxis.mode);
+            ASSERT_EQ(expectedAxis.axis, actualAxis.axis);
+            ASSERT_EQ(expectedAxis.highAxis, actualAxis.highAxis);
+            ASSERT_EQ(expectedAxis.splitValue, actualAxis.splitValue);
+            ASSERT_EQ(expectedAxis.flatOverride, actualAxis.flatOverride);
+        }
+
+        for (int32_t keyCode = 0; keyCode < 256; keyCode++) {
+            Vector<int32_t> expectedScanCodes, actualScanCodes;
+            expected->findScanCodesForKey(keyCode, &expectedScanCodes);
+            actual->findScanCodesForKey(keyCode, &actualScanCodes);
+            ASSERT_EQ(expectedScanCodes.size(), actualScanCodes.size()) << "key " << keyCode;
+            for (size_t i = 0; i < expectedScanCodes.size(); i++) {
+                ASSERT_EQ(expectedScanCodes[i], actualScanCodes[i]);
+            }
+        }
+    }
+
+    static void assertSameKeyCharacterMaps(const sp<KeyCharacterMap>& expected,
+            const sp<KeyCharacterMap>& actual) {
+        ASSERT_EQ(expected->getKeyboardType(), actual->getKeyboardType());
+
+        const int32_t metaStates[] = {
+            0, AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON, AMETA_CAPS_LOCK_ON,
+            AMETA_ALT_ON | AMETA_ALT_RIGHT_ON, AMETA_CTRL_ON | AMETA_CTRL_LEFT_ON,
+            AMETA_META_ON | AMETA_META_LEFT_ON, AMETA_NUM_LOCK_ON, AMETA_FUNCTION_ON,
+        };
+        for (int32_t keyCode = 0; keyCode < 256; keyCode++) {
+            ASSERT_EQ(expected->getDisplayLabel(keyCode), actual->getDisplayLabel(keyCode))
+                    << "key " << keyCode;
+            ASSERT_EQ(expected->getNumber(keyCode), actual->getNumber(keyCode));
+            for (size_t i = 0; i < sizeof(metaStates) / sizeof(metaStates[0]); i++) {
+                ASSERT_EQ(expected->getCharacter(keyCode, metaStates[i]),
+                        actual->getCharacter(keyCode, metaStates[i]))
+                        << "key " << keyCode << ", meta state " << metaStates[i];
+                KeyCharacterMap::FallbackAction expectedAction, actualAction;
+                ASSERT_EQ(expected->getFallbackAction(keyCode, metaStates[i], &expectedAction),
+                        actual->getFallbackAction(keyCode, metaStates[i], &actualAction));
+                ASSERT_EQ(expectedAction.keyCode, actualAction.keyCode);
+                ASSERT_EQ(expectedAction.metaState, actualAction.metaState);
+            }
+        }
+
+        for (int32_t scanCode = 0; scanCode < 0x300; scanCode++) {
+            int32_t expectedKeyCode, actualKeyCode;
+            ASSERT_EQ(expected->mapKey(scanCode, 0, &expectedKeyCode),
+                    actual->mapKey(scanCode, 0, &actualKeyCode));
+            ASSERT_EQ(expectedKeyCode, actualKeyCode);
+        }
+    }
+};
+
+TEST_F(KeyMapImageTest, KeyLayoutMap_LoadsSameMapFromImage) {
+    sp<KeyLayoutMap> textMap, imageMap;
+    ASSERT_EQ(OK, KeyLayoutMap::load(mKeyLayoutFile, &textMap));
+    ASSERT_EQ(OK, KeyLayoutMap::compile(mKeyLayoutFile,
+            KeyMapImage::getImagePath(mKeyLayoutFile)));
+
+    ASSERT_EQ(OK, KeyLayoutMap::load(mKeyLayoutFile, &imageMap));
+    ASSERT_NO_FATAL_FAILURE(assertSameKeyLayoutMaps(textMap, imageMap));
+}
+
+TEST_F(KeyMapImageTest, KeyCharacterMap_LoadsSameMapFromImage) {
+    sp<KeyCharacterMap> textMap, imageMap;
+    ASSERT_EQ(OK, KeyCharacterMap::load(mKeyCharacterMapFile,
+            KeyCharacterMap::FORMAT_BASE, &textMap));
+    ASSERT_EQ(OK, KeyCharacterMap::compile(mKeyCharacterMapFile,
+            KeyCharacterMap::FORMAT_BASE, KeyMapImage::getImagePath(mKeyCharacterMapFile)));
+
+    ASSERT_EQ(OK, KeyCharacterMap::load(mKeyCharacterMapFile,
+            KeyCharacterMap::FORMAT_BASE, &imageMap));
+    ASSERT_NO_FATAL_FAILURE(assertSameKeyCharacterMaps(textMap, imageMap));
+
+    // The format is still checked.
+    sp<KeyCharacterMap> overlayMap;
+    ASSERT_NE(OK, KeyCharacterMap::load(mKeyCharacterMapFile,
+            KeyCharacterMap::FORMAT_OVERLAY, &overlayMap));
+}
+
+TEST_F(KeyMapImageTest, IgnoresImageOfChangedFile) {
+    ASSERT_EQ(OK, KeyLayoutMap::compile(mKeyLayoutFile,
+            KeyMapImage::getImagePath(mKeyLayoutFile)));
+    const char* contents = "key 1 BACK\n";
+    ASSERT_NO_FATAL_FAILURE(writeFile(mKeyLayoutFile, contents, strlen(contents)));
+
+    sp<KeyLayoutMap> map;
+    ASSERT_EQ(OK, KeyLayoutMap::load(mKeyLayoutFile, &map));
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, map->mapKey(1, 0, &keyCode, &flags));
+    EXPECT_EQ(AKEYCODE_BACK, keyCode)
+            << "the text file should be used when it has changed since it was compiled";
+}
+
+TEST_F(KeyMapImageTest, IgnoresMalformedImage) {
+    sp<KeyLayoutMap> textMap, imageMap;
+    ASSERT_EQ(OK, KeyLayoutMap::load(mKeyLayoutFile, &textMap));
+    String8 imagePath(KeyMapImage::getImagePath(mKeyLayoutFile));
+    ASSERT_EQ(OK, KeyLayoutMap::compile(mKeyLayoutFile, imagePath));
+    ASSERT_EQ(0, truncate(imagePath.string(), getFileSize(imagePath) - 4));
+
+    ASSERT_EQ(OK, KeyLayoutMap::load(mKeyLayoutFile, &imageMap));
+    ASSERT_NO_FATAL_FAILURE(assertSameKeyLayoutMaps(textMap, imageMap));
+}
+
+TEST_F(KeyMapImageTest, IgnoresImageOlderThanFile) {
+    String8 imagePath(KeyMapImage::getImagePath(mKeyLayoutFile));
+    ASSERT_EQ(OK, KeyLayoutMap::compile(mKeyLayoutFile, imagePath));
+    // Same size, but edited after the image was compiled.
+    const char* contents = "key 1 BACK\n";
+    String8 data(contents);
+    for (size_t i = data.length(); i < getFileSize(mKeyLayoutFile); i++) {
+        data.append(i + 1 < getFileSize(mKeyLayoutFile) ? " " : "\n");
+    }
+    ASSERT_NO_FATAL_FAILURE(writeFile(mKeyLayoutFile, data.string(), data.length()));
+    struct stat st;
+    ASSERT_EQ(0, stat(imagePath.string(), &st));
+    struct timeval times[2];
+    times[0].tv_sec = times[1].tv_sec = st.st_mtime + 10;
+    times[0].tv_usec = times[1].tv_usec = 0;
+    ASSERT_EQ(0, utimes(mKeyLayoutFile.string(), times));
+
+    sp<KeyLayoutMap> map;
+    ASSERT_EQ(OK, KeyLayoutMap::load(mKeyLayoutFile, &map));
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, map->mapKey(1, 0, &keyCode, &flags));
+    EXPECT_EQ(AKEYCODE_BACK, keyCode)
+            << "the text file should be used when it is newer than the image";
+}
+
+} // namespace android
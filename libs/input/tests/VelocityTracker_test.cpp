@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <gtest/gtest.h>
+#include <input/VelocityTracker.h>
+
+namespace android {
+
+class BaseTest : public testing::Test {
+protected:
+    virtual void SetUp() { }
+    virtual void TearDown() { }
+};
+
+// --- VelocityTrackerTest ---
+
+class VelocityTrackerTest : public BaseTest {
+protected:
+    struct Movement {
+        nsecs_t eventTime;
+        BitSet32 idBits;
+        VelocityTracker::Position positions[MAX_POINTERS];
+    };
+
+    static const size_t MAX_MOVEMENTS = 512;
+
+    Movement mMovements[MAX_MOVEMENTS];
+    size_t mMovementCount;
+
+    virtual void SetUp() {
+        mMovementCount = 0;
+    }
+
+    Movement* addMovement(nsecs_t eventTime, BitSet32 idBits) {
+        Movement* movement = &mMovements[mMovementCount++];
+        movement->eventTime = eventTime;
+        movement->idBits = idBits;
+        return movement;
+    }
+
+    // A fling of a single pointer, sampled every 8 ms with some jitter in the timing,
+    // that accelerates then decelerates, with coordinates rounded to the pixel as
+    // touch screens report them.
+    void makeFling(float vx, float vy, size_t count, uint32_t seed) {
+        nsecs_t eventTime = 1000000000LL;
+        float x = 100, y = 1500;
+        for (size_t i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            eventTime += 8000000 + nsecs_t(seed >> 16) % 2000000 - 1000000;
+            float speed = i < count / 4 ? float(i) / (count / 4) : 1.0f - float(i) / count;
+            x += vx * speed * 0.008f;
+            y += vy * speed * 0.008f;
+            Movement* movement = addMovement(eventTime, BitSet32(BitSet32::valueForBit(0)));
+            movement->positions[0].x = floorf(x + 0.5f);
+            movement->positions[0].y = floorf(y + 0.5f);
+        }
+    }
+
+    // Two pointers going round in circles, one of which is lifted half way and put
+    // down again, with a long pause in the middle.
+    void makeCircles(size_t count) {
+        nsecs_t eventTime = 5000000000LL;
+        for (size_t i = 0; i < count; i++) {
+            eventTime += i == count / 3 ? 500000000 : 16000000;
+            BitSet32 idBits(BitSet32::valueForBit(0));
+            if (i < count / 2 || i > count / 2 + 5) {
+                idBits.markBit(3);
+            }
+            Movement* movement = addMovement(eventTime, idBits);
+            float angle = i * 0.15f;
+            movement->positions[0].x = 500 + 200 * cosf(angle);
+            movement->positions[0].y = 800 + 200 * sinf(angle);
+            if (idBits.hasBit(3)) {
+                movement->positions[1].x = 700 - 150 * sinf(angle * 2);
+                movement->positions[1].y = 900 + 150 * cosf(angle * 2);
+            }
+        }
+    }
+
+    // Feeds the movements to a tracker with each strategy and checks that the
+    // incremental one estimates the same velocities as the reference at every step.
+    void assertSameVelocities(const char* strategy, const char* referenceStrategy) {
+        VelocityTracker tracker(strategy);
+        VelocityTracker reference(referenceStrategy);
+        for (size_t i = 0; i < mMovementCount; i++) {
+            const Movement& movement = mMovements[i];
+            tracker.addMovement(movement.eventTime, movement.idBits, movement.positions);
+            reference.addMovement(movement.eventTime, movement.idBits, movement.positions);
+
+            for (BitSet32 idBits(movement.idBits); !idBits.isEmpty(); ) {
+                uint32_t id = idBits.clearFirstMarkedBit();
+                VelocityTracker::Estimator estimator, expected;
+                ASSERT_TRUE(tracker.getEstimator(id, &estimator));
+                ASSERT_TRUE(reference.getEstimator(id, &expected));
+                ASSERT_EQ(expected.degree, estimator.degree)
+                        << "movement " << i << ", pointer " << id;
+                ASSERT_EQ(expected.time, estimator.time);
+                // The reference fits in single precision without centering the data,
+                // so only compare the position and velocity, with a tolerance that
+                // covers its rounding errors.
+                EXPECT_NEAR(expected.xCoeff[0], estimator.xCoeff[0], 0.01f)
+                        << "movement " << i << ", pointer " << id;
+                EXPECT_NEAR(expected.yCoeff[0], estimator.yCoeff[0], 0.01f)
+                        << "movement " << i << ", pointer " << id;
+                EXPECT_NEAR(expected.xCoeff[1], estimator.xCoeff[1],
+                        0.5f + fabsf(expected.xCoeff[1]) * 0.001f)
+                        << "movement " << i << ", pointer " << id;
+                EXPECT_NEAR(expected.yCoeff[1], estimator.yCoeff[1],
+                        0.5f + fabsf(expected.yCoeff[1]) * 0.001f)
+                        << "movement " << i << ", pointer " << id;
+                EXPECT_NEAR(expected.confidence, estimator.confidence, 0.001f);
+            }
+        }
+    }
+};
+
+TEST_F(VelocityTrackerTest, IncrementalLeastSquaresMatchesLeastSquares_Fling) {
+    makeFling(3000, -8000, 60, 1);
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq2", "lsq2"));
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq1", "lsq1"));
+}
+
+TEST_F(VelocityTrackerTest, IncrementalLeastSquaresMatchesLeastSquares_SlowDrag) {
+    makeFling(-40, 25, 300, 7);
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq2", "lsq2"));
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq1", "lsq1"));
+}
+
+TEST_F(VelocityTrackerTest, IncrementalLeastSquaresMatchesLeastSquares_MultiplePointers) {
+    makeCircles(200);
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq2", "lsq2"));
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq1", "lsq1"));
+}
+
+TEST_F(VelocityTrackerTest, IncrementalLeastSquaresMatchesLeastSquares_Stationary) {
+    // All the samples at the same time, then at the same position.
+    BitSet32 idBits(BitSet32::valueForBit(0));
+    for (size_t i = 0; i < 5; i++) {
+        Movement* movement = addMovement(1000000000LL, idBits);
+        movement->positions[0].x = 10 + i;
+        movement->positions[0].y = 20;
+    }
+    for (size_t i = 0; i < 30; i++) {
+        Movement* movement = addMovement(1000000000LL + (i + 1) * 8000000, idBits);
+        movement->positions[0].x = 14;
+        movement->positions[0].y = 20;
+    }
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq2", "lsq2"));
+    ASSERT_NO_FATAL_FAILURE(assertSameVelocities("ilsq1", "lsq1"));
+}
+
+} // namespace android
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Streams a 1000 Hz stylus through an input channel to a consumer drawing at 60 Hz,
+// publishing the samples one at a time and then in batches, and reports the CPU
+// time spent per sample on both ends of the channel.  The publisher wakes up with
+// a few samples at a time, as the dispatcher does when the input reader hands it
+// several events.
+//
+// Run it under "strace -c" to count the system calls of each mode.
+//
+// Usage: test-inputbatchbenchmark [samples per wakeup] [frames]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <input/Input.h>
+#include <input/InputTransport.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const nsecs_t SAMPLE_INTERVAL = 1000000;
+static const nsecs_t FRAME_INTERVAL = 16666667;
+
+static nsecs_t getCpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return nsecs_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void drainFinishedSignals(InputPublisher& publisher, bool batched) {
+    status_t status;
+    if (batched) {
+        uint32_t seqs[16];
+        bool handled[16];
+        size_t count;
+        do {
+            status = publisher.receiveFinishedSignals(seqs, handled, 16, &count);
+        } while (!status);
+    } else {
+        uint32_t seq;
+        bool handled;
+        do {
+            status = publisher.receiveFinishedSignal(&seq, &handled);
+        } while (!status);
+    }
+}
+
+// Returns the number of samples streamed, or 0 on error.
+static size_t stream(bool batched, size_t samplesPerWakeup, size_t frames) {
+    sp<InputChannel> serverChannel, clientChannel;
+    if (InputChannel::openInputChannelPair(String8("benchmark"),
+            serverChannel, clientChannel)) {
+        return 0;
+    }
+    InputPublisher publisher(serverChannel);
+    InputConsumer consumer(clientChannel);
+    PreallocatedInputEventFactory factory;
+
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_STYLUS;
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+
+    uint32_t seq = 1;
+    nsecs_t downTime = 0;
+    nsecs_t eventTime = downTime;
+    int32_t action = AMOTION_EVENT_ACTION_DOWN;
+    size_t samples = 0;
+    for (size_t frame = 0; frame < frames; frame++) {
+        nsecs_t frameTime = downTime + (frame + 1) * FRAME_INTERVAL;
+        while (eventTime <= frameTime) {
+            if (batched) {
+                publisher.beginBatch();
+            }
+            for (size_t i = 0; i < samplesPerWakeup; i++, eventTime += SAMPLE_INTERVAL) {
+                float t = eventTime * 1e-9f;
+                pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 500 + 200 * cosf(t * 5));
+                pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, 500 + 200 * sinf(t * 5));
+                pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 0.5f);
+                if (publisher.publishMotionEvent(seq++, 1, AINPUT_SOURCE_STYLUS,
+                        action, 0, 0, 0, 0, 0, 0, 1, 1, downTime, eventTime,
+                        1, &pointerProperties, &pointerCoords)) {
+                    return 0;
+                }
+                action = AMOTION_EVENT_ACTION_MOVE;
+                samples += 1;
+            }
+            if (batched) {
+                size_t published;
+                if (publisher.endBatch(&published)) {
+                    return 0;
+                }
+            }
+            drainFinishedSignals(publisher, batched);
+        }
+
+        for (;;) {
+            uint32_t consumeSeq;
+            InputEvent* event;
+            status_t status = consumer.consume(&factory, true /*consumeBatches*/, frameTime,
+                    &consumeSeq, &event);
+            if (status == WOULD_BLOCK) {
+                break;
+            }
+            if (status || consumer.sendFinishedSignal(consumeSeq, true)) {
+                return 0;
+            }
+        }
+        drainFinishedSignals(publisher, batched);
+    }
+    return samples;
+}
+
+int main(int argc, char** argv) {
+    const size_t samplesPerWakeup = argc > 1 ? atoi(argv[1]) : 4;
+    const size_t frames = argc > 2 ? atoi(argv[2]) : 600;
+
+    for (int batched = 0; batched < 2; batched++) {
+        nsecs_t start = getCpuTime();
+        size_t samples = stream(batched, samplesPerWakeup, frames);
+        nsecs_t elapsed = getCpuTime() - start;
+        if (!samples) {
+            fprintf(stderr, "Streaming failed.\n");
+            return 1;
+        }
+        printf("%s, %u samples per wakeup: %u samples, %.2f us of CPU per sample\n",
+                batched ? "batched" : "one at a time", unsigned(samplesPerWakeup),
+                unsigned(samples), elapsed * 0.001 / samples);
+    }
+    return 0;
+}
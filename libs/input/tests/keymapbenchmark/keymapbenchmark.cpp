@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares loading a key layout map and a key character map from their text
+// files and from their images: the time it takes, and the heap that a loaded
+// map holds on to. The maps are copied to a temporary directory first, since
+// their images are written next to them.
+//
+// Usage: test-keymapbenchmark [file.kl] [file.kcm] [iterations]
+
+#include <limits.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+#include <input/KeyMapImage.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const char* DEFAULT_KEY_LAYOUT_MAP = "/system/usr/keylayout/Generic.kl";
+static const char* DEFAULT_KEY_CHARACTER_MAP = "/system/usr/keychars/Generic.kcm";
+
+static bool copyFile(const char* from, const String8& to) {
+    FILE* in = fopen(from, "r");
+    if (!in) {
+        fprintf(stderr, "Cannot open %s.\n", from);
+        return false;
+    }
+    FILE* out = fopen(to.string(), "w");
+    if (!out) {
+        fprintf(stderr, "Cannot create %s.\n", to.string());
+        fclose(in);
+        return false;
+    }
+    char buffer[4096];
+    size_t nRead;
+    while ((nRead = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        fwrite(buffer, 1, nRead, out);
+    }
+    fclose(in);
+    fclose(out);
+    return true;
+}
+
+static size_t getFileSize(const String8& filename) {
+    struct stat st;
+    return stat(filename.string(), &st) ? 0 : st.st_size;
+}
+
+static size_t getHeapSize() {
+    return mallinfo().uordblks;
+}
+
+struct Result {
+    double loadTime;        // us
+    size_t heapSize;        // bytes held by a loaded map
+};
+
+static Result measureKeyLayoutMap(const String8& filename, int iterations) {
+    Result result;
+    sp<KeyLayoutMap> map;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        map.clear();
+        KeyLayoutMap::load(filename, &map);
+    }
+    result.loadTime = (systemTime(SYSTEM_TIME_MONOTONIC) - start) * 0.001 / iterations;
+    map.clear();
+    size_t heapSize = getHeapSize();
+    KeyLayoutMap::load(filename, &map);
+    result.heapSize = getHeapSize() - heapSize;
+    return result;
+}
+
+static Result measureKeyCharacterMap(const String8& filename, int iterations) {
+    Result result;
+    sp<KeyCharacterMap> map;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        map.clear();
+        KeyCharacterMap::load(filename, KeyCharacterMap::FORMAT_BASE, &map);
+    }
+    result.loadTime = (systemTime(SYSTEM_TIME_MONOTONIC) - start) * 0.001 / iterations;
+    map.clear();
+    size_t heapSize = getHeapSize();
+    KeyCharacterMap::load(filename, KeyCharacterMap::FORMAT_BASE, &map);
+    result.heapSize = getHeapSize() - heapSize;
+    return result;
+}
+
+static void report(const String8& filename, const Result& text, const Result& image) {
+    String8 imageFilename(KeyMapImage::getImagePath(filename));
+    printf("%s:\n", filename.string());
+    printf("  text:  %6d bytes, loaded in %7.1f us, %6d bytes of heap\n",
+            int(getFileSize(filename)), text.loadTime, int(text.heapSize));
+    printf("  image: %6d bytes, loaded in %7.1f us, %6d bytes of heap\n",
+            int(getFileSize(imageFilename)), image.loadTime, int(image.heapSize));
+}
+
+int main(int argc, char** argv) {
+    const char* keyLayoutMap = argc > 1 ? argv[1] : DEFAULT_KEY_LAYOUT_MAP;
+    const char* keyCharacterMap = argc > 2 ? argv[2] : DEFAULT_KEY_CHARACTER_MAP;
+    const int iterations = argc > 3 ? atoi(argv[3]) : 200;
+
+    const char* tmpDir = getenv("TMPDIR");
+    String8 dir(tmpDir ? tmpDir : "/data/local/tmp");
+    dir.append("/keymapbenchmark.XXXXXX");
+    char path[PATH_MAX];
+    strcpy(path, dir.string());
+    if (!mkdtemp(path)) {
+        fprintf(stderr, "Cannot create a directory in %s.\n", dir.string());
+        return 1;
+    }
+    dir.setTo(path);
+    String8 keyLayoutFile(dir);
+    keyLayoutFile.append("/map.kl");
+    String8 keyCharacterMapFile(dir);
+    keyCharacterMapFile.append("/map.kcm");
+
+    int result = 1;
+    if (copyFile(keyLayoutMap, keyLayoutFile)
+            && copyFile(keyCharacterMap, keyCharacterMapFile)) {
+        Result klText = measureKeyLayoutMap(keyLayoutFile, iterations);
+        Result kcmText = measureKeyCharacterMap(keyCharacterMapFile, iterations);
+        if (KeyLayoutMap::compile(keyLayoutFile,
+                        KeyMapImage::getImagePath(keyLayoutFile))
+                || KeyCharacterMap::compile(keyCharacterMapFile, KeyCharacterMap::FORMAT_BASE,
+                        KeyMapImage::getImagePath(keyCharacterMapFile))) {
+            fprintf(stderr, "Cannot compile the maps.\n");
+        } else {
+            Result klImage = measureKeyLayoutMap(keyLayoutFile, iterations);
+            Result kcmImage = measureKeyCharacterMap(keyCharacterMapFile, iterations);
+            report(keyLayoutFile, klText, klImage);
+            report(keyCharacterMapFile, kcmText, kcmImage);
+            result = 0;
+        }
+    }
+
+    const String8* files[] = { &keyLayoutFile, &keyCharacterMapFile };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        unlink(files[i]->string());
+        unlink(KeyMapImage::getImagePath(*files[i]).string());
+    }
+    rmdir(dir.string());
+    return result;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the MotionEvent serialization throughput, for a two finger touch
+// event with nine axes per pointer and three samples.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <binder/Parcel.h>
+#include <input/Input.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static void initializeEvent(MotionEvent* event) {
+    const size_t pointerCount = 2, sampleCount = 3;
+    const int32_t axes[] = {
+        AMOTION_EVENT_AXIS_X, AMOTION_EVENT_AXIS_Y, AMOTION_EVENT_AXIS_PRESSURE,
+        AMOTION_EVENT_AXIS_SIZE, AMOTION_EVENT_AXIS_TOUCH_MAJOR,
+        AMOTION_EVENT_AXIS_TOUCH_MINOR, AMOTION_EVENT_AXIS_TOOL_MAJOR,
+        AMOTION_EVENT_AXIS_TOOL_MINOR, AMOTION_EVENT_AXIS_ORIENTATION,
+    };
+    PointerProperties pointerProperties[pointerCount];
+    PointerCoords pointerCoords[pointerCount];
+    for (size_t j = 0; j < sampleCount; j++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            pointerProperties[i].clear();
+            pointerProperties[i].id = i + 1;
+            pointerProperties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+            pointerCoords[i].clear();
+            for (size_t a = 0; a < sizeof(axes) / sizeof(axes[0]); a++) {
+                pointerCoords[i].setAxisValue(axes[a], 100 * j + 10 * i + a);
+            }
+        }
+        if (j == 0) {
+            event->initialize(2, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE,
+                    0, 0, 0, 0, 0, 0, 1, 1, 0, j,
+                    pointerCount, pointerProperties, pointerCoords);
+        } else {
+            event->addSample(j, pointerCoords);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    MotionEvent event;
+    initializeEvent(&event);
+
+    Parcel parcel;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        parcel.setDataSize(0);
+        parcel.setDataPosition(0);
+        event.writeToParcel(&parcel);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("MotionEvent::writeToParcel: %.1f ns, %.1f MB/s\n",
+            double(elapsed) / iterations,
+            double(parcel.dataSize()) * iterations * 1000 / elapsed);
+
+    MotionEvent outEvent;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        parcel.setDataPosition(0);
+        outEvent.readFromParcel(&parcel);
+    }
+    elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("MotionEvent::readFromParcel: %.1f ns, %.1f MB/s\n",
+            double(elapsed) / iterations,
+            double(parcel.dataSize()) * iterations * 1000 / elapsed);
+    return 0;
+}
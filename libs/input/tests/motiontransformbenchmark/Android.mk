@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	motiontransformbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libinput \
+	libutils \
+
+LOCAL_MODULE:= test-motiontransformbenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
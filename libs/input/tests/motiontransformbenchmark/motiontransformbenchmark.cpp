@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the cost of transforming, scaling and batching a MotionEvent that
+// holds 64 samples of two pointers.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <input/Input.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static void initializeEvent(MotionEvent* event, size_t sampleCount) {
+    const size_t pointerCount = 2;
+    PointerProperties pointerProperties[pointerCount];
+    PointerCoords pointerCoords[pointerCount];
+    for (size_t j = 0; j < sampleCount; j++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            pointerProperties[i].clear();
+            pointerProperties[i].id = i;
+            PointerCoords& c = pointerCoords[i];
+            c.clear();
+            c.setAxisValue(AMOTION_EVENT_AXIS_X, 10.5f * j + 100 * i);
+            c.setAxisValue(AMOTION_EVENT_AXIS_Y, -3.25f * j + 7);
+            c.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, j % 2 ? 0.5f : 0);
+            c.setAxisValue(AMOTION_EVENT_AXIS_SIZE, 0.25f);
+            c.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, 1.5f + j);
+            c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, 0.1f * (j / 4));
+        }
+        if (j == 0) {
+            event->initialize(2, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE,
+                    0, 0, 0, 0, 5, -8, 1, 1, 0, j,
+                    pointerCount, pointerProperties, pointerCoords);
+        } else {
+            event->addSample(j, pointerCoords);
+        }
+    }
+}
+
+static void setRotationMatrix(float matrix[9], float angle) {
+    float sin = sinf(angle);
+    float cos = cosf(angle);
+    matrix[0] = cos;
+    matrix[1] = -sin;
+    matrix[2] = 0;
+    matrix[3] = sin;
+    matrix[4] = cos;
+    matrix[5] = 0;
+    matrix[6] = 0;
+    matrix[7] = 0;
+    matrix[8] = 1.0f;
+}
+
+int main(int argc, char** argv) {
+    const size_t sampleCount = 64;
+    const int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+    MotionEvent event;
+    initializeEvent(&event, sampleCount);
+    size_t coordsCount = sampleCount * event.getPointerCount();
+    float matrix[9];
+    setRotationMatrix(matrix, 0.01f);
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        event.transform(matrix);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("MotionEvent::transform: %.2f ns/pointer sample\n",
+            double(elapsed) / (iterations * coordsCount));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        event.scale(i % 2 ? 0.5f : 2.0f);
+    }
+    elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("MotionEvent::scale: %.2f ns/pointer sample\n",
+            double(elapsed) / (iterations * coordsCount));
+
+    MotionEvent batch;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        batch.initialize(2, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE,
+                0, 0, 0, 0, 0, 0, 1, 1, 0, 0, event.getPointerCount(),
+                event.getPointerProperties(), event.getSamplePointerCoords());
+        batch.reserveSamples(sampleCount);
+        for (size_t j = 1; j < sampleCount; j++) {
+            batch.addSample(j, event.getHistoricalRawPointerCoords(0, j));
+        }
+    }
+    elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("MotionEvent::addSample: %.2f ns/sample\n",
+            double(elapsed) / (iterations * sampleCount));
+
+    // using the results keeps the loops from being optimized away
+    printf("x = %.2f, %zu samples batched\n", event.getX(0),
+            batch.getHistorySize() + 1);
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the cost of adding each movement of a 200 sample fling to a
+// VelocityTracker and getting the velocity of its pointer, as a view does
+// while handling a gesture, for each least squares strategy.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <input/VelocityTracker.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+struct Movement {
+    nsecs_t eventTime;
+    BitSet32 idBits;
+    VelocityTracker::Position positions[MAX_POINTERS];
+};
+
+static const size_t kMovementCount = 200;
+static Movement gMovements[kMovementCount];
+
+// A fling of a single pointer, sampled every 8 ms with some jitter in the timing,
+// that accelerates then decelerates, with coordinates rounded to the pixel as
+// touch screens report them.
+static void makeFling(float vx, float vy, uint32_t seed) {
+    nsecs_t eventTime = 1000000000LL;
+    float x = 100, y = 1500;
+    for (size_t i = 0; i < kMovementCount; i++) {
+        seed = seed * 1103515245 + 12345;
+        eventTime += 8000000 + nsecs_t(seed >> 16) % 2000000 - 1000000;
+        float speed = i < kMovementCount / 4
+                ? float(i) / (kMovementCount / 4) : 1.0f - float(i) / kMovementCount;
+        x += vx * speed * 0.008f;
+        y += vy * speed * 0.008f;
+        Movement& movement = gMovements[i];
+        movement.eventTime = eventTime;
+        movement.idBits = BitSet32(BitSet32::valueForBit(0));
+        movement.positions[0].x = floorf(x + 0.5f);
+        movement.positions[0].y = floorf(y + 0.5f);
+    }
+}
+
+static double measure(const char* strategy, int iterations) {
+    float vx, vy, sum = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int n = 0; n < iterations; n++) {
+        VelocityTracker tracker(strategy);
+        for (size_t i = 0; i < kMovementCount; i++) {
+            const Movement& movement = gMovements[i];
+            tracker.addMovement(movement.eventTime, movement.idBits, movement.positions);
+            tracker.getVelocity(movement.idBits.firstMarkedBit(), &vx, &vy);
+            sum += vx;
+        }
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    if (isnan(sum)) {
+        fprintf(stderr, "%s estimated a NaN velocity\n", strategy);
+    }
+    return double(elapsed) / (iterations * kMovementCount);
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    const char* strategies[] = { "lsq2", "ilsq2", "lsq1", "ilsq1" };
+    makeFling(3000, -8000, 1);
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+        printf("VelocityTracker %s: %.1f ns/movement\n", strategies[i],
+                measure(strategies[i], iterations));
+    }
+    return 0;
+}
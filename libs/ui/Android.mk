@@ -17,10 +17,12 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
 	Fence.cpp \
+	FenceWatcher.cpp \
 	FramebufferNativeWindow.cpp \
 	GraphicBuffer.cpp \
 	GraphicBufferAllocator.cpp \
 	GraphicBufferMapper.cpp \
+	mat4.cpp \
 	PixelFormat.cpp \
 	Rect.cpp \
 	Region.cpp \
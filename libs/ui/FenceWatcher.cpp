@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceWatcher"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+//#define LOG_NDEBUG 0
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <ui/Fence.h>
+#include <ui/FenceWatcher.h>
+
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Thread.h>
+#include <utils/Trace.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Maximum number of fences handled per epoll_wait call.
+static const int EPOLL_MAX_EVENTS = 16;
+
+// ===========================================================================
+// FenceWatcher
+// ===========================================================================
+
+ANDROID_SINGLETON_STATIC_INSTANCE( FenceWatcher )
+
+class FenceWatcher::WatcherThread : public Thread {
+public:
+    WatcherThread(FenceWatcher& watcher)
+        : Thread(false), mWatcher(watcher) { }
+
+private:
+    virtual bool threadLoop() {
+        return mWatcher.waitForFences();
+    }
+
+    FenceWatcher& mWatcher;
+};
+
+FenceWatcher::FenceWatcher() :
+        mEpollFd(-1),
+        mNumWatched(0),
+        mNumSignaled(0),
+        mNumWakeups(0) {
+    mEpollFd = epoll_create(EPOLL_MAX_EVENTS);
+    ALOGE_IF(mEpollFd < 0, "epoll_create failed: %s", strerror(errno));
+}
+
+FenceWatcher::~FenceWatcher() {
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+    }
+}
+
+status_t FenceWatcher::watch(const sp<Fence>& fence,
+        const sp<Callback>& callback) {
+    if (fence == NULL || callback == NULL) {
+        return BAD_VALUE;
+    }
+
+    if (!fence->isValid()) {
+        callback->onFenceSignaled(-1);
+        return NO_ERROR;
+    }
+
+    const int fd = fence->mFenceFd;
+
+    Mutex::Autolock lock(mMutex);
+
+    if (mEpollFd < 0) {
+        return NO_INIT;
+    }
+
+    // The same fence is often handed to several trackers (e.g. the present
+    // fence to every layer), poll it and query its signal time only once.
+    ssize_t index = mWatches.indexOfKey(fd);
+    if (index >= 0) {
+        mWatches.editValueAt(index).callbacks.push(wp<Callback>(callback));
+        mNumWatched++;
+        return NO_ERROR;
+    }
+
+    if (mThread == NULL) {
+        mThread = new WatcherThread(*this);
+        status_t err = mThread->run("FenceWatcher", PRIORITY_URGENT_DISPLAY);
+        if (err != NO_ERROR) {
+            ALOGE("watch: unable to start watcher thread: %s (%d)",
+                    strerror(-err), err);
+            mThread.clear();
+            return err;
+        }
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        status_t err = -errno;
+        ALOGE("watch: epoll_ctl failed: %s (%d)", strerror(-err), err);
+        return err;
+    }
+
+    watch_rec_t rec;
+    rec.fence = fence;
+    rec.callbacks.push(wp<Callback>(callback));
+    mWatches.add(fd, rec);
+
+    mNumWatched++;
+    return NO_ERROR;
+}
+
+void FenceWatcher::unwatch(const Callback* callback) {
+    Mutex::Autolock lock(mMutex);
+    for (size_t i = mWatches.size(); i > 0; i--) {
+        watch_rec_t& rec(mWatches.editValueAt(i - 1));
+        for (size_t j = rec.callbacks.size(); j > 0; j--) {
+            if (rec.callbacks[j - 1].unsafe_get() == callback) {
+                rec.callbacks.removeAt(j - 1);
+            }
+        }
+        if (rec.callbacks.isEmpty()) {
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mWatches.keyAt(i - 1), NULL);
+            mWatches.removeItemsAt(i - 1);
+        }
+    }
+}
+
+bool FenceWatcher::waitForFences() {
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int count = epoll_wait(mEpollFd, events, EPOLL_MAX_EVENTS, -1);
+    if (count < 0) {
+        if (errno != EINTR) {
+            ALOGE("waitForFences: epoll_wait failed: %s", strerror(errno));
+        }
+        return true;
+    }
+
+    ATRACE_CALL();
+
+    Vector<watch_rec_t> signaled;
+    {
+        Mutex::Autolock lock(mMutex);
+        mNumWakeups++;
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            ssize_t index = mWatches.indexOfKey(fd);
+            if (index < 0) {
+                continue;
+            }
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+            signaled.push(mWatches.valueAt(index));
+            mWatches.removeItemsAt(index);
+        }
+        mNumSignaled += signaled.size();
+    }
+
+    // The callbacks are invoked without holding the lock so that they can
+    // register new fences. The ones released meanwhile are skipped.
+    for (size_t i = 0; i < signaled.size(); i++) {
+        const watch_rec_t& rec(signaled[i]);
+        const nsecs_t signalTime = rec.fence->getSignalTime();
+        for (size_t j = 0; j < rec.callbacks.size(); j++) {
+            sp<Callback> callback(rec.callbacks[j].promote());
+            if (callback != NULL) {
+                callback->onFenceSignaled(signalTime);
+            }
+        }
+    }
+
+    return true;
+}
+
+void FenceWatcher::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("FenceWatcher: %d pending, %llu watches, "
+            "%llu fences signaled, %llu wakeups (%.2f fences/wakeup)\n",
+            int(mWatches.size()),
+            (unsigned long long)mNumWatched,
+            (unsigned long long)mNumSignaled,
+            (unsigned long long)mNumWakeups,
+            mNumWakeups ? double(mNumSignaled) / mNumWakeups : 0.0);
+}
+
+// ===========================================================================
+// FenceTime
+// ===========================================================================
+
+sp<FenceTime> FenceTime::create(const sp<Fence>& fence) {
+    sp<FenceTime> fenceTime(new FenceTime());
+    status_t err = FenceWatcher::get().watch(fence, fenceTime);
+    if (err != NO_ERROR) {
+        fenceTime->onFenceSignaled(-1);
+    }
+    return fenceTime;
+}
+
+FenceTime::FenceTime() :
+        mSignalTime(INT64_MAX) {
+}
+
+FenceTime::~FenceTime() {
+    // Once the time is set the watcher already let go of the fence.
+    if (getSignalTime() == INT64_MAX) {
+        FenceWatcher::get().unwatch(this);
+    }
+}
+
+nsecs_t FenceTime::getSignalTime() const {
+    Mutex::Autolock lock(mMutex);
+    return mSignalTime;
+}
+
+void FenceTime::onFenceSignaled(nsecs_t signalTime) {
+    Mutex::Autolock lock(mMutex);
+    mSignalTime = signalTime;
+}
+
+}; // namespace android
@@ -25,6 +25,7 @@
 #include <utils/Trace.h>
 
 #include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -134,6 +135,9 @@ status_t GraphicBufferAllocator::free(buffer_handle_t handle)
     ATRACE_CALL();
     status_t err;
 
+    // the handle may be reused by the next allocation, make sure no
+    // stale CPU mapping survives it.
+    GraphicBufferMapper::get().forgetMapping(handle);
     err = mAllocDev->free(mAllocDev, handle);
 
     ALOGW_IF(err, "free(...) failed %d (%s)", err, strerror(-err));
@@ -20,8 +20,11 @@
 #include <stdint.h>
 #include <errno.h>
 
+#include <cutils/properties.h>
+
 #include <utils/Errors.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/Trace.h>
 
 #include <ui/GraphicBufferMapper.h>
@@ -36,7 +39,7 @@ namespace android {
 ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferMapper )
 
 GraphicBufferMapper::GraphicBufferMapper()
-    : mAllocMod(0)
+    : mAllocMod(0), mMappingCacheEnabled(false)
 {
     hw_module_t const* module;
     int err = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
@@ -44,6 +47,17 @@ GraphicBufferMapper::GraphicBufferMapper()
     if (err == 0) {
         mAllocMod = (gralloc_module_t const *)module;
     }
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.gralloc.map_cache", value, "0");
+    mMappingCacheEnabled = atoi(value) != 0;
+}
+
+void GraphicBufferMapper::setMappingCacheEnabled(bool enabled)
+{
+    // the mappings in use are still released by their last unlock()
+    Mutex::Autolock _l(mLock);
+    mMappingCacheEnabled = enabled;
 }
 
 status_t GraphicBufferMapper::registerBuffer(buffer_handle_t handle)
@@ -63,6 +77,7 @@ status_t GraphicBufferMapper::unregisterBuffer(buffer_handle_t handle)
     ATRACE_CALL();
     status_t err;
 
+    forgetMapping(handle);
     err = mAllocMod->unregisterBuffer(mAllocMod, handle);
 
     ALOGW_IF(err, "unregisterBuffer(%p) failed %d (%s)",
@@ -76,11 +91,30 @@ status_t GraphicBufferMapper::lock(buffer_handle_t handle,
     ATRACE_CALL();
     status_t err;
 
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        mapping_rec_t* rec = acquireCachedMappingLocked(handle, usage,
+                bounds, false);
+        if (rec) {
+            *vaddr = rec->vaddr;
+            recordLockTimeLocked(systemTime(SYSTEM_TIME_MONOTONIC) - start, true);
+            return NO_ERROR;
+        }
+    }
+
+    // only the locked rect is passed down, so that implementations which
+    // do cache maintenance on lock can restrict it to that area.
     err = mAllocMod->lock(mAllocMod, handle, usage,
             bounds.left, bounds.top, bounds.width(), bounds.height(),
             vaddr);
 
     ALOGW_IF(err, "lock(...) failed %d (%s)", err, strerror(-err));
+    if (err == NO_ERROR) {
+        Mutex::Autolock _l(mLock);
+        addMappingLocked(handle, usage, bounds, *vaddr, NULL);
+        recordLockTimeLocked(systemTime(SYSTEM_TIME_MONOTONIC) - start, false);
+    }
     return err;
 }
 
@@ -90,11 +124,28 @@ status_t GraphicBufferMapper::lockYCbCr(buffer_handle_t handle,
     ATRACE_CALL();
     status_t err;
 
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        mapping_rec_t* rec = acquireCachedMappingLocked(handle, usage,
+                bounds, true);
+        if (rec) {
+            *ycbcr = rec->ycbcr;
+            recordLockTimeLocked(systemTime(SYSTEM_TIME_MONOTONIC) - start, true);
+            return NO_ERROR;
+        }
+    }
+
     err = mAllocMod->lock_ycbcr(mAllocMod, handle, usage,
             bounds.left, bounds.top, bounds.width(), bounds.height(),
             ycbcr);
 
     ALOGW_IF(err, "lock(...) failed %d (%s)", err, strerror(-err));
+    if (err == NO_ERROR) {
+        Mutex::Autolock _l(mLock);
+        addMappingLocked(handle, usage, bounds, NULL, ycbcr);
+        recordLockTimeLocked(systemTime(SYSTEM_TIME_MONOTONIC) - start, false);
+    }
     return err;
 }
 
@@ -103,12 +154,131 @@ status_t GraphicBufferMapper::unlock(buffer_handle_t handle)
     ATRACE_CALL();
     status_t err;
 
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mMappings.indexOfKey(handle);
+        if (index >= 0) {
+            mapping_rec_t& rec(mMappings.editValueAt(index));
+            if (rec.passthroughCount) {
+                // this unlock pairs with a lock that bypassed the cache
+                rec.passthroughCount--;
+            } else if (rec.refCount) {
+                if (--rec.refCount) {
+                    // the mapping is still in use
+                    return NO_ERROR;
+                }
+                // the last user is done, gralloc gets the buffer back so
+                // that it can do its cache maintenance before it's queued
+                mMappings.removeItemsAt(index);
+            } else {
+                ALOGW("unlock(%p) called on a buffer that isn't locked", handle);
+                mMappings.removeItemsAt(index);
+            }
+        }
+    }
+
     err = mAllocMod->unlock(mAllocMod, handle);
 
     ALOGW_IF(err, "unlock(...) failed %d (%s)", err, strerror(-err));
     return err;
 }
 
+GraphicBufferMapper::mapping_rec_t*
+GraphicBufferMapper::acquireCachedMappingLocked(buffer_handle_t handle,
+        int usage, const Rect& bounds, bool isYCbCr)
+{
+    ssize_t index = mMappings.indexOfKey(handle);
+    if (index < 0) {
+        return NULL;
+    }
+    mapping_rec_t& rec(mMappings.editValueAt(index));
+    Rect common;
+    const bool compatible = mMappingCacheEnabled &&
+            rec.isYCbCr == isYCbCr &&
+            (usage & ~rec.usage) == 0 &&
+            rec.bounds.intersect(bounds, &common) && common == bounds;
+    if (!compatible) {
+        // the request needs a different mapping, let gralloc handle it
+        return NULL;
+    }
+    rec.refCount++;
+    return &rec;
+}
+
+void GraphicBufferMapper::addMappingLocked(buffer_handle_t handle, int usage,
+        const Rect& bounds, void* vaddr, const android_ycbcr* ycbcr)
+{
+    ssize_t index = mMappings.indexOfKey(handle);
+    if (index >= 0) {
+        // the handle was locked again with a mapping we couldn't share,
+        // make sure the matching unlock is forwarded to gralloc.
+        mMappings.editValueAt(index).passthroughCount++;
+        return;
+    }
+    if (!mMappingCacheEnabled) {
+        return;
+    }
+    mapping_rec_t rec;
+    rec.usage = usage;
+    rec.bounds = bounds;
+    rec.vaddr = vaddr;
+    if (ycbcr) {
+        rec.ycbcr = *ycbcr;
+        rec.isYCbCr = true;
+    }
+    rec.refCount = 1;
+    mMappings.add(handle, rec);
+}
+
+void GraphicBufferMapper::recordLockTimeLocked(nsecs_t duration, bool hit)
+{
+    mStats.lockCount++;
+    if (hit) {
+        mStats.cacheHits++;
+    }
+    mStats.totalLockTime += duration;
+    if (duration > mStats.maxLockTime) {
+        mStats.maxLockTime = duration;
+    }
+}
+
+void GraphicBufferMapper::forgetMapping(buffer_handle_t handle)
+{
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mMappings.indexOfKey(handle);
+    if (index < 0) {
+        return;
+    }
+    const mapping_rec_t& rec(mMappings.valueAt(index));
+    ALOGW("buffer %p released while still locked (refs=%u)",
+            handle, rec.refCount + rec.passthroughCount);
+    mMappings.removeItemsAt(index);
+}
+
+void GraphicBufferMapper::dump(String8& result) const
+{
+    Mutex::Autolock _l(mLock);
+    const lock_stats_t& s(mStats);
+    result.appendFormat("GraphicBufferMapper: mapping cache %s\n",
+            mMappingCacheEnabled ? "enabled" : "disabled");
+    result.appendFormat("  locks: %llu, cache hits: %llu, "
+            "avg lock: %.2f us, max lock: %.2f us\n",
+            (unsigned long long)s.lockCount,
+            (unsigned long long)s.cacheHits,
+            s.lockCount ? (s.totalLockTime / 1000.0) / s.lockCount : 0.0,
+            s.maxLockTime / 1000.0);
+    const size_t c = mMappings.size();
+    for (size_t i=0 ; i<c ; i++) {
+        const mapping_rec_t& rec(mMappings.valueAt(i));
+        result.appendFormat("  %10p: [%4d,%4d,%4d,%4d] usage=0x%08x refs=%u%s\n",
+                mMappings.keyAt(i),
+                rec.bounds.left, rec.bounds.top,
+                rec.bounds.right, rec.bounds.bottom,
+                rec.usage, rec.refCount + rec.passthroughCount,
+                rec.isYCbCr ? " (ycbcr)" : "");
+    }
+}
+
 status_t GraphicBufferMapper::getphys(buffer_handle_t handle, void** vaddr)
 {
      status_t err;
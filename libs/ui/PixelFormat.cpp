@@ -14,6 +14,12 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include <ui/PixelFormat.h>
 #include <hardware/hardware.h>
 
@@ -33,6 +39,8 @@ ssize_t bytesPerPixel(PixelFormat format) {
         case PIXEL_FORMAT_RGBA_5551:
         case PIXEL_FORMAT_RGBA_4444:
             return 2;
+        case PIXEL_FORMAT_A_8:
+            return 1;
     }
     return BAD_VALUE;
 }
@@ -49,10 +57,257 @@ ssize_t bitsPerPixel(PixelFormat format) {
         case PIXEL_FORMAT_RGBA_5551:
         case PIXEL_FORMAT_RGBA_4444:
             return 16;
+        case PIXEL_FORMAT_A_8:
+            return 8;
     }
     return BAD_VALUE;
 }
 
+// ----------------------------------------------------------------------------
+// Pixel conversions
+//
+// Every supported format can be unpacked to and packed from RGBA_8888.
+// Conversions from or to RGBA_8888 use a single pass; other pairs go through
+// a small RGBA_8888 buffer on the stack, one chunk of a row at a time.
+// The NEON paths produce the same results as the scalar ones.
+// ----------------------------------------------------------------------------
+
+typedef void (*unpack_func_t)(uint8_t* rgba, const uint8_t* src, size_t count);
+typedef void (*pack_func_t)(uint8_t* dst, const uint8_t* rgba, size_t count);
+
+static inline uint8_t expand5(uint32_t v) { return uint8_t((v << 3) | (v >> 2)); }
+static inline uint8_t expand6(uint32_t v) { return uint8_t((v << 2) | (v >> 4)); }
+
+static void copyRgba(uint8_t* dst, const uint8_t* src, size_t count) {
+    memcpy(dst, src, count * 4);
+}
+
+static void unpackRgbx(uint8_t* rgba, const uint8_t* src, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    const uint8x16_t alpha = vdupq_n_u8(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t p = vld4q_u8(src + i * 4);
+        p.val[3] = alpha;
+        vst4q_u8(rgba + i * 4, p);
+    }
+#endif
+    for (; i < count; i++) {
+        rgba[i*4 + 0] = src[i*4 + 0];
+        rgba[i*4 + 1] = src[i*4 + 1];
+        rgba[i*4 + 2] = src[i*4 + 2];
+        rgba[i*4 + 3] = 0xFF;
+    }
+}
+
+// swapping R and B is its own inverse, so this both packs and unpacks
+static void swapRedBlue(uint8_t* dst, const uint8_t* src, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t p = vld4q_u8(src + i * 4);
+        uint8x16_t t = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = t;
+        vst4q_u8(dst + i * 4, p);
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t r = src[i*4 + 0];
+        dst[i*4 + 0] = src[i*4 + 2];
+        dst[i*4 + 1] = src[i*4 + 1];
+        dst[i*4 + 2] = r;
+        dst[i*4 + 3] = src[i*4 + 3];
+    }
+}
+
+static void unpackRgb888(uint8_t* rgba, const uint8_t* src, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    const uint8x16_t alpha = vdupq_n_u8(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t p = vld3q_u8(src + i * 3);
+        uint8x16x4_t q;
+        q.val[0] = p.val[0];
+        q.val[1] = p.val[1];
+        q.val[2] = p.val[2];
+        q.val[3] = alpha;
+        vst4q_u8(rgba + i * 4, q);
+    }
+#endif
+    for (; i < count; i++) {
+        rgba[i*4 + 0] = src[i*3 + 0];
+        rgba[i*4 + 1] = src[i*3 + 1];
+        rgba[i*4 + 2] = src[i*3 + 2];
+        rgba[i*4 + 3] = 0xFF;
+    }
+}
+
+static void packRgb888(uint8_t* dst, const uint8_t* rgba, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t p = vld4q_u8(rgba + i * 4);
+        uint8x16x3_t q;
+        q.val[0] = p.val[0];
+        q.val[1] = p.val[1];
+        q.val[2] = p.val[2];
+        vst3q_u8(dst + i * 3, q);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i*3 + 0] = rgba[i*4 + 0];
+        dst[i*3 + 1] = rgba[i*4 + 1];
+        dst[i*3 + 2] = rgba[i*4 + 2];
+    }
+}
+
+static void unpackRgb565(uint8_t* rgba, const uint8_t* src, size_t count) {
+    const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    const uint8x8_t alpha = vdup_n_u8(0xFF);
+    const uint8x8_t mask5 = vdup_n_u8(0x1F);
+    const uint8x8_t mask6 = vdup_n_u8(0x3F);
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t p = vld1q_u16(s + i);
+        const uint8x8_t r = vshrn_n_u16(p, 11);
+        const uint8x8_t g = vand_u8(vshrn_n_u16(p, 5), mask6);
+        const uint8x8_t b = vand_u8(vmovn_u16(p), mask5);
+        uint8x8x4_t q;
+        q.val[0] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+        q.val[1] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+        q.val[2] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+        q.val[3] = alpha;
+        vst4_u8(rgba + i * 4, q);
+    }
+#endif
+    for (; i < count; i++) {
+        const uint32_t p = s[i];
+        rgba[i*4 + 0] = expand5(p >> 11);
+        rgba[i*4 + 1] = expand6((p >> 5) & 0x3F);
+        rgba[i*4 + 2] = expand5(p & 0x1F);
+        rgba[i*4 + 3] = 0xFF;
+    }
+}
+
+static void packRgb565(uint8_t* dst, const uint8_t* rgba, size_t count) {
+    uint16_t* d = reinterpret_cast<uint16_t*>(dst);
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    const uint16x8_t maskR = vdupq_n_u16(0xF800);
+    const uint16x8_t maskG = vdupq_n_u16(0x07E0);
+    for (; i + 8 <= count; i += 8) {
+        const uint8x8x4_t p = vld4_u8(rgba + i * 4);
+        uint16x8_t q = vandq_u16(vshll_n_u8(p.val[0], 8), maskR);
+        q = vorrq_u16(q, vandq_u16(vshll_n_u8(p.val[1], 3), maskG));
+        q = vorrq_u16(q, vmovl_u8(vshr_n_u8(p.val[2], 3)));
+        vst1q_u16(d + i, q);
+    }
+#endif
+    for (; i < count; i++) {
+        d[i] = uint16_t(((rgba[i*4 + 0] >> 3) << 11) |
+                ((rgba[i*4 + 1] >> 2) << 5) |
+                 (rgba[i*4 + 2] >> 3));
+    }
+}
+
+static void unpackA8(uint8_t* rgba, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        rgba[i*4 + 0] = 0;
+        rgba[i*4 + 1] = 0;
+        rgba[i*4 + 2] = 0;
+        rgba[i*4 + 3] = src[i];
+    }
+}
+
+static void packA8(uint8_t* dst, const uint8_t* rgba, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = rgba[i*4 + 3];
+    }
+}
+
+static bool getConverters(PixelFormat format,
+        unpack_func_t* unpack, pack_func_t* pack) {
+    switch (format) {
+        case PIXEL_FORMAT_RGBA_8888:
+            *unpack = copyRgba;
+            *pack = copyRgba;
+            return true;
+        case PIXEL_FORMAT_RGBX_8888:
+            *unpack = unpackRgbx;
+            *pack = copyRgba;
+            return true;
+        case PIXEL_FORMAT_BGRA_8888:
+            *unpack = swapRedBlue;
+            *pack = swapRedBlue;
+            return true;
+        case PIXEL_FORMAT_RGB_888:
+            *unpack = unpackRgb888;
+            *pack = packRgb888;
+            return true;
+        case PIXEL_FORMAT_RGB_565:
+            *unpack = unpackRgb565;
+            *pack = packRgb565;
+            return true;
+        case PIXEL_FORMAT_A_8:
+            *unpack = unpackA8;
+            *pack = packA8;
+            return true;
+    }
+    return false;
+}
+
+bool canConvertPixels(PixelFormat dstFormat, PixelFormat srcFormat) {
+    unpack_func_t unpack;
+    pack_func_t pack;
+    return getConverters(dstFormat, &unpack, &pack) &&
+            getConverters(srcFormat, &unpack, &pack);
+}
+
+status_t convertPixels(void* dst, PixelFormat dstFormat, size_t dstStride,
+        const void* src, PixelFormat srcFormat, size_t srcStride,
+        uint32_t w, uint32_t h) {
+    unpack_func_t unpack, dstUnpack;
+    pack_func_t pack, srcPack;
+    if (!getConverters(srcFormat, &unpack, &srcPack) ||
+            !getConverters(dstFormat, &dstUnpack, &pack)) {
+        return BAD_VALUE;
+    }
+
+    const size_t srcBpp = bytesPerPixel(srcFormat);
+    const size_t dstBpp = bytesPerPixel(dstFormat);
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(src);
+    uint8_t* d = reinterpret_cast<uint8_t*>(dst);
+
+    // RGBX is RGBA with an undefined alpha, so RGBA -> RGBX is a plain copy.
+    const bool identity = (srcFormat == dstFormat) ||
+            (srcFormat == PIXEL_FORMAT_RGBA_8888 &&
+             dstFormat == PIXEL_FORMAT_RGBX_8888);
+
+    enum { CHUNK = 128 };
+    uint8_t rgba[CHUNK * 4];
+
+    for (uint32_t y = 0; y < h; y++) {
+        const uint8_t* srow = s + y * srcStride * srcBpp;
+        uint8_t* drow = d + y * dstStride * dstBpp;
+        if (identity) {
+            memcpy(drow, srow, w * srcBpp);
+        } else if (srcFormat == PIXEL_FORMAT_RGBA_8888) {
+            pack(drow, srow, w);
+        } else if (dstFormat == PIXEL_FORMAT_RGBA_8888) {
+            unpack(drow, srow, w);
+        } else {
+            for (uint32_t x = 0; x < w; x += CHUNK) {
+                const size_t count = (w - x) < CHUNK ? (w - x) : CHUNK;
+                unpack(rgba, srow + x * srcBpp, count);
+                pack(drow + x * dstBpp, rgba, count);
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
 // ----------------------------------------------------------------------------
 }; // namespace android
 // ----------------------------------------------------------------------------
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include <ui/mat4.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+/*
+ * mat4 stores 4 contiguous columns of 4 floats, vec4 is 4 contiguous floats
+ * and vec2 2 contiguous floats. None of them are guaranteed to be 16-bytes
+ * aligned, so only unaligned loads and stores are used.
+ */
+
+#if defined(__ARM_NEON__)
+
+typedef float32x4_t simd4f;
+
+static inline simd4f load(const float* p) { return vld1q_f32(p); }
+static inline void store(float* p, simd4f v) { vst1q_f32(p, v); }
+static inline simd4f splat(float f) { return vdupq_n_f32(f); }
+static inline simd4f mul(simd4f a, simd4f b) { return vmulq_f32(a, b); }
+static inline simd4f madd(simd4f a, simd4f b, simd4f c) { return vmlaq_f32(c, a, b); }
+#define HAS_SIMD 1
+
+#elif defined(__SSE__)
+
+typedef __m128 simd4f;
+
+static inline simd4f load(const float* p) { return _mm_loadu_ps(p); }
+static inline void store(float* p, simd4f v) { _mm_storeu_ps(p, v); }
+static inline simd4f splat(float f) { return _mm_set1_ps(f); }
+static inline simd4f mul(simd4f a, simd4f b) { return _mm_mul_ps(a, b); }
+static inline simd4f madd(simd4f a, simd4f b, simd4f c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#define HAS_SIMD 1
+
+#else
+#define HAS_SIMD 0
+#endif
+
+#if HAS_SIMD
+
+// returns c0*v[0] + c1*v[1] + c2*v[2] + c3*v[3]
+static inline simd4f transform4(simd4f c0, simd4f c1, simd4f c2, simd4f c3,
+        const float* v) {
+    simd4f r = mul(c0, splat(v[0]));
+    r = madd(c1, splat(v[1]), r);
+    r = madd(c2, splat(v[2]), r);
+    r = madd(c3, splat(v[3]), r);
+    return r;
+}
+
+tmat44<float> operator *(const tmat44<float>& lhs, const tmat44<float>& rhs) {
+    const float* a = lhs.asArray();
+    const float* b = rhs.asArray();
+    const simd4f c0 = load(a);
+    const simd4f c1 = load(a + 4);
+    const simd4f c2 = load(a + 8);
+    const simd4f c3 = load(a + 12);
+    tmat44<float> result(tmat44<float>::NO_INIT);
+    float* r = const_cast<float*>(result.asArray());
+    store(r,      transform4(c0, c1, c2, c3, b));
+    store(r + 4,  transform4(c0, c1, c2, c3, b + 4));
+    store(r + 8,  transform4(c0, c1, c2, c3, b + 8));
+    store(r + 12, transform4(c0, c1, c2, c3, b + 12));
+    return result;
+}
+
+tvec4<float> operator *(const tmat44<float>& lhs, const tvec4<float>& rhs) {
+    const float* a = lhs.asArray();
+    tvec4<float> result(tvec4<float>::NO_INIT);
+    store(&result.x, transform4(load(a), load(a + 4), load(a + 8), load(a + 12),
+            &rhs.x));
+    return result;
+}
+
+void transform(const tmat44<float>& m, tvec4<float>* out,
+        const tvec4<float>* in, size_t count) {
+    const float* a = m.asArray();
+    const simd4f c0 = load(a);
+    const simd4f c1 = load(a + 4);
+    const simd4f c2 = load(a + 8);
+    const simd4f c3 = load(a + 12);
+    for (size_t i = 0; i < count; i++) {
+        store(&out[i].x, transform4(c0, c1, c2, c3, &in[i].x));
+    }
+}
+
+void transform(const tmat44<float>& m, tvec2<float>* out,
+        const tvec2<float>* in, size_t count) {
+    const float* a = m.asArray();
+    const simd4f c0 = load(a);
+    const simd4f c1 = load(a + 4);
+    const simd4f c3 = load(a + 12);
+    for (size_t i = 0; i < count; i++) {
+        // z is 0 and w is 1, so the third column doesn't contribute
+        // and the fourth one is added as is.
+        const float x = in[i].x, y = in[i].y;
+        float r[4];
+        store(r, madd(c1, splat(y), madd(c0, splat(x), c3)));
+        out[i].x = r[0];
+        out[i].y = r[1];
+    }
+}
+
+#else // !HAS_SIMD
+
+tmat44<float> operator *(const tmat44<float>& lhs, const tmat44<float>& rhs) {
+    const float* a = lhs.asArray();
+    const float* b = rhs.asArray();
+    tmat44<float> result(tmat44<float>::NO_INIT);
+    float* r = const_cast<float*>(result.asArray());
+    for (size_t c = 0; c < 4; c++) {
+        for (size_t i = 0; i < 4; i++) {
+            r[c*4 + i] = a[i]*b[c*4] + a[4 + i]*b[c*4 + 1] +
+                    a[8 + i]*b[c*4 + 2] + a[12 + i]*b[c*4 + 3];
+        }
+    }
+    return result;
+}
+
+tvec4<float> operator *(const tmat44<float>& lhs, const tvec4<float>& rhs) {
+    const float* a = lhs.asArray();
+    tvec4<float> result(tvec4<float>::NO_INIT);
+    for (size_t i = 0; i < 4; i++) {
+        result[i] = a[i]*rhs.x + a[4 + i]*rhs.y + a[8 + i]*rhs.z + a[12 + i]*rhs.w;
+    }
+    return result;
+}
+
+void transform(const tmat44<float>& m, tvec4<float>* out,
+        const tvec4<float>* in, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = m * in[i];
+    }
+}
+
+void transform(const tmat44<float>& m, tvec2<float>* out,
+        const tvec2<float>* in, size_t count) {
+    const float* a = m.asArray();
+    for (size_t i = 0; i < count; i++) {
+        const float x = in[i].x, y = in[i].y;
+        out[i].x = a[0]*x + a[4]*y + a[12];
+        out[i].y = a[1]*x + a[5]*y + a[13];
+    }
+}
+
+#endif // HAS_SIMD
+
+/*
+ * Closed-form inverse using cofactors. Unlike the generic Gauss-Jordan
+ * elimination it has no data dependent branches, which makes it a lot
+ * cheaper for the well conditioned transforms we deal with.
+ */
+tmat44<float> matrix::InverseImpl< tmat44<float> >::inverse(const tmat44<float>& src) {
+    const float* m = src.asArray();
+    tmat44<float> result(tmat44<float>::NO_INIT);
+    float* inv = const_cast<float*>(result.asArray());
+
+    inv[0]  =  m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15]
+             + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4]  = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15]
+             - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8]  =  m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15]
+             + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14]
+             - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1]  = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15]
+             - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5]  =  m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15]
+             + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9]  = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15]
+             - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] =  m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14]
+             + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2]  =  m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15]
+             + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6]  = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15]
+             - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] =  m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15]
+             + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14]
+             - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3]  = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11]
+             - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7]  =  m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11]
+             + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11]
+             - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] =  m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10]
+             + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    const float det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+    const float invDet = 1.0f / det;
+    for (size_t i = 0; i < 16; i++) {
+        inv[i] *= invDet;
+    }
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -4,11 +4,15 @@ include $(CLEAR_VARS)
 
 # Build the unit tests.
 test_src_files := \
+    FenceWatcher_test.cpp \
+    GraphicBufferMapper_test.cpp \
     Region_test.cpp \
+    PixelFormat_test.cpp \
     vec_test.cpp \
     mat_test.cpp
 
 shared_libraries := \
+    libsync \
     libutils \
     libui
 
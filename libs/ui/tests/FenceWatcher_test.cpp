@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceWatcherTest"
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sync/sync.h>
+#include <ui/Fence.h>
+#include <ui/FenceWatcher.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const nsecs_t TIMEOUT = ms2ns(1000);
+
+class FenceWatcherTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        mTimeline = sw_sync_timeline_create();
+        ASSERT_GE(mTimeline, 0) << "sw_sync is needed to create fences";
+        mValue = 0;
+    }
+
+    virtual void TearDown() {
+        if (mTimeline >= 0) {
+            close(mTimeline);
+        }
+    }
+
+    // createFence returns a fence that signals on the next signal() call.
+    sp<Fence> createFence() {
+        return new Fence(sw_sync_fence_create(mTimeline, "test", mValue + 1));
+    }
+
+    void signal() {
+        ASSERT_EQ(0, sw_sync_timeline_inc(mTimeline, 1));
+        mValue++;
+    }
+
+    // waitForSignalTime waits until the watcher delivered the signal time.
+    static nsecs_t waitForSignalTime(const sp<FenceTime>& fenceTime) {
+        const nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + TIMEOUT;
+        nsecs_t signalTime;
+        while ((signalTime = fenceTime->getSignalTime()) == INT64_MAX &&
+                systemTime(SYSTEM_TIME_MONOTONIC) < deadline) {
+            usleep(1000);
+        }
+        return signalTime;
+    }
+
+    // getPendingCount returns the number of fences the watcher waits on.
+    static int getPendingCount() {
+        String8 result;
+        FenceWatcher::get().dump(result);
+        int pending = -1;
+        sscanf(result.string(), "FenceWatcher: %d pending", &pending);
+        return pending;
+    }
+
+    int mTimeline;
+    unsigned int mValue;
+};
+
+TEST_F(FenceWatcherTest, FenceTime_ReportsSignalTimeOfFence) {
+    sp<Fence> fence(createFence());
+    sp<FenceTime> fenceTime(FenceTime::create(fence));
+    EXPECT_EQ(INT64_MAX, fenceTime->getSignalTime());
+
+    signal();
+    const nsecs_t signalTime = waitForSignalTime(fenceTime);
+    EXPECT_NE(INT64_MAX, signalTime);
+    EXPECT_EQ(fence->getSignalTime(), signalTime);
+}
+
+TEST_F(FenceWatcherTest, FenceTime_InvalidFenceIsSignaledRightAway) {
+    sp<FenceTime> fenceTime(FenceTime::create(Fence::NO_FENCE));
+    EXPECT_EQ(-1, fenceTime->getSignalTime());
+}
+
+TEST_F(FenceWatcherTest, SharedFence_ReportsTheSameTimeToAll) {
+    sp<Fence> fence(createFence());
+    sp<FenceTime> first(FenceTime::create(fence));
+    sp<FenceTime> second(FenceTime::create(fence));
+    EXPECT_EQ(1, getPendingCount()) << "the fence should be watched once";
+
+    signal();
+    EXPECT_NE(INT64_MAX, waitForSignalTime(first));
+    EXPECT_EQ(first->getSignalTime(), waitForSignalTime(second));
+    EXPECT_EQ(0, getPendingCount());
+}
+
+TEST_F(FenceWatcherTest, ReleasingFenceTime_StopsWatchingTheFence) {
+    sp<Fence> fence(createFence());
+    sp<FenceTime> first(FenceTime::create(fence));
+    sp<FenceTime> second(FenceTime::create(fence));
+    ASSERT_EQ(1, getPendingCount());
+
+    first.clear();
+    EXPECT_EQ(1, getPendingCount()) << "the fence still has a FenceTime";
+    second.clear();
+    EXPECT_EQ(0, getPendingCount())
+            << "a fence that nobody tracks should not be held until it signals";
+
+    // the watcher goes on with the other fences
+    sp<FenceTime> later(FenceTime::create(createFence()));
+    signal();
+    EXPECT_NE(INT64_MAX, waitForSignalTime(later));
+}
+
+}; // namespace android
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferMapperTest"
+
+#include <string.h>
+
+#include <hardware/gralloc.h>
+#include <ui/GraphicBufferMapper.h>
+#include <ui/Rect.h>
+#include <utils/KeyedVector.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+// A gralloc module that only counts the locks and unlocks of each buffer.
+static int gLocks;
+static int gUnlocks;
+static DefaultKeyedVector<buffer_handle_t, int> gHeld(0);
+static char gMemory[64];
+
+static int fakeRegisterBuffer(gralloc_module_t const*, buffer_handle_t) {
+    return 0;
+}
+
+static int fakeLock(gralloc_module_t const*, buffer_handle_t handle,
+        int, int, int, int, int, void** vaddr) {
+    gLocks++;
+    gHeld.replaceValueFor(handle, gHeld.valueFor(handle) + 1);
+    *vaddr = gMemory;
+    return 0;
+}
+
+static int fakeLockYCbCr(gralloc_module_t const*, buffer_handle_t handle,
+        int, int, int, int, int, android_ycbcr* ycbcr) {
+    gLocks++;
+    gHeld.replaceValueFor(handle, gHeld.valueFor(handle) + 1);
+    memset(ycbcr, 0, sizeof(*ycbcr));
+    ycbcr->y = gMemory;
+    return 0;
+}
+
+static int fakeUnlock(gralloc_module_t const*, buffer_handle_t handle) {
+    gUnlocks++;
+    gHeld.replaceValueFor(handle, gHeld.valueFor(handle) - 1);
+    return 0;
+}
+
+static gralloc_module_t gModule;
+
+}; // namespace android
+
+// Stands in for libhardware, the mapper loads its gralloc module with it.
+int hw_get_module(const char*, const struct hw_module_t** module) {
+    android::gModule.registerBuffer = android::fakeRegisterBuffer;
+    android::gModule.unregisterBuffer = android::fakeRegisterBuffer;
+    android::gModule.lock = android::fakeLock;
+    android::gModule.lock_ycbcr = android::fakeLockYCbCr;
+    android::gModule.unlock = android::fakeUnlock;
+    *module = &android::gModule.common;
+    return 0;
+}
+
+namespace android {
+
+static const int USAGE_READ = GRALLOC_USAGE_SW_READ_OFTEN;
+static const int USAGE_READ_WRITE =
+        GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+class GraphicBufferMapperTest : public testing::Test {
+protected:
+    GraphicBufferMapperTest() : mMapper(GraphicBufferMapper::get()),
+            mHandle(reinterpret_cast<buffer_handle_t>(&mHandle)) { }
+
+    virtual void SetUp() {
+        mMapper.setMappingCacheEnabled(true);
+        gLocks = 0;
+        gUnlocks = 0;
+    }
+
+    virtual void TearDown() {
+        mMapper.setMappingCacheEnabled(false);
+        EXPECT_EQ(0, gHeld.valueFor(mHandle))
+                << "the buffer should not be left locked in gralloc";
+        gHeld.clear();
+    }
+
+    GraphicBufferMapper& mMapper;
+    buffer_handle_t mHandle;
+};
+
+TEST_F(GraphicBufferMapperTest, LockAfterLastUnlock_GoesBackToGralloc) {
+    void* vaddr;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(10, 10), &vaddr));
+        EXPECT_EQ(gMemory, vaddr);
+        ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+        EXPECT_EQ(0, gHeld.valueFor(mHandle))
+                << "the last unlock should unlock the buffer in gralloc";
+    }
+    EXPECT_EQ(10, gLocks);
+    EXPECT_EQ(10, gUnlocks);
+}
+
+TEST_F(GraphicBufferMapperTest, NestedCompatibleLocks_ShareTheMapping) {
+    void* vaddr;
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ_WRITE, Rect(10, 10), &vaddr));
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(5, 5), &vaddr));
+    EXPECT_EQ(gMemory, vaddr);
+    EXPECT_EQ(1, gLocks);
+
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    EXPECT_EQ(0, gUnlocks) << "the mapping is still in use";
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    EXPECT_EQ(1, gUnlocks);
+}
+
+TEST_F(GraphicBufferMapperTest, NestedIncompatibleLocks_GoToGralloc) {
+    void* vaddr;
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(5, 5), &vaddr));
+    // a larger rect, then a wider usage
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(10, 10), &vaddr));
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ_WRITE, Rect(5, 5), &vaddr));
+    EXPECT_EQ(3, gLocks);
+
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    EXPECT_EQ(3, gUnlocks);
+}
+
+TEST_F(GraphicBufferMapperTest, NestedYCbCrLocks_ShareOnlyYCbCrMappings) {
+    void* vaddr;
+    android_ycbcr ycbcr;
+    ASSERT_EQ(NO_ERROR, mMapper.lockYCbCr(mHandle, USAGE_READ, Rect(10, 10), &ycbcr));
+    ASSERT_EQ(NO_ERROR, mMapper.lockYCbCr(mHandle, USAGE_READ, Rect(10, 10), &ycbcr));
+    EXPECT_EQ(gMemory, ycbcr.y);
+    EXPECT_EQ(1, gLocks);
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(10, 10), &vaddr));
+    EXPECT_EQ(2, gLocks);
+
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    EXPECT_EQ(2, gUnlocks);
+}
+
+TEST_F(GraphicBufferMapperTest, DisabledCache_StillReleasesMappingInUse) {
+    void* vaddr;
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(10, 10), &vaddr));
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(10, 10), &vaddr));
+    mMapper.setMappingCacheEnabled(false);
+    ASSERT_EQ(NO_ERROR, mMapper.lock(mHandle, USAGE_READ, Rect(10, 10), &vaddr));
+    EXPECT_EQ(2, gLocks) << "the disabled cache should not share the mapping";
+
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    EXPECT_EQ(2, gUnlocks);
+}
+
+}; // namespace android
@@ -136,4 +136,73 @@ TEST_F(MatTest, MiscOps) {
     EXPECT_EQ(m1, m1*identity);
 }
 
+// fills a matrix with random values, well conditioned enough to be inverted
+template <typename MATRIX>
+static void randomMatrix(MATRIX& m, mat4& mf) {
+    for (size_t c = 0; c < 4; c++) {
+        for (size_t r = 0; r < 4; r++) {
+            float v = (rand() % 2000) / 1000.0f - 1.0f;
+            if (c == r) {
+                v += 4;
+            }
+            m[c][r] = v;
+            mf[c][r] = v;
+        }
+    }
+}
+
+TEST_F(MatTest, FloatSpecializationsMatchGeneric) {
+    // the mat4 operations have out of line SIMD implementations, compare
+    // them against the generic templates instantiated on double.
+    srand(42);
+    for (int i = 0; i < 100; i++) {
+        tmat44<double> a, b;
+        mat4 af, bf;
+        randomMatrix(a, af);
+        randomMatrix(b, bf);
+
+        tmat44<double> ab(a * b);
+        mat4 abf(af * bf);
+        tmat44<double> ai(inverse(a));
+        mat4 aif(inverse(af));
+        tvec4<double> v(a * b[0]);
+        vec4 vf(af * bf[0]);
+        for (size_t c = 0; c < 4; c++) {
+            for (size_t r = 0; r < 4; r++) {
+                EXPECT_NEAR(ab[c][r], abf[c][r], 1e-4);
+                EXPECT_NEAR(ai[c][r], aif[c][r], 1e-5);
+            }
+            EXPECT_NEAR(v[c], vf[c], 1e-4);
+        }
+    }
+}
+
+TEST_F(MatTest, BatchTransform) {
+    mat4 m(vec4(1,2,3,4), vec4(5,6,7,8), vec4(9,10,11,12), vec4(13,14,15,16));
+    const size_t count = 7;
+    vec4 in4[count], out4[count];
+    vec2 in2[count], out2[count];
+    for (size_t i = 0; i < count; i++) {
+        in4[i] = vec4(i, i+1, i+2, 1);
+        in2[i] = vec2(i, -float(i));
+    }
+    transform(m, out4, in4, count);
+    transform(m, out2, in2, count);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(m * in4[i], out4[i]);
+        vec4 p(m * vec4(in2[i].x, in2[i].y, 0, 1));
+        EXPECT_EQ(p.x, out2[i].x);
+        EXPECT_EQ(p.y, out2[i].y);
+    }
+
+    // in place
+    transform(m, in4, in4, count);
+    transform(m, in2, in2, count);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(out4[i], in4[i]);
+        EXPECT_EQ(out2[i].x, in2[i].x);
+        EXPECT_EQ(out2[i].y, in2[i].y);
+    }
+}
+
 }; // namespace android
@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	matbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libui \
+	libutils \
+
+LOCAL_MODULE:= test-matbenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the cost of the common mat4 operations.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ui/mat4.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    // a rotation, so that repeated products and inverses stay bounded
+    mat4 m(vec4(0.6,0.8,0,0), vec4(-0.8,0.6,0,0), vec4(0,0,1,0), vec4(0,0,0,1));
+    mat4 acc;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        acc = acc * m;
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("mat4 * mat4: %.1f ns\n", double(elapsed) / iterations);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        acc = inverse(acc);
+    }
+    elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("inverse(mat4): %.1f ns\n", double(elapsed) / iterations);
+
+    const size_t count = 1024;
+    const int batches = iterations / 1000 > 0 ? iterations / 1000 : 1;
+    vec2* v = new vec2[count];
+    for (size_t i = 0; i < count; i++) {
+        v[i] = vec2(i, i);
+    }
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < batches; i++) {
+        transform(m, v, v, count);
+    }
+    elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("transform(vec2): %.2f ns/vertex\n",
+            double(elapsed) / (batches * count));
+    delete [] v;
+
+    // using acc keeps the loops from being optimized away; it must still be
+    // (close to) orthonormal
+    printf("trace(acc * transpose(acc)) = %.3f (expected 4)\n",
+            trace(acc * transpose(acc)));
+    return 0;
+}
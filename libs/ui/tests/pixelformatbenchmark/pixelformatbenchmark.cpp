@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Reports the throughput of every convertPixels() pair, in GB/s of source
+// data, on a 720p image.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ui/PixelFormat.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const PixelFormat kFormats[] = {
+    PIXEL_FORMAT_RGBA_8888,
+    PIXEL_FORMAT_RGBX_8888,
+    PIXEL_FORMAT_BGRA_8888,
+    PIXEL_FORMAT_RGB_888,
+    PIXEL_FORMAT_RGB_565,
+    PIXEL_FORMAT_A_8,
+};
+static const size_t kNumFormats = sizeof(kFormats) / sizeof(kFormats[0]);
+
+int main(int argc, char** argv) {
+    const uint32_t w = 1280, h = 720;
+    const int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    uint8_t* src = new uint8_t[w * h * 4];
+    uint8_t* dst = new uint8_t[w * h * 4];
+    memset(src, 0x5A, w * h * 4);
+    for (size_t s = 0; s < kNumFormats; s++) {
+        for (size_t d = 0; d < kNumFormats; d++) {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (int i = 0; i < iterations; i++) {
+                convertPixels(dst, kFormats[d], w, src, kFormats[s], w, w, h);
+            }
+            nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            double bytes = double(w) * h * bytesPerPixel(kFormats[s]) *
+                    iterations;
+            printf("%d -> %d: %.2f GB/s\n", kFormats[s], kFormats[d],
+                    bytes / elapsed);
+        }
+    }
+    delete [] src;
+    delete [] dst;
+    return 0;
+}
@@ -24,6 +24,7 @@
 #include "TextureObjectManager.h"
 
 #include <ETC1/etc1.h>
+#include <ui/PixelFormat.h>
 
 namespace android {
 
@@ -288,7 +289,26 @@ int copyPixels(
         return 0;
     }
 
-    // use pixel-flinger to handle all the conversions
+    // unclipped conversions between the formats libui knows about (whose
+    // values match pixelflinger's) don't need the rasterizer.
+    if ((src.stride > 0) && (dst.stride > 0) &&
+        (x >= 0) && (y >= 0) && (xoffset >= 0) && (yoffset >= 0) &&
+        (x + w <= GLint(src.width)) && (y + h <= GLint(src.height)) &&
+        (xoffset + w <= GLint(dst.width)) && (yoffset + h <= GLint(dst.height)) &&
+        canConvertPixels(dst.format, src.format))
+    {
+        const GGLFormat& srcFormat(c->rasterizer.formats[src.format]);
+        const GGLFormat& dstFormat(c->rasterizer.formats[dst.format]);
+        const uint8_t* s = reinterpret_cast<const uint8_t*>(src.data) +
+                (y * src.stride + x) * srcFormat.size;
+        uint8_t* d = reinterpret_cast<uint8_t*>(dst.data) +
+                (yoffset * dst.stride + xoffset) * dstFormat.size;
+        convertPixels(d, dst.format, dst.stride,
+                s, src.format, src.stride, w, h);
+        return 0;
+    }
+
+    // use pixel-flinger to handle all the other conversions
     GGLContext* ggl = getRasterizer(c);
     if (!ggl) {
         // the only reason this would fail is because we ran out of memory
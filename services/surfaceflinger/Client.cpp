@@ -32,6 +32,12 @@ namespace android {
 
 const String16 sAccessSurfaceFlinger("android.permission.ACCESS_SURFACE_FLINGER");
 
+// interned on first use, not while the statics are initialized
+static int32_t getAccessSurfaceFlingerId() {
+    static const int32_t id = PermissionCache::getPermissionId(sAccessSurfaceFlinger);
+    return id;
+}
+
 // ---------------------------------------------------------------------------
 
 Client::Client(const sp<SurfaceFlinger>& flinger)
@@ -95,7 +101,7 @@ status_t Client::onTransact(
      const int self_pid = getpid();
      if (CC_UNLIKELY(pid != self_pid && uid != AID_GRAPHICS && uid != 0)) {
          // we're called from a different process, do the real check
-         if (!PermissionCache::checkCallingPermission(sAccessSurfaceFlinger))
+         if (!PermissionCache::checkCallingPermission(getAccessSurfaceFlingerId()))
          {
              ALOGE("Permission Denial: "
                      "can't openGlobalTransaction pid=%d, uid=%d", pid, uid);
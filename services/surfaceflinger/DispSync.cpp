@@ -24,6 +24,7 @@
 #include <cutils/log.h>
 
 #include <ui/Fence.h>
+#include <ui/FenceWatcher.h>
 
 #include <utils/String8.h>
 #include <utils/Thread.h>
@@ -328,13 +329,13 @@ void DispSync::reset() {
 bool DispSync::addPresentFence(const sp<Fence>& fence) {
     Mutex::Autolock lock(mMutex);
 
-    mPresentFences[mPresentSampleOffset] = fence;
+    mPresentFences[mPresentSampleOffset] = FenceTime::create(fence);
     mPresentTimes[mPresentSampleOffset] = 0;
     mPresentSampleOffset = (mPresentSampleOffset + 1) % NUM_PRESENT_SAMPLES;
     mNumResyncSamplesSincePresent = 0;
 
     for (size_t i = 0; i < NUM_PRESENT_SAMPLES; i++) {
-        const sp<Fence>& f(mPresentFences[i]);
+        const sp<FenceTime>& f(mPresentFences[i]);
         if (f != NULL) {
             nsecs_t t = f->getSignalTime();
             if (t < INT64_MAX) {
@@ -23,6 +23,8 @@
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
 
+#include <ui/FenceWatcher.h>
+
 namespace android {
 
 class String8;
@@ -133,7 +135,7 @@ private:
 
     // These member variables store information about the present fences used
     // to validate the currently computed model.
-    sp<Fence> mPresentFences[NUM_PRESENT_SAMPLES];
+    sp<FenceTime> mPresentFences[NUM_PRESENT_SAMPLES];
     nsecs_t mPresentTimes[NUM_PRESENT_SAMPLES];
     size_t mPresentSampleOffset;
 
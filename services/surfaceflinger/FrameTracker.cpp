@@ -20,6 +20,7 @@
 #include <cutils/log.h>
 
 #include <ui/Fence.h>
+#include <ui/FenceWatcher.h>
 
 #include <utils/String8.h>
 
@@ -58,7 +59,7 @@ void FrameTracker::setActualPresentTime(nsecs_t presentTime) {
 
 void FrameTracker::setActualPresentFence(const sp<Fence>& readyFence) {
     Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].actualPresentFence = readyFence;
+    mFrameRecords[mOffset].actualPresentFence = FenceTime::create(readyFence);
     mNumFences++;
 }
 
@@ -137,7 +138,7 @@ void FrameTracker::processFencesLocked() const {
             }
         }
 
-        const sp<Fence>& pfence = records[idx].actualPresentFence;
+        const sp<FenceTime>& pfence = records[idx].actualPresentFence;
         if (pfence != NULL) {
             records[idx].actualPresentTime = pfence->getSignalTime();
             if (records[idx].actualPresentTime < INT64_MAX) {
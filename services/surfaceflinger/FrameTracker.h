@@ -23,6 +23,8 @@
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
 
+#include <ui/FenceWatcher.h>
+
 namespace android {
 
 class String8;
@@ -35,7 +37,10 @@ class Fence;
 //
 // Some of the time values tracked may be set either as a specific timestamp
 // or a fence.  When a non-NULL fence is set for a given time value, the
-// signal time of that fence is used instead of the timestamp.
+// signal time of that fence is used instead of the timestamp.  The present
+// fence, which all the layers share, is registered with the FenceWatcher so
+// that looking up its signal time doesn't require a sync ioctl per layer.
+// The frame ready fences belong to a single layer and are queried directly.
 class FrameTracker {
 
 public:
@@ -98,7 +103,7 @@ private:
         nsecs_t frameReadyTime;
         nsecs_t actualPresentTime;
         sp<Fence> frameReadyFence;
-        sp<Fence> actualPresentFence;
+        sp<FenceTime> actualPresentFence;
     };
 
     // processFences iterates over all the frame records that have a fence set
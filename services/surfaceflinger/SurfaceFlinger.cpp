@@ -31,8 +31,11 @@
 #include <binder/IServiceManager.h>
 #include <binder/MemoryHeapBase.h>
 #include <binder/PermissionCache.h>
+#include <binder/ProcessState.h>
+#include <binder/TransactionStats.h>
 
 #include <ui/DisplayInfo.h>
+#include <ui/FenceWatcher.h>
 
 #include <gui/BitTube.h>
 #include <gui/BufferQueue.h>
@@ -42,6 +45,7 @@
 #include <gui/GraphicBufferAlloc.h>
 
 #include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
 #include <ui/PixelFormat.h>
 #include <ui/UiConfig.h>
 
@@ -130,6 +134,19 @@ const String16 sAccessSurfaceFlinger("android.permission.ACCESS_SURFACE_FLINGER"
 const String16 sReadFramebuffer("android.permission.READ_FRAME_BUFFER");
 const String16 sDump("android.permission.DUMP");
 
+// The permissions checked on each transaction, interned on first use: the
+// strings above and the PermissionCache singleton may not be constructed
+// yet when this file's statics are initialized.
+static int32_t getAccessSurfaceFlingerId() {
+    static const int32_t id = PermissionCache::getPermissionId(sAccessSurfaceFlinger);
+    return id;
+}
+
+static int32_t getReadFramebufferId() {
+    static const int32_t id = PermissionCache::getPermissionId(sReadFramebuffer);
+    return id;
+}
+
 // ---------------------------------------------------------------------------
 
 SurfaceFlinger::SurfaceFlinger()
@@ -2591,6 +2608,25 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
      */
     const GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
     alloc.dump(result);
+    const GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+    mapper.dump(result);
+
+    /*
+     * Dump fence watcher state
+     */
+    FenceWatcher::get().dump(result);
+
+    /*
+     * Dump binder transaction stats, when enabled
+     */
+    if (TransactionStats::isEnabled()) {
+        TransactionStats::dump(result);
+    }
+
+    /*
+     * Dump binder thread pool stats
+     */
+    ProcessState::self()->dumpThreadPoolStats(result);
 }
 
 const Vector< sp<Layer> >&
@@ -2645,7 +2681,7 @@ status_t SurfaceFlinger::onTransact(
             const int pid = ipc->getCallingPid();
             const int uid = ipc->getCallingUid();
             if ((uid != AID_GRAPHICS) &&
-                    !PermissionCache::checkPermission(sAccessSurfaceFlinger, pid, uid)) {
+                    !PermissionCache::checkPermission(getAccessSurfaceFlingerId(), pid, uid)) {
                 ALOGE("Permission Denial: "
                         "can't access SurfaceFlinger pid=%d, uid=%d", pid, uid);
                 return PERMISSION_DENIED;
@@ -2659,7 +2695,7 @@ status_t SurfaceFlinger::onTransact(
             const int pid = ipc->getCallingPid();
             const int uid = ipc->getCallingUid();
             if ((uid != AID_GRAPHICS) &&
-                    !PermissionCache::checkPermission(sReadFramebuffer, pid, uid)) {
+                    !PermissionCache::checkPermission(getReadFramebufferId(), pid, uid)) {
                 ALOGE("Permission Denial: "
                         "can't read framebuffer pid=%d, uid=%d", pid, uid);
                 return PERMISSION_DENIED;